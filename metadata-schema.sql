@@ -2,11 +2,18 @@
 
 PRAGMA foreign_keys = ON;
 
--- A block is a series of bytes that is (or is to be) backed up.
+-- The version of this schema. Databases created from an older version are
+-- brought up to date when they are opened (see MetadataDbImpl::MigrateDb).
+PRAGMA user_version = 1;
+
+-- A block is a series of bytes that is (or is to be) backed up. Holes
+-- in sparse files are also recorded as blocks, with an empty digest;
+-- these are never backed up, since they contain only zeros.
 create table blocks (
   'id'                  INTEGER PRIMARY KEY NOT NULL,
-  'sha1_digest'         TEXT    NOT NULL,
-  'length'              INTEGER NOT NULL
+  'sha1_digest'         BLOB    NOT NULL,
+  'length'              INTEGER NOT NULL,
+  'is_hole'             INTEGER NOT NULL DEFAULT false
 );
 create index idx_blocks_sha1_digest_length on blocks('sha1_digest', 'length');
 
@@ -51,9 +58,10 @@ create table snapshots (
   'extra_attributes'    TEXT,
   'is_regular'          INTEGER NOT NULL DEFAULT true,
   'is_deleted'          INTEGER NOT NULL DEFAULT false,
-  'sha1_digest'         TEXT    NOT NULL,
+  'sha1_digest'         BLOB    NOT NULL,
   'length'              INTEGER NOT NULL,
-  'observation_time'    INTEGER NOT NULL
+  'observation_time'    INTEGER NOT NULL,
+  'sha1_digest_range_size' INTEGER NOT NULL DEFAULT 0
 );
 create index idx_snapshots_file_id on snapshots('file_id');
 create index idx_snapshots_attributes_id on snapshots('attributes_id');
@@ -85,8 +93,8 @@ create index idx_files_to_blocks_observation_time on
 -- (or will be) uploaded to the server.
 create table local_bundles (
   'id'                    INTEGER PRIMARY KEY NOT NULL,
-  'sha256_linear_digest'  TEXT    NOT NULL,
-  'sha256_tree_digest'    TEXT    NOT NULL,
+  'sha256_linear_digest'  BLOB    NOT NULL,
+  'sha256_tree_digest'    BLOB    NOT NULL,
   'length'                INTEGER NOT NULL
 );
 
@@ -186,4 +194,55 @@ create table local_files_to_blocks_to_bundle_manifest (
 create index idx_local_files_to_blocks_to_bundle_manifest_files_to_blocks_id on
   local_files_to_blocks_to_bundle_manifest('files_to_blocks_id');
 create index idx_local_files_to_blocks_to_bundle_manifest_bundle_id on
-  local_files_to_blocks_to_bundle_manifest('bundle_id');
\ No newline at end of file
+  local_files_to_blocks_to_bundle_manifest('bundle_id');
+
+-- Records what each directory looked like when it was last read during
+-- a scan (rather than skipped as unchanged), so that later scans can skip
+-- directories that have not changed since. Times are in nanoseconds,
+-- except verification_time, which is when the directory was last read.
+-- The names of its subdirectories are separated by '/', which cannot
+-- appear in a name. path_filter_hash identifies the path filter rules
+-- that the scan applied, or is 0 if there were none.
+create table local_directories (
+  'id'                    INTEGER PRIMARY KEY NOT NULL,
+  'path'                  TEXT    UNIQUE NOT NULL,
+  'device'                INTEGER NOT NULL,
+  'inode'                 INTEGER NOT NULL,
+  'modification_time_ns'  INTEGER NOT NULL,
+  'change_time_ns'        INTEGER NOT NULL,
+  'num_entries'           INTEGER NOT NULL,
+  'subdirectory_names'    TEXT    NOT NULL DEFAULT '',
+  'verification_time'     INTEGER NOT NULL,
+  'path_filter_hash'      INTEGER NOT NULL DEFAULT 0
+);
+create unique index idx_local_directories_path on local_directories('path');
+
+-- Records the identity of a file (its device, inode, length and
+-- modification time in nanoseconds) as of when the chunks of its latest
+-- snapshot were hashed, so that when the same file appears at another
+-- path (because it was renamed or hard-linked) its chunks can be reused
+-- without reading it again. Only the latest snapshot of each file whose
+-- chunks are in local_snapshots_to_files_to_blocks has a row here.
+create table local_snapshot_file_identities (
+  'snapshot_id'           INTEGER PRIMARY KEY NOT NULL
+                                  REFERENCES snapshots('id')
+                                  ON DELETE CASCADE,
+  'device'                INTEGER NOT NULL,
+  'inode'                 INTEGER NOT NULL,
+  'length'                INTEGER NOT NULL,
+  'modification_time_ns'  INTEGER NOT NULL
+);
+create index idx_local_snapshot_file_identities_identity on
+  local_snapshot_file_identities('device', 'inode', 'length',
+                                 'modification_time_ns');
+
+-- Records the latest snapshot of each file, so that it can be found
+-- without sorting all of the file's snapshots. Updated whenever a snapshot
+-- is recorded.
+create table local_latest_snapshots (
+  'file_id'               INTEGER PRIMARY KEY NOT NULL
+                                  REFERENCES files('id')
+                                  ON DELETE CASCADE,
+  'snapshot_id'           INTEGER NOT NULL REFERENCES snapshots('id')
+                                  ON DELETE CASCADE
+);
@@ -1,11 +1,87 @@
 #include "backup-executor.h"
 
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "base/options.h"
+#include "proto/file.pb.h"
+#include "services/change-journal.h"
+#include "services/chunk-reader.h"
+#include "services/directory-fingerprints.h"
 #include "services/filesystem-scanner.h"
+#include "services/metadata-db.h"
+#include "services/metadata-db-impl.h"
+#include "services/path-filter.h"
 #include "state_machines/bundle-state-machine-pool.h"
 #include "state_machines/snapshot-state-machine-pool.h"
 #include "state_machines/upload-state-machine-pool.h"
+#include "util/disk-order-util.h"
+#include "util/file-stat-util.h"
+#include "util/path-arena.h"
+
+DEFINE_OPTION(change_journal_directory, string, "",
+              "Directory of the change journal recorded by "
+              "polar-express-watcher. If set, and the watcher has recorded "
+              "every change since the last backup, only the changed paths "
+              "are backed up, rather than scanning the whole tree.");
+
+DEFINE_OPTION(path_filter_rules_file, string, "",
+              "File of rules excluding paths from the backup, one per line "
+              "(e.g. '- node_modules/', '- *.o', '- re:\\.cache/', "
+              "'- *.iso size>1G'). The first rule matching a path decides; "
+              "'+' rules include paths that later rules would exclude. "
+              "Excluded directories are not read.");
+
+DEFINE_OPTION(
+    snapshot_path_order, string, "inode",
+    "Order in which each batch of scanned paths is processed. 'scan' keeps "
+    "the order in which directories were read. 'inode' sorts by inode "
+    "number, which on most local file systems roughly follows the order of "
+    "the data on disk. 'physical' sorts by the disk offset of each file's "
+    "first extent (via FIEMAP, at the cost of an ioctl per file), which "
+    "cuts seeks the most on rotational disks.");
+
+DEFINE_OPTION(snapshot_path_order_window, size_t, 4096,
+              "Number of consecutive scanned paths sorted together by "
+              "snapshot_path_order. If zero, each whole batch is sorted.");
 
 namespace polar_express {
+namespace {
+
+// Sets disk_order to the order named by snapshot_path_order, or returns
+// false if it names none.
+bool ParseSnapshotPathOrder(disk_order_util::DiskOrder* disk_order) {
+  if (options::snapshot_path_order == "scan") {
+    *disk_order = disk_order_util::DiskOrder::kScan;
+  } else if (options::snapshot_path_order == "inode") {
+    *disk_order = disk_order_util::DiskOrder::kInode;
+  } else if (options::snapshot_path_order == "physical") {
+    *disk_order = disk_order_util::DiskOrder::kPhysicalOffset;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void SortPathsByDiskOrder(
+    disk_order_util::DiskOrder disk_order, const PathArena* path_arena,
+    vector<std::pair<PathArena::Handle, FileStat> >* handles_with_stat,
+    Callback callback) {
+  disk_order_util::SortByDiskOrder(
+      disk_order, options::snapshot_path_order_window, *path_arena,
+      handles_with_stat);
+  callback();
+}
+
+}  // namespace
+
+struct BackupExecutor::SnapshotPathBatch {
+  PathArena path_arena;
+  vector<std::pair<PathArena::Handle, FileStat> > handles_with_stat;
+};
 
 BackupExecutor::BackupExecutor()
     : scan_state_(ScanState::kNotStarted),
@@ -21,7 +97,7 @@ BackupExecutor::BackupExecutor()
 BackupExecutor::~BackupExecutor() {
 }
 
-void BackupExecutor::Start(
+bool BackupExecutor::Start(
     const string& root,
     Cryptor::EncryptionType encryption_type,
     boost::shared_ptr<const Cryptor::KeyingData> encryption_keying_data,
@@ -37,6 +113,27 @@ void BackupExecutor::Start(
   assert(bundle_state_machine_pool_ == nullptr);
   assert(upload_state_machine_pool_ == nullptr);
 
+  if (!ChunkReader::ValidateOptions()) {
+    return false;
+  }
+
+  if (!MetadataDbImpl::Init()) {
+    return false;
+  }
+
+  disk_order_util::DiskOrder disk_order;
+  if (!ParseSnapshotPathOrder(&disk_order)) {
+    std::cerr << "ERROR: Unknown snapshot_path_order '"
+              << options::snapshot_path_order
+              << "'. Expected 'scan', 'inode' or 'physical'." << std::endl;
+    return false;
+  }
+
+  if (!LoadPathFilter(root)) {
+    return false;
+  }
+  filesystem_scanner_->SetPathFilter(path_filter_.get());
+
   snapshot_state_machine_pool_.reset(
       new SnapshotStateMachinePool(strand_dispatcher_, root));
 
@@ -54,13 +151,68 @@ void BackupExecutor::Start(
       strand_dispatcher_->CreateStrandCallback(
           bind(&BackupExecutor::TryScanMorePaths, this)));
 
+  if (!options::change_journal_directory.empty()) {
+    change_journal_.reset(
+        new ChangeJournal(options::change_journal_directory));
+    vector<boost::filesystem::path> changed_paths;
+    vector<boost::filesystem::path> changed_directories;
+    if (change_journal_->TakeChanges(
+            root, &changed_paths, &changed_directories)) {
+      DLOG(std::cerr << "Backing up " << changed_paths.size()
+                     << " changed paths and " << changed_directories.size()
+                     << " changed directories from the change journal."
+                     << std::endl);
+      changed_paths_filesystem_scanner_ =
+          FilesystemScanner::CreateFilesystemScannerForChangedPaths(
+              changed_paths, changed_directories);
+      changed_paths_filesystem_scanner_->SetPathFilter(path_filter_.get());
+    }
+  }
+
   snapshot_state_machine_pool_max_weight_ =
       snapshot_state_machine_pool_->InputWeightRemaining();
-  filesystem_scanner_->StartScan(
-      root, snapshot_state_machine_pool_max_weight_ / 2,
+  if (changed_paths_filesystem_scanner_ != nullptr) {
+    StartScan(root);
+    return true;
+  }
+
+  boost::shared_ptr<vector<DirectoryFingerprint> > previous_fingerprints(
+      new vector<DirectoryFingerprint>);
+  metadata_db_.reset(new MetadataDb);
+  metadata_db_->GetDirectoryFingerprints(
+      root, previous_fingerprints.get(),
       strand_dispatcher_->CreateStrandCallback(
-          bind(&BackupExecutor::AddNewPendingSnapshotPaths, this)));
-  scan_state_ = ScanState::kInProgress;
+          bind(&BackupExecutor::StartScanWithDirectoryFingerprints, this,
+               root, previous_fingerprints)));
+  return true;
+}
+
+void BackupExecutor::Finish() {
+  if (directory_fingerprints_ == nullptr) {
+    CommitChangeJournal();
+    return;
+  }
+
+  DLOG(std::cerr << "Skipped "
+                 << directory_fingerprints_->num_unchanged_directories()
+                 << " unchanged directories; "
+                 << directory_fingerprints_->num_inconsistent_directories()
+                 << " directories had unchanged times but a different "
+                 << "number of entries." << std::endl);
+  boost::shared_ptr<vector<DirectoryFingerprint> > fingerprints(
+      new vector<DirectoryFingerprint>);
+  directory_fingerprints_->GetRecordedFingerprints(fingerprints.get());
+  // The dispatcher has been restarted since the backup's own calls, and the
+  // old stub's strand belongs to the services that have since stopped.
+  metadata_db_.reset(new MetadataDb);
+  metadata_db_->RecordDirectoryFingerprints(
+      fingerprints, bind(&BackupExecutor::CommitChangeJournal, this));
+}
+
+void BackupExecutor::CommitChangeJournal() {
+  if (change_journal_ != nullptr) {
+    change_journal_->CommitChanges();
+  }
 }
 
 int BackupExecutor::GetNumFilesProcessed() const {
@@ -96,13 +248,85 @@ size_t BackupExecutor::GetSizeOfBundlesUploaded() const {
   return CHECK_NOTNULL(upload_state_machine_pool_)->size_of_bundles_uploaded();
 }
 
+size_t BackupExecutor::GetNumUnchangedDirectoriesSkipped() const {
+  if (directory_fingerprints_ == nullptr) {
+    return 0;
+  }
+  return directory_fingerprints_->num_unchanged_directories();
+}
+
+void BackupExecutor::GetPathFilterRuleHits(
+    vector<std::pair<string, size_t> >* rule_hits) const {
+  if (path_filter_ != nullptr) {
+    path_filter_->GetRuleHits(rule_hits);
+  }
+}
+
+bool BackupExecutor::LoadPathFilter(const string& root) {
+  if (options::path_filter_rules_file.empty()) {
+    return true;
+  }
+  std::ifstream rules_file(options::path_filter_rules_file.c_str());
+  std::ostringstream rules;
+  rules << rules_file.rdbuf();
+  if (!rules_file) {
+    std::cerr << "ERROR: Could not read path filter rules from '"
+              << options::path_filter_rules_file << "'." << std::endl;
+    return false;
+  }
+
+  path_filter_.reset(new PathFilter(root, time(nullptr)));
+  string error;
+  if (!path_filter_->AddRules(rules.str(), &error)) {
+    std::cerr << "ERROR: Malformed path filter rule in '"
+              << options::path_filter_rules_file << "', " << error
+              << std::endl;
+    path_filter_.reset();
+    return false;
+  }
+  return true;
+}
+
+void BackupExecutor::StartScanWithDirectoryFingerprints(
+    const string& root,
+    boost::shared_ptr<vector<DirectoryFingerprint> > previous_fingerprints) {
+  directory_fingerprints_.reset(new DirectoryFingerprints(
+      *previous_fingerprints, time(nullptr),
+      path_filter_ != nullptr ? path_filter_->hash() : 0));
+  filesystem_scanner_->SetDirectoryFingerprints(
+      directory_fingerprints_.get());
+  StartScan(root);
+}
+
+void BackupExecutor::StartScan(const string& root) {
+  GetFilesystemScanner()->StartScan(
+      root, snapshot_state_machine_pool_max_weight_ / 2,
+      strand_dispatcher_->CreateStrandCallback(
+          bind(&BackupExecutor::AddNewPendingSnapshotPaths, this)));
+  scan_state_ = ScanState::kInProgress;
+}
+
 void BackupExecutor::AddNewPendingSnapshotPaths() {
-  vector<std::pair<boost::filesystem::path, size_t> > paths_with_size;
-  if (filesystem_scanner_->GetPathsWithFilesize(&paths_with_size)) {
-    filesystem_scanner_->ClearPaths();
-    scan_state_ = ScanState::kWaitingToContinue;
-    for (const auto& path_with_size : paths_with_size) {
-      TryAddSnapshotPathWithSize(path_with_size);
+  boost::shared_ptr<SnapshotPathBatch> batch(new SnapshotPathBatch);
+  if (GetFilesystemScanner()->GetPathHandlesWithFileStat(
+          &batch->path_arena, &batch->handles_with_stat)) {
+    GetFilesystemScanner()->ClearPaths();
+    // snapshot_path_order was checked when the backup started.
+    disk_order_util::DiskOrder disk_order =
+        disk_order_util::DiskOrder::kInode;
+    ParseSnapshotPathOrder(&disk_order);
+    if (disk_order == disk_order_util::DiskOrder::kScan) {
+      AddSnapshotPathBatch(batch);
+    } else {
+      // Finding physical offsets is disk-bound, so the paths are sorted off
+      // the strand. The scan does not continue until they have been added.
+      // The callback keeps the batch alive until then.
+      AsioDispatcher::GetInstance()->PostDiskBound(
+          bind(&SortPathsByDiskOrder, disk_order, &batch->path_arena,
+               &batch->handles_with_stat,
+               strand_dispatcher_->CreateStrandCallback(
+                   bind(&BackupExecutor::AddSnapshotPathBatch, this,
+                        batch))));
     }
   } else if (buffered_paths_with_weight_.empty()) {
     scan_state_ = ScanState::kFinished;
@@ -111,38 +335,71 @@ void BackupExecutor::AddNewPendingSnapshotPaths() {
   }
 }
 
+void BackupExecutor::AddSnapshotPathBatch(
+    boost::shared_ptr<const SnapshotPathBatch> batch) {
+  scan_state_ = ScanState::kWaitingToContinue;
+
+  const size_t num_paths_to_prefetch = std::min(
+      batch->handles_with_stat.size(),
+      CHECK_NOTNULL(snapshot_state_machine_pool_)
+          ->NumPreviousSnapshotsToPrefetch());
+  if (num_paths_to_prefetch > 0) {
+    vector<boost::filesystem::path> paths_to_prefetch;
+    paths_to_prefetch.reserve(num_paths_to_prefetch);
+    for (size_t i = 0; i < num_paths_to_prefetch; ++i) {
+      paths_to_prefetch.push_back(
+          batch->path_arena.GetPath(batch->handles_with_stat[i].first));
+    }
+    snapshot_state_machine_pool_->PrefetchPreviousSnapshots(
+        paths_to_prefetch);
+  }
+
+  for (size_t i = 0; i < batch->handles_with_stat.size(); ++i) {
+    TryAddSnapshotPath(batch, i);
+  }
+}
+
 void BackupExecutor::AddBufferedSnapshotPaths() {
   const size_t initial_buffer_size = buffered_paths_with_weight_.size();
   for (size_t i = 0; i < initial_buffer_size; ++i) {
-    const auto path_with_weight = buffered_paths_with_weight_.front();
+    const BufferedSnapshotPath buffered_snapshot_path =
+        buffered_paths_with_weight_.front();
     buffered_paths_with_weight_.pop();
-    buffered_paths_total_weight_ -= path_with_weight.second;
-    TryAddSnapshotPathWithWeight(path_with_weight);
+    buffered_paths_total_weight_ -= buffered_snapshot_path.weight;
+    TryAddBufferedSnapshotPath(buffered_snapshot_path);
   }
 }
 
-void BackupExecutor::TryAddSnapshotPathWithSize(
-    const std::pair<boost::filesystem::path, size_t>& path_with_size) {
-  const auto path = path_with_size.first;
-  const size_t weight = WeightFromFilesize(path_with_size.second);
+void BackupExecutor::TryAddSnapshotPath(
+    boost::shared_ptr<const SnapshotPathBatch> batch, size_t index) {
+  const FileStat& file_stat = batch->handles_with_stat[index].second;
+  const size_t filesize = file_stat_util::IsRegularFile(file_stat)
+      ? file_stat.length() : 0;
+  const size_t weight = WeightFromFilesize(filesize);
   ++num_files_processed_;
-  size_of_files_processed_ += path_with_size.second;
-  TryAddSnapshotPathWithWeight(make_pair(path, weight));
+  size_of_files_processed_ += filesize;
+  TryAddBufferedSnapshotPath({ batch, index, weight });
 }
 
-void BackupExecutor::TryAddSnapshotPathWithWeight(
-    const std::pair<boost::filesystem::path, size_t>& path_with_weight) {
-  const auto path = path_with_weight.first;
-  const size_t weight = path_with_weight.second;
+void BackupExecutor::TryAddBufferedSnapshotPath(
+    const BufferedSnapshotPath& buffered_snapshot_path) {
+  const size_t weight = buffered_snapshot_path.weight;
   if (CHECK_NOTNULL(snapshot_state_machine_pool_)->CanAcceptNewInput(weight)) {
+    // The path is only created once the pool can take it.
     // TODO: It might be nice if the StateMachinePool did not require inputs
     // to be shared pointers.
+    const SnapshotPathBatch& batch = *buffered_snapshot_path.batch;
+    const auto& handle_with_stat =
+        batch.handles_with_stat[buffered_snapshot_path.index];
     snapshot_state_machine_pool_->AddNewInput(
-        boost::shared_ptr<boost::filesystem::path>(
-            new boost::filesystem::path(path)), weight);
+        boost::shared_ptr<std::pair<boost::filesystem::path, FileStat> >(
+            new std::pair<boost::filesystem::path, FileStat>(
+                batch.path_arena.GetPath(handle_with_stat.first),
+                handle_with_stat.second)),
+        weight);
   } else {
     buffered_paths_total_weight_ += weight;
-    buffered_paths_with_weight_.push(path_with_weight);
+    buffered_paths_with_weight_.push(buffered_snapshot_path);
   }
 }
 
@@ -158,7 +415,7 @@ void BackupExecutor::TryScanMorePaths() {
       CHECK_NOTNULL(snapshot_state_machine_pool_)->InputWeightRemaining();
   if (scan_state_ == ScanState::kWaitingToContinue &&
       input_weight_remaining >= 2) {
-    filesystem_scanner_->ContinueScan(
+    GetFilesystemScanner()->ContinueScan(
         input_weight_remaining / 2,
         strand_dispatcher_->CreateStrandCallback(
             bind(&BackupExecutor::AddNewPendingSnapshotPaths, this)));
@@ -166,6 +423,13 @@ void BackupExecutor::TryScanMorePaths() {
   }
 }
 
+FilesystemScanner* BackupExecutor::GetFilesystemScanner() const {
+  if (changed_paths_filesystem_scanner_ != nullptr) {
+    return changed_paths_filesystem_scanner_.get();
+  }
+  return filesystem_scanner_.get();
+}
+
 size_t BackupExecutor::WeightFromFilesize(size_t filesize) const {
   // Weight is equal to the filesize, capped between 1 and max_weight / 2. The
   // upper bound is necessary to support very large files. If we allowed weights
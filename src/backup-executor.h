@@ -1,8 +1,10 @@
 #ifndef BACKUP_EXECUTOR_H
 #define BACKUP_EXECUTOR_H
 
+#include <memory>
 #include <queue>
 #include <string>
+#include <vector>
 
 #include <boost/filesystem.hpp>
 #include <boost/shared_ptr.hpp>
@@ -18,7 +20,12 @@ namespace polar_express {
 
 class AnnotatedBundleData;
 class BundleStateMachinePool;
+class ChangeJournal;
+class DirectoryFingerprint;
+class DirectoryFingerprints;
 class FilesystemScanner;
+class MetadataDb;
+class PathFilter;
 class Snapshot;
 class SnapshotStateMachinePool;
 class UploadStateMachinePool;
@@ -36,12 +43,14 @@ class BackupExecutor {
   virtual ~BackupExecutor();
 
   // Starts a new backup job at a given root path. This method returns
-  // immediately as the backup tasks continue asynchronously.
+  // immediately as the backup tasks continue asynchronously. Returns false,
+  // without starting anything, if the options are invalid, the metadata DB
+  // cannot be migrated, or the path filter rules cannot be loaded.
   //
   // TODO: Maybe add a Done callback? The current design assumes that the caller
   // is subsequently going to call AsioDispatcher::WaitForFinish to determine
   // when the backup is done.
-  virtual void Start(
+  virtual bool Start(
       const string& root,
       Cryptor::EncryptionType encryption_type,
       boost::shared_ptr<const Cryptor::KeyingData> encryption_keying_data,
@@ -50,6 +59,14 @@ class BackupExecutor {
       const CryptoPP::SecByteBlock& aws_secret_key,
       const string& glacier_vault_name);
 
+  // Records that the backup has completed, so that the changes taken from
+  // the change journal (if any) are not backed up again, and so that the
+  // directories read during the scan can be skipped by later scans if they
+  // are unchanged. Should be called only after the backup has completed,
+  // with the dispatcher started again; the records have been written once
+  // AsioDispatcher::WaitForFinish returns.
+  virtual void Finish();
+
   // Returns the number and total size (in bytes) of files processed during the
   // backup. Should be called only after the backup has completed.
   virtual int GetNumFilesProcessed() const;
@@ -70,25 +87,72 @@ class BackupExecutor {
   virtual int GetNumBundlesUploaded() const;
   virtual size_t GetSizeOfBundlesUploaded() const;
 
+  // Returns the number of directories that the scan skipped because they
+  // were unchanged since a previous backup. Should be called only after the
+  // backup has completed.
+  virtual size_t GetNumUnchangedDirectoriesSkipped() const;
+
+  // Appends the text of each path filter rule, in order, with the number
+  // of paths it decided to exclude or include. Should be called only after
+  // the backup has completed.
+  virtual void GetPathFilterRuleHits(
+      vector<std::pair<string, size_t> >* rule_hits) const;
+
  private:
+  // Commits the changes taken from the change journal, if any. The last
+  // step of Finish.
+  void CommitChangeJournal();
+
+  // Loads the rules in path_filter_rules_file, if any, into path_filter_.
+  // Returns false if they cannot be read or are malformed.
+  bool LoadPathFilter(const string& root);
+
   // Snapshot-Generation methods:
 
+  // Starts a full scan of root, which skips the directories that
+  // previous_fingerprints show to be unchanged.
+  void StartScanWithDirectoryFingerprints(
+      const string& root,
+      boost::shared_ptr<vector<DirectoryFingerprint> > previous_fingerprints);
+
+  void StartScan(const string& root);
+
   // Obtains new file paths from the directory scanner and enqueues them. Posts
   // a callback to try to start the next snapshot state machine. If the
   // directory scanner had no new file paths, it considers the scan to be
   // complete.
   void AddNewPendingSnapshotPaths();
 
+  // A batch of paths from the scanner, stored in a PathArena rather than as
+  // separate paths. Defined in the .cc file.
+  struct SnapshotPathBatch;
+
+  // A path in a batch that is waiting for room in the snapshot state
+  // machine pool. The batch is kept until none of its paths are buffered.
+  struct BufferedSnapshotPath {
+    boost::shared_ptr<const SnapshotPathBatch> batch;
+    size_t index;
+    size_t weight;
+  };
+
+  // Enqueues a batch of paths from the scanner, once they have been put in
+  // the order given by snapshot_path_order.
+  void AddSnapshotPathBatch(boost::shared_ptr<const SnapshotPathBatch> batch);
+
   void AddBufferedSnapshotPaths();
 
-  void TryAddSnapshotPathWithSize(
-      const std::pair<boost::filesystem::path, size_t>& path_with_size);
+  void TryAddSnapshotPath(
+      boost::shared_ptr<const SnapshotPathBatch> batch, size_t index);
 
-  void TryAddSnapshotPathWithWeight(
-      const std::pair<boost::filesystem::path, size_t>& path_with_weight);
+  void TryAddBufferedSnapshotPath(
+      const BufferedSnapshotPath& buffered_snapshot_path);
 
   void TryScanMorePaths();
 
+  // Returns the scanner for changed paths if the backup is of the changes
+  // recorded in the change journal, and otherwise the full scanner.
+  FilesystemScanner* GetFilesystemScanner() const;
+
   size_t WeightFromFilesize(size_t filesize) const;
 
   enum class ScanState {
@@ -103,10 +167,14 @@ class BackupExecutor {
   boost::shared_ptr<AsioDispatcher::StrandDispatcher> strand_dispatcher_;
 
   OverrideableUniquePtr<FilesystemScanner> filesystem_scanner_;
+  unique_ptr<ChangeJournal> change_journal_;
+  unique_ptr<FilesystemScanner> changed_paths_filesystem_scanner_;
+  unique_ptr<MetadataDb> metadata_db_;
+  unique_ptr<DirectoryFingerprints> directory_fingerprints_;
+  unique_ptr<PathFilter> path_filter_;
   size_t snapshot_state_machine_pool_max_weight_;
 
-  std::queue<std::pair<boost::filesystem::path, size_t> >
-      buffered_paths_with_weight_;
+  std::queue<BufferedSnapshotPath> buffered_paths_with_weight_;
   size_t buffered_paths_total_weight_;
 
   int num_files_processed_;
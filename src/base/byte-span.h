@@ -0,0 +1,61 @@
+#ifndef BYTE_SPAN_H
+#define BYTE_SPAN_H
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "base/macros.h"
+
+namespace polar_express {
+
+// A read-only view of a contiguous range of bytes owned by someone
+// else (e.g. a vector, or a memory-mapped file). A ByteSpan is cheap to
+// copy and is intended to be passed around by value, including into
+// asynchronous callbacks.
+//
+// The span does NOT keep the underlying storage alive. Whoever hands
+// out a span must document how long it remains valid, and whoever
+// receives one must not use it beyond that.
+class ByteSpan {
+ public:
+  ByteSpan()
+      : data_(nullptr),
+        size_(0) {
+  }
+
+  ByteSpan(const byte* data, size_t size)
+      : data_(data),
+        size_(size) {
+  }
+
+  // Implicit so that existing callers holding a vector can pass it
+  // wherever a span is expected. The vector must not be modified or
+  // destroyed while the span is in use.
+  ByteSpan(const vector<byte>& data)  // NOLINT
+      : data_(data.data()),
+        size_(data.size()) {
+  }
+
+  const byte* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  const byte* begin() const { return data_; }
+  const byte* end() const { return data_ + size_; }
+
+  // Returns a span of at most length bytes starting at offset. Offsets
+  // past the end yield an empty span.
+  ByteSpan subspan(size_t offset, size_t length) const {
+    offset = std::min(offset, size_);
+    return ByteSpan(data_ + offset, std::min(length, size_ - offset));
+  }
+
+ private:
+  const byte* data_;
+  size_t size_;
+};
+
+}  // namespace polar_express
+
+#endif  // BYTE_SPAN_H
@@ -0,0 +1,264 @@
+#include "base/io-uring-queue.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "base/options.h"
+
+DEFINE_OPTION(io_uring_queue_depth, int, 256,
+              "Maximum number of reads in flight at once when reading files "
+              "with io_uring.");
+
+namespace polar_express {
+namespace {
+
+int IoUringSetup(unsigned entries, io_uring_params* params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int IoUringEnter(int ring_fd, unsigned to_submit, unsigned min_complete,
+                 unsigned flags) {
+  return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+                 flags, nullptr, 0);
+}
+
+template <typename T>
+T* RingPointer(void* ring, uint32_t offset) {
+  return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+}  // namespace
+
+struct IoUringQueue::Request {
+  int fd;
+  iovec iov;
+  int64_t offset;
+  ReadCompletion completion;
+};
+
+// static
+IoUringQueue* IoUringQueue::GetInstance() {
+  static IoUringQueue* instance = CreateInstance();
+  return instance;
+}
+
+// static
+IoUringQueue* IoUringQueue::CreateInstance() {
+  // Intentionally leaked, since the completion thread runs for the
+  // lifetime of the process.
+  unique_ptr<IoUringQueue> io_uring_queue(new IoUringQueue);
+  if (!io_uring_queue->Init(std::max(options::io_uring_queue_depth, 1))) {
+    return nullptr;
+  }
+  return io_uring_queue.release();
+}
+
+IoUringQueue::IoUringQueue()
+    : ring_fd_(-1),
+      sq_ring_(MAP_FAILED),
+      sq_ring_size_(0),
+      cq_ring_(MAP_FAILED),
+      cq_ring_size_(0),
+      sqes_(static_cast<io_uring_sqe*>(MAP_FAILED)),
+      sqes_size_(0),
+      max_in_flight_(0),
+      error_(0) {
+}
+
+IoUringQueue::~IoUringQueue() {
+  if (sqes_ != MAP_FAILED) {
+    munmap(sqes_, sqes_size_);
+  }
+  if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  if (sq_ring_ != MAP_FAILED) {
+    munmap(sq_ring_, sq_ring_size_);
+  }
+  if (ring_fd_ >= 0) {
+    close(ring_fd_);
+  }
+}
+
+void IoUringQueue::Read(int fd, byte* buffer, size_t length, int64_t offset,
+                        ReadCompletion completion) {
+  Request* request = new Request;
+  request->fd = fd;
+  request->iov.iov_base = buffer;
+  request->iov.iov_len = length;
+  request->offset = offset;
+  request->completion = completion;
+
+  boost::mutex::scoped_lock lock(mu_);
+  if (error_ == 0 && in_flight_requests_.size() < max_in_flight_) {
+    SubmitLocked(request);
+  } else {
+    pending_requests_.push_back(request);
+    if (error_ != 0) {
+      requests_pending_.notify_one();
+    }
+  }
+}
+
+bool IoUringQueue::Init(unsigned queue_depth) {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_fd_ = IoUringSetup(queue_depth, &params);
+  if (ring_fd_ < 0) {
+    DLOG(std::cerr << "io_uring unavailable: " << strerror(errno)
+                   << std::endl);
+    return false;
+  }
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  }
+  sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    return false;
+  }
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      return false;
+    }
+  }
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  sqes_ = static_cast<io_uring_sqe*>(
+      mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES));
+  if (sqes_ == MAP_FAILED) {
+    return false;
+  }
+
+  sq_tail_ = RingPointer<unsigned>(sq_ring_, params.sq_off.tail);
+  sq_ring_mask_ = *RingPointer<unsigned>(sq_ring_, params.sq_off.ring_mask);
+  sq_array_ = RingPointer<unsigned>(sq_ring_, params.sq_off.array);
+  cq_head_ = RingPointer<unsigned>(cq_ring_, params.cq_off.head);
+  cq_tail_ = RingPointer<unsigned>(cq_ring_, params.cq_off.tail);
+  cq_ring_mask_ = *RingPointer<unsigned>(cq_ring_, params.cq_off.ring_mask);
+  cqes_ = RingPointer<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+
+  // The completion queue is at least as large as the submission queue, so
+  // limiting the number of reads in flight to the submission queue size
+  // ensures that completions can never overflow.
+  max_in_flight_ = params.sq_entries;
+
+  boost::thread(boost::bind(&IoUringQueue::CompletionThread, this)).detach();
+  return true;
+}
+
+void IoUringQueue::SubmitLocked(Request* request) {
+  // Only this method writes the submission queue, and only with mu_ held,
+  // so the tail cannot change underneath us.
+  const unsigned tail = *sq_tail_;
+  const unsigned index = tail & sq_ring_mask_;
+  io_uring_sqe* sqe = &sqes_[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_READV;
+  sqe->fd = request->fd;
+  sqe->addr = reinterpret_cast<uint64_t>(&request->iov);
+  sqe->len = 1;
+  sqe->off = request->offset;
+  sqe->user_data = reinterpret_cast<uint64_t>(request);
+  sq_array_[index] = index;
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+  in_flight_requests_.insert(request);
+
+  // Ask the kernel to consume every entry in the submission queue, so
+  // that an entry left behind by a failed call is picked up by the next.
+  int result;
+  do {
+    result = IoUringEnter(ring_fd_, max_in_flight_, 0, 0);
+  } while (result < 0 && errno == EINTR);
+}
+
+void IoUringQueue::CompletionThread() {
+  vector<unique_ptr<Request> > completed_requests;
+  for (;;) {
+    if (IoUringEnter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS) < 0 &&
+        errno != EINTR) {
+      const int error = errno;
+      DLOG(std::cerr << "io_uring_enter failed: " << strerror(error)
+                     << std::endl);
+      FailRequests(error);
+    }
+
+    unsigned head = *cq_head_;
+    const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      const io_uring_cqe& cqe = cqes_[head & cq_ring_mask_];
+      completed_requests.emplace_back(
+          reinterpret_cast<Request*>(cqe.user_data));
+      const int result = cqe.res;
+      __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+      completed_requests.back()->completion(result);
+    }
+
+    if (!completed_requests.empty()) {
+      // The requests are freed only once they are no longer in flight, so
+      // that a new request allocated at the same address cannot be
+      // mistaken for one of them.
+      boost::mutex::scoped_lock lock(mu_);
+      for (const unique_ptr<Request>& request : completed_requests) {
+        in_flight_requests_.erase(request.get());
+      }
+      completed_requests.clear();
+      while (!pending_requests_.empty() &&
+             in_flight_requests_.size() < max_in_flight_) {
+        SubmitLocked(pending_requests_.front());
+        pending_requests_.pop_front();
+      }
+    }
+  }
+}
+
+void IoUringQueue::FailRequests(int error) {
+  boost::mutex::scoped_lock lock(mu_);
+  error_ = error;
+
+  // No further completions can be reaped from a ring in this state, so the
+  // reads still in flight are failed along with the pending ones rather
+  // than left for callers to wait on forever.
+  vector<Request*> failed_requests(
+      in_flight_requests_.begin(), in_flight_requests_.end());
+  in_flight_requests_.clear();
+  for (;;) {
+    failed_requests.insert(failed_requests.end(), pending_requests_.begin(),
+                           pending_requests_.end());
+    pending_requests_.clear();
+
+    lock.unlock();
+    for (Request* failed_request : failed_requests) {
+      unique_ptr<Request> request(failed_request);
+      request->completion(-error);
+    }
+    failed_requests.clear();
+    lock.lock();
+
+    while (pending_requests_.empty()) {
+      requests_pending_.wait(lock);
+    }
+  }
+}
+
+}  // namespace polar_express
@@ -0,0 +1,99 @@
+#ifndef IO_URING_QUEUE_H
+#define IO_URING_QUEUE_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <unordered_set>
+
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "base/macros.h"
+
+struct io_uring_cqe;
+struct io_uring_sqe;
+
+namespace polar_express {
+
+// Singleton wrapper around a Linux io_uring, used to keep many reads in
+// flight at once without dedicating a thread to each. Reads may be
+// submitted from any thread; their completions are run on a single
+// completion thread owned by the queue, so completions must be short and
+// should post any real work to the AsioDispatcher.
+//
+// The ring is driven with raw system calls rather than liburing, so that
+// no additional library is needed to build.
+class IoUringQueue {
+ public:
+  typedef boost::function<void(int)> ReadCompletion;
+
+  // Returns null if io_uring is unavailable, either because the kernel
+  // is too old or because it is blocked (e.g. by a seccomp filter).
+  static IoUringQueue* GetInstance();
+
+  ~IoUringQueue();
+
+  // Reads up to length bytes at offset in fd into buffer. The completion
+  // is called with the number of bytes read, or a negative errno value.
+  // Reads beyond the queue depth are held back until earlier reads
+  // complete. If the ring itself fails, every read that has not completed,
+  // and every read submitted afterwards, completes with the ring's error.
+  void Read(int fd, byte* buffer, size_t length, int64_t offset,
+            ReadCompletion completion);
+
+ private:
+  struct Request;
+
+  static IoUringQueue* CreateInstance();
+
+  IoUringQueue();
+
+  bool Init(unsigned queue_depth);
+
+  // Must be called with mu_ held.
+  void SubmitLocked(Request* request);
+
+  void CompletionThread();
+
+  // Completes every outstanding request, and every one submitted from
+  // then on, with -error. Called on the completion thread once the ring
+  // has failed; never returns.
+  void FailRequests(int error);
+
+  int ring_fd_;
+
+  void* sq_ring_;
+  size_t sq_ring_size_;
+  void* cq_ring_;
+  size_t cq_ring_size_;
+  io_uring_sqe* sqes_;
+  size_t sqes_size_;
+
+  unsigned* sq_tail_;
+  unsigned sq_ring_mask_;
+  unsigned* sq_array_;
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_ring_mask_;
+  io_uring_cqe* cqes_;
+
+  boost::mutex mu_;
+  std::unordered_set<Request*> in_flight_requests_;
+  unsigned max_in_flight_;
+  std::deque<Request*> pending_requests_;
+
+  // Set once the ring has failed, after which requests are completed with
+  // -error_ as they are submitted.
+  int error_;
+  boost::condition_variable requests_pending_;
+
+  friend class IoUringQueueTest;
+
+  DISALLOW_COPY_AND_ASSIGN(IoUringQueue);
+};
+
+}  // namespace polar_express
+
+#endif  // IO_URING_QUEUE_H
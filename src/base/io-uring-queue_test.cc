@@ -0,0 +1,197 @@
+#include "base/io-uring-queue.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/bind/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <gtest/gtest.h>
+
+#include "base/macros.h"
+
+namespace polar_express {
+
+class IoUringQueueTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    path_ = boost::filesystem::temp_directory_path() /
+        boost::filesystem::unique_path("io-uring-queue_test-%%%%%%%%");
+    FILE* file = fopen(path_.c_str(), "wb");
+    ASSERT_TRUE(file != nullptr);
+    fputs("0123456789", file);
+    fclose(file);
+    fd_ = open(path_.c_str(), O_RDONLY);
+    ASSERT_GE(fd_, 0);
+  }
+
+  virtual void TearDown() {
+    close(fd_);
+    boost::filesystem::remove(path_);
+  }
+
+  // Returns a queue of the given depth, or null if io_uring is unavailable
+  // here. Queues are never destroyed, since their completion threads run
+  // for as long as the process.
+  static IoUringQueue* CreateQueue(unsigned queue_depth) {
+    IoUringQueue* io_uring_queue = new IoUringQueue;
+    if (!io_uring_queue->Init(queue_depth)) {
+      std::cerr << "io_uring is unavailable; skipping test." << std::endl;
+      return nullptr;
+    }
+    return io_uring_queue;
+  }
+
+
+  static size_t NumInFlight(IoUringQueue* io_uring_queue) {
+    boost::mutex::scoped_lock lock(io_uring_queue->mu_);
+    return io_uring_queue->in_flight_requests_.size();
+  }
+
+  IoUringQueue::ReadCompletion RecordResult() {
+    return boost::bind(&IoUringQueueTest::HandleResult, this,
+                       boost::placeholders::_1);
+  }
+
+  // As RecordResult, but first makes every later call on the ring fail.
+  // Since completions run on the completion thread, the thread can only
+  // see the broken ring after this read has completed.
+  IoUringQueue::ReadCompletion BreakRingAndRecordResult(
+      IoUringQueue* io_uring_queue) {
+    return boost::bind(&IoUringQueueTest::HandleResultAndBreakRing, this,
+                       io_uring_queue, boost::placeholders::_1);
+  }
+
+  // Waits for num_results completions, and returns their results in the
+  // order in which they completed.
+  vector<int> WaitForResults(size_t num_results) {
+    boost::mutex::scoped_lock lock(mu_);
+    while (results_.size() < num_results) {
+      result_recorded_.wait(lock);
+    }
+    return results_;
+  }
+
+  boost::filesystem::path path_;
+  int fd_;
+
+ private:
+  void HandleResult(int result) {
+    boost::mutex::scoped_lock lock(mu_);
+    results_.push_back(result);
+    result_recorded_.notify_all();
+  }
+
+  void HandleResultAndBreakRing(IoUringQueue* io_uring_queue, int result) {
+    {
+      boost::mutex::scoped_lock lock(io_uring_queue->mu_);
+      io_uring_queue->ring_fd_ = -1;
+    }
+    HandleResult(result);
+  }
+
+  boost::mutex mu_;
+  boost::condition_variable result_recorded_;
+  vector<int> results_;
+};
+
+namespace {
+
+TEST_F(IoUringQueueTest, ReadsFile) {
+  IoUringQueue* io_uring_queue = CreateQueue(4);
+  if (io_uring_queue == nullptr) {
+    return;
+  }
+
+  char head[4];
+  char tail[8];
+  io_uring_queue->Read(fd_, reinterpret_cast<byte*>(head), sizeof(head), 0,
+                       RecordResult());
+  const vector<int> head_results = WaitForResults(1);
+  ASSERT_EQ(1, head_results.size());
+  EXPECT_EQ(4, head_results[0]);
+  EXPECT_EQ("0123", string(head, sizeof(head)));
+
+  // Reads stop short at EOF.
+  io_uring_queue->Read(fd_, reinterpret_cast<byte*>(tail), sizeof(tail), 6,
+                       RecordResult());
+  const vector<int> tail_results = WaitForResults(2);
+  EXPECT_EQ(4, tail_results[1]);
+  EXPECT_EQ("6789", string(tail, 4));
+}
+
+TEST_F(IoUringQueueTest, HoldsBackReadsBeyondQueueDepth) {
+  IoUringQueue* io_uring_queue = CreateQueue(1);
+  if (io_uring_queue == nullptr) {
+    return;
+  }
+
+  // A read from an empty pipe stays in flight until the pipe is written.
+  int pipe_fds[2];
+  ASSERT_EQ(0, pipe(pipe_fds));
+  char pipe_data;
+  io_uring_queue->Read(pipe_fds[0], reinterpret_cast<byte*>(&pipe_data), 1,
+                       0, RecordResult());
+  char file_data[10][1];
+  for (int i = 0; i < 10; ++i) {
+    io_uring_queue->Read(fd_, reinterpret_cast<byte*>(file_data[i]), 1, i,
+                         RecordResult());
+  }
+  EXPECT_EQ(1, NumInFlight(io_uring_queue));
+
+  ASSERT_EQ(1, write(pipe_fds[1], "x", 1));
+  const vector<int> results = WaitForResults(11);
+  EXPECT_EQ(vector<int>(11, 1), results);
+  EXPECT_EQ('x', pipe_data);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ('0' + i, file_data[i][0]);
+  }
+
+  close(pipe_fds[0]);
+  close(pipe_fds[1]);
+}
+
+TEST_F(IoUringQueueTest, FailsAllReadsWhenRingFails) {
+  IoUringQueue* io_uring_queue = CreateQueue(1);
+  if (io_uring_queue == nullptr) {
+    return;
+  }
+
+  int pipe_fds[2];
+  ASSERT_EQ(0, pipe(pipe_fds));
+  char pipe_data;
+  io_uring_queue->Read(pipe_fds[0], reinterpret_cast<byte*>(&pipe_data), 1,
+                       0, BreakRingAndRecordResult(io_uring_queue));
+  char file_data[2];
+  io_uring_queue->Read(fd_, reinterpret_cast<byte*>(&file_data[0]), 1, 0,
+                       RecordResult());
+  io_uring_queue->Read(fd_, reinterpret_cast<byte*>(&file_data[1]), 1, 1,
+                       RecordResult());
+
+  // Completing the pipe read submits the first file read, which the broken
+  // ring never sees, and the completion thread then fails to wait on it.
+  ASSERT_EQ(1, write(pipe_fds[1], "x", 1));
+  vector<int> results = WaitForResults(3);
+  EXPECT_EQ(1, results[0]);
+  EXPECT_EQ(-EBADF, results[1]);
+  EXPECT_EQ(-EBADF, results[2]);
+
+  // Reads submitted once the ring has failed fail too.
+  io_uring_queue->Read(fd_, reinterpret_cast<byte*>(&file_data[0]), 1, 0,
+                       RecordResult());
+  results = WaitForResults(4);
+  EXPECT_EQ(-EBADF, results[3]);
+
+  close(pipe_fds[0]);
+  close(pipe_fds[1]);
+}
+
+}  // namespace
+}  // namespace polar_express
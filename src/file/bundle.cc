@@ -5,11 +5,10 @@
 #include <unistd.h>
 
 #include <boost/lexical_cast.hpp>
-#include <crypto++/hex.h>
-#include <crypto++/sha.h>
-
 #include "file/tar-header-block.h"
 #include "proto/block.pb.h"
+#include "util/digest.h"
+#include "util/sha-hasher.h"
 
 namespace polar_express {
 namespace {
@@ -138,19 +137,13 @@ void Bundle::AppendSerializedManifest() {
                serialized_manifest.end());
   EndCurrentFile(serialized_manifest.length());
 
-  string serialized_manifest_sha1_digest;
-  CryptoPP::SHA1 sha1_engine;
-  unsigned char raw_digest[CryptoPP::SHA1::DIGESTSIZE];
-  sha1_engine.CalculateDigest(
-      raw_digest,
-      reinterpret_cast<const unsigned char*>(serialized_manifest.c_str()),
-      serialized_manifest.length());
+  Sha1Digest raw_digest;
+  Sha1Hasher::Hash(
+      ByteSpan(reinterpret_cast<const byte*>(serialized_manifest.data()),
+               serialized_manifest.length()),
+      &raw_digest);
 
-  CryptoPP::HexEncoder encoder;
-  encoder.Attach(new CryptoPP::StringSink(serialized_manifest_sha1_digest));
-  encoder.Put(raw_digest, sizeof(raw_digest));
-  encoder.MessageEnd();
-  serialized_manifest_sha1_digest += '\n';
+  string serialized_manifest_sha1_digest = raw_digest.ToHex() + '\n';
 
   StartNewFile(kManifestDigestFilename);
   data_->insert(data_->end(), serialized_manifest_sha1_digest.begin(),
@@ -218,7 +211,7 @@ size_t AnnotatedBundleData::file_contents_size() const {
 
 string AnnotatedBundleData::unique_filename() const {
   return string("bundle_") + boost::lexical_cast<string>(annotations_.id()) +
-      "_" + annotations_.sha256_linear_digest();
+      "_" + HexEncode(annotations_.sha256_linear_digest());
 }
 
 }  // namespace polar_express
@@ -0,0 +1,78 @@
+// Polar Express
+// Copyright (C) 2014  Tyler McHenry
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+// Watches a backup root between backups and records the paths that change
+// in a change journal, so that polar-express run with the same
+// --change_journal_directory backs up only those paths. Runs until it is
+// interrupted or terminated.
+
+#include <signal.h>
+
+#include <iostream>
+#include <string>
+
+#include "base/options.h"
+#include "services/change-journal.h"
+#include "services/change-journal-watcher.h"
+
+using namespace polar_express;
+
+DEFINE_OPTION(backup_root, string, "", "Local path to watch for changes.");
+DEFINE_OPTION(change_journal_directory, string, "",
+              "Directory in which to record the change journal.");
+
+namespace {
+
+ChangeJournalWatcher* watcher = nullptr;
+
+void HandleStopSignal(int /* signal */) {
+  watcher->Stop();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (!options::Init(argc, argv)) {
+    return 0;
+  }
+  if (options::backup_root.empty() ||
+      options::change_journal_directory.empty()) {
+    std::cerr << "ERROR: Both --backup_root and --change_journal_directory "
+              << "must be specified." << std::endl;
+    return -1;
+  }
+
+  ChangeJournal change_journal(options::change_journal_directory);
+  ChangeJournalWatcher change_journal_watcher(
+      options::backup_root, &change_journal);
+  if (!change_journal_watcher.Start()) {
+    std::cerr << "FATAL: Failed to start watching "
+              << options::backup_root << ". Is another watcher running?"
+              << std::endl;
+    return -1;
+  }
+
+  watcher = &change_journal_watcher;
+  signal(SIGINT, &HandleStopSignal);
+  signal(SIGTERM, &HandleStopSignal);
+
+  if (!change_journal_watcher.Run()) {
+    std::cerr << "FATAL: Failed to write the change journal." << std::endl;
+    return -1;
+  }
+  return 0;
+}
@@ -18,6 +18,8 @@
 #include <ctime>
 #include <iostream>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <boost/shared_ptr.hpp>
 #include <crypto++/secblock.h>
@@ -97,11 +99,17 @@ int main(int argc, char** argv) {
   }
 
   BackupExecutor backup_executor;
-  backup_executor.Start(options::backup_root, encryption_type,
-                        encryption_keying_data, options::aws_region_name,
-                        aws_access_key, aws_secret_key,
-                        options::aws_glacier_vault_name);
+  if (!backup_executor.Start(options::backup_root, encryption_type,
+                             encryption_keying_data, options::aws_region_name,
+                             aws_access_key, aws_secret_key,
+                             options::aws_glacier_vault_name)) {
+    std::cerr << "FATAL: Failed to start the backup." << std::endl;
+    return -1;
+  }
 
+  AsioDispatcher::GetInstance()->WaitForFinish();
+  AsioDispatcher::GetInstance()->Start();
+  backup_executor.Finish();
   AsioDispatcher::GetInstance()->WaitForFinish();
   const time_t end_time = time(nullptr);
 
@@ -110,6 +118,15 @@ int main(int argc, char** argv) {
             << io_util::HumanReadableSize(
                 backup_executor.GetSizeOfFilesProcessed())
             << ")." << std::endl;
+  std::cout << "Skipped "
+            << backup_executor.GetNumUnchangedDirectoriesSkipped()
+            << " unchanged directories." << std::endl;
+  vector<std::pair<string, size_t> > rule_hits;
+  backup_executor.GetPathFilterRuleHits(&rule_hits);
+  for (const auto& rule_hit : rule_hits) {
+    std::cout << "Path filter rule '" << rule_hit.first << "' matched "
+              << rule_hit.second << " paths." << std::endl;
+  }
   std::cout << "Generated " << backup_executor.GetNumSnapshotsGenerated()
             << " new snapshots ("
             << io_util::HumanReadableSize(
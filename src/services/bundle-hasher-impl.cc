@@ -1,7 +1,9 @@
 #include "services/bundle-hasher-impl.h"
 
-#include <crypto++/hex.h>
-#include <crypto++/sha.h>
+#include <algorithm>
+
+#include "base/byte-span.h"
+#include "util/sha-hasher.h"
 
 namespace polar_express {
 namespace {
@@ -9,19 +11,6 @@ namespace {
 // Defined by Amazon AWS API
 const size_t kTreeHashIntermediateDigestDataSize = 1024 * 1024;  // 1 MiB
 
-void WriteHashToString(const byte* raw_digest, size_t n, string* str) {
-  CryptoPP::HexEncoder encoder;
-  encoder.Attach(new CryptoPP::StringSink(*CHECK_NOTNULL(str)));
-  encoder.Put(raw_digest, n);
-  encoder.MessageEnd();
-}
-
-// TODO(tylermchenry): Duplicated in chunk-hasher-impl.cc; consolidate.
-template <int N>
-void WriteHashToString(const byte (&raw_digest)[N], string* str) {
-  WriteHashToString(raw_digest, N, str);
-}
-
 }  // namespace
 
 BundleHasherImpl::BundleHasherImpl()
@@ -54,17 +43,25 @@ void BundleHasherImpl::ValidateHashes(
 void BundleHasherImpl::HashData(
     const vector<const vector<byte>*>& sequential_data,
     string* sha256_linear_digest, string* sha256_tree_digest) const {
-  CryptoPP::SHA256 sha256_linear_engine;
-  CryptoPP::SHA256 sha256_tree_engine;
-  vector<vector<byte> > sha256_tree_intermediate_digests;
+  Sha256Hasher sha256_linear_hasher;
+  Sha256Hasher sha256_tree_hasher;
+  vector<Sha256Digest> sha256_tree_intermediate_digests;
   size_t bytes_in_current_intermediate_digest = 0;
 
+  // Pieces that lie entirely within one vector are not hashed as they
+  // are found; they are collected here (along with the index of their
+  // slot in sha256_tree_intermediate_digests) and hashed together at
+  // the end, so that the digest backend can process several of them at
+  // once in multi-buffer mode.
+  vector<ByteSpan> contiguous_pieces;
+  vector<size_t> contiguous_piece_indices;
+
   for (const auto* data : sequential_data) {
     if (data->empty()) {
       continue;
     }
 
-    sha256_linear_engine.Update(data->data(), data->size());
+    sha256_linear_hasher.Update(ByteSpan(*data));
 
     // For the tree digest we need to compute a digest of each 1 MiB
     // peice of the data. But here the data is spread out over
@@ -72,31 +69,29 @@ void BundleHasherImpl::HashData(
     // MiB. So do this:
     //
     // 1. Check if there is some leftover data from the previous
-    // vector in the tree engine. If so, add to it, up to a complete
+    // vector in the tree hasher. If so, add to it, up to a complete
     // peice (or the end of the current vector).
     //
     // 2. If we made a complete peice this way, compute its digest and
-    // clear the engine.
+    // reset the hasher.
     //
-    // 3. For the remaining data in the current vector, compute
-    // digests of each 1 MiB peice, until there is less than 1 MiB
+    // 3. For the remaining data in the current vector, queue each 1
+    // MiB peice for hashing, until there is less than 1 MiB
     // remaining.
     //
-    // 4. Put whatever data is remaining into the engine, but do not
+    // 4. Put whatever data is remaining into the hasher, but do not
     // finalize.
-    //
-    // TODO(tylermchenry): Gah, there has to be a cleaner way to write this!
     size_t offset = 0;
     if (bytes_in_current_intermediate_digest > 0) {
       offset = std::min(data->size(), kTreeHashIntermediateDigestDataSize -
                                           bytes_in_current_intermediate_digest);
-      sha256_tree_engine.Update(&(*data)[0], offset);
+      sha256_tree_hasher.Update(data->data(), offset);
       bytes_in_current_intermediate_digest += offset;
     }
     if (bytes_in_current_intermediate_digest ==
         kTreeHashIntermediateDigestDataSize) {
-      vector<byte> intermediate_digest(CryptoPP::SHA256::DIGESTSIZE);
-      sha256_tree_engine.Final(intermediate_digest.data());
+      Sha256Digest intermediate_digest;
+      sha256_tree_hasher.Final(&intermediate_digest);
       sha256_tree_intermediate_digests.push_back(intermediate_digest);
       bytes_in_current_intermediate_digest = 0;
     }
@@ -104,15 +99,15 @@ void BundleHasherImpl::HashData(
     if (data->size() >= kTreeHashIntermediateDigestDataSize) {
       for (; offset <= data->size() - kTreeHashIntermediateDigestDataSize;
            offset += kTreeHashIntermediateDigestDataSize) {
-        vector<byte> intermediate_digest(CryptoPP::SHA256::DIGESTSIZE);
-        sha256_tree_engine.CalculateDigest(
-            intermediate_digest.data(), &(*data)[offset],
-            kTreeHashIntermediateDigestDataSize);
-        sha256_tree_intermediate_digests.push_back(intermediate_digest);
+        contiguous_pieces.push_back(ByteSpan(
+            data->data() + offset, kTreeHashIntermediateDigestDataSize));
+        contiguous_piece_indices.push_back(
+            sha256_tree_intermediate_digests.size());
+        sha256_tree_intermediate_digests.push_back(Sha256Digest());
       }
     }
     if (offset != data->size()) {
-      sha256_tree_engine.Update(&(*data)[offset], data->size() - offset);
+      sha256_tree_hasher.Update(data->data() + offset, data->size() - offset);
       bytes_in_current_intermediate_digest = data->size() - offset;
     }
   }
@@ -121,24 +116,28 @@ void BundleHasherImpl::HashData(
   // 1 MiB peice, compute its digest. The Glacier tree hash algorithm
   // allows the final peice (but only the final peice!) to be short.
   if (bytes_in_current_intermediate_digest != 0) {
-    vector<byte> intermediate_digest(CryptoPP::SHA256::DIGESTSIZE);
-    sha256_tree_engine.Final(intermediate_digest.data());
+    Sha256Digest intermediate_digest;
+    sha256_tree_hasher.Final(&intermediate_digest);
     sha256_tree_intermediate_digests.push_back(intermediate_digest);
   }
 
-  byte raw_digest[CryptoPP::SHA256::DIGESTSIZE];
-  sha256_linear_engine.Final(raw_digest);
-  WriteHashToString(raw_digest, CHECK_NOTNULL(sha256_linear_digest));
+  vector<Sha256Digest> contiguous_piece_digests;
+  Sha256Hasher::HashMultiple(contiguous_pieces, &contiguous_piece_digests);
+  for (size_t i = 0; i < contiguous_piece_digests.size(); ++i) {
+    sha256_tree_intermediate_digests[contiguous_piece_indices[i]] =
+        contiguous_piece_digests[i];
+  }
 
-  vector<byte> sha256_tree_digest_vector(CryptoPP::SHA256::DIGESTSIZE);
+  Sha256Digest linear_digest;
+  sha256_linear_hasher.Final(&linear_digest);
+  *CHECK_NOTNULL(sha256_linear_digest) = linear_digest.ToBytes();
+
+  Sha256Digest tree_digest;
   ComputeFinalTreeHash(
       sha256_tree_intermediate_digests.begin(),
       sha256_tree_intermediate_digests.end(),
-      &sha256_tree_digest_vector);
-  WriteHashToString(
-      sha256_tree_digest_vector.data(),
-      sha256_tree_digest_vector.size(),
-      sha256_tree_digest);
+      &tree_digest);
+  *CHECK_NOTNULL(sha256_tree_digest) = tree_digest.ToBytes();
 }
 
 // The tree digest is an Amazon-specific thing. See here for description:
@@ -146,11 +145,11 @@ void BundleHasherImpl::HashData(
 //
 // TODO(tylermchenry): Probably some performance improvements to be made here.
 void BundleHasherImpl::ComputeFinalTreeHash(
-    const vector<vector<byte> >::const_iterator
+    const vector<Sha256Digest>::const_iterator
       sha256_intermediate_digests_begin,
-    const vector<vector<byte> >::const_iterator
+    const vector<Sha256Digest>::const_iterator
       sha256_intermediate_digests_end,
-    vector<byte>* sha256_tree_digest) const {
+    Sha256Digest* sha256_tree_digest) const {
   const size_t num_intermediate_digests = std::distance(
       sha256_intermediate_digests_begin, sha256_intermediate_digests_end);
 
@@ -163,20 +162,19 @@ void BundleHasherImpl::ComputeFinalTreeHash(
     return;
   }
 
-  vector<vector<byte> > next_level_sha256_intermediate_digests;
+  vector<Sha256Digest> next_level_sha256_intermediate_digests;
   for (auto left_digest_itr = sha256_intermediate_digests_begin;
        left_digest_itr < sha256_intermediate_digests_end - 1;
        std::advance(left_digest_itr, 2)) {
     auto right_digest_itr = left_digest_itr;
     std::advance(right_digest_itr, 1);
 
-    CryptoPP::SHA256 sha256_engine;
-    sha256_engine.Update(left_digest_itr->data(), left_digest_itr->size());
-    sha256_engine.Update(right_digest_itr->data(), right_digest_itr->size());
+    Sha256Hasher sha256_hasher;
+    sha256_hasher.Update(left_digest_itr->data(), left_digest_itr->size());
+    sha256_hasher.Update(right_digest_itr->data(), right_digest_itr->size());
 
-    vector<byte> next_level_sha256_intermediate_digest(
-        CryptoPP::SHA256::DIGESTSIZE);
-    sha256_engine.Final(next_level_sha256_intermediate_digest.data());
+    Sha256Digest next_level_sha256_intermediate_digest;
+    sha256_hasher.Final(&next_level_sha256_intermediate_digest);
 
     next_level_sha256_intermediate_digests.push_back(
         next_level_sha256_intermediate_digest);
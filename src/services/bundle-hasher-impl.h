@@ -8,6 +8,7 @@
 #include "base/callback.h"
 #include "base/macros.h"
 #include "services/bundle-hasher.h"
+#include "util/digest.h"
 
 namespace polar_express {
 
@@ -30,11 +31,11 @@ class BundleHasherImpl : public BundleHasher {
                 string* sha256_linear_digest, string* sha256_tree_digest) const;
 
   void ComputeFinalTreeHash(
-      const vector<vector<byte> >::const_iterator
+      const vector<Sha256Digest>::const_iterator
         sha256_intermediate_digests_begin,
-      const vector<vector<byte> >::const_iterator
+      const vector<Sha256Digest>::const_iterator
         sha256_intermediate_digests_end,
-      vector<byte>* sha256_tree_digest) const;
+      Sha256Digest* sha256_tree_digest) const;
 
   friend class BundleHasherImplTest;
   DISALLOW_COPY_AND_ASSIGN(BundleHasherImpl);
@@ -7,6 +7,8 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include "util/hex-util.h"
+
 namespace polar_express {
 
 class BundleHasherImplTest : public testing::Test {
@@ -44,9 +46,9 @@ TEST_F(BundleHasherImplTest, HashDataUnderOneMegabyte) {
   HashData();
 
   EXPECT_EQ("CE80D3FC3B705B3CC4A15F596F81E55A5AC1A87617209EB6C46A37FF03FC1D40",
-            sha256_linear_digest_);
+            HexEncode(sha256_linear_digest_));
   EXPECT_EQ("CE80D3FC3B705B3CC4A15F596F81E55A5AC1A87617209EB6C46A37FF03FC1D40",
-            sha256_tree_digest_);
+            HexEncode(sha256_tree_digest_));
 }
 
 TEST_F(BundleHasherImplTest, HashDataOverOneMegabyte) {
@@ -57,9 +59,9 @@ TEST_F(BundleHasherImplTest, HashDataOverOneMegabyte) {
   HashData();
 
   EXPECT_EQ("34C28E6AB5A010D247B0E833548EC75BF4D0DDBE58AF8B4B8EB098D7F046C05D",
-            sha256_linear_digest_);
+            HexEncode(sha256_linear_digest_));
   EXPECT_EQ("08C2957765E7137B37A209402B4E0A6704BD78E01F8153B385FB079AC6F46264",
-            sha256_tree_digest_);
+            HexEncode(sha256_tree_digest_));
 }
 
 TEST_F(BundleHasherImplTest, HashDataOverOneMegabyteOddNumberOfBlocks) {
@@ -70,9 +72,9 @@ TEST_F(BundleHasherImplTest, HashDataOverOneMegabyteOddNumberOfBlocks) {
   HashData();
 
   EXPECT_EQ("27A0525680BEB5E3B65EFFA8F61A4C097E5418613C4AA7F9E30483D8490324BE",
-            sha256_linear_digest_);
+            HexEncode(sha256_linear_digest_));
   EXPECT_EQ("94497490CCB052FFEB81DD4300374EC5618B459DC8083F441383E95693987CDD",
-            sha256_tree_digest_);
+            HexEncode(sha256_tree_digest_));
 }
 
 }  // namespace
@@ -14,7 +14,8 @@ namespace polar_express {
 
 class BundleHasherImpl;
 
-// Class for computing the hashes of bundles, prior to uploading.
+// Class for computing the hashes of bundles, prior to uploading. All
+// digests are in raw binary form (see util/digest.h), not hex.
 class BundleHasher {
  public:
   BundleHasher();
@@ -2,15 +2,35 @@
 
 #include <grp.h>
 #include <pwd.h>
-#include <sys/stat.h>
 #include <time.h>
 
+#include <map>
+
 #include <boost/thread.hpp>
 #include <boost/filesystem.hpp>
 
+#include "base/options.h"
+#include "proto/file.pb.h"
 #include "proto/snapshot.pb.h"
+#include "util/file-stat-util.h"
+#include "util/id-name-cache.h"
+
+DEFINE_OPTION(owner_name_cache_max_entries, size_t, 4096,
+              "Maximum number of user names, and of group names, that are "
+              "cached for snapshots.");
+
+DEFINE_OPTION(owner_name_cache_ttl_seconds, int, 600,
+              "Number of seconds for which cached user and group names are "
+              "used before they are looked up again.");
 
 namespace polar_express {
+namespace {
+
+// Canonical forms of backup roots, shared by all generators.
+boost::mutex canonical_roots_mu;
+std::map<string, filesystem::path> canonical_roots;
+
+}  // namespace
 
 CandidateSnapshotGeneratorImpl::CandidateSnapshotGeneratorImpl()
   : CandidateSnapshotGenerator(false) {
@@ -22,55 +42,110 @@ CandidateSnapshotGeneratorImpl::~CandidateSnapshotGeneratorImpl() {
 void CandidateSnapshotGeneratorImpl::GenerateCandidateSnapshot(
     const string& root,
     const filesystem::path& path,
+    const FileStat& file_stat,
     boost::shared_ptr<Snapshot>* snapshot_ptr,
     Callback callback) const {
   CHECK_NOTNULL(snapshot_ptr)->reset(new Snapshot);
-  GenerateCandidateSnapshot(root, path, snapshot_ptr->get());
+  GenerateCandidateSnapshot(root, path, file_stat, snapshot_ptr->get());
   callback();
 }
 
 bool CandidateSnapshotGeneratorImpl::GenerateCandidateSnapshot(
     const string& root,
     const filesystem::path& path,
+    const FileStat& file_stat,
     Snapshot* candidate_snapshot) const {
   assert(candidate_snapshot != nullptr);
 
-  system::error_code ec;
-  filesystem::path canonical_path = canonical(path, root, ec);
-  if (ec) {
+  // The scanner normally provides the stat results, but stat here if it
+  // did not (e.g. it could not stat the file at the time).
+  FileStat own_file_stat;
+  const FileStat* stat_ptr = &file_stat;
+  if (!file_stat.has_mode()) {
+    if (!file_stat_util::GetFileStat(path, &own_file_stat)) {
+      return false;
+    }
+    stat_ptr = &own_file_stat;
+  }
+
+  if (!GetFilePath(
+          root, path, candidate_snapshot->mutable_file()->mutable_path())) {
     return false;
   }
 
+  // Unix-specific stuff. TODO: Deal with Windows FS as well.
+  Attributes* attribs = candidate_snapshot->mutable_attributes();
+  attribs->set_owner_user(GetUserNameCache()->GetName(stat_ptr->uid()));
+  attribs->set_owner_group(GetGroupNameCache()->GetName(stat_ptr->gid()));
+  attribs->set_uid(stat_ptr->uid());
+  attribs->set_gid(stat_ptr->gid());
+  attribs->set_mode(stat_ptr->mode() & 07777);
+
+  candidate_snapshot->set_modification_time(
+      stat_ptr->modification_time_ns() / 1000000000);
+  candidate_snapshot->set_is_regular(file_stat_util::IsRegularFile(*stat_ptr));
+  candidate_snapshot->set_is_deleted(false);
+  if (file_stat_util::IsRegularFile(*stat_ptr)) {
+    candidate_snapshot->set_length(stat_ptr->length());
+  }
+  candidate_snapshot->set_observation_time(time(NULL));
+  return true;
+}
+
+bool CandidateSnapshotGeneratorImpl::GetFilePath(
+    const string& root,
+    const filesystem::path& path,
+    string* file_path) const {
+  filesystem::path canonical_path = GetCanonicalPath(root, path);
   string canonical_path_str = canonical_path.string();
   if (canonical_path_str.empty()) {
     return false;
   }
 
-  // Generic platform-independent stuff.
-  filesystem::file_status file_stat = status(path);
+  *CHECK_NOTNULL(file_path) = RemoveRootFromPath(root, canonical_path_str);
+  return true;
+}
 
-  // Unix-specific stuff. TODO: Deal with Windows FS as well.
-  struct stat unix_stat;
-  stat(canonical_path_str.c_str(), &unix_stat);
+filesystem::path CandidateSnapshotGeneratorImpl::GetCanonicalPath(
+    const string& root,
+    const filesystem::path& path) const {
+  const string& path_str = path.string();
+  const bool is_below_root =
+      path_str.compare(0, root.length(), root) == 0 &&
+      (root.empty() || root.back() == '/' ||
+       path_str.length() == root.length() || path_str[root.length()] == '/');
+  if (!is_below_root) {
+    system::error_code ec;
+    filesystem::path canonical_path = canonical(path, root, ec);
+    return ec ? filesystem::path() : canonical_path;
+  }
 
-  File* file = candidate_snapshot->mutable_file();
-  file->set_path(RemoveRootFromPath(root, canonical_path_str));
+  filesystem::path canonical_root;
+  {
+    boost::mutex::scoped_lock lock(canonical_roots_mu);
+    auto it = canonical_roots.find(root);
+    if (it != canonical_roots.end()) {
+      canonical_root = it->second;
+    }
+  }
+  if (canonical_root.empty()) {
+    system::error_code ec;
+    canonical_root = filesystem::canonical(root, ec);
+    if (ec) {
+      return filesystem::path();
+    }
+    boost::mutex::scoped_lock lock(canonical_roots_mu);
+    canonical_roots[root] = canonical_root;
+  }
 
-  Attributes* attribs = candidate_snapshot->mutable_attributes();
-  attribs->set_owner_user(GetUserNameFromUid(unix_stat.st_uid));
-  attribs->set_owner_group(GetGroupNameFromGid(unix_stat.st_gid));
-  attribs->set_uid(unix_stat.st_uid);
-  attribs->set_gid(unix_stat.st_gid);
-  attribs->set_mode(file_stat.permissions());
-
-  candidate_snapshot->set_modification_time(last_write_time(canonical_path));
-  candidate_snapshot->set_is_regular(is_regular_file(canonical_path));
-  candidate_snapshot->set_is_deleted(!exists(canonical_path));
-  if (is_regular_file(canonical_path)) {
-    candidate_snapshot->set_length(file_size(canonical_path));
+  size_t suffix_start = root.length();
+  while (suffix_start < path_str.length() && path_str[suffix_start] == '/') {
+    ++suffix_start;
   }
-  candidate_snapshot->set_observation_time(time(NULL));
-  return true;
+  if (suffix_start == path_str.length()) {
+    return canonical_root;
+  }
+  return canonical_root / path_str.substr(suffix_start);
 }
 
 string CandidateSnapshotGeneratorImpl::RemoveRootFromPath(
@@ -82,23 +157,45 @@ string CandidateSnapshotGeneratorImpl::RemoveRootFromPath(
   return path_str;
 }
 
-string CandidateSnapshotGeneratorImpl::GetUserNameFromUid(int uid) const {
+// static
+IdNameCache* CandidateSnapshotGeneratorImpl::GetUserNameCache() {
+  static IdNameCache* user_name_cache = new IdNameCache(
+      &CandidateSnapshotGeneratorImpl::LookUpUserName,
+      options::owner_name_cache_max_entries,
+      std::chrono::seconds(options::owner_name_cache_ttl_seconds));
+  return user_name_cache;
+}
+
+// static
+IdNameCache* CandidateSnapshotGeneratorImpl::GetGroupNameCache() {
+  static IdNameCache* group_name_cache = new IdNameCache(
+      &CandidateSnapshotGeneratorImpl::LookUpGroupName,
+      options::owner_name_cache_max_entries,
+      std::chrono::seconds(options::owner_name_cache_ttl_seconds));
+  return group_name_cache;
+}
+
+// static
+string CandidateSnapshotGeneratorImpl::LookUpUserName(uint32_t uid) {
   passwd pwd;
   passwd* tmp_pwdptr;
   char pwdbuf[256];
 
-  if (getpwuid_r(uid, &pwd, pwdbuf, sizeof(pwdbuf), &tmp_pwdptr) == 0) {
+  if (getpwuid_r(uid, &pwd, pwdbuf, sizeof(pwdbuf), &tmp_pwdptr) == 0 &&
+      tmp_pwdptr != nullptr) {
     return pwd.pw_name;
   }
   return "";
 }
 
-string CandidateSnapshotGeneratorImpl::GetGroupNameFromGid(int gid) const {
+// static
+string CandidateSnapshotGeneratorImpl::LookUpGroupName(uint32_t gid) {
   group grp;
   group* tmp_grpptr;
   char grpbuf[256];
 
-  if (getgrgid_r(gid, &grp, grpbuf, sizeof(grpbuf), &tmp_grpptr) == 0) {
+  if (getgrgid_r(gid, &grp, grpbuf, sizeof(grpbuf), &tmp_grpptr) == 0 &&
+      tmp_grpptr != nullptr) {
     return grp.gr_name;
   }
   return "";
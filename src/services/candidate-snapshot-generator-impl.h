@@ -1,6 +1,7 @@
 #ifndef CANDIDATE_SNAPSHOT_GENERATOR_IMPL_H
 #define CANDIDATE_SNAPSHOT_GENERATOR_IMPL_H
 
+#include <cstdint>
 #include <string>
 
 #include <boost/filesystem.hpp>
@@ -13,6 +14,8 @@
 
 namespace polar_express {
 
+class FileStat;
+class IdNameCache;
 class Snapshot;
 
 // This class is the synchronous implementation of the asynchronous stub class
@@ -27,26 +30,47 @@ class CandidateSnapshotGeneratorImpl : public CandidateSnapshotGenerator {
   virtual void GenerateCandidateSnapshot(
       const string& root,
       const filesystem::path& path,
+      const FileStat& file_stat,
       boost::shared_ptr<Snapshot>* snapshot_ptr,
       Callback callback) const;
 
+  virtual bool GetFilePath(
+      const string& root,
+      const filesystem::path& path,
+      string* file_path) const;
+
+  // The caches of user and group names, shared by all generators.
+  static IdNameCache* GetUserNameCache();
+  static IdNameCache* GetGroupNameCache();
+
  private:
   // Fills the candidate snapshot information into a pre-existing snapshot
-  // protocol buffer.
+  // protocol buffer. Makes no syscalls for the file itself if file_stat is
+  // not empty, and at most one stat otherwise.
   bool GenerateCandidateSnapshot(
       const string& root,
       const filesystem::path& path,
+      const FileStat& file_stat,
       Snapshot* candidate_snapshot) const;
 
+  // Returns the canonical form of path, which must be below root, or an
+  // empty path on failure. The scanner does not follow symlinks to
+  // directories, so only the root can contain symlinks; its canonical form
+  // is resolved once and cached, rather than resolving every component of
+  // every path.
+  filesystem::path GetCanonicalPath(
+      const string& root,
+      const filesystem::path& path) const;
+
   // If path_str starts with root, returns path_str with the root prefix
   // removed. Otherwise return path_str as-is.
   string RemoveRootFromPath(
       const string& root,
       const string& path_str) const;
 
-  string GetUserNameFromUid(int uid) const;
-
-  string GetGroupNameFromGid(int gid) const;
+  // Look names up through NSS, without caching.
+  static string LookUpUserName(uint32_t uid);
+  static string LookUpGroupName(uint32_t gid);
 
   DISALLOW_COPY_AND_ASSIGN(CandidateSnapshotGeneratorImpl);
 };
@@ -3,6 +3,7 @@
 #include <boost/bind.hpp>
 
 #include "base/asio-dispatcher.h"
+#include "proto/file.pb.h"
 #include "services/candidate-snapshot-generator-impl.h"
 
 namespace polar_express {
@@ -21,11 +22,19 @@ CandidateSnapshotGenerator::~CandidateSnapshotGenerator() {
 void CandidateSnapshotGenerator::GenerateCandidateSnapshot(
     const string& root,
     const filesystem::path& path,
+    const FileStat& file_stat,
     boost::shared_ptr<Snapshot>* snapshot_ptr,
     Callback callback) const {
   AsioDispatcher::GetInstance()->PostDiskBound(
       bind(&CandidateSnapshotGenerator::GenerateCandidateSnapshot,
-           impl_.get(), root, path, snapshot_ptr, callback));
+           impl_.get(), root, path, file_stat, snapshot_ptr, callback));
+}
+
+bool CandidateSnapshotGenerator::GetFilePath(
+    const string& root,
+    const filesystem::path& path,
+    string* file_path) const {
+  return impl_->GetFilePath(root, path, file_path);
 }
 
 }  // namespace polar_express
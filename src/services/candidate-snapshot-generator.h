@@ -13,6 +13,7 @@
 namespace polar_express {
 
 class CandidateSnapshotGeneratorImpl;
+class FileStat;
 class Snapshot;
 
 // A class that asynchronously reads filesystem metadata and generates candidate
@@ -27,13 +28,27 @@ class CandidateSnapshotGenerator {
   virtual ~CandidateSnapshotGenerator();
 
   // Asynchronously generates the candidate snapshot for the given root and
-  // path, and invokes the given callback when done.
+  // path, and invokes the given callback when done. The path must be below
+  // the root, as found by the filesystem scanner.
+  //
+  // The snapshot is generated from file_stat, the results of stat'ing the
+  // file during the scan, if it is not empty. Otherwise the file is stat'ed
+  // once when the snapshot is generated.
   virtual void GenerateCandidateSnapshot(
       const string& root,
       const filesystem::path& path,
+      const FileStat& file_stat,
       boost::shared_ptr<Snapshot>* snapshot_ptr,
       Callback callback) const;
 
+  // Sets file_path to the path that the file of the candidate snapshot for
+  // the given root and path would have, without stat'ing the file. Returns
+  // false if the path has no canonical form.
+  virtual bool GetFilePath(
+      const string& root,
+      const filesystem::path& path,
+      string* file_path) const;
+
  protected:
   explicit CandidateSnapshotGenerator(bool create_impl);
 
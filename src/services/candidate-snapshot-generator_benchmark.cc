@@ -0,0 +1,311 @@
+// Measures the time and the number of syscalls that generating a candidate
+// snapshot takes per file, for the generator given the stat results from
+// the filesystem scanner, for the generator stat'ing each file itself, and
+// for the original generator, which resolved every component of the path
+// and stat'ed the file several times over (reproduced here as "legacy").
+//
+// Syscalls are counted by running the generator over a sample of the files
+// in a child process traced with ptrace, so the counts include those made
+// by libc (e.g. for looking up user and group names) as well as those made
+// directly. The legacy generator looks up user and group names for every
+// file, as the original did; the others use the shared name caches, whose
+// hits and misses (counted in this process only) are reported at the end.
+//
+// By default a synthetic tree is created and removed afterwards. To
+// measure a real tree, pass --benchmark_scan_root.
+//
+// Usage: candidate-snapshot-generator_benchmark [--benchmark_scan_root=PATH]
+//            [--benchmark_tree_path=PATH] [--benchmark_tree_num_files=N]
+//            [--benchmark_syscall_sample_size=N]
+
+#include <grp.h>
+#include <pwd.h>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "base/macros.h"
+#include "base/options.h"
+#include "proto/file.pb.h"
+#include "proto/snapshot.pb.h"
+#include "services/candidate-snapshot-generator-impl.h"
+#include "services/parallel-filesystem-scanner-impl.h"
+#include "util/id-name-cache.h"
+
+DEFINE_OPTION(benchmark_scan_root, string, "",
+              "Existing tree to measure. If empty, a synthetic tree is "
+              "created.");
+DEFINE_OPTION(benchmark_tree_path, string,
+              "candidate-snapshot-generator_benchmark.tree",
+              "Where to create the synthetic tree. Removed when the benchmark "
+              "exits.");
+DEFINE_OPTION(benchmark_tree_num_files, int, 1000000,
+              "Number of files in the synthetic tree.");
+DEFINE_OPTION(benchmark_syscall_sample_size, int, 10000,
+              "Number of files over which syscalls are counted.");
+
+using polar_express::CandidateSnapshotGeneratorImpl;
+using polar_express::FileStat;
+using polar_express::ParallelFilesystemScannerImpl;
+using polar_express::Snapshot;
+
+namespace {
+
+const int kFilesPerDirectory = 100;
+const int kSubdirectoriesPerDirectory = 10;
+const int kScannerThreads = 4;
+
+typedef vector<pair<boost::filesystem::path, FileStat> > PathsWithFileStat;
+
+enum class Mode {
+  kLegacy,
+  kWithoutFileStat,
+  kWithFileStat,
+};
+
+// Creates num_files files of a few bytes each, kFilesPerDirectory to a
+// directory, in a tree with kSubdirectoriesPerDirectory subdirectories per
+// directory.
+bool CreateTree(const boost::filesystem::path& root, int num_files) {
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(root, ec);
+  for (int i = 0; i < num_files; i += kFilesPerDirectory) {
+    boost::filesystem::path directory = root;
+    for (int d = i / kFilesPerDirectory; d > 0;
+         d /= kSubdirectoriesPerDirectory) {
+      directory /= std::to_string(d % kSubdirectoriesPerDirectory);
+    }
+    directory /= "files";
+    boost::filesystem::create_directories(directory, ec);
+    for (int j = 0; j < kFilesPerDirectory && i + j < num_files; ++j) {
+      FILE* file = fopen(
+          (directory / std::to_string(j)).string().c_str(), "w");
+      if (file == nullptr) {
+        return false;
+      }
+      fputs("data", file);
+      fclose(file);
+    }
+  }
+  return true;
+}
+
+void NoOp() {
+}
+
+PathsWithFileStat Scan(const string& root) {
+  PathsWithFileStat paths_with_stat;
+  ParallelFilesystemScannerImpl filesystem_scanner(kScannerThreads);
+  filesystem_scanner.StartScan(root, std::numeric_limits<int>::max(), &NoOp);
+  filesystem_scanner.GetPathsWithFileStat(&paths_with_stat);
+  return paths_with_stat;
+}
+
+// The original implementation of
+// CandidateSnapshotGeneratorImpl::GenerateCandidateSnapshot.
+bool LegacyGenerateCandidateSnapshot(
+    const string& root, const boost::filesystem::path& path,
+    Snapshot* candidate_snapshot) {
+  boost::system::error_code ec;
+  boost::filesystem::path canonical_path = canonical(path, root, ec);
+  if (ec) {
+    return false;
+  }
+
+  string canonical_path_str = canonical_path.string();
+  if (canonical_path_str.empty()) {
+    return false;
+  }
+
+  boost::filesystem::file_status file_stat = status(path);
+
+  struct stat unix_stat;
+  stat(canonical_path_str.c_str(), &unix_stat);
+
+  passwd pwd;
+  passwd* tmp_pwdptr;
+  char pwdbuf[256];
+  group grp;
+  group* tmp_grpptr;
+  char grpbuf[256];
+
+  candidate_snapshot->mutable_file()->set_path(canonical_path_str);
+  if (getpwuid_r(unix_stat.st_uid, &pwd, pwdbuf, sizeof(pwdbuf),
+                 &tmp_pwdptr) == 0 && tmp_pwdptr != nullptr) {
+    candidate_snapshot->mutable_attributes()->set_owner_user(pwd.pw_name);
+  }
+  if (getgrgid_r(unix_stat.st_gid, &grp, grpbuf, sizeof(grpbuf),
+                 &tmp_grpptr) == 0 && tmp_grpptr != nullptr) {
+    candidate_snapshot->mutable_attributes()->set_owner_group(grp.gr_name);
+  }
+  candidate_snapshot->mutable_attributes()->set_uid(unix_stat.st_uid);
+  candidate_snapshot->mutable_attributes()->set_gid(unix_stat.st_gid);
+  candidate_snapshot->mutable_attributes()->set_mode(file_stat.permissions());
+
+  candidate_snapshot->set_modification_time(last_write_time(canonical_path));
+  candidate_snapshot->set_is_regular(is_regular_file(canonical_path));
+  candidate_snapshot->set_is_deleted(!exists(canonical_path));
+  if (is_regular_file(canonical_path)) {
+    candidate_snapshot->set_length(file_size(canonical_path));
+  }
+  candidate_snapshot->set_observation_time(time(NULL));
+  return true;
+}
+
+void Generate(Mode mode, const string& root,
+              const PathsWithFileStat& paths_with_stat, size_t num_paths) {
+  CandidateSnapshotGeneratorImpl candidate_snapshot_generator;
+  const FileStat empty_file_stat;
+  boost::shared_ptr<Snapshot> snapshot;
+  for (size_t i = 0; i < num_paths; ++i) {
+    const auto& path_with_stat = paths_with_stat[i];
+    switch (mode) {
+      case Mode::kLegacy:
+        snapshot.reset(new Snapshot);
+        LegacyGenerateCandidateSnapshot(
+            root, path_with_stat.first, snapshot.get());
+        break;
+      case Mode::kWithoutFileStat:
+        candidate_snapshot_generator.GenerateCandidateSnapshot(
+            root, path_with_stat.first, empty_file_stat, &snapshot, &NoOp);
+        break;
+      case Mode::kWithFileStat:
+        candidate_snapshot_generator.GenerateCandidateSnapshot(
+            root, path_with_stat.first, path_with_stat.second, &snapshot,
+            &NoOp);
+        break;
+    }
+  }
+}
+
+// Returns the number of syscalls made generating snapshots for the first
+// num_paths paths, or -1 if they could not be counted.
+long CountSyscalls(Mode mode, const string& root,
+                   const PathsWithFileStat& paths_with_stat,
+                   size_t num_paths) {
+  const pid_t pid = fork();
+  if (pid < 0) {
+    return -1;
+  }
+  if (pid == 0) {
+    if (ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) != 0) {
+      _exit(1);
+    }
+    raise(SIGSTOP);
+    Generate(mode, root, paths_with_stat, num_paths);
+    _exit(0);
+  }
+
+  int status;
+  if (waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status) ||
+      ptrace(PTRACE_SETOPTIONS, pid, nullptr,
+             PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL) != 0) {
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, 0);
+    return -1;
+  }
+
+  // Each syscall stops the child twice, on entry and on exit, except for
+  // the final exit, which the child never returns from.
+  long num_syscall_stops = 0;
+  for (;;) {
+    if (ptrace(PTRACE_SYSCALL, pid, nullptr, nullptr) != 0 ||
+        waitpid(pid, &status, 0) != pid) {
+      return -1;
+    }
+    if (WIFEXITED(status)) {
+      return (WEXITSTATUS(status) == 0) ? (num_syscall_stops + 1) / 2 : -1;
+    }
+    if (WIFSTOPPED(status) && WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+      ++num_syscall_stops;
+    }
+  }
+}
+
+void Measure(const char* name, Mode mode, const string& root,
+             const PathsWithFileStat& paths_with_stat) {
+  auto start = std::chrono::steady_clock::now();
+  Generate(mode, root, paths_with_stat, paths_with_stat.size());
+  double seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+
+  const size_t sample_size = std::min<size_t>(
+      std::max(polar_express::options::benchmark_syscall_sample_size, 1),
+      paths_with_stat.size());
+  const long num_syscalls =
+      CountSyscalls(mode, root, paths_with_stat, sample_size);
+
+  printf("%-16s %10zu %12.0f %10.2f ", name, paths_with_stat.size(),
+         paths_with_stat.size() / seconds,
+         seconds * 1e6 / paths_with_stat.size());
+  if (num_syscalls >= 0) {
+    printf("%14.2f\n", static_cast<double>(num_syscalls) / sample_size);
+  } else {
+    printf("%14s\n", "n/a");
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (!polar_express::options::Init(argc, argv)) {
+    return 1;
+  }
+
+  string root = polar_express::options::benchmark_scan_root;
+  const bool create_tree = root.empty();
+  if (create_tree) {
+    root = polar_express::options::benchmark_tree_path;
+    if (!CreateTree(root, polar_express::options::benchmark_tree_num_files)) {
+      fprintf(stderr, "Could not create %s\n", root.c_str());
+      return 1;
+    }
+  }
+
+  // The backup root is always absolute, as it is compared with the paths
+  // found by the scanner.
+  root = boost::filesystem::absolute(root).string();
+  const PathsWithFileStat paths_with_stat = Scan(root);
+  if (paths_with_stat.empty()) {
+    fprintf(stderr, "No files found in %s\n", root.c_str());
+    return 1;
+  }
+
+  // Warm the caches.
+  Generate(Mode::kWithoutFileStat, root, paths_with_stat,
+           paths_with_stat.size());
+
+  printf("%-16s %10s %12s %10s %14s\n", "generator", "files", "files/s",
+         "us/file", "syscalls/file");
+  Measure("legacy", Mode::kLegacy, root, paths_with_stat);
+  Measure("without stat", Mode::kWithoutFileStat, root, paths_with_stat);
+  Measure("with stat", Mode::kWithFileStat, root, paths_with_stat);
+
+  printf("\n%-16s %14s %14s\n", "name cache", "hits", "misses");
+  printf("%-16s %14" PRIu64 " %14" PRIu64 "\n", "user",
+         CandidateSnapshotGeneratorImpl::GetUserNameCache()->num_hits(),
+         CandidateSnapshotGeneratorImpl::GetUserNameCache()->num_misses());
+  printf("%-16s %14" PRIu64 " %14" PRIu64 "\n", "group",
+         CandidateSnapshotGeneratorImpl::GetGroupNameCache()->num_hits(),
+         CandidateSnapshotGeneratorImpl::GetGroupNameCache()->num_misses());
+
+  if (create_tree) {
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(root, ec);
+  }
+  return 0;
+}
@@ -0,0 +1,251 @@
+#include "services/change-journal-watcher.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "base/options.h"
+#include "proto/file.pb.h"
+#include "services/change-journal.h"
+#include "util/file-stat-util.h"
+
+DEFINE_OPTION(change_journal_flush_interval_ms, int, 1000,
+              "How often the change journal watcher appends the changes it "
+              "has seen to the journal, in milliseconds.");
+
+namespace polar_express {
+namespace {
+
+const uint32_t kWatchMask =
+    IN_ATTRIB | IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_DELETE |
+    IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF |
+    IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+string JoinRelativePath(const string& directory, const char* name) {
+  return directory.empty() ? string(name) : directory + "/" + name;
+}
+
+}  // namespace
+
+ChangeJournalWatcher::ChangeJournalWatcher(
+    const boost::filesystem::path& root, ChangeJournal* change_journal)
+    : root_(root),
+      change_journal_(CHECK_NOTNULL(change_journal)),
+      inotify_fd_(-1),
+      missed_changes_(false) {
+  stop_pipe_fds_[0] = stop_pipe_fds_[1] = -1;
+}
+
+ChangeJournalWatcher::~ChangeJournalWatcher() {
+  for (int fd : { inotify_fd_, stop_pipe_fds_[0], stop_pipe_fds_[1] }) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+}
+
+bool ChangeJournalWatcher::Start() {
+  if (!change_journal_->StartWatching(root_)) {
+    return false;
+  }
+  inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd_ < 0 ||
+      pipe2(stop_pipe_fds_, O_NONBLOCK | O_CLOEXEC) != 0) {
+    return false;
+  }
+
+  AddWatchesRecursively("");
+  if (watch_descriptors_.count("") == 0) {
+    return false;
+  }
+
+  // A backup could have taken changes while the tree was only partly
+  // watched.
+  last_flush_time_ = std::chrono::steady_clock::now();
+  return change_journal_->MarkIncomplete();
+}
+
+bool ChangeJournalWatcher::Run() {
+  const std::chrono::milliseconds flush_interval(
+      std::max(options::change_journal_flush_interval_ms, 0));
+  // Large enough for many events, and aligned for struct inotify_event.
+  alignas(struct inotify_event) char events[64 * 1024];
+
+  for (;;) {
+    int timeout_ms = -1;
+    if (!changed_paths_.empty() || !changed_directories_.empty() ||
+        missed_changes_) {
+      const auto time_until_flush =
+          last_flush_time_ + flush_interval - std::chrono::steady_clock::now();
+      timeout_ms = std::max<int>(
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+              time_until_flush).count(), 0);
+    }
+
+    struct pollfd poll_fds[2] = {
+      { inotify_fd_, POLLIN, 0 },
+      { stop_pipe_fds_[0], POLLIN, 0 },
+    };
+    if (poll(poll_fds, 2, timeout_ms) < 0 && errno != EINTR) {
+      return false;
+    }
+
+    if (poll_fds[0].revents & POLLIN) {
+      ssize_t length;
+      while ((length = read(inotify_fd_, events, sizeof(events))) > 0) {
+        HandleEvents(events, length);
+      }
+    }
+
+    const bool stop_requested = (poll_fds[1].revents & POLLIN);
+    if (stop_requested || std::chrono::steady_clock::now() >=
+        last_flush_time_ + flush_interval) {
+      if (!FlushChanges()) {
+        return false;
+      }
+    }
+    if (stop_requested) {
+      return true;
+    }
+  }
+}
+
+void ChangeJournalWatcher::Stop() {
+  const char stop = 0;
+  if (write(stop_pipe_fds_[1], &stop, 1) < 0) {
+    // Nothing to be done; the pipe is only full if a stop is pending.
+  }
+}
+
+void ChangeJournalWatcher::AddWatchesRecursively(const string& directory) {
+  vector<string> pending_directories = { directory };
+  vector<pair<boost::filesystem::path, FileStat> > entries;
+  vector<boost::filesystem::path> subdirectories;
+
+  while (!pending_directories.empty()) {
+    const string relative_directory = pending_directories.back();
+    pending_directories.pop_back();
+
+    const boost::filesystem::path path = root_ / relative_directory;
+    const int watch_descriptor =
+        inotify_add_watch(inotify_fd_, path.c_str(), kWatchMask);
+    if (watch_descriptor < 0) {
+      // A directory which has already been removed again has nothing left
+      // to watch. Otherwise (e.g. if there are no more watches to be had)
+      // changes below it will be missed.
+      if (errno != ENOENT && errno != ENOTDIR) {
+        missed_changes_ = true;
+      }
+      continue;
+    }
+
+    // The directory may already be watched under another name, if it was
+    // moved before the move was seen.
+    auto it = watched_directories_.find(watch_descriptor);
+    if (it != watched_directories_.end()) {
+      watch_descriptors_.erase(it->second);
+    }
+    watched_directories_[watch_descriptor] = relative_directory;
+    watch_descriptors_[relative_directory] = watch_descriptor;
+
+    entries.clear();
+    subdirectories.clear();
+    file_stat_util::ReadDirectory(path, &entries, &subdirectories);
+    for (const auto& subdirectory : subdirectories) {
+      pending_directories.push_back(JoinRelativePath(
+          relative_directory, subdirectory.filename().c_str()));
+    }
+  }
+}
+
+void ChangeJournalWatcher::RemoveWatchesRecursively(const string& directory) {
+  const string prefix = directory + "/";
+  vector<int> removed_watch_descriptors;
+  for (const auto& watch_descriptor : watch_descriptors_) {
+    if (watch_descriptor.first == directory ||
+        watch_descriptor.first.compare(0, prefix.size(), prefix) == 0) {
+      removed_watch_descriptors.push_back(watch_descriptor.second);
+    }
+  }
+  for (int watch_descriptor : removed_watch_descriptors) {
+    inotify_rm_watch(inotify_fd_, watch_descriptor);
+    RemoveWatch(watch_descriptor);
+  }
+}
+
+void ChangeJournalWatcher::RemoveWatch(int watch_descriptor) {
+  auto it = watched_directories_.find(watch_descriptor);
+  if (it != watched_directories_.end()) {
+    watch_descriptors_.erase(it->second);
+    watched_directories_.erase(it);
+  }
+}
+
+void ChangeJournalWatcher::HandleEvents(const char* events, size_t length) {
+  for (size_t offset = 0; offset < length;) {
+    const struct inotify_event* event =
+        reinterpret_cast<const struct inotify_event*>(events + offset);
+    offset += sizeof(struct inotify_event) + event->len;
+
+    if (event->mask & IN_Q_OVERFLOW) {
+      missed_changes_ = true;
+      continue;
+    }
+    auto it = watched_directories_.find(event->wd);
+    if (it == watched_directories_.end()) {
+      continue;
+    }
+    const string directory = it->second;
+
+    if (event->mask & IN_IGNORED) {
+      RemoveWatch(event->wd);
+      continue;
+    }
+    if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+      // Changes to a watched directory are reported by its parent, except
+      // for the root, which has no watched parent.
+      missed_changes_ |= directory.empty();
+      continue;
+    }
+    if (event->len == 0) {
+      if (!directory.empty()) {
+        changed_paths_.insert(directory);
+      }
+      continue;
+    }
+
+    const string path = JoinRelativePath(directory, event->name);
+    if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+      AddWatchesRecursively(path);
+      changed_directories_.insert(path);
+    } else {
+      if ((event->mask & IN_ISDIR) && (event->mask & IN_MOVED_FROM)) {
+        RemoveWatchesRecursively(path);
+      }
+      changed_paths_.insert(path);
+    }
+  }
+}
+
+bool ChangeJournalWatcher::FlushChanges() {
+  last_flush_time_ = std::chrono::steady_clock::now();
+  bool success = true;
+  if (missed_changes_) {
+    success = change_journal_->MarkIncomplete();
+  } else if (!changed_paths_.empty() || !changed_directories_.empty()) {
+    success = change_journal_->AppendChanges(
+        vector<string>(changed_paths_.begin(), changed_paths_.end()),
+        vector<string>(changed_directories_.begin(),
+                       changed_directories_.end()));
+  }
+  changed_paths_.clear();
+  changed_directories_.clear();
+  missed_changes_ = false;
+  return success;
+}
+
+}  // namespace polar_express
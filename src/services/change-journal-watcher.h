@@ -0,0 +1,89 @@
+#ifndef CHANGE_JOURNAL_WATCHER_H
+#define CHANGE_JOURNAL_WATCHER_H
+
+#include <chrono>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+#include <boost/filesystem.hpp>
+
+#include "base/macros.h"
+
+namespace polar_express {
+
+class ChangeJournal;
+
+// Watches the tree below a backup root with inotify, and records the paths
+// that change in a ChangeJournal, so that the next backup need not scan the
+// whole tree. Meant to run continuously between backups, in a process of
+// its own (see polar-express-watcher).
+//
+// Every directory in the tree is watched, and directories created or moved
+// into the tree are watched as they appear. Since entries may be added to
+// such a directory before it is watched, its whole tree is recorded to be
+// scanned. Changes are collected in memory and appended to the journal
+// every change_journal_flush_interval_ms. If any change may have been
+// missed (because the kernel's event queue overflowed, or a directory could
+// not be watched, e.g. for lack of inotify watches) the journal is marked
+// incomplete instead.
+//
+// fanotify could watch a whole file system without a watch per directory,
+// but needs CAP_SYS_ADMIN, which a backup tool should not require.
+class ChangeJournalWatcher {
+ public:
+  ChangeJournalWatcher(const boost::filesystem::path& root,
+                       ChangeJournal* change_journal);
+  ~ChangeJournalWatcher();
+
+  // Registers as the journal's watcher and watches every directory below
+  // the root. Returns false if another watcher is running, or inotify is
+  // unavailable.
+  bool Start();
+
+  // Records changes until Stop is called. Returns false if the journal
+  // could not be written.
+  bool Run();
+
+  // Makes Run return once it has recorded the changes seen so far. Safe to
+  // call from a signal handler.
+  void Stop();
+
+ private:
+  // Watches directory (relative to the root) and all directories below it.
+  void AddWatchesRecursively(const string& directory);
+
+  // Stops watching directory (relative to the root) and all directories
+  // below it.
+  void RemoveWatchesRecursively(const string& directory);
+
+  void RemoveWatch(int watch_descriptor);
+
+  void HandleEvents(const char* events, size_t length);
+
+  // Appends the changes collected since the last flush to the journal.
+  bool FlushChanges();
+
+  const boost::filesystem::path root_;
+  ChangeJournal* change_journal_;
+
+  int inotify_fd_;
+  int stop_pipe_fds_[2];
+
+  // Watched directories, relative to the root, by watch descriptor, and
+  // vice versa.
+  std::unordered_map<int, string> watched_directories_;
+  std::unordered_map<string, int> watch_descriptors_;
+
+  // Changes collected since the last flush.
+  std::set<string> changed_paths_;
+  std::set<string> changed_directories_;
+  bool missed_changes_;
+  std::chrono::steady_clock::time_point last_flush_time_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChangeJournalWatcher);
+};
+
+}  // namespace polar_express
+
+#endif  // CHANGE_JOURNAL_WATCHER_H
@@ -0,0 +1,342 @@
+#include "services/change-journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <set>
+
+#include "base/options.h"
+
+DEFINE_OPTION(change_journal_max_bytes, size_t, 64 * (1 << 20) /* 64 MiB */,
+              "Maximum size of the change journal. If more changes than fit "
+              "are made between backups, the next backup scans the whole "
+              "tree.");
+
+namespace polar_express {
+namespace {
+
+// The journal is a sequence of records, each a type character followed by
+// a path (or nothing) and a NUL, since paths may contain any other
+// character.
+const char kResetRecord = 'R';       // The canonical root, recorded first.
+const char kPathRecord = 'P';        // A changed path.
+const char kDirectoryRecord = 'D';   // A directory to scan recursively.
+const char kIncompleteRecord = 'I';  // Some changes were not recorded.
+
+struct JournalContents {
+  JournalContents() : incomplete(false) {}
+
+  string root;
+  bool incomplete;
+  std::set<string> changed_paths;
+  std::set<string> changed_directories;
+};
+
+void AppendRecord(char type, const string& path, string* records) {
+  records->push_back(type);
+  records->append(path);
+  records->push_back('\0');
+}
+
+void ParseRecords(const string& records, JournalContents* contents) {
+  size_t record_start = 0;
+  for (;;) {
+    const size_t record_end = records.find('\0', record_start);
+    if (record_end == string::npos || record_end == record_start) {
+      // A truncated record can only be left by a watcher which died while
+      // appending it, so it may have missed changes.
+      contents->incomplete |= (record_start != records.size());
+      return;
+    }
+    const string path = records.substr(
+        record_start + 1, record_end - record_start - 1);
+    switch (records[record_start]) {
+      case kResetRecord:
+        contents->root = path;
+        break;
+      case kPathRecord:
+        contents->changed_paths.insert(path);
+        break;
+      case kDirectoryRecord:
+        contents->changed_directories.insert(path);
+        break;
+      default:
+        contents->incomplete = true;
+        break;
+    }
+    record_start = record_end + 1;
+  }
+}
+
+bool ReadFile(int fd, string* data) {
+  char buffer[64 * 1024];
+  off_t offset = 0;
+  for (;;) {
+    const ssize_t bytes_read = pread(fd, buffer, sizeof(buffer), offset);
+    if (bytes_read < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    if (bytes_read == 0) {
+      return true;
+    }
+    data->append(buffer, bytes_read);
+    offset += bytes_read;
+  }
+}
+
+bool WriteFile(int fd, const string& data) {
+  for (size_t offset = 0; offset < data.size();) {
+    const ssize_t bytes_written =
+        write(fd, data.data() + offset, data.size() - offset);
+    if (bytes_written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    offset += bytes_written;
+  }
+  return true;
+}
+
+// Replaces the file at path with data, such that after a crash the file
+// has either its old contents or data.
+bool WriteFileAtomically(const boost::filesystem::path& path,
+                         const string& data) {
+  const boost::filesystem::path tmp_path = path.string() + ".tmp";
+  const int fd =
+      open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return false;
+  }
+  const bool written = WriteFile(fd, data) && fsync(fd) == 0;
+  close(fd);
+  if (!written || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    return false;
+  }
+
+  const int directory_fd =
+      open(path.parent_path().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (directory_fd >= 0) {
+    fsync(directory_fd);
+    close(directory_fd);
+  }
+  return true;
+}
+
+string GetCanonicalRoot(const boost::filesystem::path& root) {
+  boost::system::error_code ec;
+  const boost::filesystem::path canonical_root =
+      boost::filesystem::canonical(root, ec);
+  return ec ? "" : canonical_root.string();
+}
+
+}  // namespace
+
+ChangeJournal::ChangeJournal(
+    const boost::filesystem::path& journal_directory)
+    : journal_directory_(journal_directory),
+      journal_path_(journal_directory / "journal"),
+      pending_path_(journal_directory / "pending"),
+      watcher_lock_path_(journal_directory / "watcher.lock"),
+      watcher_lock_fd_(-1) {
+}
+
+ChangeJournal::~ChangeJournal() {
+  if (watcher_lock_fd_ >= 0) {
+    close(watcher_lock_fd_);
+  }
+}
+
+bool ChangeJournal::StartWatching(const boost::filesystem::path& root) {
+  assert(watcher_lock_fd_ < 0);
+  const string canonical_root = GetCanonicalRoot(root);
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(journal_directory_, ec);
+  if (canonical_root.empty() || ec) {
+    return false;
+  }
+
+  const int fd =
+      open(watcher_lock_path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return false;
+  }
+  if (flock(fd, LOCK_EX | LOCK_NB) != 0 || ftruncate(fd, 0) != 0 ||
+      !WriteFile(fd, canonical_root)) {
+    close(fd);
+    return false;
+  }
+  watcher_lock_fd_ = fd;
+
+  // Anything could have changed while no watcher was running.
+  return MarkIncomplete();
+}
+
+bool ChangeJournal::AppendChanges(
+    const vector<string>& changed_paths,
+    const vector<string>& changed_directories) {
+  string records;
+  for (const string& changed_path : changed_paths) {
+    AppendRecord(kPathRecord, changed_path, &records);
+  }
+  for (const string& changed_directory : changed_directories) {
+    AppendRecord(kDirectoryRecord, changed_directory, &records);
+  }
+
+  const int fd = OpenAndLockJournal();
+  if (fd < 0) {
+    return false;
+  }
+  struct stat journal_stat;
+  bool success = (fstat(fd, &journal_stat) == 0);
+  if (success) {
+    const size_t journal_size = journal_stat.st_size;
+    if (journal_size + records.size() > options::change_journal_max_bytes) {
+      // Once the journal is full it is marked incomplete, and nothing more
+      // is appended until a backup resets it.
+      records.clear();
+      if (journal_size <= options::change_journal_max_bytes) {
+        AppendRecord(kIncompleteRecord, "", &records);
+      }
+    }
+    success = records.empty() || AppendRecords(fd, records);
+  }
+  close(fd);
+  return success;
+}
+
+bool ChangeJournal::MarkIncomplete() {
+  const int fd = OpenAndLockJournal();
+  if (fd < 0) {
+    return false;
+  }
+  string records;
+  AppendRecord(kIncompleteRecord, "", &records);
+  const bool success = AppendRecords(fd, records);
+  close(fd);
+  return success;
+}
+
+bool ChangeJournal::TakeChanges(
+    const boost::filesystem::path& root,
+    vector<boost::filesystem::path>* changed_paths,
+    vector<boost::filesystem::path>* changed_directories) {
+  CHECK_NOTNULL(changed_paths);
+  CHECK_NOTNULL(changed_directories);
+
+  const string canonical_root = GetCanonicalRoot(root);
+  if (canonical_root.empty() ||
+      !boost::filesystem::is_directory(journal_directory_)) {
+    return false;
+  }
+
+  const int fd = OpenAndLockJournal();
+  if (fd < 0) {
+    return false;
+  }
+
+  string journal_records;
+  JournalContents contents;
+  bool success = ReadFile(fd, &journal_records);
+  ParseRecords(journal_records, &contents);
+  const bool watcher_running = IsWatcherRunning(canonical_root);
+  bool complete = success && watcher_running &&
+      contents.root == canonical_root && !contents.incomplete;
+
+  // Changes taken by an earlier backup which did not complete must be
+  // taken again. If that backup was to scan the whole tree, so must this
+  // one.
+  const int pending_fd = open(pending_path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (pending_fd >= 0) {
+    string pending_records;
+    success &= ReadFile(pending_fd, &pending_records);
+    close(pending_fd);
+    ParseRecords(pending_records, &contents);
+    complete &= !contents.incomplete;
+  }
+
+  string pending_records;
+  if (complete) {
+    for (const string& changed_path : contents.changed_paths) {
+      AppendRecord(kPathRecord, changed_path, &pending_records);
+    }
+    for (const string& changed_directory : contents.changed_directories) {
+      AppendRecord(kDirectoryRecord, changed_directory, &pending_records);
+    }
+  } else {
+    AppendRecord(kIncompleteRecord, "", &pending_records);
+  }
+
+  // Reset the journal to record changes from now on, which can only be
+  // trusted if the watcher is running.
+  string reset_records;
+  if (watcher_running) {
+    AppendRecord(kResetRecord, canonical_root, &reset_records);
+  } else {
+    AppendRecord(kIncompleteRecord, "", &reset_records);
+  }
+  success = success && WriteFileAtomically(pending_path_, pending_records) &&
+      ftruncate(fd, 0) == 0 && AppendRecords(fd, reset_records);
+  close(fd);
+
+  if (!success || !complete) {
+    return false;
+  }
+  for (const string& changed_path : contents.changed_paths) {
+    changed_paths->push_back(changed_path);
+  }
+  for (const string& changed_directory : contents.changed_directories) {
+    changed_directories->push_back(changed_directory);
+  }
+  return true;
+}
+
+void ChangeJournal::CommitChanges() {
+  unlink(pending_path_.c_str());
+}
+
+int ChangeJournal::OpenAndLockJournal() const {
+  const int fd = open(journal_path_.c_str(),
+                      O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return -1;
+  }
+  // The lock is released when the file is closed.
+  while (flock(fd, LOCK_EX) != 0) {
+    if (errno != EINTR) {
+      close(fd);
+      return -1;
+    }
+  }
+  return fd;
+}
+
+bool ChangeJournal::IsWatcherRunning(const string& canonical_root) const {
+  const int fd = open(watcher_lock_path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  // The watcher holds an exclusive lock for as long as it runs.
+  bool watcher_running = false;
+  if (flock(fd, LOCK_SH | LOCK_NB) != 0 && errno == EWOULDBLOCK) {
+    string watcher_root;
+    watcher_running =
+        ReadFile(fd, &watcher_root) && watcher_root == canonical_root;
+  }
+  close(fd);
+  return watcher_running;
+}
+
+bool ChangeJournal::AppendRecords(
+    int journal_fd, const string& records) const {
+  return WriteFile(journal_fd, records) && fdatasync(journal_fd) == 0;
+}
+
+}  // namespace polar_express
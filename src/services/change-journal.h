@@ -0,0 +1,105 @@
+#ifndef CHANGE_JOURNAL_H
+#define CHANGE_JOURNAL_H
+
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "base/macros.h"
+
+namespace polar_express {
+
+// A durable journal of the paths below a backup root that have changed
+// since the last backup, recorded by a ChangeJournalWatcher running between
+// backups, so that a backup can snapshot only those paths instead of
+// scanning the whole tree.
+//
+// The journal lives in a directory of its own, and is shared between the
+// watcher, which appends changes to it, and the backup, which takes them.
+// Paths are recorded relative to the root, and are of two kinds: paths
+// which have changed themselves, and directories whose whole tree must be
+// scanned (e.g. because they were created or moved in, and may have
+// gained entries before they could be watched).
+//
+// The journal can only be trusted if a watcher has been watching the root
+// continuously since the last backup took changes from it. So it is marked
+// incomplete whenever a watcher starts, and whenever the watcher misses
+// changes (e.g. because the kernel's event queue overflowed, or the journal
+// grew too large). A backup that finds it incomplete, or finds no watcher
+// running, must scan the whole tree.
+//
+// Changes taken by a backup are kept in a pending file until the backup
+// calls CommitChanges, so that if it does not complete, the next backup
+// takes them again.
+//
+// Processes coordinate with advisory file locks: the watcher holds a lock
+// for as long as it runs, and the journal is locked while it is appended
+// to or taken from. This class is not internally synchronized.
+class ChangeJournal {
+ public:
+  explicit ChangeJournal(const boost::filesystem::path& journal_directory);
+  virtual ~ChangeJournal();
+
+  // Watcher methods:
+
+  // Registers this process as the watcher of root, creating the journal
+  // directory if necessary, and marks the journal incomplete. Returns false
+  // if another watcher is running, or the journal cannot be written. The
+  // registration lasts until this object is destroyed.
+  virtual bool StartWatching(const boost::filesystem::path& root);
+
+  // Appends changed paths and directories, relative to the root. If the
+  // journal would grow beyond the change_journal_max_bytes option, it is
+  // marked incomplete instead. Returns false if the journal cannot be
+  // written, in which case the watcher should stop.
+  virtual bool AppendChanges(
+      const vector<string>& changed_paths,
+      const vector<string>& changed_directories);
+
+  // Marks the journal incomplete, so that the next backup scans the whole
+  // tree.
+  virtual bool MarkIncomplete();
+
+  // Backup methods:
+
+  // Takes all changes recorded for root since the last backup, appending
+  // the paths (relative to the root) to changed_paths and
+  // changed_directories, and resets the journal to record changes from now
+  // on. Returns false if the changes are incomplete (or there is no journal
+  // or watcher for root), in which case the whole tree must be scanned.
+  virtual bool TakeChanges(
+      const boost::filesystem::path& root,
+      vector<boost::filesystem::path>* changed_paths,
+      vector<boost::filesystem::path>* changed_directories);
+
+  // Discards the changes taken by TakeChanges, once they have been backed
+  // up.
+  virtual void CommitChanges();
+
+ private:
+  // Opens (creating if necessary) and locks the journal file. Returns the
+  // file descriptor, or -1 on failure.
+  int OpenAndLockJournal() const;
+
+  // Returns true if a watcher is running for root.
+  bool IsWatcherRunning(const string& canonical_root) const;
+
+  // Appends the given records to the journal, which must be locked, and
+  // syncs them.
+  bool AppendRecords(int journal_fd, const string& records) const;
+
+  const boost::filesystem::path journal_directory_;
+  const boost::filesystem::path journal_path_;
+  const boost::filesystem::path pending_path_;
+  const boost::filesystem::path watcher_lock_path_;
+
+  // Held by the watcher for as long as it runs. -1 otherwise.
+  int watcher_lock_fd_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChangeJournal);
+};
+
+}  // namespace polar_express
+
+#endif  // CHANGE_JOURNAL_H
@@ -0,0 +1,137 @@
+#include "services/change-journal.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#include "base/options.h"
+
+DECLARE_OPTION(change_journal_max_bytes, size_t);
+
+namespace polar_express {
+namespace {
+
+class ChangeJournalTest : public testing::Test {
+ protected:
+  ChangeJournalTest()
+      : test_directory_(boost::filesystem::temp_directory_path() /
+                        boost::filesystem::unique_path()),
+        root_(test_directory_ / "root"),
+        journal_directory_(test_directory_ / "journal"),
+        watcher_journal_(journal_directory_),
+        backup_journal_(journal_directory_) {
+    boost::filesystem::create_directories(root_);
+  }
+
+  virtual ~ChangeJournalTest() {
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(test_directory_, ec);
+  }
+
+  bool TakeChanges() {
+    changed_paths_.clear();
+    changed_directories_.clear();
+    if (!backup_journal_.TakeChanges(
+            root_, &changed_paths_, &changed_directories_)) {
+      return false;
+    }
+    std::sort(changed_paths_.begin(), changed_paths_.end());
+    std::sort(changed_directories_.begin(), changed_directories_.end());
+    return true;
+  }
+
+  const boost::filesystem::path test_directory_;
+  const boost::filesystem::path root_;
+  const boost::filesystem::path journal_directory_;
+  ChangeJournal watcher_journal_;
+  ChangeJournal backup_journal_;
+  vector<boost::filesystem::path> changed_paths_;
+  vector<boost::filesystem::path> changed_directories_;
+};
+
+TEST_F(ChangeJournalTest, IncompleteWithoutWatcher) {
+  EXPECT_FALSE(TakeChanges());
+  EXPECT_FALSE(TakeChanges());
+}
+
+TEST_F(ChangeJournalTest, IncompleteUntilFirstBackupSinceWatcherStarted) {
+  ASSERT_TRUE(watcher_journal_.StartWatching(root_));
+  ASSERT_TRUE(watcher_journal_.AppendChanges({ "a" }, {}));
+  EXPECT_FALSE(TakeChanges());
+  backup_journal_.CommitChanges();
+
+  ASSERT_TRUE(watcher_journal_.AppendChanges({ "b", "c/d" }, { "e" }));
+  ASSERT_TRUE(watcher_journal_.AppendChanges({ "b" }, {}));
+  ASSERT_TRUE(TakeChanges());
+  EXPECT_EQ(vector<boost::filesystem::path>({ "b", "c/d" }), changed_paths_);
+  EXPECT_EQ(vector<boost::filesystem::path>({ "e" }), changed_directories_);
+  backup_journal_.CommitChanges();
+
+  ASSERT_TRUE(TakeChanges());
+  EXPECT_TRUE(changed_paths_.empty());
+  EXPECT_TRUE(changed_directories_.empty());
+}
+
+TEST_F(ChangeJournalTest, UncommittedChangesAreTakenAgain) {
+  ASSERT_TRUE(watcher_journal_.StartWatching(root_));
+  EXPECT_FALSE(TakeChanges());
+
+  // The full scan did not complete, so the next backup must scan again.
+  ASSERT_TRUE(watcher_journal_.AppendChanges({ "a" }, {}));
+  EXPECT_FALSE(TakeChanges());
+  backup_journal_.CommitChanges();
+
+  ASSERT_TRUE(watcher_journal_.AppendChanges({ "b" }, {}));
+  ASSERT_TRUE(TakeChanges());
+  ASSERT_TRUE(watcher_journal_.AppendChanges({ "c" }, {}));
+  ASSERT_TRUE(TakeChanges());
+  EXPECT_EQ(vector<boost::filesystem::path>({ "b", "c" }), changed_paths_);
+}
+
+TEST_F(ChangeJournalTest, MarkIncomplete) {
+  ASSERT_TRUE(watcher_journal_.StartWatching(root_));
+  EXPECT_FALSE(TakeChanges());
+  backup_journal_.CommitChanges();
+
+  ASSERT_TRUE(watcher_journal_.AppendChanges({ "a" }, {}));
+  ASSERT_TRUE(watcher_journal_.MarkIncomplete());
+  EXPECT_FALSE(TakeChanges());
+  backup_journal_.CommitChanges();
+  EXPECT_TRUE(TakeChanges());
+}
+
+TEST_F(ChangeJournalTest, IncompleteWhenFull) {
+  ASSERT_TRUE(watcher_journal_.StartWatching(root_));
+  EXPECT_FALSE(TakeChanges());
+  backup_journal_.CommitChanges();
+
+  const size_t max_bytes = *options::internal::opt_change_journal_max_bytes;
+  *options::internal::opt_change_journal_max_bytes = 1024;
+  ASSERT_TRUE(watcher_journal_.AppendChanges({ string(2000, 'a') }, {}));
+  ASSERT_TRUE(watcher_journal_.AppendChanges({ "b" }, {}));
+  *options::internal::opt_change_journal_max_bytes = max_bytes;
+  EXPECT_FALSE(TakeChanges());
+}
+
+TEST_F(ChangeJournalTest, OneWatcherAtATime) {
+  ASSERT_TRUE(watcher_journal_.StartWatching(root_));
+  ChangeJournal other_watcher_journal(journal_directory_);
+  EXPECT_FALSE(other_watcher_journal.StartWatching(root_));
+}
+
+TEST_F(ChangeJournalTest, IncompleteForOtherRoot) {
+  ASSERT_TRUE(watcher_journal_.StartWatching(root_));
+  EXPECT_FALSE(TakeChanges());
+  backup_journal_.CommitChanges();
+
+  vector<boost::filesystem::path> changed_paths;
+  vector<boost::filesystem::path> changed_directories;
+  EXPECT_FALSE(backup_journal_.TakeChanges(
+      test_directory_, &changed_paths, &changed_directories));
+}
+
+}  // namespace
+}  // namespace polar_express
@@ -0,0 +1,195 @@
+#include "services/changed-paths-filesystem-scanner-impl.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "services/path-filter.h"
+#include "util/file-stat-util.h"
+
+namespace polar_express {
+
+ChangedPathsFilesystemScannerImpl::ChangedPathsFilesystemScannerImpl(
+    const vector<boost::filesystem::path>& changed_paths,
+    const vector<boost::filesystem::path>& changed_directories)
+    : FilesystemScanner(false),
+      changed_paths_(changed_paths),
+      changed_directories_(changed_directories),
+      path_filter_(nullptr),
+      next_changed_path_index_(0),
+      next_changed_directory_index_(0) {
+}
+
+ChangedPathsFilesystemScannerImpl::~ChangedPathsFilesystemScannerImpl() {
+}
+
+void ChangedPathsFilesystemScannerImpl::SetDirectoryFingerprints(
+    DirectoryFingerprints* /* directory_fingerprints */) {
+  // Only the trees of directories recorded as changed are read, and all of
+  // them must be.
+}
+
+void ChangedPathsFilesystemScannerImpl::SetPathFilter(
+    const PathFilter* path_filter) {
+  path_filter_ = path_filter;
+}
+
+void ChangedPathsFilesystemScannerImpl::StartScan(
+    const string& root, int max_paths, Callback callback) {
+  ClearPaths();
+  root_ = root;
+  next_changed_path_index_ = 0;
+  next_changed_directory_index_ = 0;
+  pending_directories_.clear();
+  found_paths_.clear();
+  found_path_strs_.clear();
+  ContinueScan(max_paths, callback);
+}
+
+void ChangedPathsFilesystemScannerImpl::ContinueScan(
+    int max_paths, Callback callback) {
+  const size_t num_paths = std::max(max_paths, 0);
+  while (found_paths_.size() < num_paths) {
+    if (next_changed_path_index_ < changed_paths_.size()) {
+      const boost::filesystem::path path =
+          root_ / changed_paths_[next_changed_path_index_++];
+      FileStat file_stat;
+      file_stat_util::GetFileStat(path, &file_stat);
+      if (!IsExcluded(path, file_stat, true)) {
+        AddPath(path, file_stat);
+      }
+    } else if (!pending_directories_.empty()) {
+      const boost::filesystem::path directory = pending_directories_.back();
+      pending_directories_.pop_back();
+      vector<pair<boost::filesystem::path, FileStat> > entries;
+      vector<boost::filesystem::path> subdirectories;
+      file_stat_util::ReadDirectory(directory, &entries, &subdirectories);
+      size_t subdirectory_index = 0;
+      for (const auto& entry : entries) {
+        const bool is_subdirectory =
+            subdirectory_index < subdirectories.size() &&
+            entry.first.native() ==
+                subdirectories[subdirectory_index].native();
+        if (is_subdirectory) {
+          ++subdirectory_index;
+        }
+        if (IsExcluded(entry.first, entry.second, false)) {
+          continue;
+        }
+        if (is_subdirectory) {
+          pending_directories_.push_back(entry.first);
+        }
+        AddPath(entry.first, entry.second);
+      }
+    } else if (next_changed_directory_index_ < changed_directories_.size()) {
+      const boost::filesystem::path& relative_directory =
+          changed_directories_[next_changed_directory_index_++];
+      const boost::filesystem::path directory = root_ / relative_directory;
+      // The root itself is never returned by a scan, but is recorded when
+      // everything below it must be scanned.
+      if (!relative_directory.empty()) {
+        FileStat file_stat;
+        file_stat_util::GetFileStat(directory, &file_stat);
+        if (IsExcluded(directory, file_stat, true)) {
+          continue;
+        }
+        AddPath(directory, file_stat);
+      }
+      boost::system::error_code ec;
+      if (boost::filesystem::is_directory(
+              boost::filesystem::symlink_status(directory, ec))) {
+        pending_directories_.push_back(directory);
+      }
+    } else {
+      break;
+    }
+  }
+
+  const size_t num_collected = std::min(found_paths_.size(), num_paths);
+  for (size_t i = 0; i < num_collected; ++i) {
+    handles_with_stat_.push_back(make_pair(
+        path_arena_.Add(found_paths_[i].first),
+        std::move(found_paths_[i].second)));
+  }
+  found_paths_.erase(found_paths_.begin(),
+                     found_paths_.begin() + num_collected);
+  callback();
+}
+
+bool ChangedPathsFilesystemScannerImpl::GetPaths(
+    vector<boost::filesystem::path>* paths) const {
+  CHECK_NOTNULL(paths)->reserve(handles_with_stat_.size());
+  for (const auto& handle_with_stat : handles_with_stat_) {
+    paths->push_back(path_arena_.GetPath(handle_with_stat.first));
+  }
+  return !handles_with_stat_.empty();
+}
+
+bool ChangedPathsFilesystemScannerImpl::GetPathsWithFilesize(
+    vector<pair<boost::filesystem::path, size_t> >* paths_with_size) const {
+  CHECK_NOTNULL(paths_with_size)->reserve(handles_with_stat_.size());
+  for (const auto& handle_with_stat : handles_with_stat_) {
+    paths_with_size->push_back(make_pair(
+        path_arena_.GetPath(handle_with_stat.first),
+        file_stat_util::IsRegularFile(handle_with_stat.second)
+            ? handle_with_stat.second.length() : 0));
+  }
+  return !handles_with_stat_.empty();
+}
+
+bool ChangedPathsFilesystemScannerImpl::GetPathsWithFileStat(
+    vector<pair<boost::filesystem::path, FileStat> >* paths_with_stat) const {
+  CHECK_NOTNULL(paths_with_stat)->reserve(
+      paths_with_stat->size() + handles_with_stat_.size());
+  for (const auto& handle_with_stat : handles_with_stat_) {
+    paths_with_stat->push_back(make_pair(
+        path_arena_.GetPath(handle_with_stat.first), handle_with_stat.second));
+  }
+  return !handles_with_stat_.empty();
+}
+
+bool ChangedPathsFilesystemScannerImpl::GetPathHandlesWithFileStat(
+    PathArena* path_arena,
+    vector<pair<PathArena::Handle, FileStat> >* handles_with_stat) const {
+  CHECK_NOTNULL(path_arena);
+  CHECK_NOTNULL(handles_with_stat)->reserve(
+      handles_with_stat->size() + handles_with_stat_.size());
+  for (const auto& handle_with_stat : handles_with_stat_) {
+    handles_with_stat->push_back(make_pair(
+        path_arena->Add(path_arena_, handle_with_stat.first),
+        handle_with_stat.second));
+  }
+  return !handles_with_stat_.empty();
+}
+
+void ChangedPathsFilesystemScannerImpl::ClearPaths() {
+  path_arena_.Clear();
+  handles_with_stat_.clear();
+}
+
+void ChangedPathsFilesystemScannerImpl::AddPath(
+    const boost::filesystem::path& path, const FileStat& file_stat) {
+  if (!file_stat.has_mode()) {
+    // Dangling symlinks cannot be stat'ed, but are found by a full scan.
+    boost::system::error_code ec;
+    if (!boost::filesystem::exists(
+            boost::filesystem::symlink_status(path, ec))) {
+      return;
+    }
+  }
+  if (found_path_strs_.insert(path.string()).second) {
+    found_paths_.push_back(make_pair(path, file_stat));
+  }
+}
+
+bool ChangedPathsFilesystemScannerImpl::IsExcluded(
+    const boost::filesystem::path& path, const FileStat& file_stat,
+    bool check_ancestors) const {
+  if (path_filter_ == nullptr) {
+    return false;
+  }
+  return check_ancestors
+      ? path_filter_->IsExcludedOrBelowExcluded(path, file_stat)
+      : path_filter_->IsExcluded(path, file_stat);
+}
+
+}  // namespace polar_express
@@ -0,0 +1,94 @@
+#ifndef CHANGED_PATHS_FILESYSTEM_SCANNER_IMPL_H
+#define CHANGED_PATHS_FILESYSTEM_SCANNER_IMPL_H
+
+#include <deque>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "base/callback.h"
+#include "base/macros.h"
+#include "proto/file.pb.h"
+#include "services/filesystem-scanner.h"
+#include "util/path-arena.h"
+
+namespace polar_express {
+
+// A synchronous implementation of FilesystemScanner which, rather than
+// scanning the whole tree, returns only the paths that a ChangeJournal
+// recorded as changed since the last backup, and the entries of the trees
+// of directories that it recorded as needing to be scanned. Paths are
+// given relative to the root, and are returned below the root passed to
+// StartScan. Changed paths that no longer exist are skipped, as they would
+// not be found by a full scan either.
+class ChangedPathsFilesystemScannerImpl : public FilesystemScanner {
+ public:
+  ChangedPathsFilesystemScannerImpl(
+      const vector<boost::filesystem::path>& changed_paths,
+      const vector<boost::filesystem::path>& changed_directories);
+  virtual ~ChangedPathsFilesystemScannerImpl();
+
+  virtual void SetDirectoryFingerprints(
+      DirectoryFingerprints* directory_fingerprints);
+
+  virtual void SetPathFilter(const PathFilter* path_filter);
+
+  virtual void StartScan(
+      const string& root, int max_paths, Callback callback);
+
+  virtual void ContinueScan(int max_paths, Callback callback);
+
+  virtual bool GetPaths(vector<boost::filesystem::path>* paths) const;
+
+  virtual bool GetPathsWithFilesize(
+      vector<pair<boost::filesystem::path, size_t> >* paths_with_size) const;
+
+  virtual bool GetPathsWithFileStat(
+      vector<pair<boost::filesystem::path, FileStat> >* paths_with_stat) const;
+
+  virtual bool GetPathHandlesWithFileStat(
+      PathArena* path_arena,
+      vector<pair<PathArena::Handle, FileStat> >* handles_with_stat) const;
+
+  virtual void ClearPaths();
+
+ private:
+  // Adds path to found_paths_ unless it has already been found or no
+  // longer exists.
+  void AddPath(const boost::filesystem::path& path,
+               const FileStat& file_stat);
+
+  // Returns true if path_filter_ excludes path. If check_ancestors, also
+  // returns true if a directory above path is excluded.
+  bool IsExcluded(const boost::filesystem::path& path,
+                  const FileStat& file_stat, bool check_ancestors) const;
+
+  const vector<boost::filesystem::path> changed_paths_;
+  const vector<boost::filesystem::path> changed_directories_;
+  const PathFilter* path_filter_;
+
+  boost::filesystem::path root_;
+  size_t next_changed_path_index_;
+  size_t next_changed_directory_index_;
+
+  // Directories below changed directories still to be read.
+  vector<boost::filesystem::path> pending_directories_;
+
+  // Paths found but not yet returned by ContinueScan.
+  std::deque<pair<boost::filesystem::path, FileStat> > found_paths_;
+
+  // Every path found so far, so that paths recorded more than once (e.g.
+  // both as changed and below a changed directory) are returned once.
+  std::unordered_set<string> found_path_strs_;
+
+  PathArena path_arena_;
+  vector<pair<PathArena::Handle, FileStat> > handles_with_stat_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChangedPathsFilesystemScannerImpl);
+};
+
+}  // namespace polar_express
+
+#endif  // CHANGED_PATHS_FILESYSTEM_SCANNER_IMPL_H
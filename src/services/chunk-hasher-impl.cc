@@ -1,35 +1,120 @@
 #include "services/chunk-hasher-impl.h"
 
+#include <algorithm>
 #include <ctime>
 #include <cstdlib>
+#include <limits>
 
-#include <crypto++/hex.h>
-#include <crypto++/sha.h>
-
+#include "base/asio-dispatcher.h"
 #include "base/options.h"
 #include "proto/snapshot.pb.h"
 #include "services/chunk-reader.h"
+#include "util/content-defined-chunker.h"
+#include "util/file-identity-util.h"
 
 DEFINE_OPTION(
     max_block_size_bytes, size_t, 1024 * 1024 /* 1 MB */,
     "Maximum size of blocks that files will be split into during backup.");
 
+DEFINE_OPTION(
+    use_content_defined_chunking, bool, false,
+    "When true, files are split into blocks at boundaries determined by "
+    "their contents (FastCDC) rather than at fixed offsets. This allows "
+    "unchanged regions of a file to be deduplicated even when data has been "
+    "inserted or removed before them. Changing this setting causes all "
+    "files to be re-chunked on the next backup.");
+
+DEFINE_OPTION(
+    min_block_size_bytes, size_t, 64 * 1024 /* 64 KiB */,
+    "Minimum size of blocks when using content-defined chunking (except for "
+    "the last block of a file).");
+
+DEFINE_OPTION(
+    average_block_size_bytes, size_t, 256 * 1024 /* 256 KiB */,
+    "Target average size of blocks when using content-defined chunking. "
+    "Rounded down to a power of two.");
+
+DEFINE_OPTION(
+    parallel_hashing_min_file_size_bytes, size_t,
+    4UL * 1024 * 1024 * 1024 /* 4 GiB */,
+    "Files at least this large are divided into ranges which are chunked "
+    "and hashed in parallel. Zero disables parallel hashing.");
+
+DEFINE_OPTION(
+    parallel_hashing_range_size_bytes, size_t, 256 * 1024 * 1024 /* 256 MiB */,
+    "Size of the ranges that large files are divided into for parallel "
+    "hashing. Rounded up to a multiple of max_block_size_bytes.");
+
+DEFINE_OPTION(
+    parallel_hashing_max_workers, int, 4,
+    "Maximum number of ranges of a single large file that are hashed at "
+    "the same time.");
+
+DEFINE_OPTION(
+    min_hole_size_bytes, size_t, 64 * 1024 /* 64 KiB */,
+    "Runs of sparse files at least this long that are not stored on disk "
+    "are recorded as holes, which are never read, hashed or uploaded. Zero "
+    "disables hole detection.");
+
+DEFINE_OPTION(
+    num_reused_chunks_to_verify, int, 1,
+    "When a file that was renamed or hard-linked since it was last backed "
+    "up reuses its previous chunks rather than being hashed again, this "
+    "many of them (spread evenly across the file) are read back and "
+    "hashed to check that they still match. Zero disables the check.");
+
 namespace polar_express {
 namespace {
 
-template <int N>
-void WriteHashToString(unsigned char (&raw_digest)[N], string* str) {
-  CryptoPP::HexEncoder encoder;
-  encoder.Attach(new CryptoPP::StringSink(*str));
-  encoder.Put(raw_digest, N);
-  encoder.MessageEnd();
+FileIdentity InitialFileIdentity(const boost::filesystem::path& path) {
+  FileIdentity file_identity;
+  FileIdentityUtil::GetFileIdentity(path, &file_identity);
+  return file_identity;
+}
+
+// Returns the first hole that ends after offset, or null if there is none.
+const ChunkReader::Hole* FindHoleAtOrAfter(
+    const vector<ChunkReader::Hole>& holes, int64_t offset) {
+  auto hole_itr = std::upper_bound(
+      holes.begin(), holes.end(), offset,
+      [](int64_t offset, const ChunkReader::Hole& hole) {
+        return offset < hole.offset + hole.length;
+      });
+  return (hole_itr == holes.end()) ? nullptr : &*hole_itr;
+}
+
+// Returns the data chunks (not holes) of snapshot that should be read back
+// when reusing its chunks: the middle chunk of each of
+// num_reused_chunks_to_verify equal runs of them, in order of offset.
+vector<const Chunk*> ChunksToVerify(const Snapshot& snapshot) {
+  vector<const Chunk*> data_chunks;
+  for (const Chunk& chunk : snapshot.chunks()) {
+    if (!chunk.block().is_hole()) {
+      data_chunks.push_back(&chunk);
+    }
+  }
+
+  const size_t num_chunks_to_verify = std::min<size_t>(
+      std::max(options::num_reused_chunks_to_verify, 0), data_chunks.size());
+  vector<const Chunk*> chunks_to_verify;
+  for (size_t i = 0; i < num_chunks_to_verify; ++i) {
+    chunks_to_verify.push_back(
+        data_chunks[(2 * i + 1) * data_chunks.size() /
+                    (2 * num_chunks_to_verify)]);
+  }
+  return chunks_to_verify;
 }
 
 }  // namespace
 
 ChunkHasherImpl::ChunkHasherImpl()
   : ChunkHasher(false),
-    whole_file_sha1_engine_(new CryptoPP::SHA1) {
+    content_defined_chunker_(
+        options::use_content_defined_chunking
+            ? new ContentDefinedChunker(options::min_block_size_bytes,
+                                        options::average_block_size_bytes,
+                                        options::max_block_size_bytes)
+            : nullptr) {
 }
 
 ChunkHasherImpl::~ChunkHasherImpl() {
@@ -40,91 +125,540 @@ void ChunkHasherImpl::GenerateAndHashChunks(
     boost::shared_ptr<Snapshot> snapshot, Callback callback) {
   if (!snapshot->is_regular() || snapshot->length() <= 0) {
     callback();
+  } else if (ParallelHashingRangeSizeForLength(snapshot->length()) > 0) {
+    StartGeneratingAndHashingLargeFileChunks(path, snapshot, callback);
   } else {
-    ContinueGeneratingAndHashingChunks(
-        boost::shared_ptr<Context>(new Context(path, snapshot, callback)));
+    boost::shared_ptr<Context> context(new Context(path, snapshot, callback));
+    if (options::min_hole_size_bytes > 0) {
+      context->chunk_reader_->FindHoles(
+          options::min_hole_size_bytes, &context->holes_,
+          bind(&ChunkHasherImpl::ContinueGeneratingAndHashingChunks,
+               this, context));
+    } else {
+      ContinueGeneratingAndHashingChunks(context);
+    }
   }
 }
 
-void ChunkHasherImpl::ValidateHash(
-    const Chunk& chunk, const vector<byte>& block_data_for_chunk,
-    bool* is_valid, Callback callback) {
-  string block_data_sha1_digest;
-  HashData(block_data_for_chunk, &block_data_sha1_digest);
-  *CHECK_NOTNULL(is_valid) =
-      (block_data_sha1_digest == chunk.block().sha1_digest());
-  callback();
+void ChunkHasherImpl::ReuseChunks(
+    const boost::filesystem::path& path,
+    boost::shared_ptr<const Snapshot> source_snapshot,
+    boost::shared_ptr<Snapshot> snapshot, bool* reused, Callback callback) {
+  *CHECK_NOTNULL(reused) = false;
+  const FileIdentity file_identity = InitialFileIdentity(path);
+  if (!CanReuseChunks(*source_snapshot, *snapshot, file_identity)) {
+    callback();
+    return;
+  }
+
+  boost::shared_ptr<ReuseContext> reuse_context(
+      new ReuseContext(path, source_snapshot, snapshot, file_identity,
+                       reused, callback));
+  reuse_context->chunks_to_verify_ = ChunksToVerify(*source_snapshot);
+  if (!reuse_context->chunks_to_verify_.empty()) {
+    reuse_context->chunk_reader_.reset(
+        ChunkReader::CreateChunkReaderForPath(path).release());
+  }
+  ContinueVerifyingReusedChunks(reuse_context);
 }
 
 void ChunkHasherImpl::ContinueGeneratingAndHashingChunks(
     boost::shared_ptr<Context> context) {
-  int64_t offset = 0;
-  if (context->current_chunk_ != nullptr) {
-    offset = context->current_chunk_->offset() +
-        context->current_chunk_->block().length();
-  }
+  const int64_t offset =
+      context->offset_ + context->pending_data_.size();
 
-  context->current_chunk_ = context->snapshot_->add_chunks();
-  context->current_chunk_->set_offset(offset);
+  // Reads stop short of holes and always end a chunk there, so no data is
+  // pending when a hole is reached.
+  const ChunkReader::Hole* hole = FindHoleAtOrAfter(context->holes_, offset);
+  if (hole != nullptr && hole->offset <= offset) {
+    const int64_t hole_end_offset = hole->offset + hole->length;
+    Chunk* hole_chunk = context->snapshot_->add_chunks();
+    hole_chunk->set_offset(offset);
+    SetHoleChunk(hole_end_offset - offset, hole_chunk);
+    UpdateHashForHole(*hole_chunk, &whole_file_sha1_hasher_);
+    context->offset_ = hole_end_offset;
+    if (hole_end_offset >= context->snapshot_->length()) {
+      FinishGeneratingAndHashingChunks(context);
+    } else {
+      ContinueGeneratingAndHashingChunks(context);
+    }
+    return;
+  }
 
-  // Ask for a block of the default size. If EOF is reached, then the
-  // reader will return less than this many bytes.
-  context->current_chunk_->mutable_block()
-      ->set_length(options::max_block_size_bytes);
+  // Ask for a block of the default size, stopping short of the next hole.
+  // If EOF is reached, then the reader will return less than this many
+  // bytes.
+  SetChunkForRead(context->holes_, offset,
+                  std::numeric_limits<int64_t>::max(),
+                  &context->read_chunk_);
 
-  context->block_data_buffer_.clear();
-  context->chunk_reader_->ReadBlockDataForChunk(
-      *context->current_chunk_, &context->block_data_buffer_,
+  context->block_data_span_ = ByteSpan();
+  context->chunk_reader_->ReadBlockDataSpanForChunk(
+      context->read_chunk_, &context->block_data_span_,
       bind(&ChunkHasherImpl::UpdateHashesFromBlockData, this, context));
 }
 
 void ChunkHasherImpl::UpdateHashesFromBlockData(
     boost::shared_ptr<Context> context) {
-  // If the chunk reader returned less data than we requested, this
-  // means that it hit EOF.
-  size_t expected_data_length = context->current_chunk_->block().length();
+  const Chunk& read_chunk = context->read_chunk_;
+
+  // Read ahead while this data is hashed.
+  PrefetchChunksAfter(
+      context->holes_, read_chunk.offset() + read_chunk.block().length(),
+      context->snapshot_->length(), std::numeric_limits<int64_t>::max(),
+      context->chunk_reader_.get());
+
+  context->offset_ += AddChunksForRead(
+      context->holes_, read_chunk, context->block_data_span_,
+      context->snapshot_->length(), &context->pending_data_,
+      context->snapshot_->mutable_chunks(), &whole_file_sha1_hasher_);
+
+  // If the chunk reader returned less data than we requested, this means
+  // that it hit EOF, and all of the data read has been chunked.
+  if (context->block_data_span_.size() <
+      static_cast<size_t>(read_chunk.block().length())) {
+    FinishGeneratingAndHashingChunks(context);
+  } else {
+    ContinueGeneratingAndHashingChunks(context);
+  }
+}
+
+void ChunkHasherImpl::FinishGeneratingAndHashingChunks(
+    boost::shared_ptr<Context> context) {
+  Sha1Digest whole_file_sha1_digest;
+  WriteWholeFileHash(&whole_file_sha1_digest);
+  context->snapshot_->set_sha1_digest(whole_file_sha1_digest.ToBytes());
+  SetHashedFileIdentity(context->path_, context->initial_file_identity_,
+                        context->snapshot_.get());
+  context->callback_();
+}
 
-  if (context->block_data_buffer_.empty()) {
-    // Do not generate chunks for empty blocks.
-    context->snapshot_->mutable_chunks()->RemoveLast();
+void ChunkHasherImpl::StartGeneratingAndHashingLargeFileChunks(
+    const boost::filesystem::path& path,
+    boost::shared_ptr<Snapshot> snapshot, Callback callback) {
+  boost::shared_ptr<LargeFileContext> large_file_context(
+      new LargeFileContext(
+          path, snapshot,
+          ParallelHashingRangeSizeForLength(snapshot->length()), callback));
+
+  if (options::min_hole_size_bytes > 0) {
+    large_file_context->chunk_reader_->FindHoles(
+        options::min_hole_size_bytes, &large_file_context->holes_,
+        bind(&ChunkHasherImpl::StartRanges, this, large_file_context));
   } else {
-    context->current_chunk_->set_observation_time(time(nullptr));
+    StartRanges(large_file_context);
+  }
+}
 
-    Block* current_block = context->current_chunk_->mutable_block();
-    current_block->set_length(context->block_data_buffer_.size());
+void ChunkHasherImpl::StartRanges(
+    boost::shared_ptr<LargeFileContext> large_file_context) {
+  const size_t num_workers = std::min<size_t>(
+      std::max(options::parallel_hashing_max_workers, 1),
+      large_file_context->num_ranges_);
+  for (size_t i = 0; i < num_workers; ++i) {
+    StartNextRange(large_file_context);
+  }
+}
 
-    HashData(context->block_data_buffer_, current_block->mutable_sha1_digest());
-    UpdateWholeFileHash(context->block_data_buffer_);
+void ChunkHasherImpl::StartNextRange(
+    boost::shared_ptr<LargeFileContext> large_file_context) {
+  size_t range_index;
+  {
+    boost::mutex::scoped_lock lock(large_file_context->mu_);
+    if (large_file_context->next_range_index_ >=
+        large_file_context->num_ranges_) {
+      return;
+    }
+    range_index = large_file_context->next_range_index_++;
   }
 
-  if (context->block_data_buffer_.size() < expected_data_length) {
-    WriteWholeFileHash(context->snapshot_->mutable_sha1_digest());
-    context->callback_();
+  ContinueGeneratingAndHashingRangeChunks(
+      boost::shared_ptr<RangeContext>(
+          new RangeContext(large_file_context, range_index)));
+}
+
+void ChunkHasherImpl::ContinueGeneratingAndHashingRangeChunks(
+    boost::shared_ptr<RangeContext> range_context) {
+  const int64_t offset =
+      range_context->offset_ + range_context->pending_data_.size();
+
+  // Holes are split at range boundaries like any other chunk.
+  const ChunkReader::Hole* hole = FindHoleAtOrAfter(
+      range_context->large_file_context_->holes_, offset);
+  if (hole != nullptr && hole->offset <= offset) {
+    const int64_t hole_end_offset = std::min(
+        hole->offset + hole->length, range_context->end_offset_);
+    Chunk* hole_chunk = range_context->chunks_.Add();
+    hole_chunk->set_offset(offset);
+    SetHoleChunk(hole_end_offset - offset, hole_chunk);
+    UpdateHashForHole(*hole_chunk, &range_context->range_sha1_hasher_);
+    range_context->offset_ = hole_end_offset;
+    if (range_context->offset_ >= range_context->end_offset_) {
+      FinishRange(range_context);
+    } else {
+      ContinueGeneratingAndHashingRangeChunks(range_context);
+    }
+    return;
+  }
+
+  SetChunkForRead(range_context->large_file_context_->holes_,
+                  offset, range_context->end_offset_,
+                  &range_context->read_chunk_);
+
+  range_context->block_data_span_ = ByteSpan();
+  range_context->chunk_reader_->ReadBlockDataSpanForChunk(
+      range_context->read_chunk_, &range_context->block_data_span_,
+      bind(&ChunkHasherImpl::PostUpdateRangeHashesFromBlockData,
+           this, range_context));
+}
+
+void ChunkHasherImpl::PostUpdateRangeHashesFromBlockData(
+    boost::shared_ptr<RangeContext> range_context) {
+  // The chunk reader invokes its callback on a disk-bound thread; move
+  // back to a CPU-bound one so that ranges are hashed in parallel.
+  AsioDispatcher::GetInstance()->PostCpuBound(
+      bind(&ChunkHasherImpl::UpdateRangeHashesFromBlockData,
+           this, range_context));
+}
+
+void ChunkHasherImpl::UpdateRangeHashesFromBlockData(
+    boost::shared_ptr<RangeContext> range_context) {
+  const Chunk& read_chunk = range_context->read_chunk_;
+
+  // Read ahead while this data is hashed.
+  PrefetchChunksAfter(
+      range_context->large_file_context_->holes_,
+      read_chunk.offset() + read_chunk.block().length(),
+      range_context->end_offset_, range_context->end_offset_,
+      range_context->chunk_reader_.get());
+
+  // Reads never extend past the end of the range, so a range boundary is
+  // always a chunk boundary. When chunking by content, this means the last
+  // chunk of a range may be shorter than the minimum.
+  range_context->offset_ += AddChunksForRead(
+      range_context->large_file_context_->holes_, read_chunk,
+      range_context->block_data_span_, range_context->end_offset_,
+      &range_context->pending_data_, &range_context->chunks_,
+      &range_context->range_sha1_hasher_);
+
+  // If the chunk reader returned less data than we requested, this means
+  // that it hit EOF (i.e. the file was truncated).
+  if (range_context->offset_ >= range_context->end_offset_ ||
+      range_context->block_data_span_.size() <
+          static_cast<size_t>(read_chunk.block().length())) {
+    FinishRange(range_context);
   } else {
-    ContinueGeneratingAndHashingChunks(context);
+    ContinueGeneratingAndHashingRangeChunks(range_context);
   }
 }
 
-void ChunkHasherImpl::HashData(
-    const vector<byte>& data, string* sha1_digest) const {
-  CryptoPP::SHA1 sha1_engine;
-  unsigned char raw_digest[CryptoPP::SHA1::DIGESTSIZE];
-  sha1_engine.CalculateDigest(
-      raw_digest,
-      reinterpret_cast<const unsigned char*>(data.data()),
-      data.size());
-  WriteHashToString(raw_digest, sha1_digest);
+void ChunkHasherImpl::FinishRange(
+    boost::shared_ptr<RangeContext> range_context) {
+  boost::shared_ptr<LargeFileContext> large_file_context =
+      range_context->large_file_context_;
+  const size_t range_index = range_context->range_index_;
+
+  bool all_ranges_completed;
+  {
+    boost::mutex::scoped_lock lock(large_file_context->mu_);
+    range_context->range_sha1_hasher_.Final(
+        &large_file_context->range_sha1_digests_[range_index]);
+    large_file_context->range_chunks_[range_index].Swap(
+        &range_context->chunks_);
+    all_ranges_completed = (++large_file_context->num_completed_ranges_ ==
+                            large_file_context->num_ranges_);
+  }
+
+  if (all_ranges_completed) {
+    FinishLargeFile(large_file_context);
+  } else {
+    StartNextRange(large_file_context);
+  }
 }
 
-void ChunkHasherImpl::UpdateWholeFileHash(const vector<byte>& data) {
-  whole_file_sha1_engine_->Update(
-      reinterpret_cast<const unsigned char*>(data.data()), data.size());
+void ChunkHasherImpl::FinishLargeFile(
+    boost::shared_ptr<LargeFileContext> large_file_context) {
+  Snapshot* snapshot = large_file_context->snapshot_.get();
+  Sha1Hasher whole_file_sha1_hasher;
+  for (size_t i = 0; i < large_file_context->num_ranges_; ++i) {
+    snapshot->mutable_chunks()->MergeFrom(
+        large_file_context->range_chunks_[i]);
+    whole_file_sha1_hasher.Update(
+        large_file_context->range_sha1_digests_[i].data(),
+        large_file_context->range_sha1_digests_[i].size());
+  }
+
+  Sha1Digest whole_file_sha1_digest;
+  whole_file_sha1_hasher.Final(&whole_file_sha1_digest);
+  snapshot->set_sha1_digest(whole_file_sha1_digest.ToBytes());
+  snapshot->set_sha1_digest_range_size(large_file_context->range_size_);
+  SetHashedFileIdentity(large_file_context->path_,
+                        large_file_context->initial_file_identity_, snapshot);
+  large_file_context->callback_();
 }
 
-void ChunkHasherImpl::WriteWholeFileHash(string* sha1_digest) const {
-  unsigned char raw_digest[CryptoPP::SHA1::DIGESTSIZE];
-  whole_file_sha1_engine_->Final(raw_digest);
-  WriteHashToString(raw_digest, sha1_digest);
+void ChunkHasherImpl::ContinueVerifyingReusedChunks(
+    boost::shared_ptr<ReuseContext> reuse_context) {
+  const vector<const Chunk*>& chunks_to_verify =
+      reuse_context->chunks_to_verify_;
+  const size_t chunk_index = reuse_context->num_verified_chunks_;
+  if (chunk_index == chunks_to_verify.size()) {
+    FinishReusingChunks(reuse_context);
+    return;
+  }
+
+  if (chunk_index + 1 < chunks_to_verify.size()) {
+    reuse_context->chunk_reader_->PrefetchChunk(
+        *chunks_to_verify[chunk_index + 1]);
+  }
+  reuse_context->block_data_span_ = ByteSpan();
+  reuse_context->chunk_reader_->ReadBlockDataSpanForChunk(
+      *chunks_to_verify[chunk_index], &reuse_context->block_data_span_,
+      bind(&ChunkHasherImpl::VerifyReusedChunk, this, reuse_context));
+}
+
+void ChunkHasherImpl::VerifyReusedChunk(
+    boost::shared_ptr<ReuseContext> reuse_context) {
+  const Chunk& chunk =
+      *reuse_context->chunks_to_verify_[reuse_context->num_verified_chunks_];
+  const ByteSpan block_data_span = reuse_context->block_data_span_;
+
+  Sha1Digest block_sha1_digest;
+  HashData(block_data_span.data(), block_data_span.size(),
+           &block_sha1_digest);
+  if (block_data_span.size() != static_cast<size_t>(chunk.block().length()) ||
+      !block_sha1_digest.EqualsBytes(chunk.block().sha1_digest())) {
+    reuse_context->callback_();
+    return;
+  }
+
+  ++reuse_context->num_verified_chunks_;
+  ContinueVerifyingReusedChunks(reuse_context);
+}
+
+void ChunkHasherImpl::FinishReusingChunks(
+    boost::shared_ptr<ReuseContext> reuse_context) {
+  // The file must not have changed while its chunks were being checked.
+  FileIdentity final_file_identity;
+  FileIdentityUtil::GetFileIdentity(
+      reuse_context->path_, &final_file_identity);
+  if (!FileIdentityUtil::FileIdentitiesEqual(
+          reuse_context->initial_file_identity_, final_file_identity)) {
+    reuse_context->callback_();
+    return;
+  }
+
+  const Snapshot& source_snapshot = *reuse_context->source_snapshot_;
+  Snapshot* snapshot = reuse_context->snapshot_.get();
+  const int64_t observation_time = time(nullptr);
+  snapshot->mutable_chunks()->CopyFrom(source_snapshot.chunks());
+  for (Chunk& chunk : *snapshot->mutable_chunks()) {
+    // Chunk IDs belong to the source file; block IDs are shared.
+    chunk.clear_id();
+    chunk.set_observation_time(observation_time);
+  }
+  snapshot->set_sha1_digest(source_snapshot.sha1_digest());
+  snapshot->set_sha1_digest_range_size(
+      source_snapshot.sha1_digest_range_size());
+  snapshot->mutable_hashed_file_identity()->Swap(&final_file_identity);
+
+  *reuse_context->reused_ = true;
+  reuse_context->callback_();
+}
+
+bool ChunkHasherImpl::CanReuseChunks(
+    const Snapshot& source_snapshot, const Snapshot& snapshot,
+    const FileIdentity& file_identity) const {
+  if (!snapshot.is_regular() || snapshot.length() <= 0 ||
+      !source_snapshot.is_regular() ||
+      source_snapshot.length() != snapshot.length() ||
+      file_identity.length() != snapshot.length() ||
+      !FileIdentityUtil::FileIdentitiesEqual(
+          file_identity, source_snapshot.hashed_file_identity())) {
+    return false;
+  }
+
+  // The digest is only comparable with those of later snapshots if it was
+  // computed over the same ranges as it would be now.
+  if (source_snapshot.sha1_digest_range_size() !=
+      ParallelHashingRangeSizeForLength(snapshot.length())) {
+    return false;
+  }
+
+  // The chunks must cover the whole file, with no gaps or overlaps.
+  int64_t offset = 0;
+  for (const Chunk& chunk : source_snapshot.chunks()) {
+    if (chunk.offset() != offset || chunk.block().length() <= 0 ||
+        !chunk.block().has_id()) {
+      return false;
+    }
+    offset += chunk.block().length();
+  }
+  return offset == snapshot.length();
+}
+
+void ChunkHasherImpl::SetHashedFileIdentity(
+    const boost::filesystem::path& path,
+    const FileIdentity& initial_file_identity, Snapshot* snapshot) const {
+  FileIdentity final_file_identity;
+  FileIdentityUtil::GetFileIdentity(path, &final_file_identity);
+  if (FileIdentityUtil::FileIdentitiesEqual(
+          initial_file_identity, final_file_identity) &&
+      final_file_identity.length() == snapshot->length()) {
+    snapshot->mutable_hashed_file_identity()->Swap(&final_file_identity);
+  } else {
+    snapshot->clear_hashed_file_identity();
+  }
+}
+
+int64_t ChunkHasherImpl::ParallelHashingRangeSizeForLength(
+    int64_t length) const {
+  if (options::parallel_hashing_min_file_size_bytes == 0 ||
+      length < static_cast<int64_t>(
+          options::parallel_hashing_min_file_size_bytes)) {
+    return 0;
+  }
+
+  // Ranges are a whole number of maximum-size blocks, so that with
+  // fixed-size chunking the chunks are the same as if the file were
+  // hashed sequentially.
+  const int64_t block_size = options::max_block_size_bytes;
+  const int64_t range_size = std::max<int64_t>(
+      (options::parallel_hashing_range_size_bytes + block_size - 1) /
+      block_size * block_size, block_size);
+  return (range_size < length) ? range_size : 0;
+}
+
+size_t ChunkHasherImpl::ChunkLengthForBlockData(
+    ByteSpan block_data) const {
+  if (content_defined_chunker_ == nullptr) {
+    return block_data.size();
+  }
+  return content_defined_chunker_->FindChunkLength(
+      block_data.data(), block_data.size());
+}
+
+size_t ChunkHasherImpl::AddChunksForRead(
+    const vector<ChunkReader::Hole>& holes, const Chunk& read_chunk,
+    ByteSpan block_data, int64_t end_offset, vector<byte>* pending_data,
+    google::protobuf::RepeatedPtrField<Chunk>* chunks,
+    Sha1Hasher* sha1_hasher) const {
+  // A chunk cannot continue past a short read (EOF), end_offset, or the
+  // start of a hole.
+  const int64_t read_end_offset =
+      read_chunk.offset() + read_chunk.block().length();
+  const ChunkReader::Hole* hole = FindHoleAtOrAfter(holes, read_end_offset);
+  const bool read_ends_chunk =
+      block_data.size() < static_cast<size_t>(read_chunk.block().length()) ||
+      read_end_offset >= end_offset ||
+      (hole != nullptr && hole->offset == read_end_offset);
+
+  const bool has_pending_data = !CHECK_NOTNULL(pending_data)->empty();
+  int64_t offset = read_chunk.offset();
+  ByteSpan data = block_data;
+  if (has_pending_data) {
+    offset -= pending_data->size();
+    pending_data->insert(
+        pending_data->end(), block_data.begin(), block_data.end());
+    data = ByteSpan(*pending_data);
+  }
+
+  const int64_t observation_time = time(nullptr);
+  size_t num_bytes_chunked = 0;
+  while (num_bytes_chunked < data.size()) {
+    // No chunk is longer than a read would be.
+    const ByteSpan chunk_data = data.subspan(
+        num_bytes_chunked, options::max_block_size_bytes);
+    const size_t chunk_length = ChunkLengthForBlockData(chunk_data);
+    if (content_defined_chunker_ != nullptr && !read_ends_chunk &&
+        chunk_length == chunk_data.size() &&
+        chunk_length < options::max_block_size_bytes) {
+      break;
+    }
+
+    Chunk* chunk = CHECK_NOTNULL(chunks)->Add();
+    chunk->set_offset(offset + num_bytes_chunked);
+    chunk->set_observation_time(observation_time);
+    Block* block = chunk->mutable_block();
+    block->set_length(chunk_length);
+
+    Sha1Digest block_sha1_digest;
+    HashData(chunk_data.data(), chunk_length, &block_sha1_digest);
+    block->set_sha1_digest(block_sha1_digest.ToBytes());
+    CHECK_NOTNULL(sha1_hasher)->Update(chunk_data.data(), chunk_length);
+    num_bytes_chunked += chunk_length;
+  }
+
+  // The rest of the data begins the next chunk.
+  if (has_pending_data) {
+    pending_data->erase(pending_data->begin(),
+                        pending_data->begin() + num_bytes_chunked);
+  } else {
+    pending_data->assign(
+        block_data.begin() + num_bytes_chunked, block_data.end());
+  }
+  return num_bytes_chunked;
+}
+
+void ChunkHasherImpl::SetChunkForRead(
+    const vector<ChunkReader::Hole>& holes, int64_t offset,
+    int64_t read_end_offset, Chunk* chunk) const {
+  int64_t length = std::min<int64_t>(
+      options::max_block_size_bytes, read_end_offset - offset);
+  const ChunkReader::Hole* hole = FindHoleAtOrAfter(holes, offset);
+  if (hole != nullptr) {
+    length = std::min(length, hole->offset - offset);
+  }
+  CHECK_NOTNULL(chunk)->set_offset(offset);
+  chunk->mutable_block()->set_length(length);
+}
+
+void ChunkHasherImpl::PrefetchChunksAfter(
+    const vector<ChunkReader::Hole>& holes, int64_t offset,
+    int64_t end_offset, int64_t read_end_offset,
+    ChunkReader* chunk_reader) const {
+  while (offset < end_offset) {
+    const ChunkReader::Hole* hole = FindHoleAtOrAfter(holes, offset);
+    if (hole != nullptr && hole->offset <= offset) {
+      offset = hole->offset + hole->length;
+      continue;
+    }
+
+    Chunk chunk;
+    SetChunkForRead(holes, offset, read_end_offset, &chunk);
+    if (!chunk_reader->PrefetchChunk(chunk)) {
+      return;
+    }
+    offset += chunk.block().length();
+  }
+}
+
+void ChunkHasherImpl::SetHoleChunk(int64_t length, Chunk* chunk) const {
+  CHECK_NOTNULL(chunk)->set_observation_time(time(nullptr));
+  Block* block = chunk->mutable_block();
+  block->set_length(length);
+  block->set_is_hole(true);
+}
+
+void ChunkHasherImpl::UpdateHashForHole(
+    const Chunk& hole_chunk, Sha1Hasher* sha1_hasher) const {
+  byte hole_data[16];
+  const uint64_t offset = hole_chunk.offset();
+  const uint64_t length = hole_chunk.block().length();
+  for (int i = 0; i < 8; ++i) {
+    hole_data[7 - i] = static_cast<byte>(offset >> (8 * i));
+    hole_data[15 - i] = static_cast<byte>(length >> (8 * i));
+  }
+  CHECK_NOTNULL(sha1_hasher)->Update(hole_data, sizeof(hole_data));
+}
+
+void ChunkHasherImpl::HashData(
+    const byte* data, size_t size, Sha1Digest* sha1_digest) const {
+  Sha1Hasher::Hash(ByteSpan(data, size), CHECK_NOTNULL(sha1_digest));
+}
+
+void ChunkHasherImpl::WriteWholeFileHash(Sha1Digest* sha1_digest) {
+  whole_file_sha1_hasher_.Final(CHECK_NOTNULL(sha1_digest));
 }
 
 ChunkHasherImpl::Context::Context(
@@ -132,8 +666,53 @@ ChunkHasherImpl::Context::Context(
     Callback callback)
     : path_(path),
       snapshot_(snapshot),
+      initial_file_identity_(InitialFileIdentity(path)),
+      chunk_reader_(ChunkReader::CreateChunkReaderForPath(path).release()),
+      offset_(0),
+      callback_(callback) {
+}
+
+ChunkHasherImpl::LargeFileContext::LargeFileContext(
+    const boost::filesystem::path& path, boost::shared_ptr<Snapshot> snapshot,
+    int64_t range_size, Callback callback)
+    : path_(path),
+      snapshot_(snapshot),
+      initial_file_identity_(InitialFileIdentity(path)),
       chunk_reader_(ChunkReader::CreateChunkReaderForPath(path).release()),
-      current_chunk_(nullptr),
+      range_size_(range_size),
+      num_ranges_((snapshot->length() + range_size - 1) / range_size),
+      callback_(callback),
+      next_range_index_(0),
+      num_completed_ranges_(0),
+      range_chunks_(num_ranges_),
+      range_sha1_digests_(num_ranges_) {
+}
+
+ChunkHasherImpl::RangeContext::RangeContext(
+    boost::shared_ptr<LargeFileContext> large_file_context,
+    size_t range_index)
+    : large_file_context_(large_file_context),
+      chunk_reader_(ChunkReader::CreateChunkReaderForPath(
+          large_file_context->path_).release()),
+      range_index_(range_index),
+      end_offset_(std::min<int64_t>(
+          (range_index + 1) * large_file_context->range_size_,
+          large_file_context->snapshot_->length())),
+      offset_(range_index * large_file_context->range_size_) {
+}
+
+ChunkHasherImpl::ReuseContext::ReuseContext(
+    const boost::filesystem::path& path,
+    boost::shared_ptr<const Snapshot> source_snapshot,
+    boost::shared_ptr<Snapshot> snapshot,
+    const FileIdentity& initial_file_identity,
+    bool* reused, Callback callback)
+    : path_(path),
+      source_snapshot_(source_snapshot),
+      snapshot_(snapshot),
+      initial_file_identity_(initial_file_identity),
+      num_verified_chunks_(0),
+      reused_(reused),
       callback_(callback) {
 }
 
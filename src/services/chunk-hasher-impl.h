@@ -6,20 +6,21 @@
 
 #include <boost/filesystem.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <google/protobuf/repeated_field.h>
 
+#include "base/byte-span.h"
 #include "base/callback.h"
 #include "base/macros.h"
+#include "proto/snapshot.pb.h"
 #include "services/chunk-hasher.h"
-
-namespace CryptoPP {
-class SHA1;
-}  // namespace CryptoPP
+#include "services/chunk-reader.h"
+#include "util/digest.h"
+#include "util/sha-hasher.h"
 
 namespace polar_express {
 
-class Block;
-class Chunk;
-class ChunkReader;
+class ContentDefinedChunker;
 
 class ChunkHasherImpl : public ChunkHasher {
  public:
@@ -30,9 +31,10 @@ class ChunkHasherImpl : public ChunkHasher {
       const boost::filesystem::path& path,
       boost::shared_ptr<Snapshot> snapshot, Callback callback);
 
-  virtual void ValidateHash(
-      const Chunk& chunk, const vector<byte>& block_data_for_chunk,
-      bool* is_valid, Callback callback);
+  virtual void ReuseChunks(
+      const boost::filesystem::path& path,
+      boost::shared_ptr<const Snapshot> source_snapshot,
+      boost::shared_ptr<Snapshot> snapshot, bool* reused, Callback callback);
 
  private:
   struct Context {
@@ -42,9 +44,79 @@ class ChunkHasherImpl : public ChunkHasher {
 
     boost::filesystem::path path_;
     boost::shared_ptr<Snapshot> snapshot_;
+    FileIdentity initial_file_identity_;
+    boost::shared_ptr<ChunkReader> chunk_reader_;
+    vector<ChunkReader::Hole> holes_;
+    // The offset of the first byte that is not yet part of a chunk.
+    int64_t offset_;
+    Chunk read_chunk_;
+    ByteSpan block_data_span_;
+    vector<byte> pending_data_;
+    Callback callback_;
+  };
+
+  // State for hashing a large file in parallel. The file is divided into
+  // ranges of range_size_ bytes, and up to max_active_ranges_ ranges are
+  // chunked and hashed at once on separate CPU-bound workers. Each range
+  // has its own digest; the chunks and digests are merged back in file
+  // order once all ranges are complete.
+  struct LargeFileContext {
+    LargeFileContext(const boost::filesystem::path& path,
+                     boost::shared_ptr<Snapshot> snapshot,
+                     int64_t range_size, Callback callback);
+
+    boost::filesystem::path path_;
+    boost::shared_ptr<Snapshot> snapshot_;
+    FileIdentity initial_file_identity_;
     boost::shared_ptr<ChunkReader> chunk_reader_;
-    Chunk* current_chunk_;
-    vector<byte> block_data_buffer_;
+    vector<ChunkReader::Hole> holes_;
+    const int64_t range_size_;
+    const size_t num_ranges_;
+    Callback callback_;
+
+    boost::mutex mu_;
+    size_t next_range_index_;
+    size_t num_completed_ranges_;
+    vector<google::protobuf::RepeatedPtrField<Chunk> > range_chunks_;
+    vector<Sha1Digest> range_sha1_digests_;
+  };
+
+  struct RangeContext {
+    RangeContext(boost::shared_ptr<LargeFileContext> large_file_context,
+                 size_t range_index);
+
+    boost::shared_ptr<LargeFileContext> large_file_context_;
+    // Each range has its own reader, since a reader's views may not
+    // outlive its next read.
+    boost::shared_ptr<ChunkReader> chunk_reader_;
+    const size_t range_index_;
+    const int64_t end_offset_;
+    int64_t offset_;
+    google::protobuf::RepeatedPtrField<Chunk> chunks_;
+    Chunk read_chunk_;
+    ByteSpan block_data_span_;
+    vector<byte> pending_data_;
+    Sha1Hasher range_sha1_hasher_;
+  };
+
+  // State for checking a sample of the chunks reused from another snapshot
+  // of the same file.
+  struct ReuseContext {
+    ReuseContext(const boost::filesystem::path& path,
+                 boost::shared_ptr<const Snapshot> source_snapshot,
+                 boost::shared_ptr<Snapshot> snapshot,
+                 const FileIdentity& initial_file_identity,
+                 bool* reused, Callback callback);
+
+    boost::filesystem::path path_;
+    boost::shared_ptr<const Snapshot> source_snapshot_;
+    boost::shared_ptr<Snapshot> snapshot_;
+    FileIdentity initial_file_identity_;
+    boost::shared_ptr<ChunkReader> chunk_reader_;
+    vector<const Chunk*> chunks_to_verify_;
+    size_t num_verified_chunks_;
+    ByteSpan block_data_span_;
+    bool* reused_;
     Callback callback_;
   };
 
@@ -54,13 +126,105 @@ class ChunkHasherImpl : public ChunkHasher {
   void UpdateHashesFromBlockData(
       boost::shared_ptr<Context> context);
 
-  void HashData(const vector<byte>& data, string* sha1_digest) const;
+  void FinishGeneratingAndHashingChunks(
+      boost::shared_ptr<Context> context);
+
+  void StartGeneratingAndHashingLargeFileChunks(
+      const boost::filesystem::path& path,
+      boost::shared_ptr<Snapshot> snapshot, Callback callback);
+
+  void StartRanges(
+      boost::shared_ptr<LargeFileContext> large_file_context);
+
+  void StartNextRange(
+      boost::shared_ptr<LargeFileContext> large_file_context);
 
-  void UpdateWholeFileHash(const vector<byte>& data);
+  void ContinueGeneratingAndHashingRangeChunks(
+      boost::shared_ptr<RangeContext> range_context);
 
-  void WriteWholeFileHash(string* sha1_digest) const;
+  void PostUpdateRangeHashesFromBlockData(
+      boost::shared_ptr<RangeContext> range_context);
 
-  unique_ptr<CryptoPP::SHA1> whole_file_sha1_engine_;
+  void UpdateRangeHashesFromBlockData(
+      boost::shared_ptr<RangeContext> range_context);
+
+  void FinishRange(boost::shared_ptr<RangeContext> range_context);
+
+  void FinishLargeFile(
+      boost::shared_ptr<LargeFileContext> large_file_context);
+
+  void ContinueVerifyingReusedChunks(
+      boost::shared_ptr<ReuseContext> reuse_context);
+
+  void VerifyReusedChunk(boost::shared_ptr<ReuseContext> reuse_context);
+
+  void FinishReusingChunks(boost::shared_ptr<ReuseContext> reuse_context);
+
+  // Returns true if the chunks of source_snapshot can be reused for
+  // snapshot, a snapshot of a file which currently has file_identity.
+  bool CanReuseChunks(const Snapshot& source_snapshot,
+                      const Snapshot& snapshot,
+                      const FileIdentity& file_identity) const;
+
+  // Records the file's identity in the snapshot if it is the same as
+  // initial_file_identity, which was captured before any of the file's
+  // chunks were read.
+  void SetHashedFileIdentity(
+      const boost::filesystem::path& path,
+      const FileIdentity& initial_file_identity, Snapshot* snapshot) const;
+
+  // Returns the size of the ranges that a file of the given length should
+  // be hashed in parallel in, or zero if it should be hashed sequentially.
+  int64_t ParallelHashingRangeSizeForLength(int64_t length) const;
+
+  // Returns the number of bytes at the start of block_data that belong in the
+  // current chunk. For fixed-size chunking this is all of them; for
+  // content-defined chunking the remainder is the beginning of the next
+  // chunk.
+  size_t ChunkLengthForBlockData(ByteSpan block_data) const;
+
+  // Splits the data returned for read_chunk, following any data left over
+  // from the previous read in pending_data, into chunks which are appended
+  // to chunks and added to sha1_hasher. With content-defined chunking, the
+  // end of a chunk that runs to the end of the data is not known until more
+  // has been read, so that data is left in pending_data instead unless no
+  // chunk can continue past the read. Returns the number of bytes chunked.
+  size_t AddChunksForRead(
+      const vector<ChunkReader::Hole>& holes, const Chunk& read_chunk,
+      ByteSpan block_data, int64_t end_offset, vector<byte>* pending_data,
+      google::protobuf::RepeatedPtrField<Chunk>* chunks,
+      Sha1Hasher* sha1_hasher) const;
+
+  // Sets the offset and length of chunk to those of the read that is made
+  // for data starting at offset: no longer than the maximum block size,
+  // and stopping short of both the next hole and read_end_offset.
+  void SetChunkForRead(
+      const vector<ChunkReader::Hole>& holes, int64_t offset,
+      int64_t read_end_offset, Chunk* chunk) const;
+
+  // Asks chunk_reader to prefetch the reads that will follow the one ending
+  // at offset, skipping holes and stopping at end_offset.
+  void PrefetchChunksAfter(
+      const vector<ChunkReader::Hole>& holes, int64_t offset,
+      int64_t end_offset, int64_t read_end_offset,
+      ChunkReader* chunk_reader) const;
+
+  // Fills in chunk as a hole of the given length. Holes are never read.
+  void SetHoleChunk(int64_t length, Chunk* chunk) const;
+
+  // Holes are not hashed as zeros; instead, their offset and length are
+  // hashed in their place.
+  void UpdateHashForHole(
+      const Chunk& hole_chunk, Sha1Hasher* sha1_hasher) const;
+
+  void HashData(const byte* data, size_t size, Sha1Digest* sha1_digest) const;
+
+  void WriteWholeFileHash(Sha1Digest* sha1_digest);
+
+  Sha1Hasher whole_file_sha1_hasher_;
+
+  // Null when using fixed-size chunking.
+  unique_ptr<ContentDefinedChunker> content_defined_chunker_;
 
   DISALLOW_COPY_AND_ASSIGN(ChunkHasherImpl);
 };
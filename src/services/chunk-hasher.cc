@@ -25,12 +25,13 @@ void ChunkHasher::GenerateAndHashChunks(
            impl_.get(), path, snapshot, callback));
 }
 
-void ChunkHasher::ValidateHash(
-    const Chunk& chunk, const vector<byte>& block_data_for_chunk,
-    bool* is_valid, Callback callback) {
+void ChunkHasher::ReuseChunks(
+    const boost::filesystem::path& path,
+    boost::shared_ptr<const Snapshot> source_snapshot,
+    boost::shared_ptr<Snapshot> snapshot, bool* reused, Callback callback) {
   AsioDispatcher::GetInstance()->PostCpuBound(
-      bind(&ChunkHasher::ValidateHash,
-           impl_.get(), chunk, block_data_for_chunk, is_valid, callback));
+      bind(&ChunkHasher::ReuseChunks,
+           impl_.get(), path, source_snapshot, snapshot, reused, callback));
 }
 
 }  // namespace polar_express
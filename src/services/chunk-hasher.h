@@ -32,9 +32,19 @@ class ChunkHasher {
       const boost::filesystem::path& path,
       boost::shared_ptr<Snapshot> snapshot, Callback callback);
 
-  virtual void ValidateHash(
-      const Chunk& chunk, const vector<byte>& block_data_for_chunk,
-      bool* is_valid, Callback callback);
+  // Fills in the chunks and digest of snapshot from those of
+  // source_snapshot, a snapshot of the same file under another path (with
+  // its chunks and hashed_file_identity) which was found by the file's
+  // identity, so that a file that was renamed or hard-linked is not read
+  // and hashed again. A few of the chunks, spread across the file, are read
+  // back and hashed first to check that they still match. Sets reused to
+  // false, and leaves snapshot unchanged, if the file no longer has that
+  // identity, the chunks would not be the ones that hashing the file now
+  // would produce, or any checked chunk does not match.
+  virtual void ReuseChunks(
+      const boost::filesystem::path& path,
+      boost::shared_ptr<const Snapshot> source_snapshot,
+      boost::shared_ptr<Snapshot> snapshot, bool* reused, Callback callback);
 
  protected:
   explicit ChunkHasher(bool create_impl);
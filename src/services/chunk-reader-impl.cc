@@ -1,36 +1,44 @@
 #include "services/chunk-reader-impl.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+
 #include <boost/iostreams/device/mapped_file.hpp>
 
 #include <crypto++/hex.h>
 #include <crypto++/sha.h>
 
+#include "base/options.h"
 #include "proto/snapshot.pb.h"
+#include "util/file-identity-util.h"
+
+DEFINE_OPTION(
+    mmap_window_size_bytes, size_t, 128 * 1024 * 1024 /* 128 MiB */,
+    "When reading files with the 'mmap' chunk_reader_io_mode, at most this "
+    "much of each file is mapped at once (more if a single chunk is larger). "
+    "Zero maps whole files.");
 
 namespace polar_express {
 
 ChunkReaderImpl::ChunkReaderImpl(const boost::filesystem::path& path)
-  : ChunkReader(path, false),
-    mapped_file_(
-        new boost::iostreams::mapped_file(path.string(), ios_base::in)) {
+  : path_(path),
+    mapped_file_(new boost::iostreams::mapped_file),
+    window_offset_(0),
+    file_size_(0) {
 }
 
 ChunkReaderImpl::~ChunkReaderImpl() {
 }
 
-void ChunkReaderImpl::ReadBlockDataForChunk(
-    const Chunk& chunk, vector<byte>* block_data_for_chunk,
-    Callback callback) {
-  CHECK_NOTNULL(block_data_for_chunk)->clear();
+void ChunkReaderImpl::ReadBlockDataSpanForChunk(
+    const Chunk& chunk, ByteSpan* block_data_for_chunk, Callback callback) {
+  *CHECK_NOTNULL(block_data_for_chunk) = ByteSpan();
   try {
-    if (mapped_file_->is_open() &&
-        chunk.offset() < mapped_file_->size() &&
-        chunk.block().length() > 0) {
-      block_data_for_chunk->assign(
-          mapped_file_->const_data() + chunk.offset(),
-          mapped_file_->const_data() + min<size_t>(
-              chunk.offset() + chunk.block().length(), mapped_file_->size()));
-    }
+    *block_data_for_chunk = GetMappedSpanForChunk(chunk);
+    PrefaultPages(*block_data_for_chunk);
   } catch (...) {
     // TODO: Do something sane here.
   }
@@ -38,4 +46,104 @@ void ChunkReaderImpl::ReadBlockDataForChunk(
   callback();
 }
 
+void ChunkReaderImpl::ReadBlockDataSpanAndFileIdentityForChunk(
+    const Chunk& chunk, ByteSpan* block_data_for_chunk,
+    FileIdentity* file_identity_after_read, Callback callback) {
+  *CHECK_NOTNULL(block_data_for_chunk) = ByteSpan();
+  try {
+    *block_data_for_chunk = GetMappedSpanForChunk(chunk);
+    PrefaultPages(*block_data_for_chunk);
+  } catch (...) {
+    // TODO: Do something sane here.
+  }
+  FileIdentityUtil::GetFileIdentity(
+      path_, CHECK_NOTNULL(file_identity_after_read));
+
+  callback();
+}
+
+void ChunkReaderImpl::FindHoles(
+    int64_t min_hole_length, vector<Hole>* holes, Callback callback) {
+  CHECK_NOTNULL(holes)->clear();
+  int fd = open(path_.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    FindHolesInFile(fd, min_hole_length, holes);
+    close(fd);
+  }
+
+  callback();
+}
+
+ByteSpan ChunkReaderImpl::GetMappedSpanForChunk(const Chunk& chunk) {
+  if (chunk.offset() < 0 || chunk.block().length() <= 0) {
+    return ByteSpan();
+  }
+
+  // Growth of the file after it was mapped is not picked up; the file
+  // identity checked after the read shows that the file has changed.
+  if (!mapped_file_->is_open() ||
+      chunk.offset() < window_offset_ ||
+      std::min(chunk.offset() + chunk.block().length(), file_size_) >
+      window_offset_ + static_cast<int64_t>(mapped_file_->size())) {
+    MapWindowForChunk(chunk);
+  }
+
+  if (!mapped_file_->is_open() || chunk.offset() >= file_size_ ||
+      chunk.offset() - window_offset_ >=
+      static_cast<int64_t>(mapped_file_->size())) {
+    return ByteSpan();
+  }
+  return ByteSpan(
+      reinterpret_cast<const byte*>(mapped_file_->const_data()),
+      mapped_file_->size()).subspan(
+          chunk.offset() - window_offset_, chunk.block().length());
+}
+
+void ChunkReaderImpl::MapWindowForChunk(const Chunk& chunk) {
+  boost::system::error_code ec;
+  const int64_t file_size = boost::filesystem::file_size(path_, ec);
+  if (ec) {
+    mapped_file_->close();
+    return;
+  }
+  file_size_ = file_size;
+  if (chunk.offset() >= file_size) {
+    return;
+  }
+  mapped_file_->close();
+
+  int64_t window_length;
+  if (options::mmap_window_size_bytes == 0) {
+    window_offset_ = 0;
+    window_length = file_size;
+  } else {
+    // Mappings must start on an allocation granularity boundary.
+    const int64_t alignment = boost::iostreams::mapped_file::alignment();
+    window_offset_ = chunk.offset() / alignment * alignment;
+    window_length = std::min(
+        std::max<int64_t>(
+            options::mmap_window_size_bytes,
+            chunk.offset() - window_offset_ + chunk.block().length()),
+        file_size - window_offset_);
+  }
+
+  mapped_file_->open(path_.string(), ios_base::in, window_length,
+                     window_offset_);
+  madvise(const_cast<char*>(mapped_file_->const_data()),
+          mapped_file_->size(), MADV_SEQUENTIAL);
+}
+
+// static
+void ChunkReaderImpl::PrefaultPages(ByteSpan span) {
+  static const size_t kPageSize = sysconf(_SC_PAGESIZE);
+  volatile byte sink = 0;
+  for (size_t i = 0; i < span.size(); i += kPageSize) {
+    sink = span.data()[i];
+  }
+  if (!span.empty()) {
+    sink = span.data()[span.size() - 1];
+  }
+  (void)sink;
+}
+
 }  // namespace polar_express
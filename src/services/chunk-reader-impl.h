@@ -8,6 +8,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/shared_ptr.hpp>
 
+#include "base/byte-span.h"
 #include "base/callback.h"
 #include "base/macros.h"
 #include "services/chunk-reader.h"
@@ -23,17 +24,47 @@ namespace polar_express {
 class Block;
 class Chunk;
 
+// Reads chunks through a memory mapping of the file. Rather than mapping
+// the whole file, only a window of it (mmap_window_size_bytes) is mapped
+// at a time, with sequential access advice. The window slides forward to
+// each chunk that lies outside of it, unmapping the part behind the
+// reader, so that huge files being read concurrently do not tie up large
+// amounts of address space and page tables.
 class ChunkReaderImpl : public ChunkReader {
  public:
   explicit ChunkReaderImpl(const boost::filesystem::path& path);
   virtual ~ChunkReaderImpl();
 
-  virtual void ReadBlockDataForChunk(
-      const Chunk& chunk, vector<byte>* block_data_for_chunk,
-      Callback callback);
+  virtual void ReadBlockDataSpanForChunk(
+      const Chunk& chunk, ByteSpan* block_data_for_chunk, Callback callback);
+
+  virtual void ReadBlockDataSpanAndFileIdentityForChunk(
+      const Chunk& chunk, ByteSpan* block_data_for_chunk,
+      FileIdentity* file_identity_after_read, Callback callback);
+
+  virtual void FindHoles(
+      int64_t min_hole_length, vector<Hole>* holes, Callback callback);
 
  private:
+  // Returns the portion of the mapping covered by the chunk, or an
+  // empty span if the chunk lies outside of the file. Slides the window
+  // to the chunk first if necessary, which invalidates earlier spans.
+  ByteSpan GetMappedSpanForChunk(const Chunk& chunk);
+
+  // Replaces the current window with one starting at (or just before) the
+  // chunk. Leaves the current window in place if the chunk starts past EOF.
+  void MapWindowForChunk(const Chunk& chunk);
+
+  // Touches each page of the span so that it is resident in memory.
+  static void PrefaultPages(ByteSpan span);
+
+  const boost::filesystem::path path_;
   const unique_ptr<boost::iostreams::mapped_file> mapped_file_;
+  int64_t window_offset_;
+  // The size of the file when the window was last mapped. Chunks are read
+  // only up to here, so that the tail of the file, which the hasher asks
+  // for with chunks reaching well past EOF, is not remapped for each one.
+  int64_t file_size_;
 
   DISALLOW_COPY_AND_ASSIGN(ChunkReaderImpl);
 };
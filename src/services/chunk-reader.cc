@@ -1,35 +1,162 @@
 #include "services/chunk-reader.h"
 
+#include <errno.h>
+#include <unistd.h>
+
+#include <iostream>
+
 #include "base/asio-dispatcher.h"
+#include "base/io-uring-queue.h"
+#include "base/options.h"
 #include "proto/block.pb.h"
 #include "services/chunk-reader-impl.h"
+#include "services/io-uring-chunk-reader-impl.h"
+#include "services/prefetching-chunk-reader-impl.h"
+#include "services/streaming-chunk-reader-impl.h"
+
+DEFINE_OPTION(
+    chunk_reader_io_mode, string, "mmap",
+    "How files are read during backup. 'mmap' maps a sliding window of "
+    "each file into memory (see mmap_window_size_bytes). "
+    "'fadvise' streams files through a small buffer with sequential "
+    "read-ahead, and drops their pages from the page cache after reading "
+    "so that backups do not evict other programs' working sets. 'direct' "
+    "streams files with O_DIRECT, bypassing the page cache entirely (where "
+    "the file system supports it; otherwise it behaves like 'fadvise'). "
+    "'io_uring' submits reads asynchronously through io_uring, keeping many "
+    "reads in flight at once for fast SSDs (where io_uring is available; "
+    "otherwise it behaves like 'fadvise').");
+
+DEFINE_OPTION(
+    max_in_flight_chunk_reads, int, 2,
+    "Maximum number of chunks of each file being read that may be buffered "
+    "at once. With more than one, the next chunk of a file is read while "
+    "the current one is hashed or compressed. Each buffered chunk may take "
+    "up to max_block_size_bytes of memory with the streaming readers.");
 
 namespace polar_express {
 
+// static
+template<typename ChunkReaderImplT>
+unique_ptr<ChunkReader> ChunkReader::CreateChunkReaderWithImpl(
+    const boost::filesystem::path& path) {
+  return unique_ptr<ChunkReader>(new ChunkReader(
+      unique_ptr<ChunkReader>(new ChunkReaderImplT(path))));
+}
+
+// static
+bool ChunkReader::ValidateOptions() {
+  if (options::chunk_reader_io_mode == "mmap" ||
+      options::chunk_reader_io_mode == "fadvise" ||
+      options::chunk_reader_io_mode == "direct" ||
+      options::chunk_reader_io_mode == "io_uring") {
+    return true;
+  }
+  std::cerr << "ERROR: Unknown chunk_reader_io_mode '"
+            << options::chunk_reader_io_mode << "'. Expected 'mmap', "
+            << "'fadvise', 'direct' or 'io_uring'." << std::endl;
+  return false;
+}
+
 // static
 unique_ptr<ChunkReader> ChunkReader::CreateChunkReaderForPath(
     const boost::filesystem::path& path) {
-  return unique_ptr<ChunkReader>(new ChunkReader(path));
+  if (options::max_in_flight_chunk_reads > 1) {
+    return unique_ptr<ChunkReader>(new ChunkReader(
+        unique_ptr<ChunkReader>(new PrefetchingChunkReaderImpl(
+            path, options::max_in_flight_chunk_reads))));
+  }
+  return CreateNonPrefetchingChunkReaderForPath(path);
+}
+
+// static
+unique_ptr<ChunkReader> ChunkReader::CreateNonPrefetchingChunkReaderForPath(
+    const boost::filesystem::path& path) {
+  if (options::chunk_reader_io_mode == "fadvise") {
+    return CreateChunkReaderWithImpl<StreamingChunkReaderImpl>(path);
+  } else if (options::chunk_reader_io_mode == "direct") {
+    return CreateChunkReaderWithImpl<DirectStreamingChunkReaderImpl>(path);
+  } else if (options::chunk_reader_io_mode == "io_uring") {
+    if (IoUringQueue::GetInstance() == nullptr) {
+      return CreateChunkReaderWithImpl<StreamingChunkReaderImpl>(path);
+    }
+    return CreateChunkReaderWithImpl<IoUringChunkReaderImpl>(path);
+  } else {
+    assert(options::chunk_reader_io_mode == "mmap");
+    return CreateChunkReaderWithImpl<ChunkReaderImpl>(path);
+  }
 }
 
-ChunkReader::ChunkReader(const boost::filesystem::path& path)
-    : impl_(new ChunkReaderImpl(path)) {
+ChunkReader::ChunkReader() {
 }
 
-ChunkReader::ChunkReader(
-    const boost::filesystem::path& path, bool create_impl)
-    : impl_(create_impl ? new ChunkReaderImpl(path) : nullptr) {
+ChunkReader::ChunkReader(unique_ptr<ChunkReader>&& impl)
+    : impl_(std::move(CHECK_NOTNULL(impl))) {
 }
 
 ChunkReader::~ChunkReader() {
 }
 
-void ChunkReader::ReadBlockDataForChunk(
-    const Chunk& chunk, vector<byte>* block_data_for_chunk, Callback callback) {
+void ChunkReader::ReadBlockDataSpanForChunk(
+    const Chunk& chunk, ByteSpan* block_data_for_chunk, Callback callback) {
   AsioDispatcher::GetInstance()->PostDiskBound(
-      bind(&ChunkReader::ReadBlockDataForChunk,
+      bind(&ChunkReader::ReadBlockDataSpanForChunk,
            impl_.get(), chunk, block_data_for_chunk, callback));
 }
 
-}  // namespace polar_express
+void ChunkReader::ReadBlockDataSpanAndFileIdentityForChunk(
+    const Chunk& chunk, ByteSpan* block_data_for_chunk,
+    FileIdentity* file_identity_after_read, Callback callback) {
+  AsioDispatcher::GetInstance()->PostDiskBound(
+      bind(&ChunkReader::ReadBlockDataSpanAndFileIdentityForChunk,
+           impl_.get(), chunk, block_data_for_chunk, file_identity_after_read,
+           callback));
+}
+
+void ChunkReader::FindHoles(
+    int64_t min_hole_length, vector<Hole>* holes, Callback callback) {
+  AsioDispatcher::GetInstance()->PostDiskBound(
+      bind(&ChunkReader::FindHoles,
+           impl_.get(), min_hole_length, holes, callback));
+}
 
+bool ChunkReader::PrefetchChunk(const Chunk& chunk) {
+  // Prefetching only starts a read, so it is done directly rather than
+  // being posted.
+  return impl_ != nullptr && impl_->PrefetchChunk(chunk);
+}
+
+// static
+void ChunkReader::FindHolesInFile(
+    int fd, int64_t min_hole_length, vector<Hole>* holes) {
+  CHECK_NOTNULL(holes)->clear();
+
+  // Alternate between seeking to the start of the next data region and to
+  // the start of the hole that follows it. File systems which do not
+  // support holes report the whole file as a single data region, and
+  // older kernels fail with EINVAL.
+  const off_t length = lseek(fd, 0, SEEK_END);
+  off_t offset = 0;
+  while (offset < length) {
+    off_t data_offset = lseek(fd, offset, SEEK_DATA);
+    if (data_offset < 0) {
+      if (errno != ENXIO) {
+        break;
+      }
+      data_offset = length;
+    }
+    if (data_offset > offset && data_offset - offset >= min_hole_length) {
+      Hole hole = { offset, data_offset - offset };
+      holes->push_back(hole);
+    }
+    if (data_offset >= length) {
+      break;
+    }
+    offset = lseek(fd, data_offset, SEEK_HOLE);
+    if (offset < 0) {
+      break;
+    }
+  }
+}
+
+}  // namespace polar_express
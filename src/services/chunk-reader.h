@@ -1,6 +1,7 @@
 #ifndef CHUNK_READER_H
 #define CHUNK_READER_H
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
@@ -8,31 +9,93 @@
 #include <boost/filesystem.hpp>
 #include <boost/shared_ptr.hpp>
 
+#include "base/byte-span.h"
 #include "base/callback.h"
 #include "base/macros.h"
 
 namespace polar_express {
 
 class Chunk;
-class ChunkReaderImpl;
+class FileIdentity;
 
 class ChunkReader {
  public:
-  // Factory method so that we can mock these later.
+  // A run of a sparse file that is not stored on disk and reads as
+  // zeros.
+  struct Hole {
+    int64_t offset;
+    int64_t length;
+  };
+
+  // Factory method so that we can mock these later. The implementation
+  // is chosen by the chunk_reader_io_mode option, and wrapped to prefetch
+  // chunks if max_in_flight_chunk_reads is more than one.
   static unique_ptr<ChunkReader> CreateChunkReaderForPath(
       const boost::filesystem::path& path);
   virtual ~ChunkReader();
 
-  virtual void ReadBlockDataForChunk(
-      const Chunk& chunk, vector<byte>* block_data_for_chunk,
-      Callback callback);
+  // Returns false, after printing an error, if chunk_reader_io_mode does
+  // not name a known mode. Checked at startup, so that a misspelled mode
+  // is not silently read as another one.
+  static bool ValidateOptions();
+
+  // Sets block_data_for_chunk to a read-only view of the chunk's data
+  // directly within the file mapping, without copying it. The pages
+  // backing the view are faulted in before the callback is invoked, so
+  // that consumers on CPU-bound threads do not stall on disk I/O.
+  //
+  // The view remains valid until the next read from this ChunkReader,
+  // or until it is destroyed. Readers that stream the file rather than
+  // mapping it reuse a single buffer, so callers that need several views
+  // at once must use a ChunkReader for each. Note that, unlike a copy, a
+  // view into a mapping reflects any concurrent modifications to the
+  // file, so a digest computed over it may not match the data later
+  // compressed from it if the file is changing.
+  virtual void ReadBlockDataSpanForChunk(
+      const Chunk& chunk, ByteSpan* block_data_for_chunk, Callback callback);
+
+  // As ReadBlockDataSpanForChunk, but also fills in the identity of the
+  // file as of just after the chunk's pages were faulted in. If this
+  // matches the identity under which the chunk was hashed, the data in
+  // the view is the data that was hashed.
+  virtual void ReadBlockDataSpanAndFileIdentityForChunk(
+      const Chunk& chunk, ByteSpan* block_data_for_chunk,
+      FileIdentity* file_identity_after_read, Callback callback);
+
+  // Fills holes with the holes in the file, in order of offset, omitting
+  // any that are shorter than min_hole_length. A hole at the end of the
+  // file extends to the file's length. If the file system cannot report
+  // holes, holes is left empty and the whole file is treated as data.
+  virtual void FindHoles(
+      int64_t min_hole_length, vector<Hole>* holes, Callback callback);
+
+  // Hints that the chunk is likely to be the next one read (or the one
+  // after that, etc.) with ReadBlockDataSpanForChunk or
+  // ReadBlockDataSpanAndFileIdentityForChunk, so that its read can be
+  // started while the caller works on the current one. Returns
+  // immediately; returns false if the reader has no buffer free for the
+  // chunk, or does not prefetch at all.
+  virtual bool PrefetchChunk(const Chunk& chunk);
 
  protected:
-  explicit ChunkReader(const boost::filesystem::path& path);
-  ChunkReader(const boost::filesystem::path& path, bool create_impl);
+  ChunkReader();
+  explicit ChunkReader(unique_ptr<ChunkReader>&& impl);
+
+  // As CreateChunkReaderForPath, but never wraps the reader to prefetch.
+  static unique_ptr<ChunkReader> CreateNonPrefetchingChunkReaderForPath(
+      const boost::filesystem::path& path);
+
+  // Implements FindHoles for an open file descriptor. The file offset is
+  // left unspecified.
+  static void FindHolesInFile(
+      int fd, int64_t min_hole_length, vector<Hole>* holes);
 
  private:
-  unique_ptr<ChunkReaderImpl> impl_;
+  template<typename ChunkReaderImplT>
+  static unique_ptr<ChunkReader> CreateChunkReaderWithImpl(
+      const boost::filesystem::path& path);
+
+  unique_ptr<ChunkReader> impl_;
 
   DISALLOW_COPY_AND_ASSIGN(ChunkReader);
 };
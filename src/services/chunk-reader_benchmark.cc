@@ -0,0 +1,205 @@
+// Compares reading a file from a cold cache through the mmap chunk reader
+// with the streaming and io_uring readers, reporting throughput and how much of the
+// file is left in the page cache afterwards (the cache pollution that a
+// backup inflicts on everything else running on the machine).
+//
+// The benchmark file should be on the file system being backed up, not
+// on tmpfs, whose pages cannot be dropped.
+//
+// Usage: chunk-reader_benchmark [--benchmark_file_path=PATH]
+//            [--benchmark_file_size_bytes=N]
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/bind/bind.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "base/asio-dispatcher.h"
+#include "base/byte-span.h"
+#include "base/io-uring-queue.h"
+#include "base/macros.h"
+#include "base/options.h"
+#include "proto/block.pb.h"
+#include "services/chunk-reader-impl.h"
+#include "services/io-uring-chunk-reader-impl.h"
+#include "services/streaming-chunk-reader-impl.h"
+
+DEFINE_OPTION(benchmark_file_path, string, "chunk-reader_benchmark.data",
+              "File to create and read. Removed when the benchmark exits.");
+DEFINE_OPTION(benchmark_file_size_bytes, size_t,
+              512 * 1024 * 1024 /* 512 MiB */,
+              "Size of the file to read.");
+
+using polar_express::AsioDispatcher;
+using polar_express::ByteSpan;
+using polar_express::Chunk;
+using polar_express::ChunkReader;
+using polar_express::ChunkReaderImpl;
+using polar_express::DirectStreamingChunkReaderImpl;
+using polar_express::IoUringChunkReaderImpl;
+using polar_express::IoUringQueue;
+using polar_express::StreamingChunkReaderImpl;
+
+namespace {
+
+const size_t kBlockSize = 1024 * 1024;
+
+bool WriteFile(const string& path, size_t size) {
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  std::mt19937 rng(42);
+  vector<uint32_t> block(kBlockSize / sizeof(uint32_t));
+  for (size_t written = 0; written < size; written += kBlockSize) {
+    for (uint32_t& word : block) {
+      word = rng();
+    }
+    fwrite(block.data(), 1, std::min(kBlockSize, size - written), file);
+  }
+  fflush(file);
+  fdatasync(fileno(file));
+  fclose(file);
+  return true;
+}
+
+void EvictFromPageCache(const string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+}
+
+size_t BytesInPageCache(const string& path, size_t size) {
+  int fd = open(path.c_str(), O_RDONLY);
+  void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return 0;
+  }
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  vector<unsigned char> residency((size + page_size - 1) / page_size);
+  size_t resident_pages = 0;
+  if (mincore(mapping, size, residency.data()) == 0) {
+    for (unsigned char page : residency) {
+      resident_pages += (page & 1);
+    }
+  }
+  munmap(mapping, size);
+  return resident_pages * page_size;
+}
+
+// Waits for a read to complete, which the io_uring reader does on one of
+// the dispatcher's threads rather than before returning.
+class ReadWaiter {
+ public:
+  ReadWaiter() : is_done_(false) {
+  }
+
+  polar_express::Callback callback() {
+    return boost::bind(&ReadWaiter::Done, this);
+  }
+
+  void Wait() {
+    boost::mutex::scoped_lock lock(mu_);
+    while (!is_done_) {
+      done_.wait(lock);
+    }
+  }
+
+ private:
+  void Done() {
+    boost::mutex::scoped_lock lock(mu_);
+    is_done_ = true;
+    done_.notify_one();
+  }
+
+  boost::mutex mu_;
+  boost::condition_variable done_;
+  bool is_done_;
+};
+
+void Measure(const char* name, ChunkReader* chunk_reader, const string& path,
+             size_t size) {
+  Chunk chunk;
+  chunk.mutable_block()->set_length(kBlockSize);
+  uint64_t checksum = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t offset = 0; offset < size; offset += kBlockSize) {
+    chunk.set_offset(offset);
+    ByteSpan block_data;
+    ReadWaiter read_waiter;
+    chunk_reader->ReadBlockDataSpanForChunk(
+        chunk, &block_data, read_waiter.callback());
+    read_waiter.Wait();
+    for (size_t i = 0; i < block_data.size(); i += 64) {
+      checksum += block_data.data()[i];
+    }
+  }
+  double seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+
+  printf("%-10s %10.1f %16.1f %12llx\n", name, size / seconds / 1e6,
+         BytesInPageCache(path, size) / 1048576.0,
+         static_cast<unsigned long long>(checksum));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (!polar_express::options::Init(argc, argv)) {
+    return 1;
+  }
+
+  const string& path = polar_express::options::benchmark_file_path;
+  const size_t size = polar_express::options::benchmark_file_size_bytes;
+  if (!WriteFile(path, size)) {
+    fprintf(stderr, "Could not write %s\n", path.c_str());
+    return 1;
+  }
+
+  printf("%-10s %10s %16s %12s\n", "reader", "MB/s", "cached MiB after",
+         "checksum");
+
+  EvictFromPageCache(path);
+  {
+    ChunkReaderImpl chunk_reader(path);
+    Measure("mmap", &chunk_reader, path, size);
+  }
+
+  EvictFromPageCache(path);
+  {
+    StreamingChunkReaderImpl chunk_reader(path);
+    Measure("fadvise", &chunk_reader, path, size);
+  }
+
+  EvictFromPageCache(path);
+  {
+    DirectStreamingChunkReaderImpl chunk_reader(path);
+    Measure("direct", &chunk_reader, path, size);
+  }
+
+  if (IoUringQueue::GetInstance() != nullptr) {
+    AsioDispatcher::GetInstance()->Start();
+    EvictFromPageCache(path);
+    {
+      IoUringChunkReaderImpl chunk_reader(path);
+      Measure("io_uring", &chunk_reader, path, size);
+    }
+    AsioDispatcher::GetInstance()->WaitForFinish();
+  } else {
+    printf("%-10s (unavailable)\n", "io_uring");
+  }
+
+  unlink(path.c_str());
+  return 0;
+}
@@ -1,9 +1,18 @@
 #include "services/compressor.h"
 
+#include <algorithm>
+
 #include "base/asio-dispatcher.h"
+#include "base/options.h"
 #include "services/null-compressor-impl.h"
 #include "services/zlib-compressor-impl.h"
 
+DEFINE_OPTION(
+    compression_tile_size_bytes, size_t, 128 * 1024 /* 128 KiB */,
+    "Size of the tiles that data is hashed and compressed in when both are "
+    "done together. Should fit comfortably in the L2 cache alongside the "
+    "compressor's own state.");
+
 namespace polar_express {
 
 // static
@@ -50,13 +59,31 @@ void Compressor::InitializeCompression(size_t max_buffer_size) {
 }
 
 void Compressor::CompressData(
-    const vector<byte>& data, vector<byte>* compressed_data,
-    Callback callback) {
+    ByteSpan data, vector<byte>* compressed_data, Callback callback) {
   AsioDispatcher::GetInstance()->PostCpuBound(
       bind(&Compressor::CompressData,
            impl_.get(), data, compressed_data, callback));
 }
 
+void Compressor::CompressAndValidateData(
+    ByteSpan data, const string& expected_sha1_digest,
+    vector<byte>* compressed_data, bool* is_valid, Callback callback) {
+  AsioDispatcher::GetInstance()->PostCpuBound(
+      bind(&Compressor::CompressAndValidateData,
+           impl_.get(), data, expected_sha1_digest, compressed_data, is_valid,
+           callback));
+}
+
+// static
+void Compressor::ForEachTile(
+    ByteSpan data, boost::function<void(ByteSpan)> process_tile) {
+  const size_t tile_size = std::max<size_t>(
+      options::compression_tile_size_bytes, 1);
+  for (size_t offset = 0; offset < data.size(); offset += tile_size) {
+    process_tile(data.subspan(offset, tile_size));
+  }
+}
+
 void Compressor::FinalizeCompression(vector<byte>* compressed_data) {
   impl_->FinalizeCompression(compressed_data);
 }
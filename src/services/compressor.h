@@ -1,8 +1,12 @@
 #ifndef COMPRESSOR_H
 #define COMPRESSOR_H
 
+#include <string>
 #include <vector>
 
+#include <boost/function.hpp>
+
+#include "base/byte-span.h"
 #include "base/callback.h"
 #include "base/macros.h"
 #include "proto/bundle-manifest.pb.h"
@@ -31,9 +35,23 @@ class Compressor {
   // Compresses (more) data. Some or all of the compressed data may be
   // appeneded to compressed_data. It is possible that nothing will be
   // appended to compressed_data if it all remains buffered.
+  //
+  // The data is not copied, so the memory it refers to must remain
+  // valid and unmodified until the callback is invoked.
   virtual void CompressData(
-      const vector<byte>& data, vector<byte>* compressed_data,
-      Callback callback);
+      ByteSpan data, vector<byte>* compressed_data, Callback callback);
+
+  // Compresses data as CompressData does, while simultaneously
+  // computing its SHA-1 digest. The data is processed in cache-sized
+  // tiles, each of which is hashed and then compressed before moving on
+  // to the next, so that it is only streamed through the cache once.
+  //
+  // If the digest does not match expected_sha1_digest (raw binary),
+  // *is_valid is set to false and the compressor is rolled back to its
+  // state before the call, as if the data had never been given to it.
+  virtual void CompressAndValidateData(
+      ByteSpan data, const string& expected_sha1_digest,
+      vector<byte>* compressed_data, bool* is_valid, Callback callback);
 
   // Outputs any remaining buffered compressed data to compressed_data
   // and clears all state. InitializeCompression must have been called
@@ -48,6 +66,10 @@ class Compressor {
   Compressor();
   explicit Compressor(unique_ptr<Compressor>&& impl);
 
+  // Invokes process_tile on each successive cache-sized tile of data.
+  static void ForEachTile(
+      ByteSpan data, boost::function<void(ByteSpan)> process_tile);
+
  private:
   template<typename CompressorImplT>
   static unique_ptr<Compressor> CreateCompressorWithImpl();
@@ -0,0 +1,239 @@
+#include "services/directory-fingerprints.h"
+
+#include <sys/statfs.h>
+
+#include <functional>
+#include <sstream>
+
+#include "base/options.h"
+#include "util/file-stat-util.h"
+
+DEFINE_OPTION(directory_fingerprint_verify_interval_hours, int, 168,
+              "How often a directory which is unchanged since the last "
+              "backup is read anyway, to verify its fingerprint, in hours. "
+              "If zero, every directory is always read.");
+
+DEFINE_OPTION(directory_fingerprint_trusted_filesystems, string, "",
+              "Comma-separated types of file system (e.g. 'ext4,xfs') on "
+              "which directories whose fingerprints are unchanged since the "
+              "last backup are not read, nor their files stat'ed, or '*' "
+              "for all. Only safe if files there are never modified in "
+              "place, but only created, renamed into place or deleted. "
+              "If empty, every directory is always read.");
+
+namespace polar_express {
+namespace {
+
+struct FilesystemType {
+  const char* name;
+  int64_t magic;
+};
+
+// statfs reports the type of a file system only as a magic number.
+const FilesystemType kFilesystemTypes[] = {
+  { "btrfs", 0x9123683E },
+  { "ext2", 0xEF53 },
+  { "ext3", 0xEF53 },
+  { "ext4", 0xEF53 },
+  { "f2fs", 0xF2F52010 },
+  { "fuse", 0x65735546 },
+  { "iso9660", 0x9660 },
+  { "nfs", 0x6969 },
+  { "overlay", 0x794C7630 },
+  { "squashfs", 0x73717368 },
+  { "tmpfs", 0x01021994 },
+  { "xfs", 0x58465342 },
+  { "zfs", 0x2FC12FC1 },
+};
+
+bool IsTrustedFilesystemType(int64_t magic) {
+  std::istringstream trusted_filesystems(
+      options::directory_fingerprint_trusted_filesystems);
+  string name;
+  while (std::getline(trusted_filesystems, name, ',')) {
+    if (name == "*") {
+      return true;
+    }
+    for (const auto& filesystem_type : kFilesystemTypes) {
+      if (name == filesystem_type.name && magic == filesystem_type.magic) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+DirectoryFingerprint FingerprintFromFileStat(
+    const boost::filesystem::path& directory, const FileStat& file_stat) {
+  DirectoryFingerprint fingerprint;
+  fingerprint.set_path(directory.string());
+  fingerprint.set_device(file_stat.device());
+  fingerprint.set_inode(file_stat.inode());
+  fingerprint.set_modification_time_ns(file_stat.modification_time_ns());
+  fingerprint.set_change_time_ns(file_stat.change_time_ns());
+  return fingerprint;
+}
+
+// Returns true if the fingerprints are of the same directory, which has
+// not had entries added, removed or renamed in between.
+bool HaveSameStat(const DirectoryFingerprint& fingerprint1,
+                  const DirectoryFingerprint& fingerprint2) {
+  return fingerprint1.device() == fingerprint2.device() &&
+      fingerprint1.inode() == fingerprint2.inode() &&
+      fingerprint1.modification_time_ns() ==
+          fingerprint2.modification_time_ns() &&
+      fingerprint1.change_time_ns() == fingerprint2.change_time_ns();
+}
+
+}  // namespace
+
+DirectoryFingerprints::DirectoryFingerprints(
+    const vector<DirectoryFingerprint>& previous_fingerprints, int64_t now,
+    int64_t path_filter_hash)
+    : now_(now),
+      path_filter_hash_(path_filter_hash),
+      num_unchanged_directories_(0),
+      num_inconsistent_directories_(0) {
+  for (const auto& fingerprint : previous_fingerprints) {
+    previous_fingerprints_[fingerprint.path()] = fingerprint;
+  }
+}
+
+DirectoryFingerprints::~DirectoryFingerprints() {
+}
+
+bool DirectoryFingerprints::IsUnchanged(
+    const boost::filesystem::path& directory, const FileStat& file_stat) {
+  if (!file_stat.has_modification_time_ns() ||
+      !file_stat.has_change_time_ns()) {
+    return false;
+  }
+
+  DirectoryFingerprint fingerprint =
+      FingerprintFromFileStat(directory, file_stat);
+  auto previous_it = previous_fingerprints_.find(fingerprint.path());
+  const bool is_unchanged = previous_it != previous_fingerprints_.end() &&
+      HaveSameStat(previous_it->second, fingerprint) &&
+      previous_it->second.path_filter_hash() == path_filter_hash_ &&
+      !IsVerificationDue(previous_it->second);
+
+  boost::mutex::scoped_lock lock(mu_);
+  if (is_unchanged && IsTrustedFilesystem(directory, file_stat.device())) {
+    ++num_unchanged_directories_;
+    return true;
+  }
+  fingerprints_[fingerprint.path()] = std::move(fingerprint);
+  return false;
+}
+
+void DirectoryFingerprints::FindChangedDirectoriesBelow(
+    const boost::filesystem::path& directory,
+    vector<pair<boost::filesystem::path, FileStat> >* changed_directories) {
+  CHECK_NOTNULL(changed_directories);
+  vector<boost::filesystem::path> unchanged_directories = { directory };
+  while (!unchanged_directories.empty()) {
+    const boost::filesystem::path unchanged_directory =
+        unchanged_directories.back();
+    unchanged_directories.pop_back();
+
+    // Only directories with previous fingerprints are found unchanged.
+    const DirectoryFingerprint& fingerprint =
+        previous_fingerprints_.find(unchanged_directory.string())->second;
+    for (const string& subdirectory_name : fingerprint.subdirectory_names()) {
+      const boost::filesystem::path subdirectory =
+          unchanged_directory / subdirectory_name;
+      FileStat file_stat;
+      if (!file_stat_util::GetFileStat(subdirectory, &file_stat)) {
+        // Removed since its parent was stat'ed, which will have changed.
+        continue;
+      }
+      if (IsUnchanged(subdirectory, file_stat)) {
+        unchanged_directories.push_back(subdirectory);
+      } else {
+        changed_directories->push_back(make_pair(subdirectory, file_stat));
+      }
+    }
+  }
+}
+
+void DirectoryFingerprints::RecordDirectoryRead(
+    const boost::filesystem::path& directory, size_t num_entries,
+    const vector<boost::filesystem::path>& subdirectories) {
+  boost::mutex::scoped_lock lock(mu_);
+  auto it = fingerprints_.find(directory.string());
+  if (it == fingerprints_.end()) {
+    // The root of the scan, or a directory that could not be stat'ed.
+    return;
+  }
+  DirectoryFingerprint* fingerprint = &it->second;
+  fingerprint->set_num_entries(num_entries);
+  fingerprint->set_verification_time(now_);
+  fingerprint->set_path_filter_hash(path_filter_hash_);
+  fingerprint->clear_subdirectory_names();
+  for (const auto& subdirectory : subdirectories) {
+    fingerprint->add_subdirectory_names(subdirectory.filename().string());
+  }
+
+  auto previous_it = previous_fingerprints_.find(fingerprint->path());
+  if (previous_it != previous_fingerprints_.end() &&
+      HaveSameStat(previous_it->second, *fingerprint) &&
+      previous_it->second.num_entries() != fingerprint->num_entries()) {
+    ++num_inconsistent_directories_;
+    trusted_devices_[fingerprint->device()] = false;
+  }
+}
+
+void DirectoryFingerprints::GetRecordedFingerprints(
+    vector<DirectoryFingerprint>* fingerprints) const {
+  CHECK_NOTNULL(fingerprints);
+  boost::mutex::scoped_lock lock(mu_);
+  for (const auto& path_and_fingerprint : fingerprints_) {
+    if (path_and_fingerprint.second.has_num_entries()) {
+      fingerprints->push_back(path_and_fingerprint.second);
+    }
+  }
+}
+
+size_t DirectoryFingerprints::num_unchanged_directories() const {
+  boost::mutex::scoped_lock lock(mu_);
+  return num_unchanged_directories_;
+}
+
+size_t DirectoryFingerprints::num_inconsistent_directories() const {
+  boost::mutex::scoped_lock lock(mu_);
+  return num_inconsistent_directories_;
+}
+
+bool DirectoryFingerprints::IsTrustedFilesystem(
+    const boost::filesystem::path& directory, int64_t device) {
+  auto it = trusted_devices_.find(device);
+  if (it != trusted_devices_.end()) {
+    return it->second;
+  }
+
+  bool is_trusted = false;
+  struct statfs unix_statfs;
+  if (statfs(directory.c_str(), &unix_statfs) == 0) {
+    is_trusted = IsTrustedFilesystemType(unix_statfs.f_type);
+  }
+  trusted_devices_[device] = is_trusted;
+  return is_trusted;
+}
+
+bool DirectoryFingerprints::IsVerificationDue(
+    const DirectoryFingerprint& fingerprint) const {
+  const int64_t interval =
+      static_cast<int64_t>(
+          options::directory_fingerprint_verify_interval_hours) * 3600;
+  if (interval <= 0) {
+    return true;
+  }
+  // Each directory's interval is between half and all of the configured
+  // one, so that the directories first read in the same scan are verified
+  // over several later scans, rather than all in one.
+  const int64_t spread = std::hash<string>()(fingerprint.path()) % 1024;
+  return now_ >= fingerprint.verification_time() +
+      interval / 2 + interval / 2 * spread / 1024;
+}
+
+}  // namespace polar_express
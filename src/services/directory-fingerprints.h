@@ -0,0 +1,128 @@
+#ifndef DIRECTORY_FINGERPRINTS_H
+#define DIRECTORY_FINGERPRINTS_H
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "base/macros.h"
+#include "proto/file.pb.h"
+
+namespace polar_express {
+
+// Decides, during a scan, which directories need not be read because they
+// have not changed since a previous scan read them, and collects the
+// fingerprints of the directories that are read, to be recorded in the
+// metadata DB once the backup has completed. Thread-safe, so that it can
+// be shared by the workers of a parallel scan.
+//
+// A directory's modification and change times only move when entries are
+// added to, removed from or renamed within it, not when the files in it
+// are written, nor when anything changes further down the tree. So an
+// unchanged fingerprint proves only that the directory's own entries are
+// unchanged, and then only on a file system which is not being written in
+// place, which only the user can vouch for by listing its type in
+// directory_fingerprint_trusted_filesystems. Even a read-only mount may be
+// written underneath, as with an NFS export of a live file system.
+// Elsewhere, directories are always read. An unchanged directory need not
+// be read, nor its files stat'ed, but each of the subdirectories it had
+// when it was last read must still be stat'ed and checked in turn.
+//
+// Even where it is trusted, each fingerprint is verified (by reading the
+// directory anyway) once it is older than
+// directory_fingerprint_verify_interval_hours, with the interval spread
+// across directories so that they do not all come due in the same scan.
+// If a directory whose fingerprint matched turns out to have a different
+// number of entries, its file system does not keep directory times
+// reliably, and nothing more on it is skipped during the scan.
+//
+// A directory is also read if the path filter rules have changed since it
+// was last read, since an unchanged directory's entries are not filtered
+// again, so entries that a removed rule used to exclude would never be
+// found.
+class DirectoryFingerprints {
+ public:
+  // previous_fingerprints are those recorded by previous scans, now is the
+  // time of this scan, in seconds since the epoch, and path_filter_hash is
+  // the PathFilter hash of the rules applied by this scan (or 0 if none).
+  DirectoryFingerprints(
+      const vector<DirectoryFingerprint>& previous_fingerprints, int64_t now,
+      int64_t path_filter_hash);
+  ~DirectoryFingerprints();
+
+  // Returns true if the directory, whose stat results (taken while reading
+  // its parent) are file_stat, need not be read, in which case
+  // FindChangedDirectoriesBelow must be called for it. Otherwise, the
+  // directory is expected to be read, and its fingerprint is noted to be
+  // recorded once RecordDirectoryRead is called.
+  bool IsUnchanged(const boost::filesystem::path& directory,
+                   const FileStat& file_stat);
+
+  // Stats the subdirectories that the unchanged directory had when it was
+  // last read, and theirs in turn while they are unchanged, and appends the
+  // paths and stat results of those which have changed, and so must be
+  // read, to changed_directories.
+  void FindChangedDirectoriesBelow(
+      const boost::filesystem::path& directory,
+      vector<pair<boost::filesystem::path, FileStat> >* changed_directories);
+
+  // Records that the directory was read completely, and had num_entries
+  // entries (other than "." and ".."), of which subdirectories were
+  // directories.
+  void RecordDirectoryRead(
+      const boost::filesystem::path& directory, size_t num_entries,
+      const vector<boost::filesystem::path>& subdirectories);
+
+  // Appends the fingerprints of all directories recorded by
+  // RecordDirectoryRead.
+  void GetRecordedFingerprints(
+      vector<DirectoryFingerprint>* fingerprints) const;
+
+  // Returns the number of directories that IsUnchanged said need not be
+  // read.
+  size_t num_unchanged_directories() const;
+
+  // Returns the number of directories whose fingerprint matched, but whose
+  // number of entries did not.
+  size_t num_inconsistent_directories() const;
+
+ private:
+  // Returns true if unchanged fingerprints can be trusted for the file
+  // system of device, on which directory lies.
+  bool IsTrustedFilesystem(const boost::filesystem::path& directory,
+                           int64_t device);
+
+  // Returns true if the fingerprint was last verified long enough ago that
+  // its directory must be read again.
+  bool IsVerificationDue(const DirectoryFingerprint& fingerprint) const;
+
+  const int64_t now_;
+  const int64_t path_filter_hash_;
+
+  // Not modified after construction, so read without holding mu_.
+  std::unordered_map<string, DirectoryFingerprint> previous_fingerprints_;
+
+  // Guards everything below.
+  mutable boost::mutex mu_;
+
+  // Fingerprints of directories expected to be read, by path. Only those
+  // with num_entries set have been read.
+  std::unordered_map<string, DirectoryFingerprint> fingerprints_;
+
+  // Whether each device's file system is trusted, once known.
+  std::map<int64_t, bool> trusted_devices_;
+
+  size_t num_unchanged_directories_;
+  size_t num_inconsistent_directories_;
+
+  DISALLOW_COPY_AND_ASSIGN(DirectoryFingerprints);
+};
+
+}  // namespace polar_express
+
+#endif  // DIRECTORY_FINGERPRINTS_H
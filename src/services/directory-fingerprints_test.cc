@@ -0,0 +1,267 @@
+#include "services/directory-fingerprints.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <gtest/gtest.h>
+
+#include "base/options.h"
+#include "proto/file.pb.h"
+#include "util/file-stat-util.h"
+
+DECLARE_OPTION(directory_fingerprint_verify_interval_hours, int);
+DECLARE_OPTION(directory_fingerprint_trusted_filesystems, string);
+
+namespace polar_express {
+namespace {
+
+const int64_t kNow = 1400000000;
+const int64_t kHour = 3600;
+
+class DirectoryFingerprintsTest : public testing::Test {
+ protected:
+  DirectoryFingerprintsTest()
+      : test_directory_(boost::filesystem::temp_directory_path() /
+                        boost::filesystem::unique_path()),
+        directory1_(test_directory_ / "directory1"),
+        directory2_(test_directory_ / "directory2") {
+    verify_interval_hours_ =
+        *options::internal::opt_directory_fingerprint_verify_interval_hours;
+    trusted_filesystems_ =
+        *options::internal::opt_directory_fingerprint_trusted_filesystems;
+    boost::filesystem::create_directories(directory1_);
+    boost::filesystem::create_directories(directory2_);
+    *options::internal::opt_directory_fingerprint_verify_interval_hours = 168;
+    *options::internal::opt_directory_fingerprint_trusted_filesystems = "*";
+  }
+
+  virtual ~DirectoryFingerprintsTest() {
+    *options::internal::opt_directory_fingerprint_verify_interval_hours =
+        verify_interval_hours_;
+    *options::internal::opt_directory_fingerprint_trusted_filesystems =
+        trusted_filesystems_;
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(test_directory_, ec);
+  }
+
+  FileStat Stat(const boost::filesystem::path& directory) const {
+    FileStat file_stat;
+    EXPECT_TRUE(file_stat_util::GetFileStat(directory, &file_stat));
+    return file_stat;
+  }
+
+  // Reads both directories as a scan with no previous fingerprints would,
+  // and returns the fingerprints recorded.
+  vector<DirectoryFingerprint> ReadDirectories(size_t num_entries) const {
+    DirectoryFingerprints directory_fingerprints({}, kNow, 0);
+    for (const auto& directory : { directory1_, directory2_ }) {
+      EXPECT_FALSE(
+          directory_fingerprints.IsUnchanged(directory, Stat(directory)));
+      directory_fingerprints.RecordDirectoryRead(directory, num_entries, {});
+    }
+    vector<DirectoryFingerprint> fingerprints;
+    directory_fingerprints.GetRecordedFingerprints(&fingerprints);
+    return fingerprints;
+  }
+
+  const boost::filesystem::path test_directory_;
+  const boost::filesystem::path directory1_;
+  const boost::filesystem::path directory2_;
+
+ private:
+  int verify_interval_hours_;
+  string trusted_filesystems_;
+};
+
+TEST_F(DirectoryFingerprintsTest, RecordsDirectoriesRead) {
+  DirectoryFingerprints directory_fingerprints({}, kNow, 0);
+  EXPECT_FALSE(directory_fingerprints.IsUnchanged(directory1_,
+                                                  Stat(directory1_)));
+  EXPECT_FALSE(directory_fingerprints.IsUnchanged(directory2_,
+                                                  Stat(directory2_)));
+  directory_fingerprints.RecordDirectoryRead(
+      directory1_, 3, { directory1_ / "a", directory1_ / "b" });
+  // The root of a scan is read without being checked, and is not recorded.
+  directory_fingerprints.RecordDirectoryRead(
+      test_directory_, 2, { directory1_, directory2_ });
+
+  vector<DirectoryFingerprint> fingerprints;
+  directory_fingerprints.GetRecordedFingerprints(&fingerprints);
+  ASSERT_EQ(1, fingerprints.size());
+  EXPECT_EQ(directory1_.string(), fingerprints[0].path());
+  EXPECT_EQ(Stat(directory1_).inode(), fingerprints[0].inode());
+  EXPECT_EQ(Stat(directory1_).modification_time_ns(),
+            fingerprints[0].modification_time_ns());
+  EXPECT_EQ(Stat(directory1_).change_time_ns(),
+            fingerprints[0].change_time_ns());
+  EXPECT_EQ(3, fingerprints[0].num_entries());
+  ASSERT_EQ(2, fingerprints[0].subdirectory_names_size());
+  EXPECT_EQ("a", fingerprints[0].subdirectory_names(0));
+  EXPECT_EQ("b", fingerprints[0].subdirectory_names(1));
+  EXPECT_EQ(kNow, fingerprints[0].verification_time());
+}
+
+TEST_F(DirectoryFingerprintsTest, SkipsUnchangedDirectories) {
+  DirectoryFingerprints directory_fingerprints(
+      ReadDirectories(0), kNow + 1, 0);
+  EXPECT_TRUE(directory_fingerprints.IsUnchanged(directory1_,
+                                                 Stat(directory1_)));
+  EXPECT_TRUE(directory_fingerprints.IsUnchanged(directory2_,
+                                                 Stat(directory2_)));
+  EXPECT_EQ(2, directory_fingerprints.num_unchanged_directories());
+
+  vector<DirectoryFingerprint> fingerprints;
+  directory_fingerprints.GetRecordedFingerprints(&fingerprints);
+  EXPECT_TRUE(fingerprints.empty());
+}
+
+TEST_F(DirectoryFingerprintsTest, ReadsChangedDirectories) {
+  const vector<DirectoryFingerprint> previous_fingerprints =
+      ReadDirectories(0);
+  boost::filesystem::ofstream(directory1_ / "file");
+
+  DirectoryFingerprints directory_fingerprints(
+      previous_fingerprints, kNow + 1, 0);
+  EXPECT_FALSE(directory_fingerprints.IsUnchanged(directory1_,
+                                                  Stat(directory1_)));
+  EXPECT_TRUE(directory_fingerprints.IsUnchanged(directory2_,
+                                                 Stat(directory2_)));
+}
+
+TEST_F(DirectoryFingerprintsTest, ReadsDirectoriesWhenPathFilterChanges) {
+  const vector<DirectoryFingerprint> previous_fingerprints =
+      ReadDirectories(0);
+
+  DirectoryFingerprints directory_fingerprints(
+      previous_fingerprints, kNow + 1, 42);
+  EXPECT_FALSE(directory_fingerprints.IsUnchanged(directory1_,
+                                                  Stat(directory1_)));
+  directory_fingerprints.RecordDirectoryRead(directory1_, 0, {});
+
+  vector<DirectoryFingerprint> fingerprints;
+  directory_fingerprints.GetRecordedFingerprints(&fingerprints);
+  ASSERT_EQ(1, fingerprints.size());
+  EXPECT_EQ(42, fingerprints[0].path_filter_hash());
+
+  // Once read under the new rules, the directory is skipped again.
+  DirectoryFingerprints next_directory_fingerprints(
+      fingerprints, kNow + 2, 42);
+  EXPECT_TRUE(next_directory_fingerprints.IsUnchanged(directory1_,
+                                                      Stat(directory1_)));
+}
+
+TEST_F(DirectoryFingerprintsTest, FindsChangedDirectoriesBelowUnchanged) {
+  const boost::filesystem::path subdirectory1 = directory1_ / "a";
+  const boost::filesystem::path subdirectory2 = directory1_ / "b";
+  const boost::filesystem::path subsubdirectory = subdirectory1 / "c";
+  boost::filesystem::create_directories(subsubdirectory);
+  boost::filesystem::create_directories(subdirectory2);
+
+  vector<DirectoryFingerprint> previous_fingerprints;
+  {
+    DirectoryFingerprints directory_fingerprints({}, kNow, 0);
+    for (const auto& directory : { directory1_, subdirectory1,
+                                   subdirectory2, subsubdirectory }) {
+      EXPECT_FALSE(
+          directory_fingerprints.IsUnchanged(directory, Stat(directory)));
+    }
+    directory_fingerprints.RecordDirectoryRead(
+        directory1_, 2, { subdirectory1, subdirectory2 });
+    directory_fingerprints.RecordDirectoryRead(
+        subdirectory1, 1, { subsubdirectory });
+    directory_fingerprints.RecordDirectoryRead(subdirectory2, 0, {});
+    // The scan never got to read subsubdirectory.
+    directory_fingerprints.GetRecordedFingerprints(&previous_fingerprints);
+  }
+  boost::filesystem::ofstream(subdirectory2 / "file");
+
+  DirectoryFingerprints directory_fingerprints(
+      previous_fingerprints, kNow + 1, 0);
+  ASSERT_TRUE(directory_fingerprints.IsUnchanged(directory1_,
+                                                 Stat(directory1_)));
+  vector<pair<boost::filesystem::path, FileStat> > changed_directories;
+  directory_fingerprints.FindChangedDirectoriesBelow(
+      directory1_, &changed_directories);
+  ASSERT_EQ(2, changed_directories.size());
+  std::sort(changed_directories.begin(), changed_directories.end(),
+            [](const pair<boost::filesystem::path, FileStat>& a,
+               const pair<boost::filesystem::path, FileStat>& b) {
+              return a.first < b.first;
+            });
+  EXPECT_EQ(subsubdirectory, changed_directories[0].first);
+  EXPECT_EQ(Stat(subsubdirectory).inode(),
+            changed_directories[0].second.inode());
+  EXPECT_EQ(subdirectory2, changed_directories[1].first);
+  EXPECT_EQ(2, directory_fingerprints.num_unchanged_directories());
+}
+
+TEST_F(DirectoryFingerprintsTest, ReadsDirectoriesOnUntrustedFilesystems) {
+  const vector<DirectoryFingerprint> previous_fingerprints =
+      ReadDirectories(0);
+  *options::internal::opt_directory_fingerprint_trusted_filesystems = "";
+
+  DirectoryFingerprints directory_fingerprints(
+      previous_fingerprints, kNow + 1, 0);
+  EXPECT_FALSE(directory_fingerprints.IsUnchanged(directory1_,
+                                                  Stat(directory1_)));
+}
+
+TEST_F(DirectoryFingerprintsTest, VerifiesPeriodically) {
+  const vector<DirectoryFingerprint> previous_fingerprints =
+      ReadDirectories(0);
+
+  DirectoryFingerprints not_due_directory_fingerprints(
+      previous_fingerprints, kNow + 84 * kHour - 1, 0);
+  EXPECT_TRUE(not_due_directory_fingerprints.IsUnchanged(
+      directory1_, Stat(directory1_)));
+
+  DirectoryFingerprints due_directory_fingerprints(
+      previous_fingerprints, kNow + 168 * kHour, 0);
+  EXPECT_FALSE(due_directory_fingerprints.IsUnchanged(
+      directory1_, Stat(directory1_)));
+  due_directory_fingerprints.RecordDirectoryRead(directory1_, 0, {});
+
+  vector<DirectoryFingerprint> fingerprints;
+  due_directory_fingerprints.GetRecordedFingerprints(&fingerprints);
+  ASSERT_EQ(1, fingerprints.size());
+  EXPECT_EQ(kNow + 168 * kHour, fingerprints[0].verification_time());
+}
+
+TEST_F(DirectoryFingerprintsTest, NeverSkipsWithoutVerifyInterval) {
+  const vector<DirectoryFingerprint> previous_fingerprints =
+      ReadDirectories(0);
+  *options::internal::opt_directory_fingerprint_verify_interval_hours = 0;
+
+  DirectoryFingerprints directory_fingerprints(
+      previous_fingerprints, kNow + 1, 0);
+  EXPECT_FALSE(directory_fingerprints.IsUnchanged(directory1_,
+                                                  Stat(directory1_)));
+}
+
+TEST_F(DirectoryFingerprintsTest, DistrustsFilesystemWithInconsistentEntries) {
+  vector<DirectoryFingerprint> previous_fingerprints = ReadDirectories(1);
+  for (auto& fingerprint : previous_fingerprints) {
+    if (fingerprint.path() == directory1_.string()) {
+      fingerprint.set_verification_time(kNow - 168 * kHour);
+    }
+  }
+
+  DirectoryFingerprints directory_fingerprints(
+      previous_fingerprints, kNow + 1, 0);
+  EXPECT_FALSE(directory_fingerprints.IsUnchanged(directory1_,
+                                                  Stat(directory1_)));
+  // Directory times did not change, but the number of entries did.
+  directory_fingerprints.RecordDirectoryRead(directory1_, 2, {});
+  EXPECT_EQ(1, directory_fingerprints.num_inconsistent_directories());
+
+  EXPECT_FALSE(directory_fingerprints.IsUnchanged(directory2_,
+                                                  Stat(directory2_)));
+  EXPECT_EQ(0, directory_fingerprints.num_unchanged_directories());
+}
+
+}  // namespace
+}  // namespace polar_express
@@ -1,53 +1,186 @@
 #include "services/filesystem-scanner-impl.h"
 
+#include "services/directory-fingerprints.h"
+#include "services/path-filter.h"
+#include "util/file-stat-util.h"
+
 namespace polar_express {
 
 FilesystemScannerImpl::FilesystemScannerImpl()
-  : FilesystemScanner(false) {
+  : FilesystemScanner(false),
+    directory_fingerprints_(nullptr),
+    path_filter_(nullptr) {
 }
 
 FilesystemScannerImpl::~FilesystemScannerImpl() {
 }
 
+void FilesystemScannerImpl::SetDirectoryFingerprints(
+    DirectoryFingerprints* directory_fingerprints) {
+  directory_fingerprints_ = directory_fingerprints;
+}
+
+void FilesystemScannerImpl::SetPathFilter(const PathFilter* path_filter) {
+  path_filter_ = path_filter;
+}
+
 void FilesystemScannerImpl::StartScan(
     const string& root, int max_paths, Callback callback) {
   ClearPaths();
-  itr_ = filesystem::recursive_directory_iterator(root);
+  pending_directories_.clear();
+  StartIterating(root);
   ContinueScan(max_paths, callback);
 }
 
 void FilesystemScannerImpl::ContinueScan(int max_paths, Callback callback) {
   const filesystem::recursive_directory_iterator eod;
-  int initial_paths = paths_with_size_.size();
-  while ((paths_with_size_.size() - initial_paths < max_paths) && itr_ != eod) {
-    AddPath(*itr_++);
+  int initial_paths = handles_with_stat_.size();
+  while (handles_with_stat_.size() - initial_paths < max_paths) {
+    if (itr_ == eod) {
+      if (directory_fingerprints_ != nullptr) {
+        RecordDirectoriesRead(0);
+      }
+      if (pending_directories_.empty()) {
+        break;
+      }
+      // Changed directories below unchanged ones are not entries of any
+      // directory iterated over, so are returned here instead. The
+      // directories between them were not checked against the filter.
+      pair<boost::filesystem::path, FileStat> pending_directory =
+          std::move(pending_directories_.back());
+      pending_directories_.pop_back();
+      if (path_filter_ != nullptr &&
+          path_filter_->IsExcludedOrBelowExcluded(
+              pending_directory.first, pending_directory.second)) {
+        continue;
+      }
+      AddPath(pending_directory.first, pending_directory.second);
+      StartIterating(pending_directory.first);
+      continue;
+    }
+
+    FileStat file_stat;
+    file_stat_util::GetFileStat(itr_->path(), &file_stat);
+    const bool is_excluded = path_filter_ != nullptr &&
+        path_filter_->IsExcluded(itr_->path(), file_stat);
+    if (directory_fingerprints_ != nullptr) {
+      CountEntry(file_stat, is_excluded);
+    }
+    if (is_excluded) {
+      // The iterator does not follow symlinks to directories.
+      if (filesystem::is_directory(itr_->symlink_status())) {
+        itr_.no_push();
+      }
+    } else {
+      AddPath(itr_->path(), file_stat);
+    }
+    ++itr_;
   }
   callback();
 }
 
 bool FilesystemScannerImpl::GetPaths(
     vector<boost::filesystem::path>* paths) const {
-  CHECK_NOTNULL(paths)->reserve(paths_with_size_.size());
-  for (const auto& path_with_size : paths_with_size_) {
-    paths->push_back(path_with_size.first);
+  CHECK_NOTNULL(paths)->reserve(handles_with_stat_.size());
+  for (const auto& handle_with_stat : handles_with_stat_) {
+    paths->push_back(path_arena_.GetPath(handle_with_stat.first));
   }
-  return !paths_with_size_.empty();
+  return !handles_with_stat_.empty();
 }
 
 bool FilesystemScannerImpl::GetPathsWithFilesize(
     vector<pair<boost::filesystem::path, size_t> >* paths_with_size) const {
-  CHECK_NOTNULL(paths_with_size)->insert(
-      paths_with_size->end(), paths_with_size_.begin(), paths_with_size_.end());
-  return !paths_with_size_.empty();
+  CHECK_NOTNULL(paths_with_size)->reserve(handles_with_stat_.size());
+  for (const auto& handle_with_stat : handles_with_stat_) {
+    paths_with_size->push_back(make_pair(
+        path_arena_.GetPath(handle_with_stat.first),
+        file_stat_util::IsRegularFile(handle_with_stat.second)
+            ? handle_with_stat.second.length() : 0));
+  }
+  return !handles_with_stat_.empty();
+}
+
+bool FilesystemScannerImpl::GetPathsWithFileStat(
+    vector<pair<boost::filesystem::path, FileStat> >* paths_with_stat) const {
+  CHECK_NOTNULL(paths_with_stat)->reserve(
+      paths_with_stat->size() + handles_with_stat_.size());
+  for (const auto& handle_with_stat : handles_with_stat_) {
+    paths_with_stat->push_back(make_pair(
+        path_arena_.GetPath(handle_with_stat.first), handle_with_stat.second));
+  }
+  return !handles_with_stat_.empty();
+}
+
+bool FilesystemScannerImpl::GetPathHandlesWithFileStat(
+    PathArena* path_arena,
+    vector<pair<PathArena::Handle, FileStat> >* handles_with_stat) const {
+  CHECK_NOTNULL(path_arena);
+  CHECK_NOTNULL(handles_with_stat)->reserve(
+      handles_with_stat->size() + handles_with_stat_.size());
+  for (const auto& handle_with_stat : handles_with_stat_) {
+    handles_with_stat->push_back(make_pair(
+        path_arena->Add(path_arena_, handle_with_stat.first),
+        handle_with_stat.second));
+  }
+  return !handles_with_stat_.empty();
 }
 
 void FilesystemScannerImpl::ClearPaths() {
-  paths_with_size_.clear();
+  path_arena_.Clear();
+  handles_with_stat_.clear();
 }
 
-void FilesystemScannerImpl::AddPath(const boost::filesystem::path& path) {
-  paths_with_size_.push_back(
-      make_pair(path, is_regular(path) ? file_size(path) : 0));
+void FilesystemScannerImpl::AddPath(
+    const boost::filesystem::path& path, const FileStat& file_stat) {
+  handles_with_stat_.push_back(make_pair(path_arena_.Add(path), file_stat));
+}
+
+void FilesystemScannerImpl::StartIterating(
+    const boost::filesystem::path& directory) {
+  boost::system::error_code ec;
+  itr_ = filesystem::recursive_directory_iterator(directory, ec);
+  directories_being_read_.clear();
+  if (!ec && directory_fingerprints_ != nullptr) {
+    directories_being_read_.push_back({ directory, 0, {} });
+  }
+}
+
+void FilesystemScannerImpl::CountEntry(
+    const FileStat& file_stat, bool is_excluded) {
+  const size_t level = itr_.level();
+  RecordDirectoriesRead(level + 1);
+
+  // The iterator does not follow symlinks to directories.
+  const bool is_directory =
+      filesystem::is_directory(itr_->symlink_status());
+  if (directories_being_read_.size() == level + 1) {
+    DirectoryBeingRead* directory_being_read = &directories_being_read_.back();
+    ++directory_being_read->num_entries;
+    if (is_directory) {
+      directory_being_read->subdirectories.push_back(itr_->path());
+    }
+  }
+
+  if (is_directory && !is_excluded) {
+    if (directory_fingerprints_->IsUnchanged(itr_->path(), file_stat)) {
+      itr_.no_push();
+      directory_fingerprints_->FindChangedDirectoriesBelow(
+          itr_->path(), &pending_directories_);
+    } else {
+      directories_being_read_.push_back({ itr_->path(), 0, {} });
+    }
+  }
+}
+
+void FilesystemScannerImpl::RecordDirectoriesRead(size_t num_directories) {
+  while (directories_being_read_.size() > num_directories) {
+    const DirectoryBeingRead& directory_being_read =
+        directories_being_read_.back();
+    directory_fingerprints_->RecordDirectoryRead(
+        directory_being_read.directory, directory_being_read.num_entries,
+        directory_being_read.subdirectories);
+    directories_being_read_.pop_back();
+  }
 }
 
 }  // namespace polar_express
@@ -3,12 +3,15 @@
 
 #include <queue>
 #include <string>
+#include <vector>
 
 #include <boost/filesystem.hpp>
 
 #include "base/callback.h"
 #include "base/macros.h"
+#include "proto/file.pb.h"
 #include "services/filesystem-scanner.h"
+#include "util/path-arena.h"
 
 namespace polar_express {
 
@@ -20,6 +23,11 @@ class FilesystemScannerImpl : public FilesystemScanner {
   FilesystemScannerImpl();
   virtual ~FilesystemScannerImpl();
 
+  virtual void SetDirectoryFingerprints(
+      DirectoryFingerprints* directory_fingerprints);
+
+  virtual void SetPathFilter(const PathFilter* path_filter);
+
   virtual void StartScan(
       const string& root, int max_paths, Callback callback);
 
@@ -30,13 +38,53 @@ class FilesystemScannerImpl : public FilesystemScanner {
   virtual bool GetPathsWithFilesize(
       vector<pair<boost::filesystem::path, size_t> >* paths_with_size) const;
 
+  virtual bool GetPathsWithFileStat(
+      vector<pair<boost::filesystem::path, FileStat> >* paths_with_stat) const;
+
+  virtual bool GetPathHandlesWithFileStat(
+      PathArena* path_arena,
+      vector<pair<PathArena::Handle, FileStat> >* handles_with_stat) const;
+
   virtual void ClearPaths();
 
  private:
-  void AddPath(const boost::filesystem::path& path);
+  struct DirectoryBeingRead {
+    boost::filesystem::path directory;
+    size_t num_entries;
+    vector<boost::filesystem::path> subdirectories;
+  };
+
+  void AddPath(const boost::filesystem::path& path, const FileStat& file_stat);
+
+  // Starts iterating over the tree below directory. Directories that cannot
+  // be read are skipped.
+  void StartIterating(const boost::filesystem::path& directory);
+
+  // Counts the entry that the iterator is at (with the given stat results)
+  // towards its directory's entries, and if it is a directory that is not
+  // excluded, either keeps the iterator from descending into it, if it is
+  // unchanged, or starts counting its entries.
+  void CountEntry(const FileStat& file_stat, bool is_excluded);
+
+  // Records all but the first num_directories directories being read as
+  // read.
+  void RecordDirectoriesRead(size_t num_directories);
 
   filesystem::recursive_directory_iterator itr_;
-  vector<pair<boost::filesystem::path, size_t> > paths_with_size_;
+  PathArena path_arena_;
+  vector<pair<PathArena::Handle, FileStat> > handles_with_stat_;
+
+  DirectoryFingerprints* directory_fingerprints_;
+  const PathFilter* path_filter_;
+
+  // Changed directories below unchanged ones, with their stat results. Each
+  // is returned, and its tree iterated over, once the iterator is done.
+  vector<pair<boost::filesystem::path, FileStat> > pending_directories_;
+
+  // The directory that the iterator started at, followed by those it has
+  // descended into and not yet left. The entries of the directory at index
+  // i are at level i.
+  vector<DirectoryBeingRead> directories_being_read_;
 
   DISALLOW_COPY_AND_ASSIGN(FilesystemScannerImpl);
 };
@@ -5,21 +5,65 @@
 #include <boost/bind.hpp>
 
 #include "base/asio-dispatcher.h"
+#include "base/options.h"
+#include "proto/file.pb.h"
+#include "services/changed-paths-filesystem-scanner-impl.h"
 #include "services/filesystem-scanner-impl.h"
+#include "services/parallel-filesystem-scanner-impl.h"
+
+DEFINE_OPTION(
+    filesystem_scanner_threads, int, 4,
+    "Number of threads that read directories in parallel when scanning for "
+    "files to back up. With one, the scan is done by a single recursive "
+    "directory iterator, in directory order.");
 
 namespace polar_express {
+namespace {
+
+FilesystemScanner* CreateFilesystemScannerImpl() {
+  if (options::filesystem_scanner_threads > 1) {
+    return new ParallelFilesystemScannerImpl(
+        options::filesystem_scanner_threads);
+  }
+  return new FilesystemScannerImpl;
+}
+
+}  // namespace
 
 FilesystemScanner::FilesystemScanner()
-    : impl_(new FilesystemScannerImpl) {
+    : impl_(CreateFilesystemScannerImpl()) {
 }
 
 FilesystemScanner::FilesystemScanner(bool create_impl)
-    : impl_(create_impl ? new FilesystemScannerImpl : nullptr) {
+    : impl_(create_impl ? CreateFilesystemScannerImpl() : nullptr) {
+}
+
+FilesystemScanner::FilesystemScanner(unique_ptr<FilesystemScanner>&& impl)
+    : impl_(std::move(CHECK_NOTNULL(impl))) {
+}
+
+// static
+unique_ptr<FilesystemScanner>
+FilesystemScanner::CreateFilesystemScannerForChangedPaths(
+    const vector<boost::filesystem::path>& changed_paths,
+    const vector<boost::filesystem::path>& changed_directories) {
+  return unique_ptr<FilesystemScanner>(new FilesystemScanner(
+      unique_ptr<FilesystemScanner>(new ChangedPathsFilesystemScannerImpl(
+          changed_paths, changed_directories))));
 }
 
 FilesystemScanner::~FilesystemScanner() {
 }
 
+void FilesystemScanner::SetDirectoryFingerprints(
+    DirectoryFingerprints* directory_fingerprints) {
+  impl_->SetDirectoryFingerprints(directory_fingerprints);
+}
+
+void FilesystemScanner::SetPathFilter(const PathFilter* path_filter) {
+  impl_->SetPathFilter(path_filter);
+}
+
 void FilesystemScanner::StartScan(
     const string& root, int max_paths, Callback callback) {
   AsioDispatcher::GetInstance()->PostDiskBound(
@@ -43,6 +87,17 @@ bool FilesystemScanner::GetPathsWithFilesize(
   return impl_->GetPathsWithFilesize(paths_with_size);
 }
 
+bool FilesystemScanner::GetPathsWithFileStat(
+    vector<pair<boost::filesystem::path, FileStat> >* paths_with_stat) const {
+  return impl_->GetPathsWithFileStat(paths_with_stat);
+}
+
+bool FilesystemScanner::GetPathHandlesWithFileStat(
+    PathArena* path_arena,
+    vector<pair<PathArena::Handle, FileStat> >* handles_with_stat) const {
+  return impl_->GetPathHandlesWithFileStat(path_arena, handles_with_stat);
+}
+
 void FilesystemScanner::ClearPaths() {
   impl_->ClearPaths();
 }
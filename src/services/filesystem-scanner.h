@@ -10,10 +10,13 @@
 
 #include "base/callback.h"
 #include "base/macros.h"
+#include "util/path-arena.h"
 
 namespace polar_express {
 
-class FilesystemScannerImpl;
+class DirectoryFingerprints;
+class FileStat;
+class PathFilter;
 
 // A class that asynchronously performs a recursive scan of a filesystem
 // hierarchy from a specified root directory and collects all of the file paths
@@ -27,11 +30,33 @@ class FilesystemScannerImpl;
 // This class is the asynchronous stub. Calls to its asynchronous methods post a
 // task which will invoke the equivalent method on its implementation
 // class. Calls to other methods are forwarded directly to the implementation.
+// The implementation scans with a pool of threads of its own if the
+// filesystem_scanner_threads option is more than one.
 class FilesystemScanner {
  public:
   FilesystemScanner();
   virtual ~FilesystemScanner();
 
+  // Returns a scanner which, instead of scanning the whole tree below the
+  // root, returns only the given paths and the trees of the given
+  // directories, as recorded by a ChangeJournal (relative to the root).
+  static unique_ptr<FilesystemScanner> CreateFilesystemScannerForChangedPaths(
+      const vector<boost::filesystem::path>& changed_paths,
+      const vector<boost::filesystem::path>& changed_directories);
+
+  // Makes the scan skip the directories below the root that
+  // directory_fingerprints shows to be unchanged since a previous scan, and
+  // record in it the fingerprints of the directories that it reads. Must be
+  // called before StartScan, and directory_fingerprints must outlive the
+  // scan.
+  virtual void SetDirectoryFingerprints(
+      DirectoryFingerprints* directory_fingerprints);
+
+  // Makes the scan leave out the paths that path_filter excludes, and not
+  // read excluded directories. Must be called before StartScan, and
+  // path_filter must outlive the scan.
+  virtual void SetPathFilter(const PathFilter* path_filter);
+
   // Asynchronously begins a new scan starting at root, which will collect at
   // most max_paths paths, and will invoke callback when done. Clears any
   // existing paths.
@@ -50,6 +75,18 @@ class FilesystemScanner {
   virtual bool GetPathsWithFilesize(
       vector<pair<boost::filesystem::path, size_t> >* paths_with_size) const;
 
+  // Returns all paths obtained since the last call to StartScan or ClearPaths,
+  // along with the results of stat'ing them during the scan (following
+  // symlinks). Paths that could not be stat'ed have an empty FileStat.
+  virtual bool GetPathsWithFileStat(
+      vector<pair<boost::filesystem::path, FileStat> >* paths_with_stat) const;
+
+  // As GetPathsWithFileStat, but adds the paths to path_arena, returning
+  // their handles in it, so that no path object is created for them.
+  virtual bool GetPathHandlesWithFileStat(
+      PathArena* path_arena,
+      vector<pair<PathArena::Handle, FileStat> >* handles_with_stat) const;
+
   // Clears all existing discovered paths.
   virtual void ClearPaths();
 
@@ -57,7 +94,9 @@ class FilesystemScanner {
   explicit FilesystemScanner(bool create_impl);
 
  private:
-  unique_ptr<FilesystemScannerImpl> impl_;
+  explicit FilesystemScanner(unique_ptr<FilesystemScanner>&& impl);
+
+  unique_ptr<FilesystemScanner> impl_;
 
   DISALLOW_COPY_AND_ASSIGN(FilesystemScanner);
 };
@@ -0,0 +1,146 @@
+// Measures how scanning a directory tree scales with the number of
+// scanner threads, compared with the single-threaded recursive directory
+// iterator. Paths are collected in sections of benchmark_scan_batch_size,
+// as the backup executor does.
+//
+// By default a synthetic tree is created and removed afterwards. To
+// measure a real tree (e.g. on NFS, where parallelism matters most), pass
+// --benchmark_scan_root. Every configuration is run once beforehand so
+// that all of them see the same (warm) dentry and inode caches; drop the
+// caches between runs by hand to measure cold scans.
+//
+// Usage: filesystem-scanner_benchmark [--benchmark_scan_root=PATH]
+//            [--benchmark_tree_path=PATH] [--benchmark_tree_num_files=N]
+//            [--benchmark_scan_batch_size=N]
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "base/macros.h"
+#include "base/options.h"
+#include "services/filesystem-scanner-impl.h"
+#include "services/parallel-filesystem-scanner-impl.h"
+
+DEFINE_OPTION(benchmark_scan_root, string, "",
+              "Existing tree to scan. If empty, a synthetic tree is created.");
+DEFINE_OPTION(benchmark_tree_path, string, "filesystem-scanner_benchmark.tree",
+              "Where to create the synthetic tree. Removed when the benchmark "
+              "exits.");
+DEFINE_OPTION(benchmark_tree_num_files, int, 200000,
+              "Number of files in the synthetic tree.");
+DEFINE_OPTION(benchmark_scan_batch_size, int, 10000,
+              "Maximum number of paths collected per section of the scan.");
+
+using polar_express::FilesystemScanner;
+using polar_express::FilesystemScannerImpl;
+using polar_express::ParallelFilesystemScannerImpl;
+
+namespace {
+
+const int kFilesPerDirectory = 100;
+const int kSubdirectoriesPerDirectory = 10;
+
+// Creates num_files empty files, kFilesPerDirectory to a directory, in a
+// tree with kSubdirectoriesPerDirectory subdirectories per directory.
+bool CreateTree(const boost::filesystem::path& root, int num_files) {
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(root, ec);
+  for (int i = 0; i < num_files; i += kFilesPerDirectory) {
+    boost::filesystem::path directory = root;
+    for (int d = i / kFilesPerDirectory; d > 0;
+         d /= kSubdirectoriesPerDirectory) {
+      directory /= std::to_string(d % kSubdirectoriesPerDirectory);
+    }
+    directory /= "files";
+    boost::filesystem::create_directories(directory, ec);
+    for (int j = 0; j < kFilesPerDirectory && i + j < num_files; ++j) {
+      FILE* file = fopen(
+          (directory / std::to_string(j)).string().c_str(), "w");
+      if (file == nullptr) {
+        return false;
+      }
+      fclose(file);
+    }
+  }
+  return true;
+}
+
+void NoOp() {
+}
+
+size_t Scan(FilesystemScanner* filesystem_scanner, const string& root) {
+  const int batch_size = polar_express::options::benchmark_scan_batch_size;
+  size_t num_paths = 0;
+  vector<pair<boost::filesystem::path, size_t> > paths_with_size;
+  filesystem_scanner->StartScan(root, batch_size, &NoOp);
+  while (filesystem_scanner->GetPathsWithFilesize(&paths_with_size)) {
+    num_paths += paths_with_size.size();
+    paths_with_size.clear();
+    filesystem_scanner->ClearPaths();
+    filesystem_scanner->ContinueScan(batch_size, &NoOp);
+  }
+  return num_paths;
+}
+
+double Measure(const char* name, int num_threads, const string& root,
+               double baseline_seconds) {
+  unique_ptr<FilesystemScanner> filesystem_scanner;
+  if (num_threads == 0) {
+    filesystem_scanner.reset(new FilesystemScannerImpl);
+  } else {
+    filesystem_scanner.reset(new ParallelFilesystemScannerImpl(num_threads));
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  const size_t num_paths = Scan(filesystem_scanner.get(), root);
+  double seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+
+  printf("%-10s %8d %10zu %12.0f %8.2f\n", name, std::max(num_threads, 1),
+         num_paths, num_paths / seconds,
+         (baseline_seconds > 0) ? baseline_seconds / seconds : 1.0);
+  return seconds;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (!polar_express::options::Init(argc, argv)) {
+    return 1;
+  }
+
+  string root = polar_express::options::benchmark_scan_root;
+  const bool create_tree = root.empty();
+  if (create_tree) {
+    root = polar_express::options::benchmark_tree_path;
+    if (!CreateTree(root, polar_express::options::benchmark_tree_num_files)) {
+      fprintf(stderr, "Could not create %s\n", root.c_str());
+      return 1;
+    }
+  }
+
+  const int kThreadCounts[] = { 1, 2, 4, 8, 16, 32 };
+
+  // Warm the caches.
+  {
+    FilesystemScannerImpl filesystem_scanner;
+    Scan(&filesystem_scanner, root);
+  }
+
+  printf("%-10s %8s %10s %12s %8s\n", "scanner", "threads", "paths",
+         "paths/s", "speedup");
+  const double baseline_seconds = Measure("iterator", 0, root, 0);
+  for (int num_threads : kThreadCounts) {
+    Measure("parallel", num_threads, root, baseline_seconds);
+  }
+
+  if (create_tree) {
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(root, ec);
+  }
+  return 0;
+}
@@ -0,0 +1,152 @@
+#include "services/io-uring-chunk-reader-impl.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <boost/bind/bind.hpp>
+
+#include "base/io-uring-queue.h"
+#include "base/options.h"
+#include "proto/block.pb.h"
+#include "proto/snapshot.pb.h"
+#include "util/file-identity-util.h"
+
+DEFINE_OPTION(io_uring_read_piece_size_bytes, size_t, 256 * 1024 /* 256 KiB */,
+              "Chunks read with io_uring are split into pieces of at most "
+              "this many bytes, which are read concurrently.");
+
+namespace polar_express {
+
+struct IoUringChunkReaderImpl::PendingRead {
+  size_t length;
+  size_t piece_size;
+  vector<int> piece_results;
+  size_t num_pieces_remaining;
+  boost::function<void(size_t)> done;
+
+  // Keeps the dispatcher from shutting down while the read is in flight
+  // outside of any of its services.
+  boost::shared_ptr<asio::io_service::work> work;
+};
+
+IoUringChunkReaderImpl::IoUringChunkReaderImpl(
+    const boost::filesystem::path& path)
+    : path_(path),
+      fd_(open(path.c_str(), O_RDONLY)),
+      strand_dispatcher_(
+          AsioDispatcher::GetInstance()->NewStrandDispatcherDiskBound()) {
+  if (fd_ >= 0) {
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+}
+
+IoUringChunkReaderImpl::~IoUringChunkReaderImpl() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+void IoUringChunkReaderImpl::ReadBlockDataSpanForChunk(
+    const Chunk& chunk, ByteSpan* block_data_for_chunk, Callback callback) {
+  *CHECK_NOTNULL(block_data_for_chunk) = ByteSpan();
+  buffer_.resize(std::max<int64_t>(chunk.block().length(), 0));
+  ReadChunk(chunk, buffer_.data(),
+            boost::bind(&IoUringChunkReaderImpl::FinishReadBlockDataSpan,
+                        this, block_data_for_chunk,
+                        static_cast<FileIdentity*>(nullptr), callback,
+                        boost::placeholders::_1));
+}
+
+void IoUringChunkReaderImpl::ReadBlockDataSpanAndFileIdentityForChunk(
+    const Chunk& chunk, ByteSpan* block_data_for_chunk,
+    FileIdentity* file_identity_after_read, Callback callback) {
+  *CHECK_NOTNULL(block_data_for_chunk) = ByteSpan();
+  buffer_.resize(std::max<int64_t>(chunk.block().length(), 0));
+  ReadChunk(chunk, buffer_.data(),
+            boost::bind(&IoUringChunkReaderImpl::FinishReadBlockDataSpan,
+                        this, block_data_for_chunk,
+                        CHECK_NOTNULL(file_identity_after_read), callback,
+                        boost::placeholders::_1));
+}
+
+void IoUringChunkReaderImpl::FindHoles(
+    int64_t min_hole_length, vector<Hole>* holes, Callback callback) {
+  CHECK_NOTNULL(holes)->clear();
+  if (fd_ >= 0) {
+    FindHolesInFile(fd_, min_hole_length, holes);
+  }
+  callback();
+}
+
+void IoUringChunkReaderImpl::ReadChunk(
+    const Chunk& chunk, byte* buffer, boost::function<void(size_t)> done) {
+  IoUringQueue* io_uring_queue = IoUringQueue::GetInstance();
+  const int64_t length = chunk.block().length();
+  if (fd_ < 0 || io_uring_queue == nullptr ||
+      chunk.offset() < 0 || length <= 0) {
+    strand_dispatcher_->Post(boost::bind(done, 0));
+    return;
+  }
+
+  boost::shared_ptr<PendingRead> pending_read(new PendingRead);
+  pending_read->length = length;
+  pending_read->piece_size = std::max<size_t>(
+      options::io_uring_read_piece_size_bytes, 1);
+  const size_t num_pieces =
+      (length + pending_read->piece_size - 1) / pending_read->piece_size;
+  pending_read->piece_results.resize(num_pieces);
+  pending_read->num_pieces_remaining = num_pieces;
+  pending_read->done = done;
+  pending_read->work.reset(strand_dispatcher_->make_work().release());
+
+  for (size_t i = 0; i < num_pieces; ++i) {
+    const size_t piece_offset = i * pending_read->piece_size;
+    io_uring_queue->Read(
+        fd_, buffer + piece_offset,
+        std::min<size_t>(pending_read->piece_size, length - piece_offset),
+        chunk.offset() + piece_offset,
+        boost::bind(&IoUringChunkReaderImpl::HandlePieceRead, this,
+                    pending_read, i, boost::placeholders::_1));
+  }
+}
+
+void IoUringChunkReaderImpl::HandlePieceRead(
+    boost::shared_ptr<PendingRead> pending_read, size_t piece_index,
+    int result) {
+  // All completions run on the IoUringQueue's completion thread, so the
+  // pieces of a read need no synchronization among themselves.
+  pending_read->piece_results[piece_index] = result;
+  if (--pending_read->num_pieces_remaining > 0) {
+    return;
+  }
+
+  // The data ends at the first piece that came up short, which means
+  // that it reached EOF.
+  size_t bytes_read = 0;
+  for (int piece_result : pending_read->piece_results) {
+    if (piece_result <= 0) {
+      break;
+    }
+    bytes_read += piece_result;
+    if (static_cast<size_t>(piece_result) < pending_read->piece_size) {
+      break;
+    }
+  }
+  bytes_read = std::min(bytes_read, pending_read->length);
+
+  strand_dispatcher_->Post(boost::bind(pending_read->done, bytes_read));
+}
+
+void IoUringChunkReaderImpl::FinishReadBlockDataSpan(
+    ByteSpan* block_data_for_chunk, FileIdentity* file_identity_after_read,
+    Callback callback, size_t bytes_read) {
+  *block_data_for_chunk = ByteSpan(buffer_.data(), bytes_read);
+  if (file_identity_after_read != nullptr) {
+    FileIdentityUtil::GetFileIdentity(path_, file_identity_after_read);
+  }
+  callback();
+}
+
+}  // namespace polar_express
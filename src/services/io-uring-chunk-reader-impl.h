@@ -0,0 +1,74 @@
+#ifndef IO_URING_CHUNK_READER_IMPL_H
+#define IO_URING_CHUNK_READER_IMPL_H
+
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "base/asio-dispatcher.h"
+#include "base/byte-span.h"
+#include "base/callback.h"
+#include "base/macros.h"
+#include "services/chunk-reader.h"
+
+namespace polar_express {
+
+class Chunk;
+
+// Reads chunks through the process-wide IoUringQueue instead of blocking
+// a disk-bound thread on each read. Each chunk is split into several
+// pieces which are read concurrently, and since reads no longer occupy a
+// thread while they are in flight, reads from many files can be
+// outstanding at once. This gives fast SSDs the deep queues they need to
+// reach full throughput.
+//
+// Callbacks are invoked on a disk-bound strand belonging to the reader,
+// as they would be if the read had been done synchronously. Like
+// StreamingChunkReaderImpl, data is read into a single reusable buffer.
+class IoUringChunkReaderImpl : public ChunkReader {
+ public:
+  explicit IoUringChunkReaderImpl(const boost::filesystem::path& path);
+  virtual ~IoUringChunkReaderImpl();
+
+  virtual void ReadBlockDataSpanForChunk(
+      const Chunk& chunk, ByteSpan* block_data_for_chunk, Callback callback);
+
+  virtual void ReadBlockDataSpanAndFileIdentityForChunk(
+      const Chunk& chunk, ByteSpan* block_data_for_chunk,
+      FileIdentity* file_identity_after_read, Callback callback);
+
+  virtual void FindHoles(
+      int64_t min_hole_length, vector<Hole>* holes, Callback callback);
+
+ private:
+  struct PendingRead;
+
+  // Reads the chunk's data into buffer, which must have room for the
+  // whole chunk, and then calls done with the number of bytes read on
+  // the reader's strand.
+  void ReadChunk(const Chunk& chunk, byte* buffer,
+                 boost::function<void(size_t)> done);
+
+  void HandlePieceRead(
+      boost::shared_ptr<PendingRead> pending_read, size_t piece_index,
+      int result);
+
+  void FinishReadBlockDataSpan(
+      ByteSpan* block_data_for_chunk, FileIdentity* file_identity_after_read,
+      Callback callback, size_t bytes_read);
+
+  const boost::filesystem::path path_;
+  int fd_;
+  vector<byte> buffer_;
+  boost::shared_ptr<AsioDispatcher::StrandDispatcher> strand_dispatcher_;
+
+  DISALLOW_COPY_AND_ASSIGN(IoUringChunkReaderImpl);
+};
+
+}  // namespace polar_express
+
+#endif  // IO_URING_CHUNK_READER_IMPL_H
@@ -1,6 +1,9 @@
 #include "services/metadata-db-impl.h"
 
+#include <algorithm>
 #include <iostream>
+#include <sstream>
+#include <unordered_map>
 
 #include <boost/thread/once.hpp>
 #include <sqlite3.h>
@@ -11,6 +14,8 @@
 #include "proto/file.pb.h"
 #include "proto/snapshot.pb.h"
 #include "services/sqlite3-helpers.h"
+#include "util/block-id-index.h"
+#include "util/hex-util.h"
 
 #define HAS_FIELD(field_name) has_ ## field_name
 
@@ -53,15 +58,202 @@ DEFINE_OPTION(sqlite_use_write_ahead_logging, bool, true,
               "expense of the possibility of losing some of most recent "
               "transactions in the event of a crash.");
 
+DEFINE_OPTION(index_block_ids_in_memory, bool, true,
+              "When true, the ids of all blocks in the metadata DB are "
+              "loaded into memory at startup, taking about 46 bytes per "
+              "block, so that the blocks of changed files can be found "
+              "without a query for each one.");
+
 namespace polar_express {
+namespace {
+
+// Number of paths looked up by each query of GetLatestSnapshots.
+const size_t kLatestSnapshotsBatchSize = 64;
+
+// The version of metadata-schema.sql, which is stored as the database's
+// user_version.
+const int kSchemaVersion = 1;
+
+// Brings a database created before metadata-schema.sql had a version up to
+// version 1. The local_ tables added since are created if missing, and
+// local_latest_snapshots is populated from the snapshots table; where a
+// file has several snapshots, SQLite takes the id from the row with the
+// greatest observation_time.
+const char kMigrateToVersion1[] =
+    "create table if not exists local_directories ("
+    "  'id'                    INTEGER PRIMARY KEY NOT NULL,"
+    "  'path'                  TEXT    UNIQUE NOT NULL,"
+    "  'device'                INTEGER NOT NULL,"
+    "  'inode'                 INTEGER NOT NULL,"
+    "  'modification_time_ns'  INTEGER NOT NULL,"
+    "  'change_time_ns'        INTEGER NOT NULL,"
+    "  'num_entries'           INTEGER NOT NULL,"
+    "  'subdirectory_names'    TEXT    NOT NULL DEFAULT '',"
+    "  'verification_time'     INTEGER NOT NULL,"
+    "  'path_filter_hash'      INTEGER NOT NULL DEFAULT 0"
+    ");"
+    "create unique index if not exists idx_local_directories_path on "
+    "  local_directories('path');"
+    "create table if not exists local_snapshot_file_identities ("
+    "  'snapshot_id'           INTEGER PRIMARY KEY NOT NULL"
+    "                                  REFERENCES snapshots('id')"
+    "                                  ON DELETE CASCADE,"
+    "  'device'                INTEGER NOT NULL,"
+    "  'inode'                 INTEGER NOT NULL,"
+    "  'length'                INTEGER NOT NULL,"
+    "  'modification_time_ns'  INTEGER NOT NULL"
+    ");"
+    "create index if not exists idx_local_snapshot_file_identities_identity "
+    "  on local_snapshot_file_identities('device', 'inode', 'length',"
+    "                                    'modification_time_ns');"
+    "create table if not exists local_latest_snapshots ("
+    "  'file_id'               INTEGER PRIMARY KEY NOT NULL"
+    "                                  REFERENCES files('id')"
+    "                                  ON DELETE CASCADE,"
+    "  'snapshot_id'           INTEGER NOT NULL REFERENCES snapshots('id')"
+    "                                  ON DELETE CASCADE"
+    ");"
+    "insert or replace into local_latest_snapshots ('file_id', 'snapshot_id') "
+    "  select file_id, id from ("
+    "    select file_id, id, max(observation_time) from snapshots "
+    "    group by file_id);";
+
+// Columns added to tables which unversioned databases may already have
+// without them, since "create table if not exists" leaves those alone.
+struct AddedColumn {
+  const char* table;
+  const char* column;
+  const char* definition;
+};
+
+const AddedColumn kColumnsAddedInVersion1[] = {
+  { "blocks", "is_hole", "INTEGER NOT NULL DEFAULT false" },
+  { "snapshots", "sha1_digest_range_size", "INTEGER NOT NULL DEFAULT 0" },
+  { "local_directories", "path_filter_hash", "INTEGER NOT NULL DEFAULT 0" },
+};
+
+// Returns the names of table's columns, or nothing if there is no table.
+vector<string> GetColumnNames(sqlite3* db, const string& table) {
+  vector<string> column_names;
+  ScopedStatement table_info_stmt(db);
+  table_info_stmt.Prepare("pragma table_info('" + table + "');");
+  while (table_info_stmt.StepUntilNotBusy() == SQLITE_ROW) {
+    column_names.push_back(table_info_stmt.GetColumnText("name"));
+  }
+  return column_names;
+}
+
+// Returns the statements adding the columns of kColumnsAddedInVersion1
+// that are missing from tables which exist.
+string GetAddMissingColumnsStatements(sqlite3* db) {
+  string statements;
+  for (const AddedColumn& added_column : kColumnsAddedInVersion1) {
+    const vector<string> column_names =
+        GetColumnNames(db, added_column.table);
+    if (!column_names.empty() &&
+        std::find(column_names.begin(), column_names.end(),
+                  added_column.column) == column_names.end()) {
+      statements += string("alter table ") + added_column.table +
+          " add column '" + added_column.column + "' " +
+          added_column.definition + ";";
+    }
+  }
+  return statements;
+}
+
+// Number of hex digests converted by each query of ConvertHexDigests.
+const int kHexDigestsBatchSize = 4096;
+
+struct DigestColumn {
+  const char* table;
+  const char* column;
+};
+
+// Columns which held digests as hex strings before they were stored in
+// binary.
+const DigestColumn kDigestColumns[] = {
+  { "blocks", "sha1_digest" },
+  { "snapshots", "sha1_digest" },
+  { "local_bundles", "sha256_linear_digest" },
+  { "local_bundles", "sha256_tree_digest" },
+};
+
+// Runs the statements. Returns false, and sets error, if any fails.
+bool ExecuteStatements(sqlite3* db, const string& statements, string* error) {
+  char* error_message = nullptr;
+  if (sqlite3_exec(db, statements.c_str(), nullptr, nullptr,
+                   &error_message) != SQLITE_OK) {
+    *error = error_message;
+    sqlite3_free(error_message);
+    return false;
+  }
+  return true;
+}
+
+// Replaces the hex digests in kDigestColumns with the binary digests they
+// encode, a batch at a time, since converted rows no longer match. Returns
+// false, and sets error, if a digest is not valid hex or cannot be
+// written.
+bool ConvertHexDigests(sqlite3* db, string* error) {
+  for (const DigestColumn& digest_column : kDigestColumns) {
+    const string table = digest_column.table;
+    const string column = digest_column.column;
+    ScopedStatement select_stmt(db);
+    select_stmt.Prepare(
+        "select id, " + column + " as hex_digest from " + table + " "
+        "where typeof(" + column + ") = 'text' "
+        "limit " + std::to_string(kHexDigestsBatchSize) + ";");
+    ScopedStatement update_stmt(db);
+    update_stmt.Prepare(
+        "update " + table + " set " + column + " = :digest where id = :id;");
+
+    vector<pair<int64_t, string> > digests;
+    do {
+      digests.clear();
+      select_stmt.Reset();
+      while (select_stmt.StepUntilNotBusy() == SQLITE_ROW) {
+        const int64_t id = select_stmt.GetColumnInt64("id");
+        string digest;
+        if (!HexDecode(select_stmt.GetColumnText("hex_digest"), &digest)) {
+          *error = "invalid hex digest in " + table + "." + column +
+              " of row " + std::to_string(id);
+          return false;
+        }
+        digests.push_back(make_pair(id, digest));
+      }
+
+      for (const auto& id_and_digest : digests) {
+        update_stmt.Reset();
+        update_stmt.BindBlob(":digest", id_and_digest.second);
+        update_stmt.BindInt64(":id", id_and_digest.first);
+        if (update_stmt.StepUntilNotBusy() != SQLITE_DONE) {
+          *error = sqlite3_errmsg(db);
+          return false;
+        }
+      }
+    } while (!digests.empty());
+  }
+  return true;
+}
+
+}  // namespace
 
 sqlite3* MetadataDbImpl::db_ = nullptr;
+bool MetadataDbImpl::is_migrated_ = false;
+BlockIdIndex* MetadataDbImpl::block_id_index_ = nullptr;
+boost::mutex MetadataDbImpl::block_id_index_mu_;
 
 MetadataDbImpl::MetadataDbImpl()
     : MetadataDb(false),
       snapshots_select_latest_stmt_(new ScopedStatement(db())),
       snapshots_select_latest_id_stmt_(new ScopedStatement(db())),
+      snapshots_select_latest_by_paths_stmt_(new ScopedStatement(db())),
       snapshots_insert_stmt_(new ScopedStatement(db())),
+      latest_snapshots_insert_stmt_(new ScopedStatement(db())),
+      snapshots_select_by_file_identity_stmt_(new ScopedStatement(db())),
+      snapshot_chunks_select_stmt_(new ScopedStatement(db())),
+      file_identities_insert_stmt_(new ScopedStatement(db())),
+      file_identities_delete_stmt_(new ScopedStatement(db())),
       files_select_id_stmt_(new ScopedStatement(db())),
       files_insert_stmt_(new ScopedStatement(db())),
       attributes_select_id_stmt_(new ScopedStatement(db())),
@@ -77,7 +269,9 @@ MetadataDbImpl::MetadataDbImpl()
       snapshots_to_files_to_blocks_mapping_delete_stmt_(
           new ScopedStatement(db())),
       blocks_to_bundles_mapping_insert_stmt_(new ScopedStatement(db())),
-      bundles_to_servers_mapping_insert_stmt_(new ScopedStatement(db())) {
+      bundles_to_servers_mapping_insert_stmt_(new ScopedStatement(db())),
+      directories_select_stmt_(new ScopedStatement(db())),
+      directories_insert_stmt_(new ScopedStatement(db())) {
   PrepareStatements();
 }
 
@@ -104,40 +298,126 @@ void MetadataDbImpl::GetLatestSnapshot(
       ":file_id", (*snapshot)->file().id());
 
   if (snapshots_select_latest_stmt_->StepUntilNotBusy() == SQLITE_ROW) {
-    SET_IF_PRESENT(*snapshots_select_latest_stmt_, Int64, *snapshot, snapshots,
-                   id);
-
-    Attributes* attributes = (*snapshot)->mutable_attributes();
-    SET_IF_PRESENT(*snapshots_select_latest_stmt_, Int64, attributes,
-                   attributes, id);
-    SET_IF_PRESENT(*snapshots_select_latest_stmt_, Text, attributes,
-                   attributes, owner_user);
-    SET_IF_PRESENT(*snapshots_select_latest_stmt_, Text, attributes,
-                   attributes, owner_group);
-    SET_IF_PRESENT(*snapshots_select_latest_stmt_, Int64, attributes,
-                   attributes, uid);
-    SET_IF_PRESENT(*snapshots_select_latest_stmt_, Int64, attributes,
-                   attributes, gid);
-    SET_IF_PRESENT(*snapshots_select_latest_stmt_, Int64, attributes,
-                   attributes, mode);
-
-    SET_IF_PRESENT(*snapshots_select_latest_stmt_, Int64, *snapshot,
-                   snapshots, creation_time);
-    SET_IF_PRESENT(*snapshots_select_latest_stmt_, Int64, *snapshot,
-                   snapshots, modification_time);
-    SET_IF_PRESENT(*snapshots_select_latest_stmt_, Int64, *snapshot,
-                   snapshots, access_time);
-    // TODO: Extra attributes
-    SET_IF_PRESENT(*snapshots_select_latest_stmt_, Bool, *snapshot,
-                   snapshots, is_regular);
-    SET_IF_PRESENT(*snapshots_select_latest_stmt_, Bool, *snapshot,
-                   snapshots, is_deleted);
-    SET_IF_PRESENT(*snapshots_select_latest_stmt_, Text, *snapshot,
-                   snapshots, sha1_digest);
-    SET_IF_PRESENT(*snapshots_select_latest_stmt_, Int64, *snapshot, snapshots,
+    ReadSnapshotRow(snapshots_select_latest_stmt_.get(), snapshot->get());
+  }
+
+  callback();
+}
+
+void MetadataDbImpl::GetLatestSnapshots(
+    const vector<File>& files,
+    vector<boost::shared_ptr<Snapshot> >* snapshots, Callback callback) {
+  CHECK_NOTNULL(snapshots)->clear();
+  snapshots->reserve(files.size());
+  std::unordered_multimap<string, size_t> indices_by_path;
+  for (size_t i = 0; i < files.size(); ++i) {
+    snapshots->push_back(boost::shared_ptr<Snapshot>(new Snapshot));
+    snapshots->back()->mutable_file()->CopyFrom(files[i]);
+    indices_by_path.insert(make_pair(files[i].path(), i));
+  }
+
+  for (size_t begin = 0; begin < files.size();
+       begin += kLatestSnapshotsBatchSize) {
+    snapshots_select_latest_by_paths_stmt_->Reset();
+    // The statement always takes a full batch of paths, so the last batch
+    // is padded by repeating its last path.
+    for (size_t i = 0; i < kLatestSnapshotsBatchSize; ++i) {
+      const size_t index = std::min(begin + i, files.size() - 1);
+      snapshots_select_latest_by_paths_stmt_->BindText(
+          ":path_" + std::to_string(i), files[index].path());
+    }
+
+    while (snapshots_select_latest_by_paths_stmt_->StepUntilNotBusy() ==
+           SQLITE_ROW) {
+      const auto range = indices_by_path.equal_range(
+          snapshots_select_latest_by_paths_stmt_->GetColumnText(
+              "files_path"));
+      for (auto it = range.first; it != range.second; ++it) {
+        Snapshot* snapshot = (*snapshots)[it->second].get();
+        SET_IF_PRESENT(*snapshots_select_latest_by_paths_stmt_, Int64,
+                       snapshot->mutable_file(), files, id);
+        if (!snapshots_select_latest_by_paths_stmt_->IsColumnNull(
+                "snapshots_id")) {
+          ReadSnapshotRow(snapshots_select_latest_by_paths_stmt_.get(),
+                          snapshot);
+        }
+      }
+    }
+  }
+
+  callback();
+}
+
+void MetadataDbImpl::GetLatestSnapshotWithFileIdentity(
+    const FileIdentity& file_identity,
+    boost::shared_ptr<Snapshot>* snapshot, Callback callback) {
+  CHECK_NOTNULL(snapshot)->reset();
+
+  snapshots_select_by_file_identity_stmt_->Reset();
+  snapshots_select_by_file_identity_stmt_->BindInt64(
+      ":device", file_identity.device());
+  snapshots_select_by_file_identity_stmt_->BindInt64(
+      ":inode", file_identity.inode());
+  snapshots_select_by_file_identity_stmt_->BindInt64(
+      ":length", file_identity.length());
+  snapshots_select_by_file_identity_stmt_->BindInt64(
+      ":modification_time_ns", file_identity.modification_time_ns());
+
+  if (snapshots_select_by_file_identity_stmt_->StepUntilNotBusy() !=
+      SQLITE_ROW) {
+    callback();
+    return;
+  }
+
+  snapshot->reset(new Snapshot);
+  SET_IF_PRESENT(*snapshots_select_by_file_identity_stmt_, Int64, *snapshot,
+                 snapshots, id);
+  (*snapshot)->mutable_file()->set_id(
+      snapshots_select_by_file_identity_stmt_->GetColumnInt64(
+          "snapshots_file_id"));
+  SET_IF_PRESENT(*snapshots_select_by_file_identity_stmt_, Bool, *snapshot,
+                 snapshots, is_regular);
+  SET_IF_PRESENT(*snapshots_select_by_file_identity_stmt_, Blob, *snapshot,
+                 snapshots, sha1_digest);
+  SET_IF_PRESENT(*snapshots_select_by_file_identity_stmt_, Int64, *snapshot,
+                 snapshots, length);
+  SET_IF_PRESENT(*snapshots_select_by_file_identity_stmt_, Int64, *snapshot,
+                 snapshots, observation_time);
+  SET_IF_PRESENT(*snapshots_select_by_file_identity_stmt_, Int64, *snapshot,
+                 snapshots, sha1_digest_range_size);
+
+  FileIdentity* hashed_file_identity =
+      (*snapshot)->mutable_hashed_file_identity();
+  SET_IF_PRESENT(*snapshots_select_by_file_identity_stmt_, Int64,
+                 hashed_file_identity, local_snapshot_file_identities, device);
+  SET_IF_PRESENT(*snapshots_select_by_file_identity_stmt_, Int64,
+                 hashed_file_identity, local_snapshot_file_identities, inode);
+  SET_IF_PRESENT(*snapshots_select_by_file_identity_stmt_, Int64,
+                 hashed_file_identity, local_snapshot_file_identities, length);
+  SET_IF_PRESENT(*snapshots_select_by_file_identity_stmt_, Int64,
+                 hashed_file_identity, local_snapshot_file_identities,
+                 modification_time_ns);
+
+  snapshot_chunks_select_stmt_->Reset();
+  snapshot_chunks_select_stmt_->BindInt64(":snapshot_id", (*snapshot)->id());
+
+  while (snapshot_chunks_select_stmt_->StepUntilNotBusy() == SQLITE_ROW) {
+    Chunk* chunk = (*snapshot)->add_chunks();
+    SET_IF_PRESENT(*snapshot_chunks_select_stmt_, Int64, chunk,
+                   files_to_blocks, id);
+    SET_IF_PRESENT(*snapshot_chunks_select_stmt_, Int64, chunk,
+                   files_to_blocks, offset);
+    SET_IF_PRESENT(*snapshot_chunks_select_stmt_, Int64, chunk,
+                   files_to_blocks, observation_time);
+
+    Block* block = chunk->mutable_block();
+    SET_IF_PRESENT(*snapshot_chunks_select_stmt_, Int64, block, blocks, id);
+    SET_IF_PRESENT(*snapshot_chunks_select_stmt_, Blob, block, blocks,
+                   sha1_digest);
+    SET_IF_PRESENT(*snapshot_chunks_select_stmt_, Int64, block, blocks,
                    length);
-    SET_IF_PRESENT(*snapshots_select_latest_stmt_, Int64, *snapshot,
-                   snapshots, observation_time);
+    SET_IF_PRESENT(*snapshot_chunks_select_stmt_, Bool, block, blocks,
+                   is_hole);
   }
 
   callback();
@@ -167,8 +447,12 @@ void MetadataDbImpl::RecordNewSnapshot(
 
   WriteNewSnapshot(snapshot);
 
+  WriteLatestSnapshot(snapshot);
+
   UpdateLatestChunksCache(previous_snapshot_id, snapshot);
 
+  WriteNewFileIdentity(snapshot);
+
   sqlite3_exec(db(), "commit;", nullptr, nullptr, nullptr);
 
   callback();
@@ -189,9 +473,9 @@ void MetadataDbImpl::GetLatestBundleForBlock(
 
     SET_IF_PRESENT(*bundles_select_latest_by_block_id_stmt_, Int64,
                    *bundle_annotations, local_bundles, id);
-    SET_IF_PRESENT(*bundles_select_latest_by_block_id_stmt_, Text,
+    SET_IF_PRESENT(*bundles_select_latest_by_block_id_stmt_, Blob,
                    *bundle_annotations, local_bundles, sha256_linear_digest);
-    SET_IF_PRESENT(*bundles_select_latest_by_block_id_stmt_, Text,
+    SET_IF_PRESENT(*bundles_select_latest_by_block_id_stmt_, Blob,
                    *bundle_annotations, local_bundles, sha256_tree_digest);
     SET_IF_PRESENT(*bundles_select_latest_by_block_id_stmt_, Text,
                    *bundle_annotations, local_bundles_to_servers,
@@ -254,6 +538,124 @@ void MetadataDbImpl::RecordUploadedBundle(
   callback();
 }
 
+void MetadataDbImpl::GetDirectoryFingerprints(
+    const string& root, vector<DirectoryFingerprint>* fingerprints,
+    Callback callback) {
+  CHECK_NOTNULL(fingerprints);
+
+  // Paths below the root sort between the root followed by '/' and the
+  // root followed by '0', the character after '/'.
+  const string root_prefix =
+      (!root.empty() && root.back() == '/') ? root : root + "/";
+  string root_end = root_prefix;
+  root_end.back() = '0';
+
+  directories_select_stmt_->Reset();
+  directories_select_stmt_->BindText(
+      ":root", root_prefix.substr(0, root_prefix.size() - 1));
+  directories_select_stmt_->BindText(":root_prefix", root_prefix);
+  directories_select_stmt_->BindText(":root_end", root_end);
+
+  while (directories_select_stmt_->StepUntilNotBusy() == SQLITE_ROW) {
+    fingerprints->push_back(DirectoryFingerprint());
+    DirectoryFingerprint* fingerprint = &fingerprints->back();
+    SET_IF_PRESENT(*directories_select_stmt_, Text, fingerprint,
+                   local_directories, path);
+    SET_IF_PRESENT(*directories_select_stmt_, Int64, fingerprint,
+                   local_directories, device);
+    SET_IF_PRESENT(*directories_select_stmt_, Int64, fingerprint,
+                   local_directories, inode);
+    SET_IF_PRESENT(*directories_select_stmt_, Int64, fingerprint,
+                   local_directories, modification_time_ns);
+    SET_IF_PRESENT(*directories_select_stmt_, Int64, fingerprint,
+                   local_directories, change_time_ns);
+    SET_IF_PRESENT(*directories_select_stmt_, Int64, fingerprint,
+                   local_directories, num_entries);
+    SET_IF_PRESENT(*directories_select_stmt_, Int64, fingerprint,
+                   local_directories, verification_time);
+    SET_IF_PRESENT(*directories_select_stmt_, Int64, fingerprint,
+                   local_directories, path_filter_hash);
+
+    std::istringstream subdirectory_names(
+        directories_select_stmt_->GetColumnText(
+            "local_directories_subdirectory_names"));
+    string subdirectory_name;
+    while (std::getline(subdirectory_names, subdirectory_name, '/')) {
+      fingerprint->add_subdirectory_names(subdirectory_name);
+    }
+  }
+
+  callback();
+}
+
+void MetadataDbImpl::RecordDirectoryFingerprints(
+    boost::shared_ptr<const vector<DirectoryFingerprint> > fingerprints,
+    Callback callback) {
+  sqlite3_exec(db(), "begin transaction;",
+               nullptr, nullptr, nullptr);
+
+  for (const DirectoryFingerprint& fingerprint : *fingerprints) {
+    string subdirectory_names;
+    for (const string& subdirectory_name : fingerprint.subdirectory_names()) {
+      if (!subdirectory_names.empty()) {
+        subdirectory_names += '/';
+      }
+      subdirectory_names += subdirectory_name;
+    }
+
+    directories_insert_stmt_->Reset();
+    directories_insert_stmt_->BindText(":path", fingerprint.path());
+    directories_insert_stmt_->BindInt64(":device", fingerprint.device());
+    directories_insert_stmt_->BindInt64(":inode", fingerprint.inode());
+    directories_insert_stmt_->BindInt64(
+        ":modification_time_ns", fingerprint.modification_time_ns());
+    directories_insert_stmt_->BindInt64(
+        ":change_time_ns", fingerprint.change_time_ns());
+    directories_insert_stmt_->BindInt64(
+        ":num_entries", fingerprint.num_entries());
+    directories_insert_stmt_->BindText(
+        ":subdirectory_names", subdirectory_names);
+    directories_insert_stmt_->BindInt64(
+        ":verification_time", fingerprint.verification_time());
+    directories_insert_stmt_->BindInt64(
+        ":path_filter_hash", fingerprint.path_filter_hash());
+
+    if (directories_insert_stmt_->StepUntilNotBusy() != SQLITE_DONE) {
+      std::cerr << sqlite3_errmsg(db()) << std::endl;
+      std::cerr << fingerprint.DebugString() << std::endl;
+    }
+  }
+
+  sqlite3_exec(db(), "commit;", nullptr, nullptr, nullptr);
+
+  callback();
+}
+
+void MetadataDbImpl::ReadSnapshotRow(
+    ScopedStatement* statement, Snapshot* snapshot) const {
+  SET_IF_PRESENT(*statement, Int64, snapshot, snapshots, id);
+
+  Attributes* attributes = snapshot->mutable_attributes();
+  SET_IF_PRESENT(*statement, Int64, attributes, attributes, id);
+  SET_IF_PRESENT(*statement, Text, attributes, attributes, owner_user);
+  SET_IF_PRESENT(*statement, Text, attributes, attributes, owner_group);
+  SET_IF_PRESENT(*statement, Int64, attributes, attributes, uid);
+  SET_IF_PRESENT(*statement, Int64, attributes, attributes, gid);
+  SET_IF_PRESENT(*statement, Int64, attributes, attributes, mode);
+
+  SET_IF_PRESENT(*statement, Int64, snapshot, snapshots, creation_time);
+  SET_IF_PRESENT(*statement, Int64, snapshot, snapshots, modification_time);
+  SET_IF_PRESENT(*statement, Int64, snapshot, snapshots, access_time);
+  // TODO: Extra attributes
+  SET_IF_PRESENT(*statement, Bool, snapshot, snapshots, is_regular);
+  SET_IF_PRESENT(*statement, Bool, snapshot, snapshots, is_deleted);
+  SET_IF_PRESENT(*statement, Blob, snapshot, snapshots, sha1_digest);
+  SET_IF_PRESENT(*statement, Int64, snapshot, snapshots, length);
+  SET_IF_PRESENT(*statement, Int64, snapshot, snapshots, observation_time);
+  SET_IF_PRESENT(*statement, Int64, snapshot, snapshots,
+                 sha1_digest_range_size);
+}
+
 void MetadataDbImpl::PrepareStatements() {
   snapshots_select_latest_stmt_->Prepare(
       "select snapshots.id as snapshots_id, "
@@ -265,28 +667,123 @@ void MetadataDbImpl::PrepareStatements() {
       "       snapshots.sha1_digest as snapshots_sha1_digest, "
       "       snapshots.length as snapshots_length, "
       "       snapshots.observation_time as snapshots_observation_time, "
+      "       snapshots.sha1_digest_range_size as "
+      "         snapshots_sha1_digest_range_size, "
       "       attributes.id as attributes_id, "
       "       attributes.owner_user as attributes_owner_user, "
       "       attributes.owner_group as attributes_owner_group,"
       "       attributes.uid as attributes_uid, "
       "       attributes.gid as attributes_gid, "
       "       attributes.mode as attributes_mode "
-      "from snapshots join attributes on "
-      "  snapshots.attributes_id = attributes.id "
-      "where snapshots.file_id = :file_id "
-    "order by snapshots.observation_time desc limit 1;");
+      "from local_latest_snapshots "
+      "  join snapshots on "
+      "    local_latest_snapshots.snapshot_id = snapshots.id "
+      "  join attributes on snapshots.attributes_id = attributes.id "
+      "where local_latest_snapshots.file_id = :file_id;");
 
   snapshots_select_latest_id_stmt_->Prepare(
-      "select id from snapshots where file_id = :file_id "
-      "order by observation_time desc limit 1;");
+      "select snapshot_id as id from local_latest_snapshots "
+      "where file_id = :file_id;");
+
+  string path_params;
+  for (size_t i = 0; i < kLatestSnapshotsBatchSize; ++i) {
+    path_params += (i == 0 ? ":path_" : ", :path_") + std::to_string(i);
+  }
+  snapshots_select_latest_by_paths_stmt_->Prepare(
+      "select files.id as files_id, "
+      "       files.path as files_path, "
+      "       snapshots.id as snapshots_id, "
+      "       snapshots.creation_time as snapshots_creation_time, "
+      "       snapshots.modification_time as snapshots_modification_time, "
+      "       snapshots.access_time as snapshots_access_time, "
+      "       snapshots.is_regular as snapshots_is_regular, "
+      "       snapshots.is_deleted as snapshots_is_deleted, "
+      "       snapshots.sha1_digest as snapshots_sha1_digest, "
+      "       snapshots.length as snapshots_length, "
+      "       snapshots.observation_time as snapshots_observation_time, "
+      "       snapshots.sha1_digest_range_size as "
+      "         snapshots_sha1_digest_range_size, "
+      "       attributes.id as attributes_id, "
+      "       attributes.owner_user as attributes_owner_user, "
+      "       attributes.owner_group as attributes_owner_group,"
+      "       attributes.uid as attributes_uid, "
+      "       attributes.gid as attributes_gid, "
+      "       attributes.mode as attributes_mode "
+      "from files "
+      "  left join local_latest_snapshots on "
+      "    local_latest_snapshots.file_id = files.id "
+      "  left join snapshots on "
+      "    local_latest_snapshots.snapshot_id = snapshots.id "
+      "  left join attributes on snapshots.attributes_id = attributes.id "
+      "where files.path in (" + path_params + ");");
 
   snapshots_insert_stmt_->Prepare(
       "insert into snapshots ('file_id', 'attributes_id', 'creation_time', "
       "'modification_time', 'access_time', 'is_regular', 'is_deleted', "
-      "'sha1_digest', 'length', 'observation_time') "
+      "'sha1_digest', 'length', 'observation_time', "
+      "'sha1_digest_range_size') "
       "values (:file_id, :attributes_id, :creation_time, "
       ":modification_time, :access_time, :is_regular, :is_deleted, "
-      ":sha1_digest, :length, :observation_time);");
+      ":sha1_digest, :length, :observation_time, :sha1_digest_range_size);");
+
+  latest_snapshots_insert_stmt_->Prepare(
+      "insert or replace into local_latest_snapshots "
+      "('file_id', 'snapshot_id') values (:file_id, :snapshot_id);");
+
+  snapshots_select_by_file_identity_stmt_->Prepare(
+      "select snapshots.id as snapshots_id, "
+      "       snapshots.file_id as snapshots_file_id, "
+      "       snapshots.is_regular as snapshots_is_regular, "
+      "       snapshots.sha1_digest as snapshots_sha1_digest, "
+      "       snapshots.length as snapshots_length, "
+      "       snapshots.observation_time as snapshots_observation_time, "
+      "       snapshots.sha1_digest_range_size as "
+      "         snapshots_sha1_digest_range_size, "
+      "       local_snapshot_file_identities.device as "
+      "         local_snapshot_file_identities_device, "
+      "       local_snapshot_file_identities.inode as "
+      "         local_snapshot_file_identities_inode, "
+      "       local_snapshot_file_identities.length as "
+      "         local_snapshot_file_identities_length, "
+      "       local_snapshot_file_identities.modification_time_ns as "
+      "         local_snapshot_file_identities_modification_time_ns "
+      "from local_snapshot_file_identities join snapshots on "
+      "  local_snapshot_file_identities.snapshot_id = snapshots.id "
+      "where local_snapshot_file_identities.device = :device and "
+      "  local_snapshot_file_identities.inode = :inode and "
+      "  local_snapshot_file_identities.length = :length and "
+      "  local_snapshot_file_identities.modification_time_ns = "
+      "    :modification_time_ns "
+      "order by snapshots.observation_time desc, snapshots.id desc "
+      "limit 1;");
+
+  snapshot_chunks_select_stmt_->Prepare(
+      "select files_to_blocks.id as files_to_blocks_id, "
+      "       files_to_blocks.offset as files_to_blocks_offset, "
+      "       files_to_blocks.observation_time as "
+      "         files_to_blocks_observation_time, "
+      "       blocks.id as blocks_id, "
+      "       blocks.sha1_digest as blocks_sha1_digest, "
+      "       blocks.length as blocks_length, "
+      "       blocks.is_hole as blocks_is_hole "
+      "from local_snapshots_to_files_to_blocks "
+      "  join files_to_blocks on "
+      "    local_snapshots_to_files_to_blocks.files_to_blocks_id = "
+      "      files_to_blocks.id "
+      "  join blocks on files_to_blocks.block_id = blocks.id "
+      "where local_snapshots_to_files_to_blocks.snapshot_id = :snapshot_id "
+      "order by files_to_blocks.offset;");
+
+  file_identities_insert_stmt_->Prepare(
+      "insert or replace into local_snapshot_file_identities "
+      "('snapshot_id', 'device', 'inode', 'length', "
+      "'modification_time_ns') "
+      "values (:snapshot_id, :device, :inode, :length, "
+      ":modification_time_ns);");
+
+  file_identities_delete_stmt_->Prepare(
+      "delete from local_snapshot_file_identities "
+      "where snapshot_id = :snapshot_id;");
 
   files_select_id_stmt_->Prepare(
       "select files.id as files_id from files where path = :path;");
@@ -307,11 +804,11 @@ void MetadataDbImpl::PrepareStatements() {
 
   blocks_select_id_stmt_->Prepare(
       "select id from blocks where sha1_digest = :sha1_digest and "
-      "length = :length;");
+      "length = :length and is_hole = :is_hole;");
 
   blocks_insert_stmt_->Prepare(
-      "insert into blocks ('sha1_digest', 'length') "
-      "values (:sha1_digest, :length);");
+      "insert into blocks ('sha1_digest', 'length', 'is_hole') "
+      "values (:sha1_digest, :length, :is_hole);");
 
   bundles_select_latest_by_block_id_stmt_->Prepare(
       "select local_bundles.id as local_bundles_id, "
@@ -379,6 +876,30 @@ void MetadataDbImpl::PrepareStatements() {
       "values (:bundle_id, :server_id, :server_bundle_id, :status, "
       ":status_timestamp);");
 
+  directories_select_stmt_->Prepare(
+      "select path as local_directories_path, "
+      "       device as local_directories_device, "
+      "       inode as local_directories_inode, "
+      "       modification_time_ns as "
+      "         local_directories_modification_time_ns, "
+      "       change_time_ns as local_directories_change_time_ns, "
+      "       num_entries as local_directories_num_entries, "
+      "       subdirectory_names as local_directories_subdirectory_names, "
+      "       verification_time as local_directories_verification_time, "
+      "       path_filter_hash as local_directories_path_filter_hash "
+      "from local_directories "
+      "where path = :root or "
+      "  (path >= :root_prefix and path < :root_end);");
+
+  directories_insert_stmt_->Prepare(
+      "insert or replace into local_directories "
+      "('path', 'device', 'inode', 'modification_time_ns', "
+      "'change_time_ns', 'num_entries', 'subdirectory_names', "
+      "'verification_time', 'path_filter_hash') "
+      "values (:path, :device, :inode, :modification_time_ns, "
+      ":change_time_ns, :num_entries, :subdirectory_names, "
+      ":verification_time, :path_filter_hash);");
+
   // This sets the SQLite Database to use Write-Ahead Logging, but to only
   // periodically force-flush the journal to disk. This ensures that the
   // metadata DB will never become corrupted, but in the case of a crash or
@@ -471,9 +992,20 @@ void MetadataDbImpl::FindExistingBlockIds(
       continue;
     }
 
+    if (IsBlockIndexed(*block)) {
+      int64_t block_id;
+      boost::mutex::scoped_lock lock(block_id_index_mu_);
+      if (block_id_index_->Find(
+              block->sha1_digest(), block->length(), &block_id)) {
+        block->set_id(block_id);
+      }
+      continue;
+    }
+
     blocks_select_id_stmt_->Reset();
-    blocks_select_id_stmt_->BindText(":sha1_digest", block->sha1_digest());
+    blocks_select_id_stmt_->BindBlob(":sha1_digest", block->sha1_digest());
     blocks_select_id_stmt_->BindInt64(":length", block->length());
+    blocks_select_id_stmt_->BindBool(":is_hole", block->is_hole());
 
     if (blocks_select_id_stmt_->StepUntilNotBusy() == SQLITE_ROW) {
       block->set_id(blocks_select_id_stmt_->GetColumnInt64("id"));
@@ -539,10 +1071,12 @@ void MetadataDbImpl::WriteNewSnapshot(
   BIND_IF_PRESENT(*snapshots_insert_stmt_, Int64, snapshot, access_time);
   snapshots_insert_stmt_->BindBool(":is_regular", snapshot->is_regular());
   snapshots_insert_stmt_->BindBool(":is_deleted", snapshot->is_deleted());
-  snapshots_insert_stmt_->BindText(":sha1_digest", snapshot->sha1_digest());
+  snapshots_insert_stmt_->BindBlob(":sha1_digest", snapshot->sha1_digest());
   snapshots_insert_stmt_->BindInt64(":length", snapshot->length());
   snapshots_insert_stmt_->BindInt64(":observation_time",
                                    snapshot->observation_time());
+  snapshots_insert_stmt_->BindInt64(":sha1_digest_range_size",
+                                   snapshot->sha1_digest_range_size());
 
   int code = snapshots_insert_stmt_->StepUntilNotBusy();
 
@@ -554,6 +1088,21 @@ void MetadataDbImpl::WriteNewSnapshot(
   }
 }
 
+void MetadataDbImpl::WriteLatestSnapshot(
+    boost::shared_ptr<Snapshot> snapshot) const {
+  if (!snapshot->has_id()) {
+    return;
+  }
+
+  latest_snapshots_insert_stmt_->Reset();
+  latest_snapshots_insert_stmt_->BindInt64(":file_id", snapshot->file().id());
+  latest_snapshots_insert_stmt_->BindInt64(":snapshot_id", snapshot->id());
+
+  if (latest_snapshots_insert_stmt_->StepUntilNotBusy() != SQLITE_DONE) {
+    std::cerr << sqlite3_errmsg(db()) << std::endl;
+  }
+}
+
 void MetadataDbImpl::WriteNewFile(File* file) const {
   assert(file != nullptr);
   assert(!file->has_id());
@@ -604,13 +1153,19 @@ void MetadataDbImpl::WriteNewBlocks(
     }
 
     blocks_insert_stmt_->Reset();
-    blocks_insert_stmt_->BindText(":sha1_digest", block->sha1_digest());
+    blocks_insert_stmt_->BindBlob(":sha1_digest", block->sha1_digest());
     blocks_insert_stmt_->BindInt64(":length", block->length());
+    blocks_insert_stmt_->BindBool(":is_hole", block->is_hole());
 
     int code = blocks_insert_stmt_->StepUntilNotBusy();
 
     if (code == SQLITE_DONE) {
       block->set_id(sqlite3_last_insert_rowid(db()));
+      if (IsBlockIndexed(*block)) {
+        boost::mutex::scoped_lock lock(block_id_index_mu_);
+        block_id_index_->Insert(
+            block->sha1_digest(), block->length(), block->id());
+      }
     } else {
       std::cerr << sqlite3_errmsg(db()) << std::endl;
       std::cerr << block->DebugString() << std::endl;
@@ -647,6 +1202,27 @@ void MetadataDbImpl::WriteNewChunks(
   }
 }
 
+void MetadataDbImpl::WriteNewFileIdentity(
+    boost::shared_ptr<Snapshot> snapshot) const {
+  if (!snapshot->has_hashed_file_identity() || !snapshot->has_id()) {
+    return;
+  }
+
+  const FileIdentity& file_identity = snapshot->hashed_file_identity();
+  file_identities_insert_stmt_->Reset();
+  file_identities_insert_stmt_->BindInt64(":snapshot_id", snapshot->id());
+  file_identities_insert_stmt_->BindInt64(":device", file_identity.device());
+  file_identities_insert_stmt_->BindInt64(":inode", file_identity.inode());
+  file_identities_insert_stmt_->BindInt64(":length", file_identity.length());
+  file_identities_insert_stmt_->BindInt64(
+      ":modification_time_ns", file_identity.modification_time_ns());
+
+  if (file_identities_insert_stmt_->StepUntilNotBusy() != SQLITE_DONE) {
+    std::cerr << sqlite3_errmsg(db()) << std::endl;
+    std::cerr << file_identity.DebugString() << std::endl;
+  }
+}
+
 void MetadataDbImpl::UpdateLatestChunksCache(
     int64_t previous_snapshot_id,
     boost::shared_ptr<Snapshot> snapshot) const {
@@ -655,6 +1231,13 @@ void MetadataDbImpl::UpdateLatestChunksCache(
     snapshots_to_files_to_blocks_mapping_delete_stmt_->BindInt64(
         ":snapshot_id", previous_snapshot_id);
     snapshots_to_files_to_blocks_mapping_delete_stmt_->StepUntilNotBusy();
+
+    // The previous snapshot's chunks can no longer be looked up, so
+    // neither can its file identity.
+    file_identities_delete_stmt_->Reset();
+    file_identities_delete_stmt_->BindInt64(
+        ":snapshot_id", previous_snapshot_id);
+    file_identities_delete_stmt_->StepUntilNotBusy();
   }
 
   for (const Chunk& chunk : *(snapshot->mutable_chunks())) {
@@ -678,9 +1261,9 @@ void MetadataDbImpl::WriteNewBundle(
 
   bundles_insert_stmt_->Reset();
 
-  bundles_insert_stmt_->BindText(
+  bundles_insert_stmt_->BindBlob(
       ":sha256_linear_digest", bundle->annotations().sha256_linear_digest());
-  bundles_insert_stmt_->BindText(
+  bundles_insert_stmt_->BindBlob(
       ":sha256_tree_digest", bundle->annotations().sha256_tree_digest());
   bundles_insert_stmt_->BindInt64(
       ":length", bundle->file_contents_size());
@@ -714,6 +1297,12 @@ void MetadataDbImpl::WriteNewBlockToBundleMappings(
   }
 }
 
+// static
+bool MetadataDbImpl::Init() {
+  db();
+  return is_migrated_;
+}
+
 // static
 sqlite3* MetadataDbImpl::db() {
   static once_flag once = BOOST_ONCE_INIT;
@@ -728,6 +1317,80 @@ void MetadataDbImpl::InitDb() {
       options::metadata_db_path.c_str(), &db_,
       SQLITE_OPEN_READWRITE | SQLITE_OPEN_FULLMUTEX, nullptr);
   assert(code == SQLITE_OK);
+
+  is_migrated_ = MigrateDb();
+  if (is_migrated_) {
+    LoadBlockIdIndex();
+  }
+}
+
+// static
+bool MetadataDbImpl::MigrateDb() {
+  int version = 0;
+  {
+    ScopedStatement version_stmt(db_);
+    version_stmt.Prepare("pragma user_version;");
+    if (version_stmt.StepUntilNotBusy() == SQLITE_ROW) {
+      version = version_stmt.GetColumnInt("user_version");
+    }
+  }
+  if (version >= kSchemaVersion) {
+    return true;
+  }
+
+  // Unversioned databases were created from any of several revisions of
+  // the schema, so each step of the migration is idempotent, and columns
+  // are only added where they are missing.
+  string error;
+  sqlite3_exec(db_, "begin transaction;", nullptr, nullptr, nullptr);
+  if (!ExecuteStatements(
+          db_, kMigrateToVersion1 + GetAddMissingColumnsStatements(db_),
+          &error) ||
+      !ConvertHexDigests(db_, &error) ||
+      !ExecuteStatements(
+          db_, "pragma user_version = " + std::to_string(kSchemaVersion) +
+              "; commit;",
+          &error)) {
+    std::cerr << "ERROR: Could not migrate the metadata DB at '"
+              << options::metadata_db_path << "' from version " << version
+              << ": " << error << std::endl;
+    sqlite3_exec(db_, "rollback;", nullptr, nullptr, nullptr);
+    return false;
+  }
+  return true;
+}
+
+// static
+void MetadataDbImpl::LoadBlockIdIndex() {
+  if (!options::index_block_ids_in_memory) {
+    return;
+  }
+
+  block_id_index_ = new BlockIdIndex;
+  ScopedStatement count_stmt(db_);
+  count_stmt.Prepare(
+      "select count(*) as num_blocks from blocks where is_hole = 0;");
+  if (count_stmt.StepUntilNotBusy() == SQLITE_ROW) {
+    block_id_index_->Reserve(count_stmt.GetColumnInt64("num_blocks"));
+  }
+
+  ScopedStatement blocks_stmt(db_);
+  blocks_stmt.Prepare(
+      "select id, sha1_digest, length from blocks where is_hole = 0;");
+  while (blocks_stmt.StepUntilNotBusy() == SQLITE_ROW) {
+    const string sha1_digest = blocks_stmt.GetColumnBlob("sha1_digest");
+    const int64_t length = blocks_stmt.GetColumnInt64("length");
+    if (BlockIdIndex::CanIndex(sha1_digest, length)) {
+      block_id_index_->Insert(
+          sha1_digest, length, blocks_stmt.GetColumnInt64("id"));
+    }
+  }
+}
+
+// static
+bool MetadataDbImpl::IsBlockIndexed(const Block& block) {
+  return block_id_index_ != nullptr && !block.is_hole() &&
+      BlockIdIndex::CanIndex(block.sha1_digest(), block.length());
 }
 
 }  // polar_express
@@ -3,8 +3,10 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include "base/callback.h"
 #include "base/macros.h"
@@ -16,6 +18,8 @@ namespace polar_express {
 
 class AnnotatedBundleData;
 class Attributes;
+class Block;
+class BlockIdIndex;
 class Chunk;
 class File;
 class ScopedStatement;
@@ -26,10 +30,23 @@ class MetadataDbImpl : public MetadataDb {
   MetadataDbImpl();
   virtual ~MetadataDbImpl();
 
+  // Opens the metadata DB, if it is not already open, bringing its schema
+  // up to date. Returns false, after printing an error, if it could not be
+  // migrated, in which case it must not be used.
+  static bool Init();
+
   virtual void GetLatestSnapshot(
       const File& file, boost::shared_ptr<Snapshot>* snapshot,
       Callback callback);
 
+  virtual void GetLatestSnapshots(
+      const vector<File>& files,
+      vector<boost::shared_ptr<Snapshot> >* snapshots, Callback callback);
+
+  virtual void GetLatestSnapshotWithFileIdentity(
+      const FileIdentity& file_identity,
+      boost::shared_ptr<Snapshot>* snapshot, Callback callback);
+
   virtual void RecordNewSnapshot(
       boost::shared_ptr<Snapshot> snapshot, Callback callback);
 
@@ -45,9 +62,21 @@ class MetadataDbImpl : public MetadataDb {
       int server_id, boost::shared_ptr<AnnotatedBundleData> bundle,
       Callback callback);
 
+  virtual void GetDirectoryFingerprints(
+      const string& root, vector<DirectoryFingerprint>* fingerprints,
+      Callback callback);
+
+  virtual void RecordDirectoryFingerprints(
+      boost::shared_ptr<const vector<DirectoryFingerprint> > fingerprints,
+      Callback callback);
+
  private:
   void PrepareStatements();
 
+  // Sets the fields of snapshot (other than its file) from the snapshots
+  // and attributes columns of the current row of statement.
+  void ReadSnapshotRow(ScopedStatement* statement, Snapshot* snapshot) const;
+
   // TODO(tylermchenry): Might be useful for this to be public later.
   int64_t GetLatestSnapshotId(const File& file) const;
 
@@ -62,10 +91,12 @@ class MetadataDbImpl : public MetadataDb {
       boost::shared_ptr<Snapshot> snapshot) const;
 
   void WriteNewSnapshot(boost::shared_ptr<Snapshot> snapshot) const;
+  void WriteLatestSnapshot(boost::shared_ptr<Snapshot> snapshot) const;
   void WriteNewFile(File* file) const;
   void WriteNewAttributes(Attributes* attributes) const;
   void WriteNewBlocks(boost::shared_ptr<Snapshot> snapshot) const;
   void WriteNewChunks(boost::shared_ptr<Snapshot> snapshot) const;
+  void WriteNewFileIdentity(boost::shared_ptr<Snapshot> snapshot) const;
 
   void UpdateLatestChunksCache(
       int64_t previous_snapshot_id,
@@ -78,7 +109,13 @@ class MetadataDbImpl : public MetadataDb {
   // Prepared statements
   std::unique_ptr<ScopedStatement> snapshots_select_latest_stmt_;
   std::unique_ptr<ScopedStatement> snapshots_select_latest_id_stmt_;
+  std::unique_ptr<ScopedStatement> snapshots_select_latest_by_paths_stmt_;
   std::unique_ptr<ScopedStatement> snapshots_insert_stmt_;
+  std::unique_ptr<ScopedStatement> latest_snapshots_insert_stmt_;
+  std::unique_ptr<ScopedStatement> snapshots_select_by_file_identity_stmt_;
+  std::unique_ptr<ScopedStatement> snapshot_chunks_select_stmt_;
+  std::unique_ptr<ScopedStatement> file_identities_insert_stmt_;
+  std::unique_ptr<ScopedStatement> file_identities_delete_stmt_;
   std::unique_ptr<ScopedStatement> files_select_id_stmt_;
   std::unique_ptr<ScopedStatement> files_insert_stmt_;
   std::unique_ptr<ScopedStatement> attributes_select_id_stmt_;
@@ -95,12 +132,31 @@ class MetadataDbImpl : public MetadataDb {
       snapshots_to_files_to_blocks_mapping_delete_stmt_;
   std::unique_ptr<ScopedStatement> blocks_to_bundles_mapping_insert_stmt_;
   std::unique_ptr<ScopedStatement> bundles_to_servers_mapping_insert_stmt_;
+  std::unique_ptr<ScopedStatement> directories_select_stmt_;
+  std::unique_ptr<ScopedStatement> directories_insert_stmt_;
 
   static sqlite3* db_;
+  static bool is_migrated_;
+
+  // The ids of the blocks in the DB, shared by all instances, or null if
+  // blocks are looked up in the DB instead.
+  static BlockIdIndex* block_id_index_;
+  static boost::mutex block_id_index_mu_;
 
   static sqlite3* db();
   static void InitDb();
 
+  // Brings the schema of a database created from an older version of
+  // metadata-schema.sql up to date, in a single transaction. Returns false,
+  // after printing an error, if it could not.
+  static bool MigrateDb();
+
+  static void LoadBlockIdIndex();
+
+  // Returns whether the id of block is looked up in block_id_index_ rather
+  // than in the DB.
+  static bool IsBlockIndexed(const Block& block);
+
   DISALLOW_COPY_AND_ASSIGN(MetadataDbImpl);
 };
 
@@ -28,6 +28,22 @@ void MetadataDb::GetLatestSnapshot(
            impl_.get(), boost::cref(file), snapshot, callback));
 }
 
+void MetadataDb::GetLatestSnapshots(
+    const vector<File>& files,
+    vector<boost::shared_ptr<Snapshot> >* snapshots, Callback callback) {
+  strand_dispatcher_->Post(
+      bind(&MetadataDb::GetLatestSnapshots,
+           impl_.get(), boost::cref(files), snapshots, callback));
+}
+
+void MetadataDb::GetLatestSnapshotWithFileIdentity(
+    const FileIdentity& file_identity,
+    boost::shared_ptr<Snapshot>* snapshot, Callback callback) {
+  strand_dispatcher_->Post(
+      bind(&MetadataDb::GetLatestSnapshotWithFileIdentity, impl_.get(),
+           boost::cref(file_identity), snapshot, callback));
+}
+
 void MetadataDb::RecordNewSnapshot(
     boost::shared_ptr<Snapshot> snapshot, Callback callback) {
   strand_dispatcher_->Post(
@@ -59,4 +75,20 @@ void MetadataDb::RecordUploadedBundle(
            impl_.get(), server_id, bundle, callback));
 }
 
+void MetadataDb::GetDirectoryFingerprints(
+    const string& root, vector<DirectoryFingerprint>* fingerprints,
+    Callback callback) {
+  strand_dispatcher_->Post(
+      bind(&MetadataDb::GetDirectoryFingerprints,
+           impl_.get(), root, fingerprints, callback));
+}
+
+void MetadataDb::RecordDirectoryFingerprints(
+    boost::shared_ptr<const vector<DirectoryFingerprint> > fingerprints,
+    Callback callback) {
+  strand_dispatcher_->Post(
+      bind(&MetadataDb::RecordDirectoryFingerprints,
+           impl_.get(), fingerprints, callback));
+}
+
 }  // polar_express
@@ -2,6 +2,8 @@
 #define METADATA_DB_H
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include <boost/shared_ptr.hpp>
 
@@ -14,7 +16,9 @@ namespace polar_express {
 class AnnotatedBundleData;
 class Block;
 class BundleAnnotations;
+class DirectoryFingerprint;
 class File;
+class FileIdentity;
 class MetadataDbImpl;
 class Snapshot;
 
@@ -27,6 +31,23 @@ class MetadataDb {
       const File& file, boost::shared_ptr<Snapshot>* snapshot,
       Callback callback);
 
+  // Retrieves the latest snapshot of each of the files, exactly as
+  // GetLatestSnapshot would, setting snapshots to one snapshot per file in
+  // the same order. The files are looked up many at a time rather than one
+  // query each. The files must remain valid until the callback is invoked.
+  virtual void GetLatestSnapshots(
+      const vector<File>& files,
+      vector<boost::shared_ptr<Snapshot> >* snapshots, Callback callback);
+
+  // Retrieves the latest snapshot of any file whose chunks were hashed while
+  // it had the given identity, together with those chunks (including their
+  // blocks), or sets snapshot to null if there is none. A file with the
+  // same identity as one at another path has been renamed or hard-linked
+  // there. The identity must remain valid until the callback is invoked.
+  virtual void GetLatestSnapshotWithFileIdentity(
+      const FileIdentity& file_identity,
+      boost::shared_ptr<Snapshot>* snapshot, Callback callback);
+
   // This also modifies the snapshot to add IDs for the snapshot itself as well
   // as any blocks that do not already have IDs.
   virtual void RecordNewSnapshot(
@@ -52,6 +73,18 @@ class MetadataDb {
       int server_id, boost::shared_ptr<AnnotatedBundleData> bundle,
       Callback callback);
 
+  // Retrieves the fingerprints recorded for root and all directories below
+  // it.
+  virtual void GetDirectoryFingerprints(
+      const string& root, vector<DirectoryFingerprint>* fingerprints,
+      Callback callback);
+
+  // Records the fingerprints, replacing any previously recorded for the
+  // same paths.
+  virtual void RecordDirectoryFingerprints(
+      boost::shared_ptr<const vector<DirectoryFingerprint> > fingerprints,
+      Callback callback);
+
  protected:
   explicit MetadataDb(bool create_impl);
 
@@ -3,6 +3,9 @@
 #include <algorithm>
 #include <iterator>
 
+#include "util/digest.h"
+#include "util/sha-hasher.h"
+
 namespace polar_express {
 
 NullCompressorImpl::NullCompressorImpl() {
@@ -20,13 +23,33 @@ void NullCompressorImpl::InitializeCompression(size_t max_buffer_size) {
 }
 
 void NullCompressorImpl::CompressData(
-    const vector<byte>& data, vector<byte>* compressed_data,
-    Callback callback) {
+    ByteSpan data, vector<byte>* compressed_data, Callback callback) {
   std::copy(data.begin(), data.end(),
             std::back_inserter(*CHECK_NOTNULL(compressed_data)));
   callback();
 }
 
+void NullCompressorImpl::CompressAndValidateData(
+    ByteSpan data, const string& expected_sha1_digest,
+    vector<byte>* compressed_data, bool* is_valid, Callback callback) {
+  const size_t initial_compressed_size = CHECK_NOTNULL(compressed_data)->size();
+
+  Sha1Hasher sha1_hasher;
+  ForEachTile(data, [&](ByteSpan tile) {
+    sha1_hasher.Update(tile);
+    compressed_data->insert(compressed_data->end(), tile.begin(), tile.end());
+  });
+
+  Sha1Digest sha1_digest;
+  sha1_hasher.Final(&sha1_digest);
+  *CHECK_NOTNULL(is_valid) = sha1_digest.EqualsBytes(expected_sha1_digest);
+  if (!*is_valid) {
+    compressed_data->resize(initial_compressed_size);
+  }
+
+  callback();
+}
+
 void NullCompressorImpl::FinalizeCompression(vector<byte>* compressed_data) {
   // No-op.
 }
@@ -3,6 +3,7 @@
 
 #include <vector>
 
+#include "base/byte-span.h"
 #include "base/callback.h"
 #include "base/macros.h"
 #include "proto/bundle-manifest.pb.h"
@@ -22,8 +23,11 @@ class NullCompressorImpl : public Compressor {
   virtual void InitializeCompression(size_t max_buffer_size);
 
   virtual void CompressData(
-      const vector<byte>& data, vector<byte>* compressed_data,
-      Callback callback);
+      ByteSpan data, vector<byte>* compressed_data, Callback callback);
+
+  virtual void CompressAndValidateData(
+      ByteSpan data, const string& expected_sha1_digest,
+      vector<byte>* compressed_data, bool* is_valid, Callback callback);
 
   virtual void FinalizeCompression(vector<byte>* compressed_data);
 
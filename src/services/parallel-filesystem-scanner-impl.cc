@@ -0,0 +1,357 @@
+#include "services/parallel-filesystem-scanner-impl.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include <boost/bind.hpp>
+
+#include "base/options.h"
+#include "services/directory-fingerprints.h"
+#include "services/path-filter.h"
+#include "util/file-stat-util.h"
+
+DEFINE_OPTION(
+    filesystem_scanner_max_buffered_paths, size_t, 100000,
+    "Maximum number of paths that parallel filesystem scanner threads find "
+    "ahead of the backup before they wait for it to catch up.");
+
+namespace polar_express {
+namespace {
+
+// Removes the entries that path_filter excludes, and the subdirectories
+// among them, which are then not read. The subdirectories must be in the
+// same order as their entries in entries, as they are returned by
+// ReadDirectory.
+void RemoveExcludedEntries(
+    const PathFilter* path_filter,
+    vector<pair<boost::filesystem::path, FileStat> >* entries,
+    vector<boost::filesystem::path>* subdirectories) {
+  size_t num_included_entries = 0;
+  size_t subdirectory_index = 0;
+  size_t num_included_subdirectories = 0;
+  for (auto& entry : *entries) {
+    const bool is_subdirectory =
+        subdirectory_index < subdirectories->size() &&
+        entry.first.native() == (*subdirectories)[subdirectory_index].native();
+    const bool is_excluded =
+        path_filter->IsExcluded(entry.first, entry.second);
+    if (is_subdirectory) {
+      if (!is_excluded) {
+        (*subdirectories)[num_included_subdirectories++].swap(
+            (*subdirectories)[subdirectory_index]);
+      }
+      ++subdirectory_index;
+    }
+    if (!is_excluded) {
+      if (&(*entries)[num_included_entries] != &entry) {
+        (*entries)[num_included_entries] = std::move(entry);
+      }
+      ++num_included_entries;
+    }
+  }
+  entries->resize(num_included_entries);
+  subdirectories->resize(num_included_subdirectories);
+}
+
+// Replaces the subdirectories that directory_fingerprints shows to be
+// unchanged (and so need not be read) with the changed directories below
+// them that path_filter (if any) does not exclude, which are also added to
+// entries, as they are not entries of any directory that will be read. The
+// subdirectories must be in the same order as their entries in entries, as
+// they are returned by ReadDirectory.
+//
+// The directories below an unchanged subdirectory are stat'ed here, rather
+// than by other workers, but unless most of them have changed that is far
+// less work than reading them would have been.
+void ReplaceUnchangedSubdirectories(
+    DirectoryFingerprints* directory_fingerprints,
+    const PathFilter* path_filter,
+    vector<pair<boost::filesystem::path, FileStat> >* entries,
+    vector<boost::filesystem::path>* subdirectories) {
+  vector<pair<boost::filesystem::path, FileStat> > changed_directories;
+  size_t entry_index = 0;
+  size_t num_changed_subdirectories = 0;
+  for (size_t i = 0; i < subdirectories->size(); ++i) {
+    boost::filesystem::path* subdirectory = &(*subdirectories)[i];
+    while ((*entries)[entry_index].first.native() !=
+           subdirectory->native()) {
+      ++entry_index;
+    }
+    if (directory_fingerprints->IsUnchanged(
+            *subdirectory, (*entries)[entry_index].second)) {
+      directory_fingerprints->FindChangedDirectoriesBelow(
+          *subdirectory, &changed_directories);
+    } else {
+      if (num_changed_subdirectories != i) {
+        (*subdirectories)[num_changed_subdirectories].swap(*subdirectory);
+      }
+      ++num_changed_subdirectories;
+    }
+  }
+  subdirectories->resize(num_changed_subdirectories);
+
+  for (auto& changed_directory : changed_directories) {
+    // The directories between them and this one were never checked.
+    if (path_filter != nullptr &&
+        path_filter->IsExcludedOrBelowExcluded(
+            changed_directory.first, changed_directory.second)) {
+      continue;
+    }
+    subdirectories->push_back(changed_directory.first);
+    entries->push_back(std::move(changed_directory));
+  }
+}
+
+}  // namespace
+
+ParallelFilesystemScannerImpl::ParallelFilesystemScannerImpl(int num_workers)
+  : FilesystemScanner(false),
+    num_workers_(std::max(num_workers, 1)),
+    directory_fingerprints_(nullptr),
+    path_filter_(nullptr),
+    num_pending_directories_(0),
+    num_idle_workers_(0),
+    stop_requested_(false),
+    max_found_paths_(0) {
+  for (size_t i = 0; i < num_workers_; ++i) {
+    workers_.push_back(unique_ptr<Worker>(new Worker));
+  }
+}
+
+ParallelFilesystemScannerImpl::~ParallelFilesystemScannerImpl() {
+  StopWorkers();
+}
+
+void ParallelFilesystemScannerImpl::SetDirectoryFingerprints(
+    DirectoryFingerprints* directory_fingerprints) {
+  directory_fingerprints_ = directory_fingerprints;
+}
+
+void ParallelFilesystemScannerImpl::SetPathFilter(
+    const PathFilter* path_filter) {
+  path_filter_ = path_filter;
+}
+
+void ParallelFilesystemScannerImpl::StartScan(
+    const string& root, int max_paths, Callback callback) {
+  StopWorkers();
+  ClearPaths();
+  {
+    boost::mutex::scoped_lock lock(mu_);
+    stop_requested_ = false;
+    found_paths_.clear();
+    num_pending_directories_ = 1;
+    workers_[0]->directories.push_back(root);
+  }
+  for (size_t i = 0; i < num_workers_; ++i) {
+    workers_[i]->thread = boost::thread(
+        boost::bind(&ParallelFilesystemScannerImpl::RunWorker, this, i));
+  }
+  ContinueScan(max_paths, callback);
+}
+
+void ParallelFilesystemScannerImpl::ContinueScan(
+    int max_paths, Callback callback) {
+  const size_t num_paths = std::max(max_paths, 0);
+  {
+    boost::mutex::scoped_lock lock(mu_);
+
+    // Workers must be allowed to find at least as many paths as are
+    // asked for, or they would stop before this section could be filled.
+    max_found_paths_ = std::max<size_t>(
+        options::filesystem_scanner_max_buffered_paths, num_paths);
+    found_paths_space_available_.notify_all();
+
+    while (found_paths_.size() < num_paths && num_pending_directories_ > 0) {
+      found_paths_available_.wait(lock);
+    }
+
+    const size_t num_collected = std::min(found_paths_.size(), num_paths);
+    for (size_t i = 0; i < num_collected; ++i) {
+      handles_with_stat_.push_back(make_pair(
+          path_arena_.Add(found_paths_[i].first),
+          std::move(found_paths_[i].second)));
+    }
+    found_paths_.erase(found_paths_.begin(),
+                       found_paths_.begin() + num_collected);
+    found_paths_space_available_.notify_all();
+  }
+  callback();
+}
+
+bool ParallelFilesystemScannerImpl::GetPaths(
+    vector<boost::filesystem::path>* paths) const {
+  CHECK_NOTNULL(paths)->reserve(handles_with_stat_.size());
+  for (const auto& handle_with_stat : handles_with_stat_) {
+    paths->push_back(path_arena_.GetPath(handle_with_stat.first));
+  }
+  return !handles_with_stat_.empty();
+}
+
+bool ParallelFilesystemScannerImpl::GetPathsWithFilesize(
+    vector<pair<boost::filesystem::path, size_t> >* paths_with_size) const {
+  CHECK_NOTNULL(paths_with_size)->reserve(handles_with_stat_.size());
+  for (const auto& handle_with_stat : handles_with_stat_) {
+    paths_with_size->push_back(make_pair(
+        path_arena_.GetPath(handle_with_stat.first),
+        file_stat_util::IsRegularFile(handle_with_stat.second)
+            ? handle_with_stat.second.length() : 0));
+  }
+  return !handles_with_stat_.empty();
+}
+
+bool ParallelFilesystemScannerImpl::GetPathsWithFileStat(
+    vector<pair<boost::filesystem::path, FileStat> >* paths_with_stat) const {
+  CHECK_NOTNULL(paths_with_stat)->reserve(
+      paths_with_stat->size() + handles_with_stat_.size());
+  for (const auto& handle_with_stat : handles_with_stat_) {
+    paths_with_stat->push_back(make_pair(
+        path_arena_.GetPath(handle_with_stat.first), handle_with_stat.second));
+  }
+  return !handles_with_stat_.empty();
+}
+
+bool ParallelFilesystemScannerImpl::GetPathHandlesWithFileStat(
+    PathArena* path_arena,
+    vector<pair<PathArena::Handle, FileStat> >* handles_with_stat) const {
+  CHECK_NOTNULL(path_arena);
+  CHECK_NOTNULL(handles_with_stat)->reserve(
+      handles_with_stat->size() + handles_with_stat_.size());
+  for (const auto& handle_with_stat : handles_with_stat_) {
+    handles_with_stat->push_back(make_pair(
+        path_arena->Add(path_arena_, handle_with_stat.first),
+        handle_with_stat.second));
+  }
+  return !handles_with_stat_.empty();
+}
+
+void ParallelFilesystemScannerImpl::ClearPaths() {
+  path_arena_.Clear();
+  handles_with_stat_.clear();
+}
+
+void ParallelFilesystemScannerImpl::RunWorker(size_t worker_index) {
+  boost::filesystem::path directory;
+  vector<pair<boost::filesystem::path, FileStat> > found_paths;
+  vector<boost::filesystem::path> subdirectories;
+
+  for (;;) {
+    {
+      boost::mutex::scoped_lock lock(mu_);
+      while (!stop_requested_ && found_paths_.size() >= max_found_paths_) {
+        found_paths_space_available_.wait(lock);
+      }
+      if (stop_requested_) {
+        return;
+      }
+    }
+
+    if (!TakeDirectory(worker_index, &directory)) {
+      // Directories are only added with mu_ held, so checking again with
+      // it held ensures that no wakeup is missed.
+      boost::mutex::scoped_lock lock(mu_);
+      ++num_idle_workers_;
+      for (;;) {
+        if (stop_requested_ || num_pending_directories_ == 0) {
+          --num_idle_workers_;
+          return;
+        }
+        if (TakeDirectory(worker_index, &directory)) {
+          break;
+        }
+        work_available_.wait(lock);
+      }
+      --num_idle_workers_;
+    }
+
+    found_paths.clear();
+    subdirectories.clear();
+    // Like a recursive_directory_iterator, every entry below the root is
+    // returned, and symlinks to directories are not followed. Directories
+    // that cannot be read are skipped.
+    const bool is_read_completely = file_stat_util::ReadDirectory(
+        directory, &found_paths, &subdirectories);
+    // Fingerprints record every entry read, including excluded ones.
+    if (directory_fingerprints_ != nullptr && is_read_completely) {
+      directory_fingerprints_->RecordDirectoryRead(
+          directory, found_paths.size(), subdirectories);
+    }
+    if (path_filter_ != nullptr) {
+      RemoveExcludedEntries(path_filter_, &found_paths, &subdirectories);
+    }
+    if (directory_fingerprints_ != nullptr) {
+      ReplaceUnchangedSubdirectories(
+          directory_fingerprints_, path_filter_, &found_paths,
+          &subdirectories);
+    }
+
+    boost::mutex::scoped_lock lock(mu_);
+    if (!subdirectories.empty()) {
+      // The subdirectories are counted as pending before this directory
+      // stops being pending, so the count cannot reach zero while any
+      // directory remains to be read.
+      num_pending_directories_ += subdirectories.size();
+      Worker* worker = workers_[worker_index].get();
+      boost::mutex::scoped_lock worker_lock(worker->mu);
+      worker->directories.insert(
+          worker->directories.end(),
+          std::make_move_iterator(subdirectories.begin()),
+          std::make_move_iterator(subdirectories.end()));
+      if (num_idle_workers_ > 0) {
+        work_available_.notify_all();
+      }
+    }
+    if (!found_paths.empty()) {
+      found_paths_.insert(
+          found_paths_.end(),
+          std::make_move_iterator(found_paths.begin()),
+          std::make_move_iterator(found_paths.end()));
+      found_paths_available_.notify_all();
+    }
+    if (--num_pending_directories_ == 0) {
+      work_available_.notify_all();
+      found_paths_available_.notify_all();
+    }
+  }
+}
+
+bool ParallelFilesystemScannerImpl::TakeDirectory(
+    size_t worker_index, boost::filesystem::path* directory) {
+  {
+    Worker* worker = workers_[worker_index].get();
+    boost::mutex::scoped_lock lock(worker->mu);
+    if (!worker->directories.empty()) {
+      *directory = std::move(worker->directories.back());
+      worker->directories.pop_back();
+      return true;
+    }
+  }
+
+  for (size_t i = 1; i < num_workers_; ++i) {
+    Worker* victim = workers_[(worker_index + i) % num_workers_].get();
+    boost::mutex::scoped_lock lock(victim->mu);
+    if (!victim->directories.empty()) {
+      *directory = std::move(victim->directories.front());
+      victim->directories.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ParallelFilesystemScannerImpl::StopWorkers() {
+  {
+    boost::mutex::scoped_lock lock(mu_);
+    stop_requested_ = true;
+    work_available_.notify_all();
+    found_paths_space_available_.notify_all();
+  }
+  for (const auto& worker : workers_) {
+    if (worker->thread.joinable()) {
+      worker->thread.join();
+    }
+    worker->directories.clear();
+  }
+}
+
+}  // namespace polar_express
@@ -0,0 +1,126 @@
+#ifndef PARALLEL_FILESYSTEM_SCANNER_IMPL_H
+#define PARALLEL_FILESYSTEM_SCANNER_IMPL_H
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "base/callback.h"
+#include "base/macros.h"
+#include "proto/file.pb.h"
+#include "services/filesystem-scanner.h"
+#include "util/path-arena.h"
+
+namespace polar_express {
+
+// A synchronous implementation of FilesystemScanner which scans with
+// several worker threads of its own, for trees (especially on network
+// file systems) where a single thread spends most of its time waiting on
+// directory reads and stats.
+//
+// Each worker keeps a deque of directories still to be read. A worker
+// takes directories from the back of its own deque, so that it descends
+// depth-first through the subtree it is working on, and when its deque is
+// empty it steals from the front of another worker's, where the
+// directories closest to the root (and so likely the largest subtrees)
+// are.
+//
+// Workers scan ahead of the caller, but stop once a bounded number of
+// paths are waiting to be collected. ContinueScan collects paths from
+// them, returning when it has max_paths paths or the scan is complete, so
+// as with FilesystemScannerImpl, a section with no paths means the scan
+// is over. Paths are not returned in any particular order.
+class ParallelFilesystemScannerImpl : public FilesystemScanner {
+ public:
+  explicit ParallelFilesystemScannerImpl(int num_workers);
+  virtual ~ParallelFilesystemScannerImpl();
+
+  virtual void SetDirectoryFingerprints(
+      DirectoryFingerprints* directory_fingerprints);
+
+  virtual void SetPathFilter(const PathFilter* path_filter);
+
+  virtual void StartScan(
+      const string& root, int max_paths, Callback callback);
+
+  virtual void ContinueScan(int max_paths, Callback callback);
+
+  virtual bool GetPaths(vector<boost::filesystem::path>* paths) const;
+
+  virtual bool GetPathsWithFilesize(
+      vector<pair<boost::filesystem::path, size_t> >* paths_with_size) const;
+
+  virtual bool GetPathsWithFileStat(
+      vector<pair<boost::filesystem::path, FileStat> >* paths_with_stat) const;
+
+  virtual bool GetPathHandlesWithFileStat(
+      PathArena* path_arena,
+      vector<pair<PathArena::Handle, FileStat> >* handles_with_stat) const;
+
+  virtual void ClearPaths();
+
+ private:
+  struct Worker {
+    boost::mutex mu;
+    std::deque<boost::filesystem::path> directories;
+    boost::thread thread;
+  };
+
+  void RunWorker(size_t worker_index);
+
+  // Takes a directory from the back of the worker's own deque, or else
+  // from the front of another worker's. Returns false if there are none.
+  bool TakeDirectory(size_t worker_index, boost::filesystem::path* directory);
+
+  // Stops and joins all worker threads, abandoning any scan in progress.
+  void StopWorkers();
+
+  const size_t num_workers_;
+  vector<unique_ptr<Worker> > workers_;
+
+  // Internally synchronized, so used by the workers without holding mu_.
+  DirectoryFingerprints* directory_fingerprints_;
+  const PathFilter* path_filter_;
+
+  // Guards everything below.
+  boost::mutex mu_;
+
+  // Signalled when a directory is added to any worker's deque, when the
+  // scan completes, and when workers are asked to stop.
+  boost::condition_variable work_available_;
+
+  // Signalled when paths are taken from found_paths_.
+  boost::condition_variable found_paths_space_available_;
+
+  // Signalled when paths are added to found_paths_, and when the scan
+  // completes.
+  boost::condition_variable found_paths_available_;
+
+  // Directories that are queued or being read. The scan is complete when
+  // this reaches zero.
+  size_t num_pending_directories_;
+  size_t num_idle_workers_;
+  bool stop_requested_;
+
+  // Workers wait once this many paths are waiting to be collected.
+  size_t max_found_paths_;
+
+  // Paths found by the workers but not yet collected by ContinueScan.
+  std::deque<pair<boost::filesystem::path, FileStat> > found_paths_;
+
+  // Paths collected by ContinueScan. Only accessed by the caller.
+  PathArena path_arena_;
+  vector<pair<PathArena::Handle, FileStat> > handles_with_stat_;
+
+  DISALLOW_COPY_AND_ASSIGN(ParallelFilesystemScannerImpl);
+};
+
+}  // namespace polar_express
+
+#endif  // PARALLEL_FILESYSTEM_SCANNER_IMPL_H
@@ -0,0 +1,470 @@
+#include "services/path-filter.h"
+
+#include <fnmatch.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <regex>
+#include <sstream>
+
+#include "proto/file.pb.h"
+#include "util/file-stat-util.h"
+
+namespace polar_express {
+namespace {
+
+const char kAnyDepth[] = "**";
+const char kRegexPrefix[] = "re:";
+
+bool IsWildcardPattern(const string& name) {
+  return name.find_first_of("*?[\\") != string::npos;
+}
+
+// Parses N with an optional suffix multiplying it, as in size>N or age>N.
+// Returns false if N is not a number or the suffix is unknown.
+bool ParsePredicateValue(const string& value, const string& suffixes,
+                         const int64_t* multipliers, int64_t* result) {
+  size_t num_digits = 0;
+  while (num_digits < value.size() && isdigit(value[num_digits])) {
+    ++num_digits;
+  }
+  if (num_digits == 0 || num_digits > 15 || value.size() > num_digits + 1) {
+    return false;
+  }
+  int64_t multiplier = 1;
+  if (value.size() == num_digits + 1) {
+    const size_t suffix_index =
+        suffixes.find(toupper(value[num_digits]));
+    if (suffix_index == string::npos) {
+      return false;
+    }
+    multiplier = multipliers[suffix_index];
+  }
+  *result = std::stoll(value.substr(0, num_digits)) * multiplier;
+  return true;
+}
+
+}  // namespace
+
+struct PathFilter::Rule {
+  Rule()
+      : is_exclude(false),
+        is_directory_only(false),
+        is_regex(false),
+        min_size(-1),
+        max_size(-1),
+        min_age(-1),
+        max_age(-1),
+        hits(0) {
+  }
+
+  bool has_predicates() const {
+    return min_size >= 0 || max_size >= 0 || min_age >= 0 || max_age >= 0;
+  }
+
+  // The line the rule was compiled from, for reporting.
+  string text;
+  bool is_exclude;
+  bool is_directory_only;
+
+  // Either a regex, or the names (or name patterns) of a glob.
+  bool is_regex;
+  std::regex regex;
+  vector<string> components;
+
+  // Exclusive bounds on size in bytes and on age in seconds, or -1.
+  int64_t min_size;
+  int64_t max_size;
+  int64_t min_age;
+  int64_t max_age;
+
+  mutable std::atomic<size_t> hits;
+};
+
+PathFilter::Node::Node()
+    : any_depth_child(-1),
+      is_any_depth(false) {
+}
+
+PathFilter::PathFilter(const boost::filesystem::path& root, int64_t now)
+    : root_(root),
+      now_(now),
+      nodes_(1) {
+}
+
+PathFilter::~PathFilter() {
+}
+
+bool PathFilter::AddRules(const string& rules, string* error) {
+  CHECK_NOTNULL(error);
+  vector<unique_ptr<Rule> > new_rules;
+  std::istringstream lines(rules);
+  string line;
+  for (int line_number = 1; std::getline(lines, line); ++line_number) {
+    const size_t begin = line.find_first_not_of(" \t\r");
+    if (begin == string::npos || line[begin] == '#') {
+      continue;
+    }
+    const size_t end = line.find_last_not_of(" \t\r");
+    unique_ptr<Rule> rule =
+        CompileRule(line.substr(begin, end + 1 - begin), error);
+    if (rule == nullptr) {
+      *error = "line " + std::to_string(line_number) + ": " + *error;
+      return false;
+    }
+    new_rules.push_back(std::move(rule));
+  }
+
+  for (auto& rule : new_rules) {
+    const size_t rule_index = rules_.size();
+    if (rule->is_regex) {
+      regex_rule_indices_.push_back(rule_index);
+    } else {
+      nodes_[AddPatternNodes(rule->components)].rule_indices.push_back(
+          rule_index);
+    }
+    rules_.push_back(std::move(rule));
+  }
+  return true;
+}
+
+bool PathFilter::IsExcluded(const boost::filesystem::path& path,
+                            const FileStat& file_stat) const {
+  return IsExcludedInternal(path, file_stat, false);
+}
+
+bool PathFilter::IsExcludedOrBelowExcluded(
+    const boost::filesystem::path& path, const FileStat& file_stat) const {
+  return IsExcludedInternal(path, file_stat, true);
+}
+
+void PathFilter::GetRuleHits(vector<pair<string, size_t> >* rule_hits) const {
+  CHECK_NOTNULL(rule_hits);
+  for (const auto& rule : rules_) {
+    rule_hits->push_back(make_pair(rule->text, rule->hits.load()));
+  }
+}
+
+bool PathFilter::empty() const {
+  return rules_.empty();
+}
+
+int64_t PathFilter::hash() const {
+  if (rules_.empty()) {
+    return 0;
+  }
+  // 64-bit FNV-1a, which (unlike std::hash) is the same in every build, as
+  // the hash is stored between backups.
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const auto& rule : rules_) {
+    for (const char c : rule->text + '\n') {
+      hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+    }
+  }
+  return static_cast<int64_t>(hash);
+}
+
+unique_ptr<PathFilter::Rule> PathFilter::CompileRule(
+    const string& line, string* error) const {
+  std::istringstream tokens(line);
+  string action;
+  string pattern;
+  tokens >> action >> pattern;
+  unique_ptr<Rule> rule(new Rule);
+  rule->text = line;
+  if (action == "-") {
+    rule->is_exclude = true;
+  } else if (action != "+") {
+    *error = "expected '-' or '+' before the pattern: " + line;
+    return nullptr;
+  }
+  if (pattern.empty()) {
+    *error = "missing pattern: " + line;
+    return nullptr;
+  }
+
+  if (pattern.compare(0, strlen(kRegexPrefix), kRegexPrefix) == 0) {
+    rule->is_regex = true;
+    try {
+      rule->regex = std::regex(pattern.substr(strlen(kRegexPrefix)),
+                               std::regex::ECMAScript | std::regex::optimize);
+    } catch (const std::regex_error& ex) {
+      *error = string("invalid regex (") + ex.what() + "): " + line;
+      return nullptr;
+    }
+  } else {
+    if (pattern.size() > 1 && pattern.back() == '/') {
+      rule->is_directory_only = true;
+      pattern.pop_back();
+    }
+    const bool is_anchored = pattern.find('/') != string::npos;
+    if (is_anchored && pattern.front() == '/') {
+      pattern.erase(0, 1);
+    }
+    if (!is_anchored) {
+      rule->components.push_back(kAnyDepth);
+    }
+    std::istringstream names(pattern);
+    string name;
+    while (std::getline(names, name, '/')) {
+      if (name.empty() || name == "." || name == "..") {
+        *error = "invalid pattern: " + line;
+        return nullptr;
+      }
+      // Consecutive ** match no more than one does.
+      if (name != kAnyDepth || rule->components.empty() ||
+          rule->components.back() != kAnyDepth) {
+        rule->components.push_back(name);
+      }
+    }
+    if (rule->components.empty()) {
+      *error = "invalid pattern: " + line;
+      return nullptr;
+    }
+  }
+
+  static const int64_t kSizeMultipliers[] = {
+    1LL << 10, 1LL << 20, 1LL << 30, 1LL << 40 };
+  static const int64_t kAgeMultipliers[] = {
+    1, 60, 3600, 24 * 3600, 7 * 24 * 3600 };
+  string predicate;
+  while (tokens >> predicate) {
+    int64_t* bound = nullptr;
+    int64_t value = 0;
+    bool is_valid = false;
+    if (predicate.compare(0, 5, "size>") == 0 ||
+        predicate.compare(0, 5, "size<") == 0) {
+      bound = (predicate[4] == '>') ? &rule->min_size : &rule->max_size;
+      is_valid = ParsePredicateValue(predicate.substr(5), "KMGT",
+                                     kSizeMultipliers, &value);
+    } else if (predicate.compare(0, 4, "age>") == 0 ||
+               predicate.compare(0, 4, "age<") == 0) {
+      bound = (predicate[3] == '>') ? &rule->min_age : &rule->max_age;
+      is_valid = ParsePredicateValue(predicate.substr(4), "SMHDW",
+                                     kAgeMultipliers, &value);
+    }
+    if (!is_valid) {
+      *error = "invalid predicate '" + predicate + "': " + line;
+      return nullptr;
+    }
+    *bound = value;
+  }
+  return rule;
+}
+
+int PathFilter::AddPatternNodes(const vector<string>& components) {
+  int node_index = 0;
+  for (const string& name : components) {
+    int child_index = -1;
+    if (name == kAnyDepth) {
+      child_index = nodes_[node_index].any_depth_child;
+    } else if (IsWildcardPattern(name)) {
+      for (const auto& wildcard_child :
+               nodes_[node_index].wildcard_children) {
+        if (wildcard_child.first == name) {
+          child_index = wildcard_child.second;
+        }
+      }
+    } else {
+      auto it = nodes_[node_index].literal_children.find(name);
+      if (it != nodes_[node_index].literal_children.end()) {
+        child_index = it->second;
+      }
+    }
+
+    if (child_index < 0) {
+      child_index = nodes_.size();
+      nodes_.push_back(Node());
+      if (name == kAnyDepth) {
+        nodes_[child_index].is_any_depth = true;
+        nodes_[node_index].any_depth_child = child_index;
+      } else if (IsWildcardPattern(name)) {
+        nodes_[node_index].wildcard_children.push_back(
+            make_pair(name, child_index));
+      } else {
+        nodes_[node_index].literal_children[name] = child_index;
+      }
+    }
+    node_index = child_index;
+  }
+  return node_index;
+}
+
+void PathFilter::AddAnyDepthChildren(vector<int>* state) const {
+  for (size_t i = 0; i < state->size(); ++i) {
+    const int child_index = nodes_[(*state)[i]].any_depth_child;
+    if (child_index >= 0 &&
+        std::find(state->begin(), state->end(), child_index) ==
+            state->end()) {
+      state->push_back(child_index);
+    }
+  }
+}
+
+vector<int> PathFilter::Step(
+    const vector<int>& state, const string& component) const {
+  vector<int> next_state;
+  auto add_node = [&next_state](int node_index) {
+    if (std::find(next_state.begin(), next_state.end(), node_index) ==
+        next_state.end()) {
+      next_state.push_back(node_index);
+    }
+  };
+  for (int node_index : state) {
+    const Node& node = nodes_[node_index];
+    if (node.is_any_depth) {
+      add_node(node_index);
+    }
+    auto it = node.literal_children.find(component);
+    if (it != node.literal_children.end()) {
+      add_node(it->second);
+    }
+    for (const auto& wildcard_child : node.wildcard_children) {
+      if (fnmatch(wildcard_child.first.c_str(), component.c_str(), 0) == 0) {
+        add_node(wildcard_child.second);
+      }
+    }
+  }
+  AddAnyDepthChildren(&next_state);
+  return next_state;
+}
+
+size_t PathFilter::FindFirstMatchingRule(
+    const vector<string>& components, size_t num_components,
+    const vector<int>& state, const FileStat* file_stat) const {
+  auto rule_applies = [this, file_stat](const Rule& rule) {
+    if (file_stat == nullptr) {
+      return !rule.has_predicates();
+    }
+    return (!rule.is_directory_only ||
+            file_stat_util::IsDirectory(*file_stat)) &&
+        SatisfiesPredicates(rule, *file_stat);
+  };
+
+  size_t first_rule_index = rules_.size();
+  for (int node_index : state) {
+    for (size_t rule_index : nodes_[node_index].rule_indices) {
+      if (rule_index >= first_rule_index) {
+        break;
+      }
+      if (rule_applies(*rules_[rule_index])) {
+        first_rule_index = rule_index;
+        break;
+      }
+    }
+  }
+
+  if (!regex_rule_indices_.empty() &&
+      regex_rule_indices_.front() < first_rule_index) {
+    string relative_path;
+    for (size_t i = 0; i < num_components; ++i) {
+      if (i > 0) {
+        relative_path += '/';
+      }
+      relative_path += components[i];
+    }
+    for (size_t rule_index : regex_rule_indices_) {
+      if (rule_index >= first_rule_index) {
+        break;
+      }
+      const Rule& rule = *rules_[rule_index];
+      if (rule_applies(rule) && std::regex_search(relative_path, rule.regex)) {
+        first_rule_index = rule_index;
+        break;
+      }
+    }
+  }
+  return first_rule_index;
+}
+
+bool PathFilter::SatisfiesPredicates(
+    const Rule& rule, const FileStat& file_stat) const {
+  if (rule.min_size >= 0 || rule.max_size >= 0) {
+    if (!file_stat_util::IsRegularFile(file_stat) ||
+        (rule.min_size >= 0 && file_stat.length() <= rule.min_size) ||
+        (rule.max_size >= 0 && file_stat.length() >= rule.max_size)) {
+      return false;
+    }
+  }
+  if (rule.min_age >= 0 || rule.max_age >= 0) {
+    if (!file_stat.has_modification_time_ns()) {
+      return false;
+    }
+    const int64_t age =
+        now_ - file_stat.modification_time_ns() / 1000000000;
+    if ((rule.min_age >= 0 && age <= rule.min_age) ||
+        (rule.max_age >= 0 && age >= rule.max_age)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool PathFilter::GetRelativeComponents(
+    const boost::filesystem::path& path, vector<string>* components) const {
+  const string& root = root_.native();
+  const string& path_str = path.native();
+  size_t root_length = root.size();
+  while (root_length > 1 && root[root_length - 1] == '/') {
+    --root_length;
+  }
+  if (path_str.compare(0, root_length, root, 0, root_length) != 0 ||
+      (path_str.size() > root_length && root[root_length - 1] != '/' &&
+       path_str[root_length] != '/')) {
+    return false;
+  }
+
+  size_t begin = root_length;
+  while (begin < path_str.size()) {
+    size_t end = path_str.find('/', begin);
+    if (end == string::npos) {
+      end = path_str.size();
+    }
+    if (end > begin) {
+      components->push_back(path_str.substr(begin, end - begin));
+    }
+    begin = end + 1;
+  }
+  return true;
+}
+
+bool PathFilter::IsExcludedInternal(
+    const boost::filesystem::path& path, const FileStat& file_stat,
+    bool check_ancestors) const {
+  if (rules_.empty()) {
+    return false;
+  }
+  vector<string> components;
+  if (!GetRelativeComponents(path, &components) || components.empty()) {
+    return false;
+  }
+
+  vector<int> state = { 0 };
+  AddAnyDepthChildren(&state);
+  for (size_t i = 0; i < components.size(); ++i) {
+    state = Step(state, components[i]);
+    if (state.empty() && regex_rule_indices_.empty()) {
+      // No pattern can match this path, nor anything below it.
+      return false;
+    }
+    const bool is_path = (i + 1 == components.size());
+    if (!is_path && !check_ancestors) {
+      continue;
+    }
+    const size_t rule_index = FindFirstMatchingRule(
+        components, i + 1, state, is_path ? &file_stat : nullptr);
+    if (rule_index == rules_.size()) {
+      continue;
+    }
+    const Rule& rule = *rules_[rule_index];
+    if (rule.is_exclude || is_path) {
+      ++rule.hits;
+      return rule.is_exclude;
+    }
+  }
+  return false;
+}
+
+}  // namespace polar_express
@@ -0,0 +1,154 @@
+#ifndef PATH_FILTER_H
+#define PATH_FILTER_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "base/macros.h"
+
+namespace polar_express {
+
+class FileStat;
+
+// A set of rules deciding which paths below the root of a scan are backed
+// up, which the scanners apply as they find paths, so that excluded
+// directories are never read. Thread-safe once all rules have been added.
+//
+// Rules are given one per line, as an action ('-' to exclude or '+' to
+// include) followed by a pattern and then any predicates:
+//
+//   # Comments and blank lines are ignored.
+//   - node_modules/       Directories named node_modules, at any depth.
+//   - *.o                 Paths whose name ends in .o, at any depth.
+//   - /build/             The directory build directly below the root.
+//   - /src/**/*.tmp       ** matches any number of directories.
+//   - re:\.cache/         Paths (relative to the root) containing a match
+//                         for the ECMAScript regex.
+//   + *.iso size<100M     .iso files smaller than 100 MiB...
+//   - *.iso               ...but no other .iso files.
+//   - * age>365d          Files not modified for a year.
+//
+// A pattern with no '/' (other than a trailing one) matches a path's name
+// at any depth. Otherwise, it is matched against the whole path relative
+// to the root, one directory at a time. A trailing '/' matches only
+// directories. '*', '?' and '[...]' match within a name as in fnmatch.
+// Patterns cannot contain whitespace; use '?' to match it. Predicates are
+// size>N and size<N (in bytes, or with a K, M, G or T suffix), which only
+// regular files can satisfy, and age>N and age<N (in seconds since the
+// path was modified, or with an m, h, d or w suffix).
+//
+// The first rule that matches a path decides whether it is excluded;
+// paths matching no rule are included. Everything below an excluded
+// directory is excluded, whatever later rules say.
+class PathFilter {
+ public:
+  // root is the root of the scan, and now is the time of the scan in
+  // seconds since the epoch, against which ages are measured.
+  PathFilter(const boost::filesystem::path& root, int64_t now);
+  ~PathFilter();
+
+  // Compiles and adds rules, one per line, after those already added.
+  // Returns false, and sets error to describe the first malformed line, if
+  // any line is malformed, in which case no rules are added.
+  bool AddRules(const string& rules, string* error);
+
+  // Returns true if the rules exclude path, whose stat results are
+  // file_stat. The directories above it are not checked, so this is for
+  // paths found by a scan which does not read excluded directories.
+  bool IsExcluded(const boost::filesystem::path& path,
+                  const FileStat& file_stat) const;
+
+  // As IsExcluded, but also returns true if any directory between the root
+  // and path is excluded, for paths that were not found by reading their
+  // parents. Rules with predicates are not applied to those directories.
+  bool IsExcludedOrBelowExcluded(const boost::filesystem::path& path,
+                                 const FileStat& file_stat) const;
+
+  // Appends the text of each rule, in order, with the number of paths it
+  // has decided (whether by excluding or including them).
+  void GetRuleHits(vector<pair<string, size_t> >* rule_hits) const;
+
+  // Returns true if no rules have been added.
+  bool empty() const;
+
+  // Returns a hash of the rules added, in order, or 0 if there are none.
+  // Adding, removing, reordering or editing any rule changes it.
+  int64_t hash() const;
+
+ private:
+  struct Rule;
+
+  struct Node {
+    Node();
+
+    // Children reached by a name equal to the key.
+    std::unordered_map<string, int> literal_children;
+    // Children reached by a name matching a wildcard pattern.
+    vector<pair<string, int> > wildcard_children;
+    // The child reached by any number of names (including none), or -1.
+    int any_depth_child;
+    // True if this node was reached by **, so also matches any name.
+    bool is_any_depth;
+    // Indices in rules_ of the rules whose patterns end at this node.
+    vector<size_t> rule_indices;
+  };
+
+  // Compiles a single line, returning null (and setting error) if it is
+  // malformed. Does not add the rule to the trie.
+  unique_ptr<Rule> CompileRule(const string& line, string* error) const;
+
+  // Adds the nodes needed to match the components of a pattern, in order,
+  // and returns the index of the last.
+  int AddPatternNodes(const vector<string>& components);
+
+  // Adds the ** child of every node in state, recursively, to state.
+  void AddAnyDepthChildren(vector<int>* state) const;
+
+  // Returns the nodes reachable from those in state by matching component.
+  vector<int> Step(const vector<int>& state, const string& component) const;
+
+  // Returns the index of the first rule matched by a path whose components
+  // (relative to the root) are the first num_components of components, and
+  // whose trie state after matching them is state, or rules_.size() if
+  // none matches. If file_stat is null, only rules without predicates and
+  // which can match directories are considered.
+  size_t FindFirstMatchingRule(
+      const vector<string>& components, size_t num_components,
+      const vector<int>& state, const FileStat* file_stat) const;
+
+  // Returns true if rule's predicates hold for file_stat.
+  bool SatisfiesPredicates(const Rule& rule, const FileStat& file_stat) const;
+
+  // Splits path, relative to root_, into its components. Returns false if
+  // path is not below root_.
+  bool GetRelativeComponents(const boost::filesystem::path& path,
+                             vector<string>* components) const;
+
+  bool IsExcludedInternal(const boost::filesystem::path& path,
+                          const FileStat& file_stat,
+                          bool check_ancestors) const;
+
+  const boost::filesystem::path root_;
+  const int64_t now_;
+
+  vector<unique_ptr<Rule> > rules_;
+
+  // The glob patterns of all rules, compiled into a trie of the names
+  // (or name patterns) that they match in turn, which is walked as an NFA.
+  // nodes_[0] is the root.
+  vector<Node> nodes_;
+
+  // Indices in rules_ of rules with regexes, which are not in the trie.
+  vector<size_t> regex_rule_indices_;
+
+  DISALLOW_COPY_AND_ASSIGN(PathFilter);
+};
+
+}  // namespace polar_express
+
+#endif  // PATH_FILTER_H
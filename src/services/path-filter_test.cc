@@ -0,0 +1,189 @@
+#include "services/path-filter.h"
+
+#include <sys/stat.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#include "proto/file.pb.h"
+
+namespace polar_express {
+namespace {
+
+const int64_t kNow = 1400000000;
+const int64_t kDay = 24 * 3600;
+
+class PathFilterTest : public testing::Test {
+ protected:
+  PathFilterTest()
+      : root_("/backup/root"),
+        path_filter_(root_, kNow) {
+  }
+
+  void AddRules(const string& rules) {
+    string error;
+    ASSERT_TRUE(path_filter_.AddRules(rules, &error)) << error;
+  }
+
+  static FileStat File(int64_t length = 0, int64_t age = 0) {
+    FileStat file_stat;
+    file_stat.set_mode(S_IFREG | 0644);
+    file_stat.set_length(length);
+    file_stat.set_modification_time_ns((kNow - age) * 1000000000);
+    return file_stat;
+  }
+
+  static FileStat Directory() {
+    FileStat file_stat;
+    file_stat.set_mode(S_IFDIR | 0755);
+    file_stat.set_modification_time_ns(kNow * 1000000000);
+    return file_stat;
+  }
+
+  bool IsExcluded(const string& relative_path, const FileStat& file_stat) {
+    return path_filter_.IsExcluded(root_ / relative_path, file_stat);
+  }
+
+  const boost::filesystem::path root_;
+  PathFilter path_filter_;
+};
+
+TEST_F(PathFilterTest, IncludesEverythingWithoutRules) {
+  EXPECT_TRUE(path_filter_.empty());
+  EXPECT_FALSE(IsExcluded("a/b", File()));
+  EXPECT_FALSE(IsExcluded("a", Directory()));
+}
+
+TEST_F(PathFilterTest, UnanchoredPatternsMatchNamesAtAnyDepth) {
+  AddRules("- node_modules/\n"
+           "- *.o\n");
+  EXPECT_TRUE(IsExcluded("node_modules", Directory()));
+  EXPECT_TRUE(IsExcluded("a/b/node_modules", Directory()));
+  EXPECT_FALSE(IsExcluded("a/node_modules", File()));
+  EXPECT_FALSE(IsExcluded("node_modules.txt", File()));
+  EXPECT_TRUE(IsExcluded("main.o", File()));
+  EXPECT_TRUE(IsExcluded("src/lib/main.o", File()));
+  EXPECT_FALSE(IsExcluded("src/lib/main.cc", File()));
+  EXPECT_FALSE(IsExcluded("main.o/x", File()));
+}
+
+TEST_F(PathFilterTest, AnchoredPatternsMatchFromRoot) {
+  AddRules("- /build/\n"
+           "- src/*/tmp\n"
+           "- /docs/**/*.pdf\n");
+  EXPECT_TRUE(IsExcluded("build", Directory()));
+  EXPECT_FALSE(IsExcluded("src/build", Directory()));
+  EXPECT_TRUE(IsExcluded("src/a/tmp", File()));
+  EXPECT_FALSE(IsExcluded("src/a/b/tmp", File()));
+  EXPECT_FALSE(IsExcluded("x/src/a/tmp", File()));
+  EXPECT_TRUE(IsExcluded("docs/a.pdf", File()));
+  EXPECT_TRUE(IsExcluded("docs/a/b/c.pdf", File()));
+  EXPECT_FALSE(IsExcluded("docs/a/b/c.txt", File()));
+}
+
+TEST_F(PathFilterTest, FirstMatchingRuleDecides) {
+  AddRules("+ keep.o\n"
+           "- *.o\n"
+           "- *\n");
+  EXPECT_FALSE(IsExcluded("a/keep.o", File()));
+  EXPECT_TRUE(IsExcluded("a/other.o", File()));
+  EXPECT_TRUE(IsExcluded("a", Directory()));
+}
+
+TEST_F(PathFilterTest, RegexRules) {
+  AddRules("+ important.log\n"
+           "- re:\\.cache/.*\\.log$\n");
+  EXPECT_TRUE(IsExcluded("home/.cache/x/y.log", File()));
+  EXPECT_FALSE(IsExcluded("home/.cache/x/important.log", File()));
+  EXPECT_FALSE(IsExcluded("home/cache/y.log", File()));
+}
+
+TEST_F(PathFilterTest, SizeAndAgePredicates) {
+  AddRules("+ *.iso size<100M\n"
+           "- *.iso\n"
+           "- *.log age>30d\n");
+  EXPECT_FALSE(IsExcluded("small.iso", File(10 << 20)));
+  EXPECT_TRUE(IsExcluded("big.iso", File(200 << 20)));
+  EXPECT_FALSE(IsExcluded("new.log", File(0, 29 * kDay)));
+  EXPECT_TRUE(IsExcluded("old.log", File(0, 31 * kDay)));
+  // Size predicates only match regular files.
+  EXPECT_TRUE(IsExcluded("directory.iso", Directory()));
+}
+
+TEST_F(PathFilterTest, ChecksAncestorsOnlyWhenAsked) {
+  AddRules("+ /a/keep\n"
+           "- /a/\n"
+           "- *.tmp size>0\n");
+  const FileStat file = File(1);
+  EXPECT_FALSE(path_filter_.IsExcluded(root_ / "a/b/c", file));
+  EXPECT_TRUE(path_filter_.IsExcludedOrBelowExcluded(root_ / "a/b/c", file));
+  EXPECT_FALSE(path_filter_.IsExcludedOrBelowExcluded(root_ / "b/c", file));
+  // Rules with predicates are not applied to ancestors.
+  EXPECT_FALSE(
+      path_filter_.IsExcludedOrBelowExcluded(root_ / "x.tmp/c", file));
+}
+
+TEST_F(PathFilterTest, IgnoresPathsOutsideRoot) {
+  AddRules("- *\n");
+  EXPECT_FALSE(path_filter_.IsExcluded("/backup/rootx/a", File()));
+  EXPECT_FALSE(path_filter_.IsExcluded(root_, Directory()));
+  EXPECT_TRUE(path_filter_.IsExcluded("/backup/root/a", File()));
+
+  PathFilter trailing_slash_path_filter("/backup/root/", kNow);
+  string error;
+  ASSERT_TRUE(trailing_slash_path_filter.AddRules("- /a\n", &error));
+  EXPECT_TRUE(trailing_slash_path_filter.IsExcluded("/backup/root/a", File()));
+}
+
+TEST_F(PathFilterTest, CountsRuleHits) {
+  AddRules("# Objects\n"
+           "\n"
+           "- *.o\n"
+           "  + *  \n");
+  IsExcluded("a.o", File());
+  IsExcluded("b.o", File());
+  IsExcluded("c.cc", File());
+  vector<pair<string, size_t> > rule_hits;
+  path_filter_.GetRuleHits(&rule_hits);
+  ASSERT_EQ(2, rule_hits.size());
+  EXPECT_EQ(make_pair(string("- *.o"), size_t(2)), rule_hits[0]);
+  EXPECT_EQ(make_pair(string("+ *"), size_t(1)), rule_hits[1]);
+}
+
+TEST_F(PathFilterTest, RejectsMalformedRules) {
+  for (const char* rules : { "* foo", "-", "- a//b", "- re:(",
+                              "- a size>", "- a size>1X", "- a colour>1" }) {
+    string error;
+    EXPECT_FALSE(path_filter_.AddRules(string("- ok\n") + rules, &error))
+        << rules;
+    EXPECT_EQ(0, error.find("line 2: ")) << error;
+  }
+  EXPECT_TRUE(path_filter_.empty());
+}
+
+TEST_F(PathFilterTest, HashesRules) {
+  EXPECT_EQ(0, path_filter_.hash());
+  AddRules("- *.o\n+ /a/\n");
+  const int64_t hash = path_filter_.hash();
+  EXPECT_NE(0, hash);
+
+  // Comments, blank lines and surrounding whitespace are not rules.
+  PathFilter same_path_filter(root_, kNow);
+  string error;
+  ASSERT_TRUE(same_path_filter.AddRules("# a\n  - *.o \n\n+ /a/", &error));
+  EXPECT_EQ(hash, same_path_filter.hash());
+
+  PathFilter reordered_path_filter(root_, kNow);
+  ASSERT_TRUE(reordered_path_filter.AddRules("+ /a/\n- *.o", &error));
+  EXPECT_NE(hash, reordered_path_filter.hash());
+
+  AddRules("- *.tmp");
+  EXPECT_NE(hash, path_filter_.hash());
+}
+
+}  // namespace
+}  // namespace polar_express
@@ -0,0 +1,261 @@
+#include "services/prefetching-chunk-reader-impl.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/bind/bind.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "proto/block.pb.h"
+#include "proto/snapshot.pb.h"
+
+namespace polar_express {
+
+class PrefetchingChunkReaderImpl::ChunkReaderPool {
+ public:
+  ChunkReaderPool(const boost::filesystem::path& path, size_t max_buffers,
+                  ChunkReaderFactory create_chunk_reader)
+      : path_(path),
+        max_buffers_(max_buffers),
+        create_chunk_reader_(create_chunk_reader),
+        num_chunk_readers_(0) {
+  }
+
+  const boost::filesystem::path& path() const { return path_; }
+  boost::mutex& mu() { return mu_; }
+  size_t max_buffers() const { return max_buffers_; }
+
+  // These must be called with mu() held. TakeIdleChunkReaderLocked
+  // returns null if all max_buffers readers are in use, unless force is
+  // true, in which case an extra reader is created.
+  unique_ptr<ChunkReader> TakeIdleChunkReaderLocked(bool force) {
+    if (!idle_chunk_readers_.empty()) {
+      unique_ptr<ChunkReader> chunk_reader =
+          std::move(idle_chunk_readers_.back());
+      idle_chunk_readers_.pop_back();
+      return chunk_reader;
+    }
+    if (num_chunk_readers_ >= max_buffers_ && !force) {
+      return nullptr;
+    }
+    ++num_chunk_readers_;
+    return create_chunk_reader_();
+  }
+
+  void ReturnChunkReaderLocked(unique_ptr<ChunkReader> chunk_reader) {
+    if (num_chunk_readers_ > max_buffers_) {
+      // An extra reader was created while discarded reads were in flight.
+      --num_chunk_readers_;
+      return;
+    }
+    idle_chunk_readers_.push_back(std::move(chunk_reader));
+  }
+
+ private:
+  const boost::filesystem::path path_;
+  const size_t max_buffers_;
+  const ChunkReaderFactory create_chunk_reader_;
+
+  boost::mutex mu_;
+  size_t num_chunk_readers_;
+  vector<unique_ptr<ChunkReader> > idle_chunk_readers_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChunkReaderPool);
+};
+
+struct PrefetchingChunkReaderImpl::Read {
+  Read() : is_complete(false), is_discarded(false),
+           block_data_for_chunk(nullptr), file_identity_after_read(nullptr) {
+  }
+
+  bool IsForChunk(const Chunk& other_chunk) const {
+    return chunk.offset() == other_chunk.offset() &&
+        chunk.block().length() == other_chunk.block().length();
+  }
+
+  Chunk chunk;
+  unique_ptr<ChunkReader> chunk_reader;
+  ByteSpan block_data;
+  FileIdentity file_identity;
+  bool is_complete;
+  bool is_discarded;
+
+  // Set once a caller asks for this read's results.
+  ByteSpan* block_data_for_chunk;
+  FileIdentity* file_identity_after_read;
+  Callback callback;
+};
+
+PrefetchingChunkReaderImpl::PrefetchingChunkReaderImpl(
+    const boost::filesystem::path& path, size_t max_buffers)
+    : pool_(new ChunkReaderPool(
+          path, std::max<size_t>(max_buffers, 2),
+          boost::bind(&ChunkReader::CreateNonPrefetchingChunkReaderForPath,
+                      path))) {
+}
+
+PrefetchingChunkReaderImpl::PrefetchingChunkReaderImpl(
+    const boost::filesystem::path& path, size_t max_buffers,
+    ChunkReaderFactory create_chunk_reader)
+    : pool_(new ChunkReaderPool(
+          path, std::max<size_t>(max_buffers, 2), create_chunk_reader)) {
+}
+
+PrefetchingChunkReaderImpl::~PrefetchingChunkReaderImpl() {
+  boost::mutex::scoped_lock lock(pool_->mu());
+  for (const auto& prefetched_read : prefetched_reads_) {
+    DiscardReadLocked(prefetched_read);
+  }
+}
+
+void PrefetchingChunkReaderImpl::ReadBlockDataSpanForChunk(
+    const Chunk& chunk, ByteSpan* block_data_for_chunk, Callback callback) {
+  ReadChunk(chunk, CHECK_NOTNULL(block_data_for_chunk), nullptr, callback);
+}
+
+void PrefetchingChunkReaderImpl::ReadBlockDataSpanAndFileIdentityForChunk(
+    const Chunk& chunk, ByteSpan* block_data_for_chunk,
+    FileIdentity* file_identity_after_read, Callback callback) {
+  ReadChunk(chunk, CHECK_NOTNULL(block_data_for_chunk),
+            CHECK_NOTNULL(file_identity_after_read), callback);
+}
+
+void PrefetchingChunkReaderImpl::FindHoles(
+    int64_t min_hole_length, vector<Hole>* holes, Callback callback) {
+  CHECK_NOTNULL(holes)->clear();
+  int fd = open(pool_->path().c_str(), O_RDONLY);
+  if (fd >= 0) {
+    FindHolesInFile(fd, min_hole_length, holes);
+    close(fd);
+  }
+
+  callback();
+}
+
+bool PrefetchingChunkReaderImpl::PrefetchChunk(const Chunk& chunk) {
+  boost::shared_ptr<Read> read;
+  {
+    boost::mutex::scoped_lock lock(pool_->mu());
+    for (const auto& prefetched_read : prefetched_reads_) {
+      if (prefetched_read->IsForChunk(chunk)) {
+        return true;
+      }
+    }
+
+    // One buffer is always left for the view returned by the next read.
+    if (prefetched_reads_.size() + 1 >= pool_->max_buffers()) {
+      return false;
+    }
+    unique_ptr<ChunkReader> chunk_reader =
+        pool_->TakeIdleChunkReaderLocked(false);
+    if (chunk_reader == nullptr) {
+      return false;
+    }
+
+    read.reset(new Read);
+    read->chunk.set_offset(chunk.offset());
+    read->chunk.mutable_block()->set_length(chunk.block().length());
+    read->chunk_reader = std::move(chunk_reader);
+    prefetched_reads_.push_back(read);
+  }
+
+  StartRead(read);
+  return true;
+}
+
+void PrefetchingChunkReaderImpl::ReadChunk(
+    const Chunk& chunk, ByteSpan* block_data_for_chunk,
+    FileIdentity* file_identity_after_read, Callback callback) {
+  boost::shared_ptr<Read> read;
+  bool needs_start = false;
+  bool is_complete = false;
+  {
+    boost::mutex::scoped_lock lock(pool_->mu());
+
+    // The caller is done with the previous view.
+    if (current_read_ != nullptr) {
+      pool_->ReturnChunkReaderLocked(std::move(current_read_->chunk_reader));
+      current_read_.reset();
+    }
+
+    // Chunks are read in order, so prefetched chunks up to this one will
+    // never be asked for. Later ones are kept, since a caller may hint the
+    // next chunk before its read of this one has even started.
+    while (!prefetched_reads_.empty() &&
+           prefetched_reads_.front()->chunk.offset() <= chunk.offset()) {
+      boost::shared_ptr<Read> prefetched_read = prefetched_reads_.front();
+      prefetched_reads_.pop_front();
+      if (prefetched_read->IsForChunk(chunk)) {
+        read = prefetched_read;
+        break;
+      }
+      DiscardReadLocked(prefetched_read);
+    }
+
+    if (read == nullptr) {
+      read.reset(new Read);
+      read->chunk.set_offset(chunk.offset());
+      read->chunk.mutable_block()->set_length(chunk.block().length());
+      read->chunk_reader = pool_->TakeIdleChunkReaderLocked(true);
+      needs_start = true;
+    }
+
+    read->block_data_for_chunk = block_data_for_chunk;
+    read->file_identity_after_read = file_identity_after_read;
+    read->callback = callback;
+    is_complete = read->is_complete;
+    current_read_ = read;
+  }
+
+  if (needs_start) {
+    StartRead(read);
+  } else if (is_complete) {
+    FinishRead(read);
+  }
+}
+
+void PrefetchingChunkReaderImpl::StartRead(boost::shared_ptr<Read> read) {
+  read->chunk_reader->ReadBlockDataSpanAndFileIdentityForChunk(
+      read->chunk, &read->block_data, &read->file_identity,
+      boost::bind(&PrefetchingChunkReaderImpl::HandleReadComplete,
+                  pool_, read));
+}
+
+// static
+void PrefetchingChunkReaderImpl::HandleReadComplete(
+    boost::shared_ptr<ChunkReaderPool> pool, boost::shared_ptr<Read> read) {
+  {
+    boost::mutex::scoped_lock lock(pool->mu());
+    read->is_complete = true;
+    if (read->is_discarded) {
+      pool->ReturnChunkReaderLocked(std::move(read->chunk_reader));
+      return;
+    }
+    if (!read->callback) {
+      // Not asked for yet; ReadChunk will finish it.
+      return;
+    }
+  }
+
+  FinishRead(read);
+}
+
+// static
+void PrefetchingChunkReaderImpl::FinishRead(boost::shared_ptr<Read> read) {
+  *read->block_data_for_chunk = read->block_data;
+  if (read->file_identity_after_read != nullptr) {
+    read->file_identity_after_read->CopyFrom(read->file_identity);
+  }
+  read->callback();
+}
+
+void PrefetchingChunkReaderImpl::DiscardReadLocked(
+    boost::shared_ptr<Read> read) {
+  if (read->is_complete) {
+    pool_->ReturnChunkReaderLocked(std::move(read->chunk_reader));
+  } else {
+    read->is_discarded = true;
+  }
+}
+
+}  // namespace polar_express
@@ -0,0 +1,102 @@
+#ifndef PREFETCHING_CHUNK_READER_IMPL_H
+#define PREFETCHING_CHUNK_READER_IMPL_H
+
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "base/byte-span.h"
+#include "base/callback.h"
+#include "base/macros.h"
+#include "services/chunk-reader.h"
+
+namespace polar_express {
+
+class Chunk;
+
+// Reads chunks through a small pool of ordinary chunk readers, so that
+// chunks passed to PrefetchChunk can be read ahead of time into buffers
+// of their own while the caller is still working on the view returned
+// by the previous read.
+//
+// At most max_buffers chunks are buffered at once: the one whose view
+// was most recently returned, plus up to max_buffers - 1 prefetched
+// chunks. Chunks are expected to be read in order of offset; prefetched
+// chunks that are passed over are discarded. (A discarded read that is
+// still in flight holds its buffer until it completes, so memory use
+// may briefly reach twice the limit when many prefetches are wasted.)
+//
+// Prefetched reads that are still in flight when the reader is destroyed
+// are allowed to finish; their buffers are freed when they do.
+class PrefetchingChunkReaderImpl : public ChunkReader {
+ public:
+  PrefetchingChunkReaderImpl(
+      const boost::filesystem::path& path, size_t max_buffers);
+  virtual ~PrefetchingChunkReaderImpl();
+
+  virtual void ReadBlockDataSpanForChunk(
+      const Chunk& chunk, ByteSpan* block_data_for_chunk, Callback callback);
+
+  virtual void ReadBlockDataSpanAndFileIdentityForChunk(
+      const Chunk& chunk, ByteSpan* block_data_for_chunk,
+      FileIdentity* file_identity_after_read, Callback callback);
+
+  virtual void FindHoles(
+      int64_t min_hole_length, vector<Hole>* holes, Callback callback);
+
+  virtual bool PrefetchChunk(const Chunk& chunk);
+
+ private:
+  class ChunkReaderPool;
+  struct Read;
+
+  typedef boost::function<unique_ptr<ChunkReader>()> ChunkReaderFactory;
+
+  // Reads through chunk readers made by create_chunk_reader rather than
+  // ones chosen by the chunk_reader_io_mode option. Used for testing.
+  PrefetchingChunkReaderImpl(
+      const boost::filesystem::path& path, size_t max_buffers,
+      ChunkReaderFactory create_chunk_reader);
+
+  // Returns the view for the chunk (and the file identity, if
+  // file_identity_after_read is non-null) once it has been read, taking
+  // it from a prefetched read if there is one.
+  void ReadChunk(
+      const Chunk& chunk, ByteSpan* block_data_for_chunk,
+      FileIdentity* file_identity_after_read, Callback callback);
+
+  void StartRead(boost::shared_ptr<Read> read);
+
+  // Bound with the pool rather than this, since a prefetched read may
+  // complete after the reader has been destroyed.
+  static void HandleReadComplete(
+      boost::shared_ptr<ChunkReaderPool> pool, boost::shared_ptr<Read> read);
+
+  // Copies the results of a completed read to where its caller asked for
+  // them, and invokes the caller's callback.
+  static void FinishRead(boost::shared_ptr<Read> read);
+
+  // Must be called with the pool's mutex held.
+  void DiscardReadLocked(boost::shared_ptr<Read> read);
+
+  boost::shared_ptr<ChunkReaderPool> pool_;
+
+  // These are guarded by the pool's mutex. current_read_ is the read
+  // whose view was most recently returned; its buffer is held until the
+  // next read.
+  boost::shared_ptr<Read> current_read_;
+  std::deque<boost::shared_ptr<Read> > prefetched_reads_;
+
+  friend class PrefetchingChunkReaderImplTest;
+
+  DISALLOW_COPY_AND_ASSIGN(PrefetchingChunkReaderImpl);
+};
+
+}  // namespace polar_express
+
+#endif  // PREFETCHING_CHUNK_READER_IMPL_H
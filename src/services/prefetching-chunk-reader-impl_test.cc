@@ -0,0 +1,220 @@
+#include "services/prefetching-chunk-reader-impl.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/bind/bind.hpp>
+#include <gtest/gtest.h>
+
+#include "base/macros.h"
+#include "proto/block.pb.h"
+#include "proto/snapshot.pb.h"
+
+namespace polar_express {
+namespace {
+
+const int64_t kChunkLength = 10;
+
+class FakeChunkReader;
+
+// A read started on a FakeChunkReader, which completes only when the test
+// says so.
+struct FakeRead {
+  FakeChunkReader* chunk_reader;
+  int64_t offset;
+  ByteSpan* block_data_for_chunk;
+  Callback callback;
+};
+
+// Records each read it is asked for in pending_reads, rather than reading
+// anything.
+class FakeChunkReader : public ChunkReader {
+ public:
+  explicit FakeChunkReader(vector<FakeRead>* pending_reads)
+      : pending_reads_(pending_reads) {
+  }
+
+  virtual void ReadBlockDataSpanForChunk(
+      const Chunk& chunk, ByteSpan* block_data_for_chunk, Callback callback) {
+    pending_reads_->push_back(
+        FakeRead{ this, chunk.offset(), block_data_for_chunk, callback });
+  }
+
+  virtual void ReadBlockDataSpanAndFileIdentityForChunk(
+      const Chunk& chunk, ByteSpan* block_data_for_chunk,
+      FileIdentity* /* file_identity_after_read */, Callback callback) {
+    ReadBlockDataSpanForChunk(chunk, block_data_for_chunk, callback);
+  }
+
+  // Fills in the read's view with data naming its offset, in this
+  // reader's buffer, and runs its callback.
+  void Complete(const FakeRead& read) {
+    buffer_ = "chunk " + std::to_string(read.offset);
+    *read.block_data_for_chunk = ByteSpan(
+        reinterpret_cast<const byte*>(buffer_.data()), buffer_.size());
+    read.callback();
+  }
+
+ private:
+  vector<FakeRead>* pending_reads_;
+  string buffer_;
+};
+
+}  // namespace
+
+class PrefetchingChunkReaderImplTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    num_chunk_readers_created_ = 0;
+    prefetching_chunk_reader_.reset(new PrefetchingChunkReaderImpl(
+        "unused", 3,
+        boost::bind(&PrefetchingChunkReaderImplTest::CreateChunkReader,
+                    this)));
+  }
+
+  static Chunk MakeChunk(int64_t offset) {
+    Chunk chunk;
+    chunk.set_offset(offset);
+    chunk.mutable_block()->set_length(kChunkLength);
+    return chunk;
+  }
+
+  void Read(int64_t offset) {
+    prefetching_chunk_reader_->ReadBlockDataSpanForChunk(
+        MakeChunk(offset), &block_data_,
+        boost::bind(&PrefetchingChunkReaderImplTest::RecordDelivery, this));
+  }
+
+  bool Prefetch(int64_t offset) {
+    return prefetching_chunk_reader_->PrefetchChunk(MakeChunk(offset));
+  }
+
+  // Returns the offsets of the reads started on the underlying readers and
+  // not yet completed, in the order in which they were started.
+  vector<int64_t> PendingOffsets() const {
+    vector<int64_t> offsets;
+    for (const FakeRead& read : pending_reads_) {
+      offsets.push_back(read.offset);
+    }
+    return offsets;
+  }
+
+  void Complete(int64_t offset) {
+    for (auto it = pending_reads_.begin(); it != pending_reads_.end(); ++it) {
+      if (it->offset == offset) {
+        const FakeRead read = *it;
+        pending_reads_.erase(it);
+        read.chunk_reader->Complete(read);
+        return;
+      }
+    }
+    ADD_FAILURE() << "No read pending at offset " << offset;
+  }
+
+  unique_ptr<PrefetchingChunkReaderImpl> prefetching_chunk_reader_;
+  int num_chunk_readers_created_;
+
+  // The data of each view delivered, in the order in which they were.
+  vector<string> deliveries_;
+
+ private:
+  unique_ptr<ChunkReader> CreateChunkReader() {
+    ++num_chunk_readers_created_;
+    return unique_ptr<ChunkReader>(new FakeChunkReader(&pending_reads_));
+  }
+
+  void RecordDelivery() {
+    deliveries_.push_back(string(
+        reinterpret_cast<const char*>(block_data_.data()),
+        block_data_.size()));
+  }
+
+  vector<FakeRead> pending_reads_;
+  ByteSpan block_data_;
+};
+
+namespace {
+
+TEST_F(PrefetchingChunkReaderImplTest, LimitsPrefetchesToFreeBuffers) {
+  Read(0);
+  EXPECT_TRUE(Prefetch(10));
+  EXPECT_TRUE(Prefetch(20));
+  // The third buffer holds the view of the chunk at 0.
+  EXPECT_FALSE(Prefetch(30));
+  // A chunk already being prefetched needs no more buffers.
+  EXPECT_TRUE(Prefetch(20));
+  EXPECT_EQ(vector<int64_t>({ 0, 10, 20 }), PendingOffsets());
+  EXPECT_EQ(3, num_chunk_readers_created_);
+
+  // Moving on to the chunk at 10 frees the buffer of the chunk at 0.
+  Complete(0);
+  Read(10);
+  EXPECT_TRUE(Prefetch(30));
+  EXPECT_FALSE(Prefetch(40));
+  EXPECT_EQ(vector<int64_t>({ 10, 20, 30 }), PendingOffsets());
+  EXPECT_EQ(3, num_chunk_readers_created_);
+
+  Complete(10);
+  Complete(20);
+  Complete(30);
+  EXPECT_EQ(vector<string>({ "chunk 0", "chunk 10" }), deliveries_);
+}
+
+TEST_F(PrefetchingChunkReaderImplTest, DeliversChunksInOrderRead) {
+  Read(0);
+  EXPECT_TRUE(Prefetch(10));
+  EXPECT_TRUE(Prefetch(20));
+
+  // Prefetches that complete first are held until they are asked for.
+  Complete(20);
+  Complete(10);
+  EXPECT_TRUE(deliveries_.empty());
+  Complete(0);
+  EXPECT_EQ(vector<string>({ "chunk 0" }), deliveries_);
+
+  // Completed prefetches are delivered as soon as they are asked for,
+  // without being read again.
+  Read(10);
+  EXPECT_EQ(vector<string>({ "chunk 0", "chunk 10" }), deliveries_);
+  Read(20);
+  EXPECT_EQ(vector<string>({ "chunk 0", "chunk 10", "chunk 20" }),
+            deliveries_);
+  EXPECT_TRUE(PendingOffsets().empty());
+}
+
+TEST_F(PrefetchingChunkReaderImplTest, DiscardsPrefetchesPassedOver) {
+  Read(0);
+  EXPECT_TRUE(Prefetch(10));
+  EXPECT_TRUE(Prefetch(20));
+  Complete(0);
+
+  // Skipping the chunk at 10 discards its prefetch, which is still in
+  // flight. Its completion is then dropped rather than delivered.
+  Read(20);
+  Complete(10);
+  Complete(20);
+  EXPECT_EQ(vector<string>({ "chunk 0", "chunk 20" }), deliveries_);
+
+  // Its buffer is reused once the discarded read has completed.
+  EXPECT_TRUE(Prefetch(30));
+  EXPECT_TRUE(Prefetch(40));
+  EXPECT_EQ(3, num_chunk_readers_created_);
+
+  // A chunk that was not prefetched is read anew, discarding the completed
+  // prefetch before it but not the one after it.
+  Complete(30);
+  Read(35);
+  EXPECT_EQ(vector<int64_t>({ 40, 35 }), PendingOffsets());
+  Complete(35);
+  EXPECT_EQ(vector<string>({ "chunk 0", "chunk 20", "chunk 35" }),
+            deliveries_);
+
+  // Prefetches still in flight when the reader is destroyed are allowed to
+  // finish, and are not delivered.
+  prefetching_chunk_reader_.reset();
+  Complete(40);
+  EXPECT_EQ(3, deliveries_.size());
+}
+
+}  // namespace
+}  // namespace polar_express
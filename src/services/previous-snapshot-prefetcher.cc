@@ -0,0 +1,118 @@
+#include "services/previous-snapshot-prefetcher.h"
+
+#include <algorithm>
+#include <utility>
+
+#include <boost/bind.hpp>
+
+#include "proto/file.pb.h"
+#include "proto/snapshot.pb.h"
+#include "services/candidate-snapshot-generator.h"
+#include "services/metadata-db.h"
+
+namespace polar_express {
+
+PreviousSnapshotPrefetcher::PreviousSnapshotPrefetcher(
+    const string& root, size_t max_snapshots)
+    : root_(root),
+      max_snapshots_(max_snapshots),
+      candidate_snapshot_generator_(new CandidateSnapshotGenerator),
+      metadata_db_(new MetadataDb) {
+}
+
+PreviousSnapshotPrefetcher::~PreviousSnapshotPrefetcher() {
+}
+
+size_t PreviousSnapshotPrefetcher::NumPathsAccepted() const {
+  boost::mutex::scoped_lock lock(mu_);
+  return max_snapshots_ - std::min(max_snapshots_, entries_.size());
+}
+
+void PreviousSnapshotPrefetcher::Prefetch(
+    const vector<boost::filesystem::path>& paths) {
+  boost::shared_ptr<Batch> batch(new Batch);
+  {
+    boost::mutex::scoped_lock lock(mu_);
+    for (const boost::filesystem::path& path : paths) {
+      if (entries_.size() >= max_snapshots_) {
+        break;
+      }
+      File file;
+      if (!candidate_snapshot_generator_->GetFilePath(
+              root_, path, file.mutable_path())) {
+        continue;
+      }
+      auto inserted = entries_.insert(make_pair(path.string(), Entry()));
+      if (inserted.second) {
+        inserted.first->second.file_path = file.path();
+        batch->paths.push_back(path.string());
+        batch->files.push_back(std::move(file));
+      }
+    }
+  }
+
+  if (!batch->files.empty()) {
+    metadata_db_->GetLatestSnapshots(
+        batch->files, &batch->snapshots,
+        bind(&PreviousSnapshotPrefetcher::HandleBatchFetched, this, batch));
+  }
+}
+
+bool PreviousSnapshotPrefetcher::GetLatestSnapshot(
+    const boost::filesystem::path& path, const File& file,
+    boost::shared_ptr<Snapshot>* snapshot, Callback callback) {
+  CHECK_NOTNULL(snapshot);
+  {
+    boost::mutex::scoped_lock lock(mu_);
+    auto it = entries_.find(path.string());
+    if (it == entries_.end()) {
+      return false;
+    }
+    if (it->second.file_path != file.path() || file.has_id()) {
+      if (it->second.snapshot != nullptr) {
+        entries_.erase(it);
+      } else {
+        // Still being fetched; HandleBatchFetched removes it.
+        it->second.file_path.clear();
+      }
+      return false;
+    }
+    if (it->second.snapshot == nullptr) {
+      it->second.waiting_snapshot = snapshot;
+      it->second.waiting_callback = callback;
+      return true;
+    }
+    *snapshot = it->second.snapshot;
+    entries_.erase(it);
+  }
+  callback();
+  return true;
+}
+
+void PreviousSnapshotPrefetcher::HandleBatchFetched(
+    boost::shared_ptr<Batch> batch) {
+  assert(batch->snapshots.size() == batch->paths.size());
+  vector<Callback> waiting_callbacks;
+  {
+    boost::mutex::scoped_lock lock(mu_);
+    for (size_t i = 0; i < batch->paths.size(); ++i) {
+      auto it = entries_.find(batch->paths[i]);
+      assert(it != entries_.end());
+      if (it->second.waiting_snapshot != nullptr) {
+        *it->second.waiting_snapshot = batch->snapshots[i];
+        waiting_callbacks.push_back(it->second.waiting_callback);
+        entries_.erase(it);
+      } else if (it->second.file_path.empty()) {
+        entries_.erase(it);
+      } else {
+        it->second.snapshot = batch->snapshots[i];
+      }
+    }
+  }
+
+  for (const Callback& waiting_callback : waiting_callbacks) {
+    waiting_callback();
+  }
+}
+
+}  // namespace polar_express
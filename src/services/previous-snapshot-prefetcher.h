@@ -0,0 +1,89 @@
+#ifndef PREVIOUS_SNAPSHOT_PREFETCHER_H
+#define PREVIOUS_SNAPSHOT_PREFETCHER_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "base/callback.h"
+#include "base/macros.h"
+
+namespace polar_express {
+
+class CandidateSnapshotGenerator;
+class File;
+class MetadataDb;
+class Snapshot;
+
+// Fetches the latest snapshots of the files at batches of paths from the
+// metadata DB with MetadataDb::GetLatestSnapshots, ahead of the snapshot
+// state machines that will need them, so that each batch costs a few
+// queries rather than one per file. A state machine whose file was not
+// prefetched falls back to MetadataDb::GetLatestSnapshot. Thread-safe.
+//
+// At most max_snapshots snapshots are held at once, whether being fetched
+// or waiting to be taken; paths beyond that are not prefetched.
+class PreviousSnapshotPrefetcher {
+ public:
+  PreviousSnapshotPrefetcher(const string& root, size_t max_snapshots);
+  ~PreviousSnapshotPrefetcher();
+
+  // Returns the number of further paths that Prefetch would accept.
+  size_t NumPathsAccepted() const;
+
+  // Asynchronously fetches the latest snapshots of the files at paths, which
+  // must be below the root. Paths already being prefetched, and those beyond
+  // NumPathsAccepted, are ignored.
+  void Prefetch(const vector<boost::filesystem::path>& paths);
+
+  // If the latest snapshot of the file at path has been prefetched, or is
+  // being prefetched, and file is that file, sets snapshot to it (exactly
+  // as MetadataDb::GetLatestSnapshot would for file) once it is available,
+  // invokes callback, and returns true. Otherwise returns false without
+  // invoking callback. Either way, the prefetched snapshot is forgotten.
+  bool GetLatestSnapshot(const boost::filesystem::path& path,
+                         const File& file,
+                         boost::shared_ptr<Snapshot>* snapshot,
+                         Callback callback);
+
+ private:
+  struct Batch {
+    vector<string> paths;
+    vector<File> files;
+    vector<boost::shared_ptr<Snapshot> > snapshots;
+  };
+
+  // The snapshot of a file being prefetched, or null while it is being
+  // fetched. A state machine which asks for it while it is being fetched
+  // waits for it with waiting_snapshot and waiting_callback.
+  struct Entry {
+    Entry() : waiting_snapshot(nullptr) {}
+
+    string file_path;
+    boost::shared_ptr<Snapshot> snapshot;
+    boost::shared_ptr<Snapshot>* waiting_snapshot;
+    Callback waiting_callback;
+  };
+
+  void HandleBatchFetched(boost::shared_ptr<Batch> batch);
+
+  const string root_;
+  const size_t max_snapshots_;
+  unique_ptr<CandidateSnapshotGenerator> candidate_snapshot_generator_;
+  unique_ptr<MetadataDb> metadata_db_;
+
+  mutable boost::mutex mu_;
+  // Keyed by the paths given to Prefetch.
+  std::unordered_map<string, Entry> entries_;
+
+  DISALLOW_COPY_AND_ASSIGN(PreviousSnapshotPrefetcher);
+};
+
+}  // namespace polar_express
+
+#endif  // PREVIOUS_SNAPSHOT_PREFETCHER_H
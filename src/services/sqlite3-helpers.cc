@@ -25,6 +25,12 @@ int ScopedStatement::BindText(const string& param_name, const string& value) {
       value.c_str(), -1, SQLITE_TRANSIENT);
 }
 
+int ScopedStatement::BindBlob(const string& param_name, const string& value) {
+  return sqlite3_bind_blob(
+      stmt_, sqlite3_bind_parameter_index(stmt_, param_name.c_str()),
+      value.data(), value.size(), SQLITE_TRANSIENT);
+}
+
 int ScopedStatement::BindInt(const string& param_name, int value) {
   return sqlite3_bind_int(
       stmt_, sqlite3_bind_parameter_index(stmt_, param_name.c_str()), value);
@@ -63,6 +69,14 @@ string ScopedStatement::GetColumnText(const string& col_name) {
   return (value_cstr != nullptr) ? string(value_cstr) : "";
 }
 
+string ScopedStatement::GetColumnBlob(const string& col_name) {
+  int col_idx = GetColumnIdx(col_name);
+  const char* value_data = reinterpret_cast<const char*>(
+      sqlite3_column_blob(stmt_, col_idx));
+  return (value_data != nullptr)
+      ? string(value_data, sqlite3_column_bytes(stmt_, col_idx)) : "";
+}
+
 int ScopedStatement::GetColumnInt(const string& col_name) {
   return sqlite3_column_int(stmt_, GetColumnIdx(col_name));
 }
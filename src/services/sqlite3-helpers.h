@@ -20,6 +20,7 @@ class ScopedStatement {
   int Prepare(const string& query);
 
   int BindText(const string& param_name, const string& value);
+  int BindBlob(const string& param_name, const string& value);
   int BindInt(const string& param_name, int value);
   int BindInt64(const string& param_name, int64_t value);
   int BindBool(const string& param_name, bool value);
@@ -32,6 +33,7 @@ class ScopedStatement {
   bool IsColumnNull(const string& col_name);
 
   string GetColumnText(const string& col_name);
+  string GetColumnBlob(const string& col_name);
   int GetColumnInt(const string& col_name);
   int64_t GetColumnInt64(const string& col_name);
   bool GetColumnBool(const string& col_name);
@@ -0,0 +1,156 @@
+#include "services/streaming-chunk-reader-impl.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+
+#include "proto/block.pb.h"
+#include "proto/snapshot.pb.h"
+#include "util/file-identity-util.h"
+
+namespace polar_express {
+namespace {
+
+// O_DIRECT requires the buffer, file offset and length to be multiples of
+// the file system's logical block size, which is at most a page.
+const size_t kDirectIoAlignment = 4096;
+
+}  // namespace
+
+StreamingChunkReaderImpl::StreamingChunkReaderImpl(
+    const boost::filesystem::path& path)
+    : StreamingChunkReaderImpl(path, false) {
+}
+
+StreamingChunkReaderImpl::StreamingChunkReaderImpl(
+    const boost::filesystem::path& path, bool use_direct_io)
+    : path_(path),
+      fd_(-1),
+      use_direct_io_(use_direct_io) {
+  if (use_direct_io_) {
+    fd_ = open(path_.c_str(), O_RDONLY | O_DIRECT);
+  }
+  if (fd_ < 0) {
+    use_direct_io_ = false;
+    fd_ = open(path_.c_str(), O_RDONLY);
+  }
+  if (fd_ >= 0 && !use_direct_io_) {
+    // Doubles the kernel's read-ahead window for this file.
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+}
+
+StreamingChunkReaderImpl::~StreamingChunkReaderImpl() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+void StreamingChunkReaderImpl::ReadBlockDataSpanForChunk(
+    const Chunk& chunk, ByteSpan* block_data_for_chunk, Callback callback) {
+  *CHECK_NOTNULL(block_data_for_chunk) = ReadChunk(chunk);
+  callback();
+}
+
+void StreamingChunkReaderImpl::ReadBlockDataSpanAndFileIdentityForChunk(
+    const Chunk& chunk, ByteSpan* block_data_for_chunk,
+    FileIdentity* file_identity_after_read, Callback callback) {
+  *CHECK_NOTNULL(block_data_for_chunk) = ReadChunk(chunk);
+  FileIdentityUtil::GetFileIdentity(
+      path_, CHECK_NOTNULL(file_identity_after_read));
+  callback();
+}
+
+void StreamingChunkReaderImpl::FindHoles(
+    int64_t min_hole_length, vector<Hole>* holes, Callback callback) {
+  CHECK_NOTNULL(holes)->clear();
+  if (fd_ >= 0) {
+    FindHolesInFile(fd_, min_hole_length, holes);
+  }
+  callback();
+}
+
+ByteSpan StreamingChunkReaderImpl::ReadChunk(const Chunk& chunk) {
+  const int64_t offset = chunk.offset();
+  const int64_t length = chunk.block().length();
+  if (fd_ < 0 || offset < 0 || length <= 0) {
+    return ByteSpan();
+  }
+
+  if (use_direct_io_) {
+    const int64_t aligned_offset =
+        offset / kDirectIoAlignment * kDirectIoAlignment;
+    const size_t aligned_length =
+        (offset + length - aligned_offset + kDirectIoAlignment - 1) /
+        kDirectIoAlignment * kDirectIoAlignment;
+    byte* buffer = AlignedBuffer(aligned_length);
+    const size_t bytes_read =
+        ReadFully(aligned_offset, aligned_length, buffer);
+    const size_t skipped_length = offset - aligned_offset;
+    if (bytes_read <= skipped_length) {
+      return ByteSpan();
+    }
+    return ByteSpan(buffer + skipped_length,
+                    std::min<size_t>(length, bytes_read - skipped_length));
+  }
+
+  // Start reading the next chunk from disk while this one is processed.
+  posix_fadvise(fd_, offset + length, length, POSIX_FADV_WILLNEED);
+
+  byte* buffer = AlignedBuffer(length);
+  const size_t bytes_read = ReadFully(offset, length, buffer);
+
+  // The data has been copied out of the page cache, so its pages are no
+  // longer needed. Only whole pages are dropped; the partial page at the
+  // end of this chunk will be dropped along with the next chunk.
+  const int64_t page_aligned_offset =
+      offset / kDirectIoAlignment * kDirectIoAlignment;
+  posix_fadvise(fd_, page_aligned_offset,
+                offset + bytes_read - page_aligned_offset,
+                POSIX_FADV_DONTNEED);
+
+  return ByteSpan(buffer, bytes_read);
+}
+
+size_t StreamingChunkReaderImpl::ReadFully(
+    int64_t offset, size_t length, byte* buffer) {
+  size_t bytes_read = 0;
+  while (bytes_read < length) {
+    ssize_t result = pread(fd_, buffer + bytes_read, length - bytes_read,
+                           offset + bytes_read);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    } else if (result < 0 && errno == EINVAL && use_direct_io_) {
+      // Some file systems accept O_DIRECT at open but reject the reads.
+      fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_DIRECT);
+      use_direct_io_ = false;
+      continue;
+    } else if (result <= 0) {
+      break;
+    }
+    bytes_read += result;
+  }
+  return bytes_read;
+}
+
+byte* StreamingChunkReaderImpl::AlignedBuffer(size_t size) {
+  if (buffer_.size() < size + kDirectIoAlignment) {
+    buffer_.resize(size + kDirectIoAlignment);
+  }
+  const uintptr_t address = reinterpret_cast<uintptr_t>(buffer_.data());
+  return buffer_.data() +
+      (kDirectIoAlignment - address % kDirectIoAlignment) % kDirectIoAlignment;
+}
+
+DirectStreamingChunkReaderImpl::DirectStreamingChunkReaderImpl(
+    const boost::filesystem::path& path)
+    : StreamingChunkReaderImpl(path, true) {
+}
+
+DirectStreamingChunkReaderImpl::~DirectStreamingChunkReaderImpl() {
+}
+
+}  // namespace polar_express
@@ -0,0 +1,84 @@
+#ifndef STREAMING_CHUNK_READER_IMPL_H
+#define STREAMING_CHUNK_READER_IMPL_H
+
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "base/byte-span.h"
+#include "base/callback.h"
+#include "base/macros.h"
+#include "services/chunk-reader.h"
+
+namespace polar_express {
+
+class Chunk;
+
+// Reads chunks with pread into a single reusable buffer instead of
+// mapping the whole file, so that backing up a large tree does not fill
+// the page cache with data that will not be read again. The kernel is
+// told that the file will be read sequentially, the next chunk is read
+// ahead while the current one is processed, and pages are dropped from
+// the page cache once they have been read.
+//
+// Note that dropped pages are dropped for every process, so a file that
+// another program has cached will need to be read from disk again by
+// that program.
+class StreamingChunkReaderImpl : public ChunkReader {
+ public:
+  explicit StreamingChunkReaderImpl(const boost::filesystem::path& path);
+  virtual ~StreamingChunkReaderImpl();
+
+  virtual void ReadBlockDataSpanForChunk(
+      const Chunk& chunk, ByteSpan* block_data_for_chunk, Callback callback);
+
+  virtual void ReadBlockDataSpanAndFileIdentityForChunk(
+      const Chunk& chunk, ByteSpan* block_data_for_chunk,
+      FileIdentity* file_identity_after_read, Callback callback);
+
+  virtual void FindHoles(
+      int64_t min_hole_length, vector<Hole>* holes, Callback callback);
+
+ protected:
+  StreamingChunkReaderImpl(
+      const boost::filesystem::path& path, bool use_direct_io);
+
+ private:
+  // Reads the chunk's data into the buffer and returns a view of it,
+  // which is shorter than the chunk if it extends past EOF.
+  ByteSpan ReadChunk(const Chunk& chunk);
+
+  // Reads length bytes at offset into buffer, stopping early at EOF.
+  // Returns the number of bytes read.
+  size_t ReadFully(int64_t offset, size_t length, byte* buffer);
+
+  // Returns a pointer into buffer_ with room for size bytes, aligned as
+  // O_DIRECT requires.
+  byte* AlignedBuffer(size_t size);
+
+  const boost::filesystem::path path_;
+  int fd_;
+  bool use_direct_io_;
+  vector<byte> buffer_;
+
+  DISALLOW_COPY_AND_ASSIGN(StreamingChunkReaderImpl);
+};
+
+// As StreamingChunkReaderImpl, but opens the file with O_DIRECT so that
+// its data never enters the page cache at all. Falls back to buffered
+// reads if the file system does not support O_DIRECT.
+class DirectStreamingChunkReaderImpl : public StreamingChunkReaderImpl {
+ public:
+  explicit DirectStreamingChunkReaderImpl(
+      const boost::filesystem::path& path);
+  virtual ~DirectStreamingChunkReaderImpl();
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(DirectStreamingChunkReaderImpl);
+};
+
+}  // namespace polar_express
+
+#endif  // STREAMING_CHUNK_READER_IMPL_H
@@ -3,6 +3,8 @@
 #include <zlib.h>
 
 #include "base/options.h"
+#include "util/digest.h"
+#include "util/sha-hasher.h"
 
 DEFINE_OPTION(zlib_compression_level, int, Z_BEST_COMPRESSION,
               "Compression level when using zlib for compression.");
@@ -35,8 +37,7 @@ void ZlibCompressorImpl::InitializeCompression(size_t max_buffer_size) {
 }
 
 void ZlibCompressorImpl::CompressData(
-    const vector<byte>& data, vector<byte>* compressed_data,
-    Callback callback) {
+    ByteSpan data, vector<byte>* compressed_data, Callback callback) {
   assert(stream_ != nullptr);
 
   stream_->next_in = reinterpret_cast<const Bytef*>(data.data());
@@ -46,6 +47,43 @@ void ZlibCompressorImpl::CompressData(
   callback();
 }
 
+void ZlibCompressorImpl::CompressAndValidateData(
+    ByteSpan data, const string& expected_sha1_digest,
+    vector<byte>* compressed_data, bool* is_valid, Callback callback) {
+  assert(stream_ != nullptr);
+
+  // Checkpoint the stream, so that it can be rolled back if the digest
+  // turns out not to match. This copies the compressor's window and hash
+  // tables, which is far cheaper than a second pass over the data.
+  unique_ptr<z_stream> checkpoint_stream(new z_stream);
+  if (deflateCopy(checkpoint_stream.get(), stream_.get()) != Z_OK) {
+    // TODO(tylermchenry): Reasonable error handling.
+    assert(false);
+  }
+  const size_t initial_compressed_size = CHECK_NOTNULL(compressed_data)->size();
+
+  Sha1Hasher sha1_hasher;
+  ForEachTile(data, [&](ByteSpan tile) {
+    sha1_hasher.Update(tile);
+    stream_->next_in = reinterpret_cast<const Bytef*>(tile.data());
+    stream_->avail_in = tile.size();
+    DeflateStream(compressed_data, false /* do not flush */);
+  });
+
+  Sha1Digest sha1_digest;
+  sha1_hasher.Final(&sha1_digest);
+  *CHECK_NOTNULL(is_valid) = sha1_digest.EqualsBytes(expected_sha1_digest);
+  if (*is_valid) {
+    deflateEnd(checkpoint_stream.get());
+  } else {
+    deflateEnd(stream_.get());
+    stream_ = std::move(checkpoint_stream);
+    compressed_data->resize(initial_compressed_size);
+  }
+
+  callback();
+}
+
 void ZlibCompressorImpl::FinalizeCompression(vector<byte>* compressed_data) {
   assert(stream_ != nullptr);
 
@@ -70,7 +108,10 @@ void ZlibCompressorImpl::DeflateStream(
     stream_->avail_out = deflate_bound;
     deflate(stream_.get(), flush ? Z_FULL_FLUSH : Z_NO_FLUSH);
     compressed_data->resize(compressed_data->size() - stream_->avail_out);
-  } while (stream_->avail_in > 0);
+    // deflateBound only accounts for avail_in, not for output that zlib
+    // is still holding internally, so keep going while the output buffer
+    // is being filled completely.
+  } while (stream_->avail_in > 0 || stream_->avail_out == 0);
 }
 
 }  // namespace polar_express
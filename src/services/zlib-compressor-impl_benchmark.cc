@@ -0,0 +1,170 @@
+// Compares validating and compressing 1 MiB blocks in separate passes
+// (as the bundle stage used to) with the fused, tiled single pass in
+// CompressAndValidateData. Throughput is reported in bytes per CPU cycle
+// where a cycle counter is available, and in MB/s.
+//
+// Usage: zlib-compressor-impl_benchmark [--zlib_compression_level=N]
+//            [--compression_tile_size_bytes=N]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "base/byte-span.h"
+#include "base/macros.h"
+#include "base/options.h"
+#include "services/zlib-compressor-impl.h"
+#include "util/digest.h"
+#include "util/sha-hasher.h"
+
+using polar_express::ByteSpan;
+using polar_express::Sha1Digest;
+using polar_express::Sha1Hasher;
+using polar_express::ZlibCompressorImpl;
+
+namespace {
+
+const size_t kBlockSize = 1024 * 1024;
+const size_t kNumBlocks = 64;
+
+uint64_t ReadCycleCounter() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+// Generates text-like data that compresses roughly as well as typical
+// documents and source code do.
+vector<byte> GenerateData(size_t size) {
+  static const char* const kWords[] = {
+    "the", "backup", "of", "chunk", "bundle", "and", "file", "to", "snapshot",
+    "digest", "a", "compress", "glacier", "in", "block", "metadata", "is",
+    "polar", "express", "data", "for", "upload", "vault", "key",
+  };
+  const size_t num_words = sizeof(kWords) / sizeof(kWords[0]);
+  std::mt19937 rng(42);
+  vector<byte> data;
+  data.reserve(size);
+  while (data.size() < size) {
+    const char* word = kWords[rng() % num_words];
+    for (; *word != '\0' && data.size() < size; ++word) {
+      data.push_back(*word);
+    }
+    if (data.size() < size) {
+      data.push_back(rng() % 16 == 0 ? '\n' : ' ');
+    }
+  }
+  return data;
+}
+
+struct Measurement {
+  double bytes_per_cycle;
+  double megabytes_per_second;
+  size_t compressed_size;
+};
+
+template <typename Function>
+Measurement Measure(const vector<byte>& data, Function process_block) {
+  ZlibCompressorImpl compressor;
+  vector<byte> compressed_data;
+
+  // Run once to warm up caches and page in the data.
+  compressor.InitializeCompression(0);
+  process_block(&compressor, ByteSpan(data).subspan(0, kBlockSize),
+                &compressed_data);
+  compressor.FinalizeCompression(&compressed_data);
+  compressed_data.clear();
+
+  compressor.InitializeCompression(0);
+  auto start = std::chrono::steady_clock::now();
+  uint64_t start_cycles = ReadCycleCounter();
+  for (size_t offset = 0; offset < data.size(); offset += kBlockSize) {
+    process_block(&compressor, ByteSpan(data).subspan(offset, kBlockSize),
+                  &compressed_data);
+  }
+  uint64_t cycles = ReadCycleCounter() - start_cycles;
+  double seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  compressor.FinalizeCompression(&compressed_data);
+
+  Measurement measurement;
+  measurement.bytes_per_cycle =
+      (cycles > 0) ? static_cast<double>(data.size()) / cycles : 0;
+  measurement.megabytes_per_second = data.size() / seconds / 1e6;
+  measurement.compressed_size = compressed_data.size();
+  return measurement;
+}
+
+void Print(const char* name, const Measurement& measurement) {
+  printf("%-32s %12.4f %10.1f %14zu\n", name, measurement.bytes_per_cycle,
+         measurement.megabytes_per_second, measurement.compressed_size);
+}
+
+void NoOp() {
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (!polar_express::options::Init(argc, argv)) {
+    return 1;
+  }
+
+  const vector<byte> data = GenerateData(kNumBlocks * kBlockSize);
+  vector<string> sha1_digests;
+  for (size_t offset = 0; offset < data.size(); offset += kBlockSize) {
+    Sha1Digest sha1_digest;
+    Sha1Hasher::Hash(ByteSpan(data).subspan(offset, kBlockSize), &sha1_digest);
+    sha1_digests.push_back(sha1_digest.ToBytes());
+  }
+
+  printf("%-32s %12s %10s %14s\n",
+         "path", "bytes/cycle", "MB/s", "compressed");
+
+  // Copy into a vector, hash while chunking, hash again to validate, and
+  // then compress: four passes over each block.
+  Print("copy+hash+hash+compress", Measure(data, [&](
+      ZlibCompressorImpl* compressor, ByteSpan block,
+      vector<byte>* compressed_data) {
+    vector<byte> copy(block.begin(), block.end());
+    Sha1Digest chunk_digest;
+    Sha1Hasher::Hash(copy, &chunk_digest);
+    Sha1Digest validation_digest;
+    Sha1Hasher::Hash(copy, &validation_digest);
+    compressor->CompressData(copy, compressed_data, &NoOp);
+  }));
+
+  // Validate and then compress: two passes over each block.
+  Print("hash+compress", Measure(data, [&](
+      ZlibCompressorImpl* compressor, ByteSpan block,
+      vector<byte>* compressed_data) {
+    Sha1Digest validation_digest;
+    Sha1Hasher::Hash(block, &validation_digest);
+    compressor->CompressData(block, compressed_data, &NoOp);
+  }));
+
+  // Validate and compress tile by tile in one pass.
+  Print("fused", Measure(data, [&](
+      ZlibCompressorImpl* compressor, ByteSpan block,
+      vector<byte>* compressed_data) {
+    bool is_valid = false;
+    compressor->CompressAndValidateData(
+        block, sha1_digests[(block.data() - data.data()) / kBlockSize],
+        compressed_data, &is_valid, &NoOp);
+    if (!is_valid) {
+      fprintf(stderr, "Digest mismatch!\n");
+      exit(1);
+    }
+  }));
+
+  return 0;
+}
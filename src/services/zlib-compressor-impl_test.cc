@@ -0,0 +1,97 @@
+#include "services/zlib-compressor-impl.h"
+
+#include <zlib.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/bind/bind.hpp>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "base/byte-span.h"
+#include "base/macros.h"
+#include "util/digest.h"
+#include "util/sha-hasher.h"
+
+namespace polar_express {
+namespace {
+
+class ZlibCompressorImplTest : public testing::Test {
+ public:
+  void CompressorCallback() {}
+
+ protected:
+  virtual void SetUp() {
+    zlib_compressor_.InitializeCompression(0);
+  }
+
+  static vector<byte> MakeData(size_t size, byte seed) {
+    vector<byte> data(size);
+    for (size_t i = 0; i < size; ++i) {
+      data[i] = static_cast<byte>((i * 7 + seed) % 251);
+    }
+    return data;
+  }
+
+  static string Sha1DigestOf(const vector<byte>& data) {
+    Sha1Digest sha1_digest;
+    Sha1Hasher::Hash(data, &sha1_digest);
+    return sha1_digest.ToBytes();
+  }
+
+  bool CompressAndValidate(const vector<byte>& data,
+                           const string& expected_sha1_digest) {
+    bool is_valid = false;
+    zlib_compressor_.CompressAndValidateData(
+        data, expected_sha1_digest, &compressed_data_, &is_valid,
+        boost::bind(&ZlibCompressorImplTest::CompressorCallback, this));
+    return is_valid;
+  }
+
+  vector<byte> FinalizeAndDecompress() {
+    zlib_compressor_.FinalizeCompression(&compressed_data_);
+
+    z_stream stream;
+    stream.zalloc = nullptr;
+    stream.zfree = nullptr;
+    stream.opaque = nullptr;
+    stream.next_in = compressed_data_.data();
+    stream.avail_in = compressed_data_.size();
+    EXPECT_EQ(Z_OK, inflateInit(&stream));
+
+    vector<byte> decompressed_data(1 << 24);
+    stream.next_out = decompressed_data.data();
+    stream.avail_out = decompressed_data.size();
+    inflate(&stream, Z_SYNC_FLUSH);
+    decompressed_data.resize(decompressed_data.size() - stream.avail_out);
+    inflateEnd(&stream);
+    return decompressed_data;
+  }
+
+  ZlibCompressorImpl zlib_compressor_;
+  vector<byte> compressed_data_;
+};
+
+TEST_F(ZlibCompressorImplTest, CompressAndValidateMatchingData) {
+  vector<byte> data = MakeData(3 * 1024 * 1024 + 17, 1);
+  EXPECT_TRUE(CompressAndValidate(data, Sha1DigestOf(data)));
+  EXPECT_THAT(FinalizeAndDecompress(), testing::ContainerEq(data));
+}
+
+TEST_F(ZlibCompressorImplTest, CompressAndValidateRollsBackMismatchedData) {
+  vector<byte> first_data = MakeData(1024 * 1024, 1);
+  vector<byte> mismatched_data = MakeData(1024 * 1024, 2);
+  vector<byte> last_data = MakeData(1024 * 1024 + 5, 3);
+
+  EXPECT_TRUE(CompressAndValidate(first_data, Sha1DigestOf(first_data)));
+  EXPECT_FALSE(CompressAndValidate(mismatched_data, Sha1DigestOf(first_data)));
+  EXPECT_TRUE(CompressAndValidate(last_data, Sha1DigestOf(last_data)));
+
+  vector<byte> expected_data = first_data;
+  expected_data.insert(expected_data.end(), last_data.begin(), last_data.end());
+  EXPECT_THAT(FinalizeAndDecompress(), testing::ContainerEq(expected_data));
+}
+
+}  // namespace
+}  // namespace polar_express
@@ -3,7 +3,6 @@
 #include "base/options.h"
 #include "file/bundle.h"
 #include "services/bundle-hasher.h"
-#include "services/chunk-hasher.h"
 #include "services/chunk-reader.h"
 #include "services/compressor.h"
 #include "services/file-writer.h"
@@ -11,6 +10,7 @@
 #include "proto/block.pb.h"
 #include "proto/file.pb.h"
 #include "proto/snapshot.pb.h"
+#include "util/file-identity-util.h"
 
 DEFINE_OPTION(
     max_compression_buffer_size_bytes, size_t, 2 * (1 << 20) /* 2 MiB */,
@@ -20,6 +20,17 @@ DEFINE_OPTION(
 DECLARE_OPTION(max_bundle_size_bytes, size_t);
 
 namespace polar_express {
+namespace {
+
+bool IsInExistingBundle(
+    const boost::shared_ptr<BundleAnnotations>& bundle_annotations) {
+  return bundle_annotations != nullptr && bundle_annotations->id() >= 0;
+}
+
+void DoNothing() {
+}
+
+}  // namespace
 
 void BundleStateMachine::Start(
     const string& root,
@@ -37,9 +48,11 @@ BundleStateMachineImpl::BundleStateMachineImpl()
       exit_requested_(false),
       chunk_bytes_pending_(0),
       active_chunk_(nullptr),
+      next_chunk_with_bundle_info_(nullptr),
+      file_identity_after_reading_active_chunk_(new FileIdentity),
       active_chunk_hash_is_valid_(false),
+      active_chunk_is_compressed_(false),
       active_bundle_(new Bundle),
-      chunk_hasher_(new ChunkHasher),
       compressor_(
           // TODO(tylermchenry): Compression type should be configurable.
           Compressor::CreateCompressor(BundlePayload::COMPRESSION_TYPE_ZLIB)),
@@ -100,6 +113,8 @@ size_t BundleStateMachineImpl::chunk_bytes_pending() const {
 
 PE_STATE_MACHINE_ACTION_HANDLER(BundleStateMachineImpl, StartNewSnapshot) {
   chunk_reader_.reset();
+  next_chunk_with_bundle_info_ = nullptr;
+  existing_bundle_annotations_for_next_chunk_.reset();
   if (pending_snapshot_ != nullptr) {
     PushPendingChunksForSnapshot(pending_snapshot_);
     chunk_reader_ = ChunkReader::CreateChunkReaderForPath(
@@ -122,21 +137,48 @@ PE_STATE_MACHINE_ACTION_HANDLER(BundleStateMachineImpl, ResetForNextSnapshot) {
 PE_STATE_MACHINE_ACTION_HANDLER(BundleStateMachineImpl, GetExistingBundleInfo) {
   const Block& active_chunk_block = CHECK_NOTNULL(active_chunk_)->block();
   existing_bundle_annotations_for_active_chunk_.reset();
-  if (block_ids_in_active_bundle_.find(active_chunk_block.id()) !=
+  bool need_active_chunk_info =
+      block_ids_in_active_bundle_.find(active_chunk_block.id()) ==
+      block_ids_in_active_bundle_.end();
+  if (next_chunk_with_bundle_info_ == active_chunk_) {
+    existing_bundle_annotations_for_active_chunk_.swap(
+        existing_bundle_annotations_for_next_chunk_);
+    need_active_chunk_info = false;
+  }
+  next_chunk_with_bundle_info_ = nullptr;
+  existing_bundle_annotations_for_next_chunk_.reset();
+
+  const Chunk* next_chunk =
+      pending_chunks_.empty() ? nullptr : pending_chunks_.front();
+  if (next_chunk != nullptr &&
+      block_ids_in_active_bundle_.find(next_chunk->block().id()) !=
       block_ids_in_active_bundle_.end()) {
-    PostEvent<ExistingBundleInfoReady>();
-  } else {
+    next_chunk = nullptr;
+  }
+
+  // The metadata DB runs lookups in order, so the active chunk's result is
+  // in place once the next chunk's lookup calls back.
+  if (need_active_chunk_info) {
     metadata_db_->GetLatestBundleForBlock(
         active_chunk_block, &existing_bundle_annotations_for_active_chunk_,
+        (next_chunk != nullptr)
+            ? Callback(&DoNothing)
+            : CreateExternalEventCallback<ExistingBundleInfoReady>());
+  }
+  if (next_chunk != nullptr) {
+    next_chunk_with_bundle_info_ = next_chunk;
+    metadata_db_->GetLatestBundleForBlock(
+        next_chunk->block(), &existing_bundle_annotations_for_next_chunk_,
         CreateExternalEventCallback<ExistingBundleInfoReady>());
+  } else if (!need_active_chunk_info) {
+    PostEvent<ExistingBundleInfoReady>();
   }
 }
 
 PE_STATE_MACHINE_ACTION_HANDLER(
     BundleStateMachineImpl, InspectExistingBundleInfo) {
   const Block& active_chunk_block = CHECK_NOTNULL(active_chunk_)->block();
-  if (existing_bundle_annotations_for_active_chunk_ != nullptr &&
-      existing_bundle_annotations_for_active_chunk_->id() >= 0) {
+  if (IsInExistingBundle(existing_bundle_annotations_for_active_chunk_)) {
     DLOG(std::cerr << "Discarding chunk for block " << active_chunk_block.id()
                    << " since it is already in bundle "
                    << existing_bundle_annotations_for_active_chunk_->id()
@@ -160,17 +202,51 @@ PE_STATE_MACHINE_ACTION_HANDLER(BundleStateMachineImpl, DiscardChunk) {
 }
 
 PE_STATE_MACHINE_ACTION_HANDLER(BundleStateMachineImpl, ReadChunkContents) {
-  block_data_for_active_chunk_.clear();
-  chunk_reader_->ReadBlockDataForChunk(
+  block_data_for_active_chunk_ = ByteSpan();
+  active_chunk_is_compressed_ = false;
+  file_identity_after_reading_active_chunk_->Clear();
+  chunk_reader_->ReadBlockDataSpanAndFileIdentityForChunk(
       *active_chunk_, &block_data_for_active_chunk_,
+      file_identity_after_reading_active_chunk_.get(),
       CreateExternalEventCallback<ChunkContentsReady>());
+
+  // Start reading the next chunk while this one is hashed, compressed and
+  // encrypted, if it was looked up along with this one and will be read.
+  if (!pending_chunks_.empty() &&
+      next_chunk_with_bundle_info_ == pending_chunks_.front() &&
+      !IsInExistingBundle(existing_bundle_annotations_for_next_chunk_) &&
+      next_chunk_with_bundle_info_->block().id() !=
+          active_chunk_->block().id() &&
+      block_ids_in_active_bundle_.find(
+          next_chunk_with_bundle_info_->block().id()) ==
+      block_ids_in_active_bundle_.end()) {
+    chunk_reader_->PrefetchChunk(*next_chunk_with_bundle_info_);
+  }
 }
 
 PE_STATE_MACHINE_ACTION_HANDLER(BundleStateMachineImpl, HashChunkContents) {
   active_chunk_hash_is_valid_ = false;
-  chunk_hasher_->ValidateHash(
-      *active_chunk_, block_data_for_active_chunk_,
-      &active_chunk_hash_is_valid_,
+
+  // If the file is unchanged since the snapshot stage hashed it, the
+  // data just read is the data that was hashed, so the chunk's digest
+  // is already known to be correct.
+  if (block_data_for_active_chunk_.size() ==
+      static_cast<size_t>(active_chunk_->block().length()) &&
+      FileIdentityUtil::FileIdentitiesEqual(
+          pending_snapshot_->hashed_file_identity(),
+          *file_identity_after_reading_active_chunk_)) {
+    active_chunk_hash_is_valid_ = true;
+    PostEvent<ChunkContentsHashReady>();
+    return;
+  }
+
+  // Otherwise validate the digest while compressing, in a single pass
+  // over the data. If it does not match, the compressor rolls back and
+  // the chunk is discarded as before.
+  active_chunk_is_compressed_ = true;
+  compressor_->CompressAndValidateData(
+      block_data_for_active_chunk_, active_chunk_->block().sha1_digest(),
+      &compressed_block_data_for_active_chunk_, &active_chunk_hash_is_valid_,
       CreateExternalEventCallback<ChunkContentsHashReady>());
 }
 
@@ -185,6 +261,11 @@ PE_STATE_MACHINE_ACTION_HANDLER(BundleStateMachineImpl, InspectChunkContents) {
 }
 
 PE_STATE_MACHINE_ACTION_HANDLER(BundleStateMachineImpl, CompressChunkContents) {
+  if (active_chunk_is_compressed_) {
+    // Already compressed while the digest was being validated.
+    PostEvent<CompressionDone>();
+    return;
+  }
   compressor_->CompressData(
       block_data_for_active_chunk_, &compressed_block_data_for_active_chunk_,
       CreateExternalEventCallback<CompressionDone>());
@@ -195,8 +276,8 @@ PE_STATE_MACHINE_ACTION_HANDLER(BundleStateMachineImpl, FinishChunk) {
   assert(active_bundle_ != nullptr);
   assert(!active_bundle_->is_finalized());
 
-  // Compression is finished; get rid of uncompressed data to free memory.
-  block_data_for_active_chunk_.clear();
+  // Compression is finished; the uncompressed data is no longer needed.
+  block_data_for_active_chunk_ = ByteSpan();
 
   if (active_bundle_->manifest().payloads_size() == 0) {
     active_bundle_->StartNewPayload(compressor_->compression_type());
@@ -304,6 +385,9 @@ PE_STATE_MACHINE_ACTION_HANDLER(BundleStateMachineImpl, ResetForNextBundle) {
   generated_bundle_.reset();
   active_bundle_.reset(new Bundle);
   block_ids_in_active_bundle_.clear();
+  // The bundle just recorded may hold the next chunk's block.
+  next_chunk_with_bundle_info_ = nullptr;
+  existing_bundle_annotations_for_next_chunk_.reset();
   compressor_->InitializeCompression(
       options::max_compression_buffer_size_bytes);
   NextChunk();
@@ -328,6 +412,10 @@ void BundleStateMachineImpl::PushPendingChunksForSnapshot(
     boost::shared_ptr<Snapshot> snapshot) {
   const Chunk* chunk_ptr = nullptr;
   for (const auto& chunk : snapshot->chunks()) {
+    // Holes contain no data, so there is nothing to bundle for them.
+    if (chunk.block().is_hole()) {
+      continue;
+    }
     chunk_ptr = &chunk;
     pending_chunks_.push(chunk_ptr);
     chunk_bytes_pending_ += chunk_ptr->block().length();
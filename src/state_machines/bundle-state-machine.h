@@ -10,6 +10,7 @@
 #include <boost/shared_ptr.hpp>
 #include <crypto++/secblock.h>
 
+#include "base/byte-span.h"
 #include "base/callback.h"
 #include "base/macros.h"
 #include "base/overrideable-unique-ptr.h"
@@ -24,10 +25,10 @@ class BundleAnnotations;
 class BundleHasher;
 class BundleStateMachine;
 class Chunk;
-class ChunkHasher;
 class ChunkReader;
 class Compressor;
 class Cryptor;
+class FileIdentity;
 class FileWriter;
 class MetadataDb;
 class Snapshot;
@@ -42,6 +43,9 @@ class Snapshot;
 //  - For the next chunk in the queue:
 //    - Check to see if it is in any bundles already, if so skip.
 //    - Read chunk contents into memory, compare to hash. If mismatch, skip.
+//      (The comparison is skipped if the file has not changed since the
+//      snapshot's chunks were hashed; otherwise it is done in the same
+//      pass as compression.)
 //    - Compress chunk contents, add to current bundle.
 //    - If current bundle is under max size, process next chunk (loop).
 //  - Once current bundle exceeds max size:
@@ -345,8 +349,20 @@ class BundleStateMachineImpl
   const Chunk* active_chunk_;
   boost::shared_ptr<BundleAnnotations>
       existing_bundle_annotations_for_active_chunk_;
-  vector<byte> block_data_for_active_chunk_;
+  // The chunk after the active one is looked up along with it, so that it
+  // can be prefetched only if it will be read. The result is reused when
+  // that chunk becomes active, unless a bundle has been recorded since.
+  const Chunk* next_chunk_with_bundle_info_;
+  boost::shared_ptr<BundleAnnotations>
+      existing_bundle_annotations_for_next_chunk_;
+  // Points into the mapping or buffer held by chunk_reader_, which is not
+  // reset or read from again until the active chunk has been finished.
+  ByteSpan block_data_for_active_chunk_;
+  unique_ptr<FileIdentity> file_identity_after_reading_active_chunk_;
   bool active_chunk_hash_is_valid_;
+  // True if the active chunk was compressed as part of validating its
+  // digest, so it does not need to be compressed again.
+  bool active_chunk_is_compressed_;
   vector<byte> compressed_block_data_for_active_chunk_;
 
   std::set<int64_t> block_ids_in_active_bundle_;
@@ -354,7 +370,6 @@ class BundleStateMachineImpl
   boost::shared_ptr<AnnotatedBundleData> generated_bundle_;
 
   unique_ptr<ChunkReader> chunk_reader_;
-  OverrideableUniquePtr<ChunkHasher> chunk_hasher_;
   OverrideableUniquePtr<Compressor> compressor_;
   // Cryptor is not overrideable because it needs to be reset in InternalStart.
   // TODO(tylermchenry): Fix this when writing unit tests.
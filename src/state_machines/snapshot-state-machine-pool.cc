@@ -4,7 +4,9 @@
 
 #include "base/options.h"
 #include "proto/snapshot.pb.h"
+#include "services/previous-snapshot-prefetcher.h"
 #include "state_machines/snapshot-state-machine.h"
+#include "util/file-stat-util.h"
 
 DEFINE_OPTION(max_pending_snapshot_bytes, size_t, 50 * (1 << 20) /* 50 MiB */,
               "Maximum amount of on-disk file data that may be waiting to "
@@ -14,15 +16,26 @@ DEFINE_OPTION(max_simultaneous_snapshots, size_t, 20,
               "Maximum number of snapshots that the system will perform "
               "simultaneously.");
 
+DEFINE_OPTION(max_prefetched_previous_snapshots, size_t, 4096,
+              "Maximum number of previous snapshots, of files about to be "
+              "snapshotted, that are fetched from the metadata DB ahead of "
+              "time in batches rather than one at a time. Zero disables "
+              "prefetching.");
+
 namespace polar_express {
 
 SnapshotStateMachinePool::SnapshotStateMachinePool(
     boost::shared_ptr<AsioDispatcher::StrandDispatcher> strand_dispatcher,
     const string& root)
-    : OneShotStateMachinePool<SnapshotStateMachine, boost::filesystem::path>(
+    : OneShotStateMachinePool<SnapshotStateMachine, PathWithFileStat>(
           strand_dispatcher, options::max_pending_snapshot_bytes,
           options::max_simultaneous_snapshots),
       root_(root),
+      previous_snapshot_prefetcher_(
+          options::max_prefetched_previous_snapshots > 0
+              ? new PreviousSnapshotPrefetcher(
+                    root, options::max_prefetched_previous_snapshots)
+              : nullptr),
       input_finished_(false),
       num_snapshots_generated_(0),
       size_of_snapshots_generated_(0) {}
@@ -41,17 +54,30 @@ void SnapshotStateMachinePool::SetNeedMoreInputCallback(Callback callback) {
 }
 
 size_t SnapshotStateMachinePool::OutputWeightToBeAddedByInput(
-    boost::shared_ptr<boost::filesystem::path> input) const {
+    boost::shared_ptr<PathWithFileStat> input) const {
   return std::min<size_t>(
       next_pool_max_input_weight(),
       std::max<size_t>(
-          1, is_regular(*CHECK_NOTNULL(input)) ? file_size(*input) : 0));
+          1, file_stat_util::IsRegularFile(CHECK_NOTNULL(input)->second)
+                 ? input->second.length() : 0));
 }
 
 void SnapshotStateMachinePool::NotifyInputFinished() {
   input_finished_ = true;
 }
 
+size_t SnapshotStateMachinePool::NumPreviousSnapshotsToPrefetch() const {
+  return previous_snapshot_prefetcher_ != nullptr
+      ? previous_snapshot_prefetcher_->NumPathsAccepted() : 0;
+}
+
+void SnapshotStateMachinePool::PrefetchPreviousSnapshots(
+    const vector<boost::filesystem::path>& paths) {
+  if (previous_snapshot_prefetcher_ != nullptr) {
+    previous_snapshot_prefetcher_->Prefetch(paths);
+  }
+}
+
 int SnapshotStateMachinePool::num_snapshots_generated() const {
   return num_snapshots_generated_;
 }
@@ -65,11 +91,12 @@ bool SnapshotStateMachinePool::IsExpectingMoreInput() const {
 }
 
 void SnapshotStateMachinePool::RunInputOnStateMachine(
-    boost::shared_ptr<boost::filesystem::path> input,
+    boost::shared_ptr<PathWithFileStat> input,
     SnapshotStateMachine* state_machine) {
-  state_machine->Start(root_, *input);
+  state_machine->Start(root_, input->first, input->second,
+                       previous_snapshot_prefetcher_.get());
 
-  DLOG(std::cerr << "Snapshotting " << *input << std::endl);
+  DLOG(std::cerr << "Snapshotting " << input->first << std::endl);
 
   if (IsExpectingMoreInput() &&
       (pending_inputs_weight() < (max_pending_inputs_weight() / 2)) &&
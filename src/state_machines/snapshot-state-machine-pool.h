@@ -1,22 +1,31 @@
 #ifndef SNAPSHOT_STATE_MACHINE_POOL_H
 #define SNAPSHOT_STATE_MACHINE_POOL_H
 
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <boost/shared_ptr.hpp>
 #include <boost/filesystem.hpp>
 
 #include "base/macros.h"
+#include "proto/file.pb.h"
 #include "services/cryptor.h"
 #include "state_machines/one-shot-state-machine-pool.h"
 
 namespace polar_express {
 
+class PreviousSnapshotPrefetcher;
 class Snapshot;
 class SnapshotStateMachine;
 
+// A path found by the filesystem scanner, with the results of stat'ing it
+// during the scan.
+typedef std::pair<boost::filesystem::path, FileStat> PathWithFileStat;
+
 class SnapshotStateMachinePool : public OneShotStateMachinePool<
-    SnapshotStateMachine, boost::filesystem::path> {
+    SnapshotStateMachine, PathWithFileStat> {
  public:
   SnapshotStateMachinePool(
       boost::shared_ptr<AsioDispatcher::StrandDispatcher> strand_dispatcher,
@@ -30,6 +39,16 @@ class SnapshotStateMachinePool : public OneShotStateMachinePool<
 
   void NotifyInputFinished();
 
+  // Returns the number of paths that PrefetchPreviousSnapshots would accept
+  // now, which is zero if previous snapshots are not prefetched.
+  size_t NumPreviousSnapshotsToPrefetch() const;
+
+  // Starts fetching the previous snapshots of the files at paths, which are
+  // about to be added as inputs, from the metadata DB in batches, so that
+  // the state machines need not each look theirs up.
+  void PrefetchPreviousSnapshots(
+      const vector<boost::filesystem::path>& paths);
+
   int num_snapshots_generated() const;
   size_t size_of_snapshots_generated() const;
 
@@ -39,18 +58,19 @@ class SnapshotStateMachinePool : public OneShotStateMachinePool<
 
  private:
   virtual size_t OutputWeightToBeAddedByInput(
-      boost::shared_ptr<boost::filesystem::path> input) const;
+      boost::shared_ptr<PathWithFileStat> input) const;
 
   virtual bool IsExpectingMoreInput() const;
 
   virtual void RunInputOnStateMachine(
-      boost::shared_ptr<boost::filesystem::path> input,
+      boost::shared_ptr<PathWithFileStat> input,
       SnapshotStateMachine* state_machine);
 
   virtual void HandleStateMachineFinishedInternal(
       SnapshotStateMachine* state_machine);
 
   const string root_;
+  const unique_ptr<PreviousSnapshotPrefetcher> previous_snapshot_prefetcher_;
 
   Callback need_more_input_callback_;
   bool input_finished_;
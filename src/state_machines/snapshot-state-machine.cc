@@ -2,18 +2,32 @@
 
 #include <iostream>
 
+#include "base/options.h"
 #include "services/candidate-snapshot-generator.h"
 #include "services/chunk-hasher.h"
 #include "services/metadata-db.h"
+#include "services/previous-snapshot-prefetcher.h"
 #include "proto/block.pb.h"
 #include "proto/snapshot.pb.h"
 #include "util/snapshot-util.h"
 
+DEFINE_OPTION(reuse_chunks_of_moved_files, bool, true,
+              "When true, a file that has not been backed up at its path "
+              "before, but which has the same device, inode, length and "
+              "modification time as a file previously backed up under "
+              "another path (because it was renamed or hard-linked), reuses "
+              "that file's chunks instead of being read and hashed again. "
+              "Files that were already backed up at their path are always "
+              "read, so that modified files do not need a metadata DB "
+              "lookup.");
+
 namespace polar_express {
 
 void SnapshotStateMachine::Start(
-    const string& root, const filesystem::path& filepath) {
-  InternalStart(root, filepath);
+    const string& root, const filesystem::path& filepath,
+    const FileStat& file_stat,
+    PreviousSnapshotPrefetcher* previous_snapshot_prefetcher) {
+  InternalStart(root, filepath, file_stat, previous_snapshot_prefetcher);
 }
 
 SnapshotStateMachineImpl::BackEnd* SnapshotStateMachine::GetBackEnd() {
@@ -24,7 +38,9 @@ SnapshotStateMachineImpl::SnapshotStateMachineImpl()
     : snapshot_util_(new SnapshotUtil),
       candidate_snapshot_generator_(new CandidateSnapshotGenerator),
       chunk_hasher_(new ChunkHasher),
-      metadata_db_(new MetadataDb) {
+      metadata_db_(new MetadataDb),
+      previous_snapshot_prefetcher_(nullptr),
+      chunks_reused_(false) {
 }
 
 SnapshotStateMachineImpl::~SnapshotStateMachineImpl() {
@@ -38,15 +54,22 @@ SnapshotStateMachineImpl::GetGeneratedSnapshot() const {
 PE_STATE_MACHINE_ACTION_HANDLER(
     SnapshotStateMachineImpl, RequestGenerateCandidateSnapshot) {
   candidate_snapshot_generator_->GenerateCandidateSnapshot(
-      root_, filepath_, &candidate_snapshot_,
+      root_, filepath_, file_stat_, &candidate_snapshot_,
       CreateExternalEventCallback<CandidateSnapshotReady>());
 }
 
 PE_STATE_MACHINE_ACTION_HANDLER(
     SnapshotStateMachineImpl, RequestPreviousSnapshot) {
-  metadata_db_->GetLatestSnapshot(
-      candidate_snapshot_->file(), &previous_snapshot_,
-      CreateExternalEventCallback<PreviousSnapshotReady>());
+  const Callback previous_snapshot_ready_callback =
+      CreateExternalEventCallback<PreviousSnapshotReady>();
+  if (previous_snapshot_prefetcher_ == nullptr ||
+      !previous_snapshot_prefetcher_->GetLatestSnapshot(
+          filepath_, candidate_snapshot_->file(), &previous_snapshot_,
+          previous_snapshot_ready_callback)) {
+    metadata_db_->GetLatestSnapshot(
+        candidate_snapshot_->file(), &previous_snapshot_,
+        previous_snapshot_ready_callback);
+  }
 }
 
 PE_STATE_MACHINE_ACTION_HANDLER(
@@ -58,6 +81,49 @@ PE_STATE_MACHINE_ACTION_HANDLER(
   } else if (snapshot_util_->FileContentsEqual(
       *candidate_snapshot_, *previous_snapshot_)) {
     PostEvent<ReadyToRecord>();
+  } else if (options::reuse_chunks_of_moved_files &&
+             candidate_snapshot_->is_regular() &&
+             candidate_snapshot_->length() > 0 && file_stat_.has_inode() &&
+             (!previous_snapshot_->has_id() ||
+              previous_snapshot_->is_deleted())) {
+    PostEvent<NeedChunks>();
+  } else {
+    PostEvent<NeedChunkHashes>();
+  }
+}
+
+PE_STATE_MACHINE_ACTION_HANDLER(
+    SnapshotStateMachineImpl, RequestSnapshotWithSameIdentity) {
+  file_identity_.set_device(file_stat_.device());
+  file_identity_.set_inode(file_stat_.inode());
+  file_identity_.set_length(file_stat_.length());
+  file_identity_.set_modification_time_ns(file_stat_.modification_time_ns());
+  metadata_db_->GetLatestSnapshotWithFileIdentity(
+      file_identity_, &snapshot_with_same_identity_,
+      CreateExternalEventCallback<SnapshotWithSameIdentityReady>());
+}
+
+PE_STATE_MACHINE_ACTION_HANDLER(
+    SnapshotStateMachineImpl, InspectSnapshotWithSameIdentity) {
+  if (snapshot_with_same_identity_ != nullptr) {
+    PostEvent<CanReuseChunks>();
+  } else {
+    PostEvent<NeedChunkHashes>();
+  }
+}
+
+PE_STATE_MACHINE_ACTION_HANDLER(
+    SnapshotStateMachineImpl, RequestReuseChunks) {
+  chunk_hasher_->ReuseChunks(
+      filepath_, snapshot_with_same_identity_, candidate_snapshot_,
+      &chunks_reused_, CreateExternalEventCallback<ReusedChunksReady>());
+}
+
+PE_STATE_MACHINE_ACTION_HANDLER(
+    SnapshotStateMachineImpl, InspectReusedChunks) {
+  snapshot_with_same_identity_.reset();
+  if (chunks_reused_) {
+    PostEvent<ReadyToRecord>();
   } else {
     PostEvent<NeedChunkHashes>();
   }
@@ -88,9 +154,13 @@ PE_STATE_MACHINE_ACTION_HANDLER(
 }
 
 void SnapshotStateMachineImpl::InternalStart(
-    const string& root, const filesystem::path& filepath) {
+    const string& root, const filesystem::path& filepath,
+    const FileStat& file_stat,
+    PreviousSnapshotPrefetcher* previous_snapshot_prefetcher) {
   root_ = root;
   filepath_ = filepath;
+  file_stat_ = file_stat;
+  previous_snapshot_prefetcher_ = previous_snapshot_prefetcher;
   PostEvent<NewFilePathReady>();
 }
 
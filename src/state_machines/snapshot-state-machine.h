@@ -8,6 +8,8 @@
 
 #include "base/macros.h"
 #include "base/overrideable-unique-ptr.h"
+#include "proto/file.pb.h"
+#include "proto/snapshot.pb.h"
 #include "state_machines/state-machine.h"
 
 namespace polar_express {
@@ -16,13 +18,18 @@ class CandidateSnapshotGenerator;
 class Chunk;
 class ChunkHasher;
 class MetadataDb;
+class PreviousSnapshotPrefetcher;
 class Snapshot;
 class SnapshotStateMachine;
 class SnapshotUtil;
 
 // A state machine which goes through the process of generating a snapshot of a
 // single file, comparing it with the previous snapshot (if any), and then
-// writing information about any updates to the database.
+// writing information about any updates to the database. If the file's
+// contents have changed, but it has the same identity (device, inode, length
+// and modification time) as a file previously hashed under another path,
+// because it was renamed or hard-linked, that file's chunks are reused
+// instead of hashing it again.
 class SnapshotStateMachineImpl
   : public StateMachine<SnapshotStateMachineImpl, SnapshotStateMachine> {
  public:
@@ -33,6 +40,10 @@ class SnapshotStateMachineImpl
   PE_STATE_MACHINE_DEFINE_STATE(WaitForCandidateSnapshot);
   PE_STATE_MACHINE_DEFINE_STATE(WaitForPreviousSnapshot);
   PE_STATE_MACHINE_DEFINE_STATE(HaveSnapshots);
+  PE_STATE_MACHINE_DEFINE_STATE(WaitForSnapshotWithSameIdentity);
+  PE_STATE_MACHINE_DEFINE_STATE(HaveSnapshotWithSameIdentity);
+  PE_STATE_MACHINE_DEFINE_STATE(WaitForReusedChunks);
+  PE_STATE_MACHINE_DEFINE_STATE(HaveReusedChunks);
   PE_STATE_MACHINE_DEFINE_STATE(WaitForChunkHashes);
   PE_STATE_MACHINE_DEFINE_STATE(HaveChunkHashes);
   PE_STATE_MACHINE_DEFINE_STATE(WaitForSnapshotToRecord);
@@ -48,6 +59,10 @@ class SnapshotStateMachineImpl
   PE_STATE_MACHINE_DEFINE_EVENT(NewFilePathReady);
   PE_STATE_MACHINE_DEFINE_EVENT(CandidateSnapshotReady);
   PE_STATE_MACHINE_DEFINE_EVENT(PreviousSnapshotReady);
+  PE_STATE_MACHINE_DEFINE_EVENT(NeedChunks);
+  PE_STATE_MACHINE_DEFINE_EVENT(SnapshotWithSameIdentityReady);
+  PE_STATE_MACHINE_DEFINE_EVENT(CanReuseChunks);
+  PE_STATE_MACHINE_DEFINE_EVENT(ReusedChunksReady);
   PE_STATE_MACHINE_DEFINE_EVENT(NeedChunkHashes);
   PE_STATE_MACHINE_DEFINE_EVENT(ChunkHashesReady);
   PE_STATE_MACHINE_DEFINE_EVENT(ReadyToRecord);
@@ -57,6 +72,10 @@ class SnapshotStateMachineImpl
   PE_STATE_MACHINE_DEFINE_ACTION(RequestGenerateCandidateSnapshot);
   PE_STATE_MACHINE_DEFINE_ACTION(RequestPreviousSnapshot);
   PE_STATE_MACHINE_DEFINE_ACTION(InspectSnapshots);
+  PE_STATE_MACHINE_DEFINE_ACTION(RequestSnapshotWithSameIdentity);
+  PE_STATE_MACHINE_DEFINE_ACTION(InspectSnapshotWithSameIdentity);
+  PE_STATE_MACHINE_DEFINE_ACTION(RequestReuseChunks);
+  PE_STATE_MACHINE_DEFINE_ACTION(InspectReusedChunks);
   PE_STATE_MACHINE_DEFINE_ACTION(RequestGenerateAndHashChunks);
   PE_STATE_MACHINE_DEFINE_ACTION(InspectChunkHashes);
   PE_STATE_MACHINE_DEFINE_ACTION(RecordCandidateSnapshot);
@@ -80,6 +99,41 @@ class SnapshotStateMachineImpl
           HaveSnapshots),
       PE_STATE_MACHINE_TRANSITION(
           HaveSnapshots,
+          NeedChunks,
+          RequestSnapshotWithSameIdentity,
+          WaitForSnapshotWithSameIdentity),
+      PE_STATE_MACHINE_TRANSITION(
+          WaitForSnapshotWithSameIdentity,
+          SnapshotWithSameIdentityReady,
+          InspectSnapshotWithSameIdentity,
+          HaveSnapshotWithSameIdentity),
+      PE_STATE_MACHINE_TRANSITION(
+          HaveSnapshotWithSameIdentity,
+          CanReuseChunks,
+          RequestReuseChunks,
+          WaitForReusedChunks),
+      PE_STATE_MACHINE_TRANSITION(
+          WaitForReusedChunks,
+          ReusedChunksReady,
+          InspectReusedChunks,
+          HaveReusedChunks),
+      PE_STATE_MACHINE_TRANSITION(
+          HaveReusedChunks,
+          ReadyToRecord,
+          RecordCandidateSnapshot,
+          WaitForSnapshotToRecord),
+      PE_STATE_MACHINE_TRANSITION(
+          HaveSnapshots,
+          NeedChunkHashes,
+          RequestGenerateAndHashChunks,
+          WaitForChunkHashes),
+      PE_STATE_MACHINE_TRANSITION(
+          HaveSnapshotWithSameIdentity,
+          NeedChunkHashes,
+          RequestGenerateAndHashChunks,
+          WaitForChunkHashes),
+      PE_STATE_MACHINE_TRANSITION(
+          HaveReusedChunks,
           NeedChunkHashes,
           RequestGenerateAndHashChunks,
           WaitForChunkHashes),
@@ -110,7 +164,9 @@ class SnapshotStateMachineImpl
           Done));
 
   void InternalStart(
-    const string& root, const filesystem::path& filepath);
+    const string& root, const filesystem::path& filepath,
+    const FileStat& file_stat,
+    PreviousSnapshotPrefetcher* previous_snapshot_prefetcher);
 
  private:
   OverrideableUniquePtr<SnapshotUtil> snapshot_util_;
@@ -118,12 +174,17 @@ class SnapshotStateMachineImpl
   candidate_snapshot_generator_;
   OverrideableUniquePtr<ChunkHasher> chunk_hasher_;
   OverrideableUniquePtr<MetadataDb> metadata_db_;
+  PreviousSnapshotPrefetcher* previous_snapshot_prefetcher_;
 
   boost::shared_ptr<Snapshot> candidate_snapshot_;
   boost::shared_ptr<Snapshot> previous_snapshot_;
+  FileIdentity file_identity_;
+  boost::shared_ptr<Snapshot> snapshot_with_same_identity_;
+  bool chunks_reused_;
 
   string root_;
   filesystem::path filepath_;
+  FileStat file_stat_;
 
   DISALLOW_COPY_AND_ASSIGN(SnapshotStateMachineImpl);
 };
@@ -132,7 +193,11 @@ class SnapshotStateMachine : public SnapshotStateMachineImpl::BackEnd {
  public:
   SnapshotStateMachine() {}
 
-  virtual void Start(const string& root, const filesystem::path& filepath);
+  // If previous_snapshot_prefetcher is not null, the previous snapshot is
+  // taken from it if it was prefetched. It must outlive the state machine.
+  virtual void Start(const string& root, const filesystem::path& filepath,
+                     const FileStat& file_stat,
+                     PreviousSnapshotPrefetcher* previous_snapshot_prefetcher);
 
  protected:
   virtual SnapshotStateMachineImpl::BackEnd* GetBackEnd();
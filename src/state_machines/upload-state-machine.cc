@@ -10,6 +10,7 @@
 #include "proto/bundle-manifest.pb.h"
 #include "proto/glacier.pb.h"
 #include "services/metadata-db.h"
+#include "util/hex-util.h"
 
 DEFINE_OPTION(use_ssl, bool, true,
               "If true, network connections will be established over SSL.");
@@ -168,8 +169,8 @@ PE_STATE_MACHINE_ACTION_HANDLER(UploadStateMachineImpl, StartUpload) {
   glacier_connection_->UploadArchive(
       glacier_vault_name_,
       current_bundle_data_->file_contents(),
-      current_bundle_data_->annotations().sha256_linear_digest(),
-      current_bundle_data_->annotations().sha256_tree_digest(),
+      HexEncode(current_bundle_data_->annotations().sha256_linear_digest()),
+      HexEncode(current_bundle_data_->annotations().sha256_tree_digest()),
       current_bundle_data_->unique_filename(),
       current_bundle_data_->mutable_annotations()->mutable_server_bundle_id(),
       CreateExternalEventCallback<UploadCompleted>());
@@ -10,12 +10,12 @@
 #include <boost/date_time/gregorian/gregorian.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/format.hpp>
-#include <crypto++/hex.h>
 #include <crypto++/hmac.h>
 #include <crypto++/sha.h>
 #include <curl/curl.h>
 
 #include "proto/http.pb.h"
+#include "util/hex-util.h"
 
 namespace polar_express {
 namespace {
@@ -351,12 +351,7 @@ void AmazonHttpRequestUtil::GenerateSha256Hmac(
 }
 
 string AmazonHttpRequestUtil::HexEncode(const vector<byte>& data) const {
-  string digest_str;
-  CryptoPP::HexEncoder encoder;
-  encoder.Attach(new CryptoPP::StringSink(digest_str));
-  encoder.Put(data.data(), data.size());
-  encoder.MessageEnd();
-  return digest_str;
+  return polar_express::HexEncode(data.data(), data.size());
 }
 
 string AmazonHttpRequestUtil::GenerateAuthorizationHeaderValue(
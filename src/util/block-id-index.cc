@@ -0,0 +1,120 @@
+#include "util/block-id-index.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+
+namespace polar_express {
+namespace {
+
+// Linear probing stays short below this fraction of slots in use. Lookups
+// of blocks that are not stored probe about six slots on average when the
+// table is this full, and those of blocks that are about two.
+const double kMaxLoadFactor = 0.7;
+
+const size_t kMinCapacity = 16;
+
+}  // namespace
+
+const size_t BlockIdIndex::kDigestLength;
+
+BlockIdIndex::BlockIdIndex()
+    : size_(0) {
+}
+
+BlockIdIndex::~BlockIdIndex() {
+}
+
+// static
+bool BlockIdIndex::CanIndex(const string& sha1_digest, uint64_t length) {
+  return sha1_digest.size() == kDigestLength &&
+      length <= std::numeric_limits<uint32_t>::max();
+}
+
+void BlockIdIndex::Reserve(size_t num_blocks) {
+  const size_t capacity =
+      static_cast<size_t>(num_blocks / kMaxLoadFactor) + 1;
+  if (capacity > entries_.size()) {
+    Rehash(std::max(kMinCapacity, capacity));
+  }
+}
+
+void BlockIdIndex::Insert(
+    const string& sha1_digest, uint64_t length, int64_t block_id) {
+  assert(CanIndex(sha1_digest, length));
+  assert(block_id > 0);
+
+  if (size_ + 1 > entries_.size() * kMaxLoadFactor) {
+    Rehash(std::max(kMinCapacity, entries_.size() * 2));
+  }
+
+  Entry& entry = entries_[FindSlot(sha1_digest.data(), length)];
+  if (entry.block_id == 0) {
+    memcpy(entry.sha1_digest, sha1_digest.data(), kDigestLength);
+    entry.length = length;
+    entry.block_id = block_id;
+    ++size_;
+  }
+}
+
+bool BlockIdIndex::Find(const string& sha1_digest, uint64_t length,
+                        int64_t* block_id) const {
+  if (size_ == 0 || !CanIndex(sha1_digest, length)) {
+    return false;
+  }
+
+  const Entry& entry = entries_[FindSlot(sha1_digest.data(), length)];
+  if (entry.block_id == 0) {
+    return false;
+  }
+  *CHECK_NOTNULL(block_id) = entry.block_id;
+  return true;
+}
+
+size_t BlockIdIndex::size() const {
+  return size_;
+}
+
+size_t BlockIdIndex::memory_usage() const {
+  return entries_.capacity() * sizeof(Entry);
+}
+
+size_t BlockIdIndex::FindSlot(
+    const char* sha1_digest, uint32_t length) const {
+  // The digest is already evenly distributed, so its first bytes serve as
+  // the hash. They are mapped onto the table by multiplication, which,
+  // unlike masking, does not need the capacity to be a power of two.
+  uint64_t hash;
+  memcpy(&hash, sha1_digest, sizeof(hash));
+  hash ^= length * 0x9e3779b97f4a7c15ULL;
+  size_t slot = static_cast<size_t>(
+      (static_cast<unsigned __int128>(hash) * entries_.size()) >> 64);
+
+  while (true) {
+    const Entry& entry = entries_[slot];
+    if (entry.block_id == 0 ||
+        (entry.length == length &&
+         memcmp(entry.sha1_digest, sha1_digest, kDigestLength) == 0)) {
+      return slot;
+    }
+    if (++slot == entries_.size()) {
+      slot = 0;
+    }
+  }
+}
+
+void BlockIdIndex::Rehash(size_t capacity) {
+  assert(capacity * kMaxLoadFactor >= size_);
+  vector<Entry> old_entries;
+  old_entries.swap(entries_);
+  entries_.assign(capacity, Entry());
+
+  for (const Entry& entry : old_entries) {
+    if (entry.block_id != 0) {
+      entries_[FindSlot(entry.sha1_digest, entry.length)] = entry;
+    }
+  }
+}
+
+}  // namespace polar_express
@@ -0,0 +1,72 @@
+#ifndef BLOCK_ID_INDEX_H
+#define BLOCK_ID_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+
+namespace polar_express {
+
+// An in-memory map from the SHA1 digest and length of a block to the id of
+// the block in the metadata DB, so that the blocks of a snapshot which are
+// already known can be found without querying the DB for each of them.
+// Each entry is stored inline in a single open-addressed table, rather than
+// as a separate heap allocation, so that it takes 32 bytes plus the table's
+// free slots. Blocks cannot be removed. Not thread-safe.
+class BlockIdIndex {
+ public:
+  // The length, in bytes, of the raw SHA1 digests that can be indexed.
+  static const size_t kDigestLength = 20;
+
+  BlockIdIndex();
+  ~BlockIdIndex();
+
+  // Returns whether a block with the given digest and length can be stored:
+  // that is, whether the digest is a raw SHA1 digest (which a hole's empty
+  // digest is not) and the length fits in 32 bits.
+  static bool CanIndex(const string& sha1_digest, uint64_t length);
+
+  // Makes room for num_blocks blocks in total, so that they can be added
+  // without the table growing.
+  void Reserve(size_t num_blocks);
+
+  // Stores the id of the block with the given digest and length, which must
+  // be indexable, unless one is already stored. Block ids are positive.
+  void Insert(const string& sha1_digest, uint64_t length, int64_t block_id);
+
+  // If the id of a block with the given digest and length is stored, sets
+  // block_id to it and returns true. Otherwise returns false.
+  bool Find(const string& sha1_digest, uint64_t length,
+            int64_t* block_id) const;
+
+  // Returns the number of blocks stored.
+  size_t size() const;
+
+  // Returns the memory used, in bytes.
+  size_t memory_usage() const;
+
+ private:
+  // A block_id of zero marks a free slot.
+  struct Entry {
+    char sha1_digest[kDigestLength];
+    uint32_t length;
+    int64_t block_id;
+  };
+
+  // Returns the slot holding the block with the given digest and length, or
+  // the free slot where it would go if it is not stored.
+  size_t FindSlot(const char* sha1_digest, uint32_t length) const;
+
+  void Rehash(size_t capacity);
+
+  vector<Entry> entries_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockIdIndex);
+};
+
+}  // namespace polar_express
+
+#endif  // BLOCK_ID_INDEX_H
@@ -0,0 +1,105 @@
+// Measures the memory used per block by a BlockIdIndex, and the rate at
+// which blocks are added to it and looked up in it, both for blocks that are
+// stored (as for the unchanged chunks of a changed file) and for those that
+// are not (as for new chunks). The table is reserved up front, as it is when
+// loaded from the metadata DB. Digests are pseudo-random rather than real
+// SHA1 digests, which are distributed the same way but slower to generate.
+// The default of 100M blocks needs about 5 GB of memory.
+//
+// Usage: block-id-index_benchmark [--benchmark_num_blocks=N]
+//            [--benchmark_num_lookups=N]
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "base/options.h"
+#include "util/block-id-index.h"
+
+DEFINE_OPTION(benchmark_num_blocks, size_t, 100000000,
+              "Number of blocks to store.");
+DEFINE_OPTION(benchmark_num_lookups, size_t, 10000000,
+              "Number of blocks to look up, of each kind.");
+
+using polar_express::BlockIdIndex;
+
+namespace {
+
+const uint64_t kBlockLength = 64 * 1024;
+
+uint64_t SplitMix64(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// Sets sha1_digest to the digest of the i'th block, without allocating.
+void MakeDigest(uint64_t i, string* sha1_digest) {
+  uint64_t words[3] = {
+    SplitMix64(3 * i), SplitMix64(3 * i + 1), SplitMix64(3 * i + 2)
+  };
+  memcpy(&(*sha1_digest)[0], words, BlockIdIndex::kDigestLength);
+}
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+// Looks up num_lookups pseudo-random blocks among the first num_blocks
+// blocks, offset by first_block, and returns the number found.
+size_t LookUp(const BlockIdIndex& block_id_index, uint64_t first_block,
+              uint64_t num_blocks, size_t num_lookups, double* seconds) {
+  string sha1_digest(BlockIdIndex::kDigestLength, '\0');
+  size_t num_found = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < num_lookups; ++i) {
+    MakeDigest(first_block + SplitMix64(~i) % num_blocks, &sha1_digest);
+    int64_t block_id;
+    num_found += block_id_index.Find(sha1_digest, kBlockLength, &block_id);
+  }
+  *seconds = SecondsSince(start);
+  return num_found;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (!polar_express::options::Init(argc, argv)) {
+    return 1;
+  }
+  const size_t num_blocks = polar_express::options::benchmark_num_blocks;
+  const size_t num_lookups = polar_express::options::benchmark_num_lookups;
+
+  BlockIdIndex block_id_index;
+  block_id_index.Reserve(num_blocks);
+  string sha1_digest(BlockIdIndex::kDigestLength, '\0');
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < num_blocks; ++i) {
+    MakeDigest(i, &sha1_digest);
+    block_id_index.Insert(sha1_digest, kBlockLength, i + 1);
+  }
+  const double insert_seconds = SecondsSince(start);
+
+  double hit_seconds;
+  const size_t num_hits =
+      LookUp(block_id_index, 0, num_blocks, num_lookups, &hit_seconds);
+  double miss_seconds;
+  const size_t num_false_hits = LookUp(
+      block_id_index, num_blocks, num_blocks, num_lookups, &miss_seconds);
+  if (num_hits != num_lookups || num_false_hits != 0) {
+    fprintf(stderr, "Lookups returned wrong results\n");
+    return 1;
+  }
+
+  printf("%12s %12s %12s %14s %14s\n", "blocks", "bytes/block", "inserts/s",
+         "hit lookups/s", "miss lookups/s");
+  printf("%12zu %12.1f %12.0f %14.0f %14.0f\n", block_id_index.size(),
+         static_cast<double>(block_id_index.memory_usage()) /
+             block_id_index.size(),
+         num_blocks / insert_seconds, num_lookups / hit_seconds,
+         num_lookups / miss_seconds);
+  return 0;
+}
@@ -0,0 +1,89 @@
+#include "util/block-id-index.h"
+
+#include <cstring>
+#include <string>
+
+#include <gtest/gtest.h>
+
+namespace polar_express {
+namespace {
+
+// Returns a distinct digest for each i, spread like a real digest.
+string MakeDigest(int i) {
+  // Multiplying by an odd constant maps distinct values to distinct values.
+  const uint64_t bits = i * 0x9e3779b97f4a7c15ULL;
+  string sha1_digest(BlockIdIndex::kDigestLength, 'x');
+  memcpy(&sha1_digest[0], &bits, sizeof(bits));
+  return sha1_digest;
+}
+
+TEST(BlockIdIndexTest, FindsInsertedBlocks) {
+  BlockIdIndex block_id_index;
+  const int num_blocks = 10000;
+  for (int i = 0; i < num_blocks; ++i) {
+    block_id_index.Insert(MakeDigest(i), 1000 + i % 7, i + 1);
+  }
+  EXPECT_EQ(num_blocks, block_id_index.size());
+
+  for (int i = 0; i < num_blocks; ++i) {
+    int64_t block_id = 0;
+    ASSERT_TRUE(block_id_index.Find(MakeDigest(i), 1000 + i % 7, &block_id));
+    EXPECT_EQ(i + 1, block_id);
+  }
+  for (int i = num_blocks; i < 2 * num_blocks; ++i) {
+    int64_t block_id = 0;
+    EXPECT_FALSE(block_id_index.Find(MakeDigest(i), 1000 + i % 7, &block_id));
+  }
+}
+
+TEST(BlockIdIndexTest, DistinguishesLengths) {
+  BlockIdIndex block_id_index;
+  block_id_index.Insert(MakeDigest(1), 100, 1);
+  block_id_index.Insert(MakeDigest(1), 200, 2);
+
+  int64_t block_id = 0;
+  EXPECT_TRUE(block_id_index.Find(MakeDigest(1), 200, &block_id));
+  EXPECT_EQ(2, block_id);
+  EXPECT_TRUE(block_id_index.Find(MakeDigest(1), 100, &block_id));
+  EXPECT_EQ(1, block_id);
+  EXPECT_FALSE(block_id_index.Find(MakeDigest(1), 300, &block_id));
+}
+
+TEST(BlockIdIndexTest, KeepsFirstIdOfDuplicateBlocks) {
+  BlockIdIndex block_id_index;
+  block_id_index.Insert(MakeDigest(5), 100, 3);
+  block_id_index.Insert(MakeDigest(5), 100, 4);
+  EXPECT_EQ(1, block_id_index.size());
+
+  int64_t block_id = 0;
+  EXPECT_TRUE(block_id_index.Find(MakeDigest(5), 100, &block_id));
+  EXPECT_EQ(3, block_id);
+}
+
+TEST(BlockIdIndexTest, DoesNotIndexHolesOrLongBlocks) {
+  EXPECT_TRUE(BlockIdIndex::CanIndex(MakeDigest(1), 4096));
+  EXPECT_FALSE(BlockIdIndex::CanIndex("", 4096));
+  EXPECT_FALSE(BlockIdIndex::CanIndex(MakeDigest(1) + "x", 4096));
+  EXPECT_FALSE(BlockIdIndex::CanIndex(MakeDigest(1), 1LL << 32));
+
+  BlockIdIndex block_id_index;
+  block_id_index.Insert(MakeDigest(1), 4096, 1);
+  int64_t block_id = 0;
+  EXPECT_FALSE(block_id_index.Find("", 4096, &block_id));
+}
+
+TEST(BlockIdIndexTest, ReserveAvoidsGrowing) {
+  BlockIdIndex block_id_index;
+  const int num_blocks = 1000;
+  block_id_index.Reserve(num_blocks);
+  const size_t memory_usage = block_id_index.memory_usage();
+  EXPECT_LT(memory_usage, num_blocks * 64);
+
+  for (int i = 0; i < num_blocks; ++i) {
+    block_id_index.Insert(MakeDigest(i), 4096, i + 1);
+  }
+  EXPECT_EQ(memory_usage, block_id_index.memory_usage());
+}
+
+}  // namespace
+}  // namespace polar_express
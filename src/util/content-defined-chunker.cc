@@ -0,0 +1,99 @@
+#include "util/content-defined-chunker.h"
+
+#include <algorithm>
+
+namespace polar_express {
+namespace {
+
+const size_t kGearTableSize = 256;
+
+// Seed for the Gear table. Changing this changes every chunk boundary.
+const uint64_t kGearTableSeed = 0x706f6c6172657870ULL;  // "polarexp"
+
+// SplitMix64, used only to fill the Gear table deterministically, so that the
+// table does not have to be spelled out in the source.
+uint64_t NextSplitMix64(uint64_t* state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+int FloorLog2(size_t n) {
+  int log = 0;
+  while (n > 1) {
+    n >>= 1;
+    ++log;
+  }
+  return log;
+}
+
+// Returns a mask with the num_bits most significant bits set. The Gear hash
+// shifts left by one for each byte, so the high bits of the hash are the ones
+// influenced by the most bytes (up to 64 of them).
+uint64_t HighBitsMask(int num_bits) {
+  num_bits = std::max(1, std::min(63, num_bits));
+  return ~0ULL << (64 - num_bits);
+}
+
+}  // namespace
+
+ContentDefinedChunker::ContentDefinedChunker(
+    size_t min_chunk_size, size_t average_chunk_size, size_t max_chunk_size)
+    : min_chunk_size_(std::max<size_t>(1, min_chunk_size)),
+      average_chunk_size_(
+          size_t(1) << FloorLog2(std::max(min_chunk_size_,
+                                          average_chunk_size))),
+      max_chunk_size_(std::max(average_chunk_size_, max_chunk_size)),
+      // Normalization level 1: one bit harder before the average size, one
+      // bit easier after it.
+      small_chunk_mask_(HighBitsMask(FloorLog2(average_chunk_size_) + 1)),
+      large_chunk_mask_(HighBitsMask(FloorLog2(average_chunk_size_) - 1)) {
+  GearTable();
+}
+
+ContentDefinedChunker::~ContentDefinedChunker() {
+}
+
+size_t ContentDefinedChunker::FindChunkLength(
+    const byte* data, size_t size) const {
+  if (size <= min_chunk_size_) {
+    return size;
+  }
+
+  const uint64_t* gear_table = GearTable();
+  const size_t end = std::min(size, max_chunk_size_);
+  const size_t normal_end = std::min(end, average_chunk_size_);
+  uint64_t hash = 0;
+  size_t i = min_chunk_size_;
+
+  for (; i < normal_end; ++i) {
+    hash = (hash << 1) + gear_table[data[i]];
+    if ((hash & small_chunk_mask_) == 0) {
+      return i + 1;
+    }
+  }
+  for (; i < end; ++i) {
+    hash = (hash << 1) + gear_table[data[i]];
+    if ((hash & large_chunk_mask_) == 0) {
+      return i + 1;
+    }
+  }
+  return end;
+}
+
+// static
+const uint64_t* ContentDefinedChunker::GearTable() {
+  static uint64_t gear_table[kGearTableSize];
+  static bool initialized = [] {
+    uint64_t state = kGearTableSeed;
+    for (size_t i = 0; i < kGearTableSize; ++i) {
+      gear_table[i] = NextSplitMix64(&state);
+    }
+    return true;
+  }();
+  (void)initialized;
+  return gear_table;
+}
+
+}  // namespace polar_express
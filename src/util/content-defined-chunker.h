@@ -0,0 +1,63 @@
+#ifndef CONTENT_DEFINED_CHUNKER_H
+#define CONTENT_DEFINED_CHUNKER_H
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "base/macros.h"
+
+namespace polar_express {
+
+// Finds chunk boundaries in a stream of data based on the data itself, rather
+// than on fixed offsets. This means that inserting or removing bytes in one
+// part of a file only changes the chunks around the edit; chunks before and
+// after it keep their boundaries (and therefore their block digests), so they
+// can still be deduplicated against previous snapshots.
+//
+// This uses the FastCDC algorithm: a Gear rolling hash is computed over the
+// data, and a boundary is declared wherever the top bits of the hash are all
+// zero. No boundary is ever declared within the first min_chunk_size bytes of a
+// chunk, and a boundary is forced at max_chunk_size. Between these limits,
+// "normalized chunking" uses a stricter mask before average_chunk_size and a
+// looser mask after it, so that chunk sizes cluster around the average.
+//
+// IMPORTANT: The boundaries chosen by this class for a given input and given
+// sizes must never change between versions of this program, otherwise every
+// previously backed-up block would fail to deduplicate. Do not modify the Gear
+// table generation or the mask construction.
+//
+// This class is stateless once constructed, and is safe to use from multiple
+// threads simultaneously.
+class ContentDefinedChunker {
+ public:
+  // Sizes are clamped so that 0 < min <= average <= max. The average size is
+  // rounded down to a power of two.
+  ContentDefinedChunker(size_t min_chunk_size, size_t average_chunk_size,
+                        size_t max_chunk_size);
+  ~ContentDefinedChunker();
+
+  // Returns the length of the chunk that begins at data. The returned length
+  // is never more than size. If size is less than max_chunk_size, the caller
+  // must ensure that data contains everything up to the end of the stream,
+  // since the remainder may be returned as a final (short) chunk.
+  size_t FindChunkLength(const byte* data, size_t size) const;
+
+  size_t min_chunk_size() const { return min_chunk_size_; }
+  size_t average_chunk_size() const { return average_chunk_size_; }
+  size_t max_chunk_size() const { return max_chunk_size_; }
+
+ private:
+  static const uint64_t* GearTable();
+
+  size_t min_chunk_size_;
+  size_t average_chunk_size_;
+  size_t max_chunk_size_;
+  uint64_t small_chunk_mask_;
+  uint64_t large_chunk_mask_;
+
+  DISALLOW_COPY_AND_ASSIGN(ContentDefinedChunker);
+};
+
+}  // namespace polar_express
+
+#endif  // CONTENT_DEFINED_CHUNKER_H
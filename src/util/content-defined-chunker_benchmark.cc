@@ -0,0 +1,127 @@
+// Compares fixed-size chunking with content-defined chunking, both for raw
+// boundary-finding throughput and for how much of a file still deduplicates
+// after a small edit near its beginning.
+//
+// Usage: content-defined-chunker_benchmark [data_size_mb]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "base/macros.h"
+#include "util/content-defined-chunker.h"
+
+using polar_express::ContentDefinedChunker;
+
+namespace {
+
+const size_t kMinChunkSize = 64 * 1024;
+const size_t kAverageChunkSize = 256 * 1024;
+const size_t kMaxChunkSize = 1024 * 1024;
+
+vector<size_t> SplitFixed(const vector<byte>& data) {
+  vector<size_t> lengths;
+  for (size_t offset = 0; offset < data.size(); offset += kMaxChunkSize) {
+    lengths.push_back(std::min(kMaxChunkSize, data.size() - offset));
+  }
+  return lengths;
+}
+
+vector<size_t> SplitContentDefined(
+    const ContentDefinedChunker& chunker, const vector<byte>& data) {
+  vector<size_t> lengths;
+  for (size_t offset = 0; offset < data.size(); offset += lengths.back()) {
+    lengths.push_back(chunker.FindChunkLength(
+        data.data() + offset, data.size() - offset));
+  }
+  return lengths;
+}
+
+std::unordered_set<size_t> ChunkHashes(
+    const vector<byte>& data, const vector<size_t>& lengths) {
+  std::unordered_set<size_t> hashes;
+  std::hash<string> hasher;
+  size_t offset = 0;
+  for (size_t length : lengths) {
+    hashes.insert(hasher(string(
+        reinterpret_cast<const char*>(data.data() + offset), length)));
+    offset += length;
+  }
+  return hashes;
+}
+
+// Returns the fraction of bytes in edited_data whose chunks already occur in
+// original_data.
+double DedupRatio(const vector<byte>& original_data,
+                  const vector<size_t>& original_lengths,
+                  const vector<byte>& edited_data,
+                  const vector<size_t>& edited_lengths) {
+  std::unordered_set<size_t> original_hashes =
+      ChunkHashes(original_data, original_lengths);
+  std::hash<string> hasher;
+  size_t offset = 0;
+  size_t deduplicated_bytes = 0;
+  for (size_t length : edited_lengths) {
+    if (original_hashes.count(hasher(string(
+            reinterpret_cast<const char*>(edited_data.data() + offset),
+            length))) > 0) {
+      deduplicated_bytes += length;
+    }
+    offset += length;
+  }
+  return static_cast<double>(deduplicated_bytes) / edited_data.size();
+}
+
+// Times splitting the data and then hashing each chunk, which is the work
+// ChunkHasherImpl does for every block.
+template <typename SplitFunction>
+vector<size_t> TimeSplit(const char* name, const vector<byte>& data,
+                         SplitFunction split) {
+  auto start = std::chrono::steady_clock::now();
+  vector<size_t> lengths = split(data);
+  ChunkHashes(data, lengths);
+  double seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  printf("%-16s %8zu chunks  %10.1f MB/s\n", name, lengths.size(),
+         data.size() / (1024.0 * 1024.0) / seconds);
+  return lengths;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t data_size_mb = (argc > 1) ? atoi(argv[1]) : 256;
+  vector<byte> data(data_size_mb * 1024 * 1024);
+  std::mt19937 generator(1);
+  for (byte& b : data) {
+    b = static_cast<byte>(generator());
+  }
+
+  vector<byte> edited_data = data;
+  edited_data.insert(edited_data.begin() + 4096, 'x');
+
+  ContentDefinedChunker chunker(
+      kMinChunkSize, kAverageChunkSize, kMaxChunkSize);
+  auto split_content_defined = [&chunker](const vector<byte>& d) {
+    return SplitContentDefined(chunker, d);
+  };
+
+  printf("Throughput over %zu MB:\n", data_size_mb);
+  vector<size_t> fixed_lengths = TimeSplit("fixed", data, SplitFixed);
+  vector<size_t> cdc_lengths =
+      TimeSplit("content-defined", data, split_content_defined);
+
+  printf("\nFraction deduplicated after a 1-byte insertion at offset 4096:\n");
+  printf("%-16s %6.2f%%\n", "fixed",
+         100.0 * DedupRatio(data, fixed_lengths,
+                            edited_data, SplitFixed(edited_data)));
+  printf("%-16s %6.2f%%\n", "content-defined",
+         100.0 * DedupRatio(data, cdc_lengths,
+                            edited_data, split_content_defined(edited_data)));
+  return 0;
+}
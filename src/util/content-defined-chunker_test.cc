@@ -0,0 +1,114 @@
+#include "util/content-defined-chunker.h"
+
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace polar_express {
+namespace {
+
+const size_t kMinChunkSize = 2 * 1024;
+const size_t kAverageChunkSize = 8 * 1024;
+const size_t kMaxChunkSize = 32 * 1024;
+
+vector<byte> GenerateRandomData(size_t size, unsigned int seed) {
+  std::mt19937 generator(seed);
+  vector<byte> data(size);
+  for (size_t i = 0; i < size; ++i) {
+    data[i] = static_cast<byte>(generator());
+  }
+  return data;
+}
+
+vector<string> SplitIntoChunks(
+    const ContentDefinedChunker& chunker, const vector<byte>& data) {
+  vector<string> chunks;
+  size_t offset = 0;
+  while (offset < data.size()) {
+    size_t length =
+        chunker.FindChunkLength(data.data() + offset, data.size() - offset);
+    chunks.push_back(string(
+        reinterpret_cast<const char*>(data.data() + offset), length));
+    offset += length;
+  }
+  return chunks;
+}
+
+class ContentDefinedChunkerTest : public testing::Test {
+ public:
+  ContentDefinedChunkerTest()
+      : chunker_(kMinChunkSize, kAverageChunkSize, kMaxChunkSize) {
+  }
+
+ protected:
+  ContentDefinedChunker chunker_;
+};
+
+TEST_F(ContentDefinedChunkerTest, ChunkSizesAreWithinLimits) {
+  vector<byte> data = GenerateRandomData(4 * 1024 * 1024, 1);
+  vector<string> chunks = SplitIntoChunks(chunker_, data);
+
+  ASSERT_GT(chunks.size(), 1);
+  size_t total_size = 0;
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    if (i + 1 < chunks.size()) {
+      EXPECT_GE(chunks[i].size(), kMinChunkSize);
+    }
+    EXPECT_LE(chunks[i].size(), kMaxChunkSize);
+    total_size += chunks[i].size();
+  }
+  EXPECT_EQ(data.size(), total_size);
+
+  // Normalized chunking should keep the mean near the requested average.
+  size_t mean_size = total_size / chunks.size();
+  EXPECT_GT(mean_size, kAverageChunkSize / 2);
+  EXPECT_LT(mean_size, kAverageChunkSize * 2);
+}
+
+TEST_F(ContentDefinedChunkerTest, ShortInputIsSingleChunk) {
+  vector<byte> data = GenerateRandomData(kMinChunkSize, 2);
+  EXPECT_EQ(data.size(), chunker_.FindChunkLength(data.data(), data.size()));
+  EXPECT_EQ(0, chunker_.FindChunkLength(data.data(), 0));
+}
+
+TEST_F(ContentDefinedChunkerTest, BoundariesAreDeterministic) {
+  vector<byte> data = GenerateRandomData(1024 * 1024, 3);
+  ContentDefinedChunker other_chunker(
+      kMinChunkSize, kAverageChunkSize, kMaxChunkSize);
+  EXPECT_EQ(SplitIntoChunks(chunker_, data),
+            SplitIntoChunks(other_chunker, data));
+}
+
+TEST_F(ContentDefinedChunkerTest, BoundariesAreStableAcrossInsertion) {
+  vector<byte> data = GenerateRandomData(4 * 1024 * 1024, 4);
+  vector<byte> edited_data = data;
+  edited_data.insert(edited_data.begin() + 1000, 'x');
+
+  vector<string> chunks = SplitIntoChunks(chunker_, data);
+  vector<string> edited_chunks = SplitIntoChunks(chunker_, edited_data);
+
+  std::set<string> unique_chunks(chunks.begin(), chunks.end());
+  size_t num_shared_chunks = 0;
+  for (const string& chunk : edited_chunks) {
+    if (unique_chunks.count(chunk) > 0) {
+      ++num_shared_chunks;
+    }
+  }
+
+  // Only the chunk containing the insertion (and possibly its neighbor)
+  // should differ.
+  EXPECT_GE(num_shared_chunks + 2, edited_chunks.size());
+}
+
+TEST_F(ContentDefinedChunkerTest, SizesAreClamped) {
+  ContentDefinedChunker chunker(0, 3000, 100);
+  EXPECT_EQ(1, chunker.min_chunk_size());
+  EXPECT_EQ(2048, chunker.average_chunk_size());
+  EXPECT_EQ(2048, chunker.max_chunk_size());
+}
+
+}  // namespace
+}  // namespace polar_express
@@ -0,0 +1,218 @@
+#include "util/digest-backend-impl.h"
+
+#if defined(__aarch64__)
+
+#include <arm_neon.h>
+#include <sys/auxv.h>
+
+#ifndef HWCAP_SHA1
+#define HWCAP_SHA1 (1 << 5)
+#endif
+#ifndef HWCAP_SHA2
+#define HWCAP_SHA2 (1 << 6)
+#endif
+
+// As on x86, the kernels are compiled for the crypto extensions with a
+// target attribute rather than a global compiler flag, so that the rest
+// of the program still runs on CPUs without them.
+#if defined(__clang__)
+#define ARMV8_CRYPTO_TARGET __attribute__((target("crypto")))
+#else
+#define ARMV8_CRYPTO_TARGET __attribute__((target("+crypto")))
+#endif
+#define ARMV8_CRYPTO_INLINE \
+  ARMV8_CRYPTO_TARGET __attribute__((always_inline)) inline
+
+namespace polar_express {
+namespace {
+
+ARMV8_CRYPTO_INLINE uint32x4_t LoadBigEndianWords(const byte* p) {
+  return vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(p)));
+}
+
+////////////////////////////////////////////////////////////////////////////
+// SHA-1. Each call handles four of the 80 rounds; the message schedule
+// for round group G + 2 is prepared while group G runs.
+
+template <int G>
+ARMV8_CRYPTO_INLINE uint32x4_t Sha1RoundConstant() {
+  return vdupq_n_u32(G < 5 ? 0x5a827999 : G < 10 ? 0x6ed9eba1 :
+                     G < 15 ? 0x8f1bbcdc : 0xca62c1d6);
+}
+
+template <int G>
+ARMV8_CRYPTO_INLINE void ArmV8Sha1Rounds(
+    uint32x4_t* abcd, uint32_t* e, uint32x4_t* msgs, uint32x4_t* round_inputs) {
+  uint32_t e_in = e[G % 2];
+  e[(G + 1) % 2] = vsha1h_u32(vgetq_lane_u32(*abcd, 0));
+  if (G < 5) {
+    *abcd = vsha1cq_u32(*abcd, e_in, round_inputs[G % 2]);
+  } else if (G < 10 || G >= 15) {
+    *abcd = vsha1pq_u32(*abcd, e_in, round_inputs[G % 2]);
+  } else {
+    *abcd = vsha1mq_u32(*abcd, e_in, round_inputs[G % 2]);
+  }
+  if (G + 2 < 20) {
+    round_inputs[G % 2] =
+        vaddq_u32(msgs[(G + 2) % 4], Sha1RoundConstant<G + 2>());
+  }
+  if (G >= 1 && G <= 16) {
+    msgs[(G + 3) % 4] = vsha1su1q_u32(msgs[(G + 3) % 4], msgs[(G + 2) % 4]);
+  }
+  if (G <= 15) {
+    msgs[G % 4] =
+        vsha1su0q_u32(msgs[G % 4], msgs[(G + 1) % 4], msgs[(G + 2) % 4]);
+  }
+}
+
+template <int G>
+struct ArmV8Sha1RoundsFrom {
+  ARMV8_CRYPTO_INLINE static void Run(
+      uint32x4_t* abcd, uint32_t* e, uint32x4_t* msgs,
+      uint32x4_t* round_inputs) {
+    ArmV8Sha1Rounds<G>(abcd, e, msgs, round_inputs);
+    ArmV8Sha1RoundsFrom<G + 1>::Run(abcd, e, msgs, round_inputs);
+  }
+};
+
+template <>
+struct ArmV8Sha1RoundsFrom<20> {
+  ARMV8_CRYPTO_INLINE static void Run(
+      uint32x4_t* abcd, uint32_t* e, uint32x4_t* msgs,
+      uint32x4_t* round_inputs) {
+  }
+};
+
+ARMV8_CRYPTO_TARGET void ArmV8Sha1Compress(
+    uint32_t* state, const byte* blocks, size_t num_blocks) {
+  uint32x4_t abcd = vld1q_u32(state);
+  uint32_t e0 = state[4];
+
+  for (; num_blocks > 0; --num_blocks, blocks += DigestBackend::kBlockSize) {
+    const uint32x4_t saved_abcd = abcd;
+    const uint32_t saved_e0 = e0;
+
+    uint32x4_t msgs[4];
+    for (int i = 0; i < 4; ++i) {
+      msgs[i] = LoadBigEndianWords(blocks + 16 * i);
+    }
+    uint32x4_t round_inputs[2] = {
+      vaddq_u32(msgs[0], Sha1RoundConstant<0>()),
+      vaddq_u32(msgs[1], Sha1RoundConstant<1>()),
+    };
+
+    uint32_t e[2] = { e0, 0 };
+    ArmV8Sha1RoundsFrom<0>::Run(&abcd, e, msgs, round_inputs);
+
+    // After the final (odd-numbered) group, the next E is in e[0].
+    e0 = e[0] + saved_e0;
+    abcd = vaddq_u32(abcd, saved_abcd);
+  }
+
+  vst1q_u32(state, abcd);
+  state[4] = e0;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// SHA-256. Each call handles four of the 64 rounds; the message schedule
+// for round group G + 1 is prepared while group G runs.
+
+template <int G>
+ARMV8_CRYPTO_INLINE void ArmV8Sha256Rounds(
+    uint32x4_t* state0, uint32x4_t* state1, uint32x4_t* msgs,
+    uint32x4_t* round_input) {
+  uint32x4_t next_round_input;
+  if (G < 12) {
+    msgs[G % 4] = vsha256su0q_u32(msgs[G % 4], msgs[(G + 1) % 4]);
+  }
+  const uint32x4_t saved_state0 = *state0;
+  if (G < 15) {
+    next_round_input = vaddq_u32(
+        msgs[(G + 1) % 4], vld1q_u32(kSha256RoundConstants + 4 * (G + 1)));
+  }
+  *state0 = vsha256hq_u32(*state0, *state1, *round_input);
+  *state1 = vsha256h2q_u32(*state1, saved_state0, *round_input);
+  if (G < 12) {
+    msgs[G % 4] = vsha256su1q_u32(
+        msgs[G % 4], msgs[(G + 2) % 4], msgs[(G + 3) % 4]);
+  }
+  if (G < 15) {
+    *round_input = next_round_input;
+  }
+}
+
+template <int G>
+struct ArmV8Sha256RoundsFrom {
+  ARMV8_CRYPTO_INLINE static void Run(
+      uint32x4_t* state0, uint32x4_t* state1, uint32x4_t* msgs,
+      uint32x4_t* round_input) {
+    ArmV8Sha256Rounds<G>(state0, state1, msgs, round_input);
+    ArmV8Sha256RoundsFrom<G + 1>::Run(state0, state1, msgs, round_input);
+  }
+};
+
+template <>
+struct ArmV8Sha256RoundsFrom<16> {
+  ARMV8_CRYPTO_INLINE static void Run(
+      uint32x4_t* state0, uint32x4_t* state1, uint32x4_t* msgs,
+      uint32x4_t* round_input) {
+  }
+};
+
+ARMV8_CRYPTO_TARGET void ArmV8Sha256Compress(
+    uint32_t* state, const byte* blocks, size_t num_blocks) {
+  uint32x4_t state0 = vld1q_u32(state);
+  uint32x4_t state1 = vld1q_u32(state + 4);
+
+  for (; num_blocks > 0; --num_blocks, blocks += DigestBackend::kBlockSize) {
+    const uint32x4_t saved_state0 = state0;
+    const uint32x4_t saved_state1 = state1;
+
+    uint32x4_t msgs[4];
+    for (int i = 0; i < 4; ++i) {
+      msgs[i] = LoadBigEndianWords(blocks + 16 * i);
+    }
+    uint32x4_t round_input =
+        vaddq_u32(msgs[0], vld1q_u32(kSha256RoundConstants));
+
+    ArmV8Sha256RoundsFrom<0>::Run(&state0, &state1, msgs, &round_input);
+
+    state0 = vaddq_u32(state0, saved_state0);
+    state1 = vaddq_u32(state1, saved_state1);
+  }
+
+  vst1q_u32(state, state0);
+  vst1q_u32(state + 4, state1);
+}
+
+}  // namespace
+
+ArmV8DigestBackend::ArmV8DigestBackend() {
+}
+
+ArmV8DigestBackend::~ArmV8DigestBackend() {
+}
+
+// static
+bool ArmV8DigestBackend::IsSupported() {
+  unsigned long hwcap = getauxval(AT_HWCAP);
+  return (hwcap & HWCAP_SHA1) && (hwcap & HWCAP_SHA2);
+}
+
+const char* ArmV8DigestBackend::name() const {
+  return "armv8-crypto";
+}
+
+void ArmV8DigestBackend::Sha1Compress(
+    uint32_t* state, const byte* blocks, size_t num_blocks) const {
+  ArmV8Sha1Compress(state, blocks, num_blocks);
+}
+
+void ArmV8DigestBackend::Sha256Compress(
+    uint32_t* state, const byte* blocks, size_t num_blocks) const {
+  ArmV8Sha256Compress(state, blocks, num_blocks);
+}
+
+}  // namespace polar_express
+
+#endif  // defined(__aarch64__)
@@ -0,0 +1,102 @@
+#ifndef DIGEST_BACKEND_IMPL_H
+#define DIGEST_BACKEND_IMPL_H
+
+#include "base/macros.h"
+#include "util/digest-backend.h"
+
+namespace polar_express {
+
+// The 64 SHA-256 round constants ("K"), shared by all implementations.
+extern const uint32_t kSha256RoundConstants[64];
+
+// Portable C++ implementation. Always available.
+class GenericDigestBackend : public DigestBackend {
+ public:
+  GenericDigestBackend();
+  virtual ~GenericDigestBackend();
+
+  virtual const char* name() const;
+
+  virtual void Sha1Compress(
+      uint32_t* state, const byte* blocks, size_t num_blocks) const;
+  virtual void Sha256Compress(
+      uint32_t* state, const byte* blocks, size_t num_blocks) const;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(GenericDigestBackend);
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// Uses the Intel SHA extensions (SHA-NI), which compute several SHA
+// rounds per instruction.
+class ShaNiDigestBackend : public DigestBackend {
+ public:
+  ShaNiDigestBackend();
+  virtual ~ShaNiDigestBackend();
+
+  static bool IsSupported();
+
+  virtual const char* name() const;
+
+  virtual void Sha1Compress(
+      uint32_t* state, const byte* blocks, size_t num_blocks) const;
+  virtual void Sha256Compress(
+      uint32_t* state, const byte* blocks, size_t num_blocks) const;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ShaNiDigestBackend);
+};
+
+// Uses AVX2 to hash eight independent messages at once, one per 32-bit
+// SIMD lane. Single messages fall back to the portable implementation,
+// so this is only useful through the multi-buffer interface on CPUs
+// that lack SHA-NI.
+class Avx2DigestBackend : public GenericDigestBackend {
+ public:
+  Avx2DigestBackend();
+  virtual ~Avx2DigestBackend();
+
+  static bool IsSupported();
+
+  virtual const char* name() const;
+
+  virtual void Sha1CompressMultiple(
+      uint32_t* const* states, const byte* const* blocks, size_t num_lanes,
+      size_t num_blocks) const;
+  virtual void Sha256CompressMultiple(
+      uint32_t* const* states, const byte* const* blocks, size_t num_lanes,
+      size_t num_blocks) const;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(Avx2DigestBackend);
+};
+
+#endif  // defined(__x86_64__) || defined(__i386__)
+
+#if defined(__aarch64__)
+
+// Uses the ARMv8 cryptography extensions.
+class ArmV8DigestBackend : public DigestBackend {
+ public:
+  ArmV8DigestBackend();
+  virtual ~ArmV8DigestBackend();
+
+  static bool IsSupported();
+
+  virtual const char* name() const;
+
+  virtual void Sha1Compress(
+      uint32_t* state, const byte* blocks, size_t num_blocks) const;
+  virtual void Sha256Compress(
+      uint32_t* state, const byte* blocks, size_t num_blocks) const;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ArmV8DigestBackend);
+};
+
+#endif  // defined(__aarch64__)
+
+}  // namespace polar_express
+
+#endif  // DIGEST_BACKEND_IMPL_H
@@ -0,0 +1,466 @@
+#include "util/digest-backend-impl.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+// Each kernel is compiled for the instruction set it needs with a
+// target attribute, so that this file builds without any special
+// compiler flags, and so that nothing outside these functions can use
+// instructions that the CPU might not support.
+#define SHA_NI_TARGET __attribute__((target("sha,sse4.1")))
+#define SHA_NI_INLINE SHA_NI_TARGET __attribute__((always_inline)) inline
+#define AVX2_TARGET __attribute__((target("avx2")))
+#define AVX2_INLINE AVX2_TARGET __attribute__((always_inline)) inline
+
+namespace polar_express {
+namespace {
+
+const int kAvx2Lanes = 8;
+
+bool GetCpuid(unsigned int leaf, unsigned int subleaf, unsigned int* regs) {
+  if (__get_cpuid_max(0, nullptr) < leaf) {
+    return false;
+  }
+  __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+  return true;
+}
+
+// Returns true if the OS saves the YMM registers on context switches.
+bool OsSupportsAvx() {
+  unsigned int regs[4];
+  if (!GetCpuid(1, 0, regs) || !(regs[2] & bit_OSXSAVE)) {
+    return false;
+  }
+  unsigned int xcr0_low, xcr0_high;
+  __asm__("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+  return (xcr0_low & 0x6) == 0x6;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// SHA-1 with SHA-NI.
+//
+// Each call handles four of the 80 rounds. The message schedule is kept
+// in four registers which are recycled as the rounds progress.
+
+template <int G>
+SHA_NI_INLINE void Sha1NiRounds(__m128i* abcd, __m128i* e, __m128i* msgs) {
+  __m128i& e_in = e[G % 2];
+  __m128i& e_out = e[(G + 1) % 2];
+  __m128i& msg = msgs[G % 4];
+
+  if (G == 0) {
+    e_in = _mm_add_epi32(e_in, msg);
+  } else {
+    e_in = _mm_sha1nexte_epu32(e_in, msg);
+  }
+  e_out = *abcd;
+  if (G >= 3 && G <= 18) {
+    msgs[(G + 1) % 4] = _mm_sha1msg2_epu32(msgs[(G + 1) % 4], msg);
+  }
+  *abcd = _mm_sha1rnds4_epu32(*abcd, e_in, G / 5);
+  if (G >= 1 && G <= 16) {
+    msgs[(G + 3) % 4] = _mm_sha1msg1_epu32(msgs[(G + 3) % 4], msg);
+  }
+  if (G >= 2 && G <= 17) {
+    msgs[(G + 2) % 4] = _mm_xor_si128(msgs[(G + 2) % 4], msg);
+  }
+}
+
+template <int G>
+struct Sha1NiRoundsFrom {
+  SHA_NI_INLINE static void Run(__m128i* abcd, __m128i* e, __m128i* msgs) {
+    Sha1NiRounds<G>(abcd, e, msgs);
+    Sha1NiRoundsFrom<G + 1>::Run(abcd, e, msgs);
+  }
+};
+
+template <>
+struct Sha1NiRoundsFrom<20> {
+  SHA_NI_INLINE static void Run(
+      __m128i* /* abcd */, __m128i* /* e */, __m128i* /* msgs */) {
+  }
+};
+
+SHA_NI_TARGET void ShaNiSha1Compress(
+    uint32_t* state, const byte* blocks, size_t num_blocks) {
+  const __m128i byte_swap_mask =
+      _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+  __m128i abcd = _mm_shuffle_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1b);
+  __m128i e0 = _mm_set_epi32(state[4], 0, 0, 0);
+
+  for (; num_blocks > 0; --num_blocks, blocks += DigestBackend::kBlockSize) {
+    const __m128i saved_abcd = abcd;
+    const __m128i saved_e0 = e0;
+
+    __m128i msgs[4];
+    for (int i = 0; i < 4; ++i) {
+      msgs[i] = _mm_shuffle_epi8(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + 16 * i)),
+          byte_swap_mask);
+    }
+
+    __m128i e[2] = { e0, _mm_setzero_si128() };
+    Sha1NiRoundsFrom<0>::Run(&abcd, e, msgs);
+
+    // After the final (odd-numbered) group, the next E is in e[0].
+    e0 = _mm_sha1nexte_epu32(e[0], saved_e0);
+    abcd = _mm_add_epi32(abcd, saved_abcd);
+  }
+
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state),
+                   _mm_shuffle_epi32(abcd, 0x1b));
+  state[4] = _mm_extract_epi32(e0, 3);
+}
+
+////////////////////////////////////////////////////////////////////////////
+// SHA-256 with SHA-NI.
+//
+// Each call handles four of the 64 rounds. The state is kept in the
+// (ABEF, CDGH) arrangement that the SHA-NI instructions expect.
+
+template <int G>
+SHA_NI_INLINE void Sha256NiRounds(
+    __m128i* state0, __m128i* state1, __m128i* msgs) {
+  __m128i& msg = msgs[G % 4];
+
+  __m128i round_input = _mm_add_epi32(
+      msg, _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(kSha256RoundConstants + 4 * G)));
+  *state1 = _mm_sha256rnds2_epu32(*state1, *state0, round_input);
+  if (G >= 3 && G <= 14) {
+    __m128i& next = msgs[(G + 1) % 4];
+    next = _mm_add_epi32(next, _mm_alignr_epi8(msg, msgs[(G + 3) % 4], 4));
+    next = _mm_sha256msg2_epu32(next, msg);
+  }
+  round_input = _mm_shuffle_epi32(round_input, 0x0e);
+  *state0 = _mm_sha256rnds2_epu32(*state0, *state1, round_input);
+  if (G >= 1 && G <= 12) {
+    msgs[(G + 3) % 4] = _mm_sha256msg1_epu32(msgs[(G + 3) % 4], msg);
+  }
+}
+
+template <int G>
+struct Sha256NiRoundsFrom {
+  SHA_NI_INLINE static void Run(
+      __m128i* state0, __m128i* state1, __m128i* msgs) {
+    Sha256NiRounds<G>(state0, state1, msgs);
+    Sha256NiRoundsFrom<G + 1>::Run(state0, state1, msgs);
+  }
+};
+
+template <>
+struct Sha256NiRoundsFrom<16> {
+  SHA_NI_INLINE static void Run(
+      __m128i* /* state0 */, __m128i* /* state1 */, __m128i* /* msgs */) {
+  }
+};
+
+SHA_NI_TARGET void ShaNiSha256Compress(
+    uint32_t* state, const byte* blocks, size_t num_blocks) {
+  const __m128i byte_swap_mask =
+      _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+  // Rearrange ABCD, EFGH into ABEF, CDGH.
+  __m128i dcba = _mm_shuffle_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0xb1);
+  __m128i efgh = _mm_shuffle_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4)), 0x1b);
+  __m128i state0 = _mm_alignr_epi8(dcba, efgh, 8);
+  __m128i state1 = _mm_blend_epi16(efgh, dcba, 0xf0);
+
+  for (; num_blocks > 0; --num_blocks, blocks += DigestBackend::kBlockSize) {
+    const __m128i saved_state0 = state0;
+    const __m128i saved_state1 = state1;
+
+    __m128i msgs[4];
+    for (int i = 0; i < 4; ++i) {
+      msgs[i] = _mm_shuffle_epi8(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + 16 * i)),
+          byte_swap_mask);
+    }
+
+    Sha256NiRoundsFrom<0>::Run(&state0, &state1, msgs);
+
+    state0 = _mm_add_epi32(state0, saved_state0);
+    state1 = _mm_add_epi32(state1, saved_state1);
+  }
+
+  // Rearrange ABEF, CDGH back into ABCD, EFGH.
+  __m128i feba = _mm_shuffle_epi32(state0, 0x1b);
+  __m128i dchg = _mm_shuffle_epi32(state1, 0xb1);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state),
+                   _mm_blend_epi16(feba, dchg, 0xf0));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4),
+                   _mm_alignr_epi8(dchg, feba, 8));
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Eight-lane SHA-1 and SHA-256 with AVX2.
+//
+// Each 32-bit lane of a 256-bit register holds the same state word (or
+// message word) for a different message, so every instruction advances
+// all eight messages at once.
+
+template <int N>
+AVX2_INLINE __m256i Avx2RotateLeft(__m256i x) {
+  return _mm256_or_si256(_mm256_slli_epi32(x, N), _mm256_srli_epi32(x, 32 - N));
+}
+
+template <int N>
+AVX2_INLINE __m256i Avx2RotateRight(__m256i x) {
+  return _mm256_or_si256(_mm256_srli_epi32(x, N), _mm256_slli_epi32(x, 32 - N));
+}
+
+// Loads big-endian word i of the current block of each of the eight
+// messages.
+AVX2_INLINE __m256i Avx2LoadMessageWords(const byte* const* blocks, int i) {
+  const __m256i byte_swap_mask = _mm256_set_epi8(
+      12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+      12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  const uint32_t* w[kAvx2Lanes];
+  for (int lane = 0; lane < kAvx2Lanes; ++lane) {
+    w[lane] = reinterpret_cast<const uint32_t*>(blocks[lane]) + i;
+  }
+  __m256i words = _mm256_set_epi32(
+      *w[7], *w[6], *w[5], *w[4], *w[3], *w[2], *w[1], *w[0]);
+  return _mm256_shuffle_epi8(words, byte_swap_mask);
+}
+
+// Transposes num_words words of each lane's state into vector form.
+AVX2_INLINE void Avx2LoadStates(
+    uint32_t* const* states, int num_words, __m256i* vectors) {
+  for (int i = 0; i < num_words; ++i) {
+    vectors[i] = _mm256_set_epi32(
+        states[7][i], states[6][i], states[5][i], states[4][i],
+        states[3][i], states[2][i], states[1][i], states[0][i]);
+  }
+}
+
+AVX2_INLINE void Avx2StoreStates(
+    const __m256i* vectors, int num_words, uint32_t* const* states) {
+  for (int i = 0; i < num_words; ++i) {
+    alignas(32) uint32_t lanes[kAvx2Lanes];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), vectors[i]);
+    for (int lane = 0; lane < kAvx2Lanes; ++lane) {
+      states[lane][i] = lanes[lane];
+    }
+  }
+}
+
+AVX2_TARGET void Avx2Sha1CompressEightLanes(
+    uint32_t* const* states, const byte* const* blocks, size_t num_blocks) {
+  __m256i state[5];
+  Avx2LoadStates(states, 5, state);
+
+  const byte* lane_blocks[kAvx2Lanes];
+  std::copy(blocks, blocks + kAvx2Lanes, lane_blocks);
+
+  const __m256i k[4] = {
+    _mm256_set1_epi32(0x5a827999), _mm256_set1_epi32(0x6ed9eba1),
+    _mm256_set1_epi32(0x8f1bbcdc), _mm256_set1_epi32(0xca62c1d6),
+  };
+
+  for (; num_blocks > 0; --num_blocks) {
+    __m256i w[80];
+    for (int i = 0; i < 16; ++i) {
+      w[i] = Avx2LoadMessageWords(lane_blocks, i);
+    }
+    for (int i = 16; i < 80; ++i) {
+      w[i] = Avx2RotateLeft<1>(_mm256_xor_si256(
+          _mm256_xor_si256(w[i - 3], w[i - 8]),
+          _mm256_xor_si256(w[i - 14], w[i - 16])));
+    }
+
+    __m256i a = state[0];
+    __m256i b = state[1];
+    __m256i c = state[2];
+    __m256i d = state[3];
+    __m256i e = state[4];
+
+    for (int i = 0; i < 80; ++i) {
+      __m256i f;
+      if (i < 20) {
+        f = _mm256_or_si256(_mm256_and_si256(b, c), _mm256_andnot_si256(b, d));
+      } else if (i < 40 || i >= 60) {
+        f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+      } else {
+        f = _mm256_or_si256(_mm256_and_si256(b, c),
+                            _mm256_and_si256(d, _mm256_or_si256(b, c)));
+      }
+      __m256i temp = _mm256_add_epi32(
+          _mm256_add_epi32(Avx2RotateLeft<5>(a), f),
+          _mm256_add_epi32(_mm256_add_epi32(e, k[i / 20]), w[i]));
+      e = d;
+      d = c;
+      c = Avx2RotateLeft<30>(b);
+      b = a;
+      a = temp;
+    }
+
+    state[0] = _mm256_add_epi32(state[0], a);
+    state[1] = _mm256_add_epi32(state[1], b);
+    state[2] = _mm256_add_epi32(state[2], c);
+    state[3] = _mm256_add_epi32(state[3], d);
+    state[4] = _mm256_add_epi32(state[4], e);
+
+    for (int lane = 0; lane < kAvx2Lanes; ++lane) {
+      lane_blocks[lane] += DigestBackend::kBlockSize;
+    }
+  }
+
+  Avx2StoreStates(state, 5, states);
+}
+
+AVX2_TARGET void Avx2Sha256CompressEightLanes(
+    uint32_t* const* states, const byte* const* blocks, size_t num_blocks) {
+  __m256i state[8];
+  Avx2LoadStates(states, 8, state);
+
+  const byte* lane_blocks[kAvx2Lanes];
+  std::copy(blocks, blocks + kAvx2Lanes, lane_blocks);
+
+  for (; num_blocks > 0; --num_blocks) {
+    __m256i w[64];
+    for (int i = 0; i < 16; ++i) {
+      w[i] = Avx2LoadMessageWords(lane_blocks, i);
+    }
+    for (int i = 16; i < 64; ++i) {
+      __m256i s0 = _mm256_xor_si256(
+          _mm256_xor_si256(Avx2RotateRight<7>(w[i - 15]),
+                           Avx2RotateRight<18>(w[i - 15])),
+          _mm256_srli_epi32(w[i - 15], 3));
+      __m256i s1 = _mm256_xor_si256(
+          _mm256_xor_si256(Avx2RotateRight<17>(w[i - 2]),
+                           Avx2RotateRight<19>(w[i - 2])),
+          _mm256_srli_epi32(w[i - 2], 10));
+      w[i] = _mm256_add_epi32(_mm256_add_epi32(w[i - 16], s0),
+                              _mm256_add_epi32(w[i - 7], s1));
+    }
+
+    __m256i a = state[0];
+    __m256i b = state[1];
+    __m256i c = state[2];
+    __m256i d = state[3];
+    __m256i e = state[4];
+    __m256i f = state[5];
+    __m256i g = state[6];
+    __m256i h = state[7];
+
+    for (int i = 0; i < 64; ++i) {
+      __m256i s1 = _mm256_xor_si256(
+          _mm256_xor_si256(Avx2RotateRight<6>(e), Avx2RotateRight<11>(e)),
+          Avx2RotateRight<25>(e));
+      __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f),
+                                    _mm256_andnot_si256(e, g));
+      __m256i temp1 = _mm256_add_epi32(
+          _mm256_add_epi32(_mm256_add_epi32(h, s1), ch),
+          _mm256_add_epi32(_mm256_set1_epi32(kSha256RoundConstants[i]), w[i]));
+      __m256i s0 = _mm256_xor_si256(
+          _mm256_xor_si256(Avx2RotateRight<2>(a), Avx2RotateRight<13>(a)),
+          Avx2RotateRight<22>(a));
+      __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b),
+                                    _mm256_and_si256(c, _mm256_or_si256(a, b)));
+      __m256i temp2 = _mm256_add_epi32(s0, maj);
+      h = g;
+      g = f;
+      f = e;
+      e = _mm256_add_epi32(d, temp1);
+      d = c;
+      c = b;
+      b = a;
+      a = _mm256_add_epi32(temp1, temp2);
+    }
+
+    state[0] = _mm256_add_epi32(state[0], a);
+    state[1] = _mm256_add_epi32(state[1], b);
+    state[2] = _mm256_add_epi32(state[2], c);
+    state[3] = _mm256_add_epi32(state[3], d);
+    state[4] = _mm256_add_epi32(state[4], e);
+    state[5] = _mm256_add_epi32(state[5], f);
+    state[6] = _mm256_add_epi32(state[6], g);
+    state[7] = _mm256_add_epi32(state[7], h);
+
+    for (int lane = 0; lane < kAvx2Lanes; ++lane) {
+      lane_blocks[lane] += DigestBackend::kBlockSize;
+    }
+  }
+
+  Avx2StoreStates(state, 8, states);
+}
+
+}  // namespace
+
+ShaNiDigestBackend::ShaNiDigestBackend() {
+}
+
+ShaNiDigestBackend::~ShaNiDigestBackend() {
+}
+
+// static
+bool ShaNiDigestBackend::IsSupported() {
+  unsigned int leaf1[4], leaf7[4];
+  return GetCpuid(1, 0, leaf1) && GetCpuid(7, 0, leaf7) &&
+      (leaf1[2] & bit_SSSE3) && (leaf1[2] & bit_SSE4_1) &&
+      (leaf7[1] & (1U << 29) /* SHA */);
+}
+
+const char* ShaNiDigestBackend::name() const {
+  return "x86-sha-ni";
+}
+
+void ShaNiDigestBackend::Sha1Compress(
+    uint32_t* state, const byte* blocks, size_t num_blocks) const {
+  ShaNiSha1Compress(state, blocks, num_blocks);
+}
+
+void ShaNiDigestBackend::Sha256Compress(
+    uint32_t* state, const byte* blocks, size_t num_blocks) const {
+  ShaNiSha256Compress(state, blocks, num_blocks);
+}
+
+Avx2DigestBackend::Avx2DigestBackend() {
+}
+
+Avx2DigestBackend::~Avx2DigestBackend() {
+}
+
+// static
+bool Avx2DigestBackend::IsSupported() {
+  unsigned int leaf7[4];
+  return OsSupportsAvx() && GetCpuid(7, 0, leaf7) &&
+      (leaf7[1] & bit_AVX2);
+}
+
+const char* Avx2DigestBackend::name() const {
+  return "x86-avx2-multibuffer";
+}
+
+void Avx2DigestBackend::Sha1CompressMultiple(
+    uint32_t* const* states, const byte* const* blocks, size_t num_lanes,
+    size_t num_blocks) const {
+  size_t lane = 0;
+  for (; lane + kAvx2Lanes <= num_lanes; lane += kAvx2Lanes) {
+    Avx2Sha1CompressEightLanes(states + lane, blocks + lane, num_blocks);
+  }
+  GenericDigestBackend::Sha1CompressMultiple(
+      states + lane, blocks + lane, num_lanes - lane, num_blocks);
+}
+
+void Avx2DigestBackend::Sha256CompressMultiple(
+    uint32_t* const* states, const byte* const* blocks, size_t num_lanes,
+    size_t num_blocks) const {
+  size_t lane = 0;
+  for (; lane + kAvx2Lanes <= num_lanes; lane += kAvx2Lanes) {
+    Avx2Sha256CompressEightLanes(states + lane, blocks + lane, num_blocks);
+  }
+  GenericDigestBackend::Sha256CompressMultiple(
+      states + lane, blocks + lane, num_lanes - lane, num_blocks);
+}
+
+}  // namespace polar_express
+
+#endif  // defined(__x86_64__) || defined(__i386__)
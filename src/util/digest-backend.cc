@@ -0,0 +1,219 @@
+#include "util/digest-backend.h"
+
+#include <iostream>
+
+#include "util/digest-backend-impl.h"
+
+namespace polar_express {
+
+const uint32_t kSha256RoundConstants[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+  0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+  0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+  0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+  0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+  0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+namespace {
+
+inline uint32_t RotateLeft(uint32_t x, int n) {
+  return (x << n) | (x >> (32 - n));
+}
+
+inline uint32_t RotateRight(uint32_t x, int n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+inline uint32_t LoadBigEndian32(const byte* p) {
+  return (static_cast<uint32_t>(p[0]) << 24) |
+      (static_cast<uint32_t>(p[1]) << 16) |
+      (static_cast<uint32_t>(p[2]) << 8) |
+      static_cast<uint32_t>(p[3]);
+}
+
+vector<const DigestBackend*>* CreateSupportedBackends() {
+  vector<const DigestBackend*>* backends = new vector<const DigestBackend*>;
+  backends->push_back(new GenericDigestBackend);
+#if defined(__x86_64__) || defined(__i386__)
+  if (Avx2DigestBackend::IsSupported()) {
+    backends->push_back(new Avx2DigestBackend);
+  }
+  if (ShaNiDigestBackend::IsSupported()) {
+    backends->push_back(new ShaNiDigestBackend);
+  }
+#endif
+#if defined(__aarch64__)
+  if (ArmV8DigestBackend::IsSupported()) {
+    backends->push_back(new ArmV8DigestBackend);
+  }
+#endif
+  DLOG(std::cerr << "Using " << backends->back()->name()
+                 << " digest backend." << std::endl);
+  return backends;
+}
+
+}  // namespace
+
+// static
+const DigestBackend& DigestBackend::GetFastest() {
+  // Backends are registered in increasing order of speed.
+  return *GetSupported().back();
+}
+
+// static
+const vector<const DigestBackend*>& DigestBackend::GetSupported() {
+  // Intentionally leaked, so that backends remain usable during static
+  // destruction.
+  static const vector<const DigestBackend*>* backends =
+      CreateSupportedBackends();
+  return *backends;
+}
+
+DigestBackend::DigestBackend() {
+}
+
+DigestBackend::~DigestBackend() {
+}
+
+void DigestBackend::Sha1CompressMultiple(
+    uint32_t* const* states, const byte* const* blocks, size_t num_lanes,
+    size_t num_blocks) const {
+  for (size_t i = 0; i < num_lanes; ++i) {
+    Sha1Compress(states[i], blocks[i], num_blocks);
+  }
+}
+
+void DigestBackend::Sha256CompressMultiple(
+    uint32_t* const* states, const byte* const* blocks, size_t num_lanes,
+    size_t num_blocks) const {
+  for (size_t i = 0; i < num_lanes; ++i) {
+    Sha256Compress(states[i], blocks[i], num_blocks);
+  }
+}
+
+GenericDigestBackend::GenericDigestBackend() {
+}
+
+GenericDigestBackend::~GenericDigestBackend() {
+}
+
+const char* GenericDigestBackend::name() const {
+  return "generic";
+}
+
+void GenericDigestBackend::Sha1Compress(
+    uint32_t* state, const byte* blocks, size_t num_blocks) const {
+  for (; num_blocks > 0; --num_blocks, blocks += kBlockSize) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+      w[i] = LoadBigEndian32(blocks + 4 * i);
+    }
+    for (int i = 16; i < 80; ++i) {
+      w[i] = RotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+    uint32_t e = state[4];
+
+#define SHA1_ROUND(i, f, k)                                 \
+    do {                                                      \
+      uint32_t temp = RotateLeft(a, 5) + (f) + e + (k) + w[i]; \
+      e = d;                                                  \
+      d = c;                                                  \
+      c = RotateLeft(b, 30);                                  \
+      b = a;                                                  \
+      a = temp;                                               \
+    } while (0)
+
+    // Separate loops for each group of 20 rounds keep the round function
+    // selection out of the inner loop.
+    for (int i = 0; i < 20; ++i) {
+      SHA1_ROUND(i, (b & c) | (~b & d), 0x5a827999);
+    }
+    for (int i = 20; i < 40; ++i) {
+      SHA1_ROUND(i, b ^ c ^ d, 0x6ed9eba1);
+    }
+    for (int i = 40; i < 60; ++i) {
+      SHA1_ROUND(i, (b & c) | (b & d) | (c & d), 0x8f1bbcdc);
+    }
+    for (int i = 60; i < 80; ++i) {
+      SHA1_ROUND(i, b ^ c ^ d, 0xca62c1d6);
+    }
+
+#undef SHA1_ROUND
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+  }
+}
+
+void GenericDigestBackend::Sha256Compress(
+    uint32_t* state, const byte* blocks, size_t num_blocks) const {
+  for (; num_blocks > 0; --num_blocks, blocks += kBlockSize) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i) {
+      w[i] = LoadBigEndian32(blocks + 4 * i);
+    }
+    for (int i = 16; i < 64; ++i) {
+      uint32_t s0 = RotateRight(w[i - 15], 7) ^ RotateRight(w[i - 15], 18) ^
+          (w[i - 15] >> 3);
+      uint32_t s1 = RotateRight(w[i - 2], 17) ^ RotateRight(w[i - 2], 19) ^
+          (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+    uint32_t e = state[4];
+    uint32_t f = state[5];
+    uint32_t g = state[6];
+    uint32_t h = state[7];
+
+    for (int i = 0; i < 64; ++i) {
+      uint32_t s1 = RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25);
+      uint32_t ch = (e & f) ^ (~e & g);
+      uint32_t temp1 = h + s1 + ch + kSha256RoundConstants[i] + w[i];
+      uint32_t s0 = RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22);
+      uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+      uint32_t temp2 = s0 + maj;
+      h = g;
+      g = f;
+      f = e;
+      e = d + temp1;
+      d = c;
+      c = b;
+      b = a;
+      a = temp1 + temp2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+}
+
+}  // namespace polar_express
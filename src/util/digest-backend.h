@@ -0,0 +1,68 @@
+#ifndef DIGEST_BACKEND_H
+#define DIGEST_BACKEND_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "base/macros.h"
+
+namespace polar_express {
+
+// Low-level SHA-1 and SHA-256 compression functions. A backend only
+// knows how to fold whole 64-byte blocks into a hash state; padding and
+// buffering of partial blocks is handled by ShaHasher (see
+// util/sha-hasher.h), which is what the rest of the program should use.
+//
+// Several backends may be compiled in (portable C++, x86 SHA
+// extensions, AVX2 multi-buffer, ARMv8 crypto extensions). Which of
+// them the CPU actually supports is detected once at runtime, and
+// GetFastest() returns the best one. All backends produce identical
+// results.
+class DigestBackend {
+ public:
+  static const size_t kBlockSize = 64;
+  static const size_t kSha1StateWords = 5;
+  static const size_t kSha256StateWords = 8;
+
+  // Returns the fastest backend that is supported by the CPU we are
+  // running on.
+  static const DigestBackend& GetFastest();
+
+  // Returns all compiled-in backends that are supported by the CPU we
+  // are running on. The portable backend is always first.
+  static const vector<const DigestBackend*>& GetSupported();
+
+  virtual ~DigestBackend();
+
+  virtual const char* name() const = 0;
+
+  // Compresses num_blocks consecutive 64-byte blocks into state. The
+  // state words are in host byte order.
+  virtual void Sha1Compress(
+      uint32_t* state, const byte* blocks, size_t num_blocks) const = 0;
+  virtual void Sha256Compress(
+      uint32_t* state, const byte* blocks, size_t num_blocks) const = 0;
+
+  // Multi-buffer versions of the above: compresses num_blocks blocks
+  // from each of num_lanes independent messages, where states[i] and
+  // blocks[i] belong to the i'th message. Backends that can hash
+  // several messages at once in SIMD lanes override these; the default
+  // implementations just process the lanes one after another.
+  virtual void Sha1CompressMultiple(
+      uint32_t* const* states, const byte* const* blocks, size_t num_lanes,
+      size_t num_blocks) const;
+  virtual void Sha256CompressMultiple(
+      uint32_t* const* states, const byte* const* blocks, size_t num_lanes,
+      size_t num_blocks) const;
+
+ protected:
+  DigestBackend();
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(DigestBackend);
+};
+
+}  // namespace polar_express
+
+#endif  // DIGEST_BACKEND_H
@@ -0,0 +1,85 @@
+// Reports SHA-1 and SHA-256 throughput for each digest backend supported
+// by this CPU, both hashing one long message and hashing many
+// independent 1 MiB blocks through the multi-buffer interface.
+//
+// Usage: digest-backend_benchmark [data_size_mb]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "base/byte-span.h"
+#include "base/macros.h"
+#include "util/digest-backend.h"
+#include "util/sha-hasher.h"
+
+using polar_express::ByteSpan;
+using polar_express::DigestBackend;
+using polar_express::Sha1Hasher;
+using polar_express::Sha256Hasher;
+
+namespace {
+
+const size_t kMultiBufferBlockSize = 1024 * 1024;
+
+template <typename Function>
+double MeasureGigabytesPerSecond(size_t num_bytes, Function function) {
+  // Run once to warm up caches and page in the data.
+  function();
+  auto start = std::chrono::steady_clock::now();
+  function();
+  double seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  return num_bytes / seconds / 1e9;
+}
+
+template <typename HasherT>
+double MeasureSingle(const DigestBackend& backend, const vector<byte>& data) {
+  return MeasureGigabytesPerSecond(data.size(), [&]() {
+    HasherT hasher(backend);
+    hasher.Update(data.data(), data.size());
+    typename HasherT::DigestType digest;
+    hasher.Final(&digest);
+  });
+}
+
+template <typename HasherT>
+double MeasureMultiple(const DigestBackend& backend,
+                       const vector<ByteSpan>& blocks, size_t num_bytes) {
+  return MeasureGigabytesPerSecond(num_bytes, [&]() {
+    vector<typename HasherT::DigestType> digests;
+    HasherT::HashMultiple(backend, blocks, &digests);
+  });
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t data_size_mb = (argc > 1) ? atoi(argv[1]) : 256;
+  vector<byte> data(data_size_mb * 1024 * 1024);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<byte>(i * 2654435761U >> 24);
+  }
+
+  vector<ByteSpan> blocks;
+  for (size_t offset = 0; offset + kMultiBufferBlockSize <= data.size();
+       offset += kMultiBufferBlockSize) {
+    blocks.push_back(ByteSpan(data.data() + offset, kMultiBufferBlockSize));
+  }
+
+  printf("Hashing %zu MB; multi-buffer mode uses %zu x 1 MiB blocks.\n",
+         data_size_mb, blocks.size());
+  printf("Fastest backend: %s\n\n", DigestBackend::GetFastest().name());
+  printf("%-22s %10s %10s %10s %10s\n", "backend (GB/s)",
+         "sha1", "sha1-mb", "sha256", "sha256-mb");
+
+  for (const DigestBackend* backend : DigestBackend::GetSupported()) {
+    printf("%-22s %10.2f %10.2f %10.2f %10.2f\n", backend->name(),
+           MeasureSingle<Sha1Hasher>(*backend, data),
+           MeasureMultiple<Sha1Hasher>(*backend, blocks, data.size()),
+           MeasureSingle<Sha256Hasher>(*backend, data),
+           MeasureMultiple<Sha256Hasher>(*backend, blocks, data.size()));
+  }
+  return 0;
+}
@@ -0,0 +1,81 @@
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <string>
+
+#include "base/macros.h"
+#include "util/hex-util.h"
+
+namespace polar_express {
+
+// A fixed-size binary digest value. Digests are stored in binary form
+// everywhere inside the program (as 'bytes' fields in protobufs and as
+// BLOBs in the metadata database), and only converted to hex at the
+// edges, using ToHex().
+template <size_t N>
+class Digest {
+ public:
+  static const size_t kSize = N;
+
+  Digest() {
+    bytes_.fill(0);
+  }
+
+  // Returns false and leaves digest unmodified if bytes is not exactly
+  // kSize bytes long.
+  static bool FromBytes(const string& bytes, Digest* digest) {
+    if (bytes.size() != kSize) {
+      return false;
+    }
+    std::copy(bytes.begin(), bytes.end(), CHECK_NOTNULL(digest)->data());
+    return true;
+  }
+
+  const byte* data() const { return bytes_.data(); }
+  byte* data() { return bytes_.data(); }
+  size_t size() const { return kSize; }
+
+  // Returns the raw binary form, suitable for storing in a 'bytes'
+  // protobuf field.
+  string ToBytes() const {
+    return string(reinterpret_cast<const char*>(data()), kSize);
+  }
+
+  string ToHex() const {
+    return HexEncode(data(), kSize);
+  }
+
+  // Compares against the raw binary form of a digest without
+  // constructing a temporary.
+  bool EqualsBytes(const string& bytes) const {
+    return bytes.size() == kSize &&
+        memcmp(bytes.data(), data(), kSize) == 0;
+  }
+
+  bool operator==(const Digest& rhs) const {
+    return bytes_ == rhs.bytes_;
+  }
+
+  bool operator!=(const Digest& rhs) const {
+    return bytes_ != rhs.bytes_;
+  }
+
+  bool operator<(const Digest& rhs) const {
+    return bytes_ < rhs.bytes_;
+  }
+
+ private:
+  std::array<byte, N> bytes_;
+};
+
+template <size_t N> const size_t Digest<N>::kSize;
+
+typedef Digest<20> Sha1Digest;
+typedef Digest<32> Sha256Digest;
+
+}  // namespace polar_express
+
+#endif  // DIGEST_H
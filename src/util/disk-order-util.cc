@@ -0,0 +1,129 @@
+#include "util/disk-order-util.h"
+
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <tuple>
+
+#include "proto/file.pb.h"
+#include "util/file-stat-util.h"
+
+namespace polar_express {
+namespace disk_order_util {
+namespace {
+
+// Sort key of a path: its device, whether it has a physical offset, and
+// either that offset or its inode number.
+typedef std::tuple<int64_t, bool, uint64_t> DiskOrderKey;
+
+// get_path returns the path of an element, and is only called for
+// kPhysicalOffset.
+template <typename T, typename GetPathFunction>
+DiskOrderKey GetDiskOrderKey(
+    DiskOrder order, const pair<T, FileStat>& element_with_stat,
+    GetPathFunction get_path) {
+  const FileStat& file_stat = element_with_stat.second;
+  uint64_t offset = 0;
+  if (order == DiskOrder::kPhysicalOffset &&
+      file_stat_util::IsRegularFile(file_stat) && file_stat.length() > 0 &&
+      GetPhysicalOffset(get_path(element_with_stat.first), &offset)) {
+    return DiskOrderKey(file_stat.device(), true, offset);
+  }
+  return DiskOrderKey(file_stat.device(), false, file_stat.inode());
+}
+
+template <typename T, typename GetPathFunction>
+void SortByDiskOrderInternal(
+    DiskOrder order, size_t window_size, GetPathFunction get_path,
+    vector<pair<T, FileStat> >* elements_with_stat) {
+  CHECK_NOTNULL(elements_with_stat);
+  if (order == DiskOrder::kScan || elements_with_stat->size() < 2) {
+    return;
+  }
+  if (window_size == 0) {
+    window_size = elements_with_stat->size();
+  }
+
+  vector<DiskOrderKey> keys;
+  keys.reserve(elements_with_stat->size());
+  for (const auto& element_with_stat : *elements_with_stat) {
+    keys.push_back(GetDiskOrderKey(order, element_with_stat, get_path));
+  }
+
+  vector<size_t> indices(elements_with_stat->size());
+  for (size_t i = 0; i < indices.size(); ++i) {
+    indices[i] = i;
+  }
+  for (size_t begin = 0; begin < indices.size(); begin += window_size) {
+    const size_t end = std::min(begin + window_size, indices.size());
+    std::stable_sort(indices.begin() + begin, indices.begin() + end,
+                     [&keys](size_t a, size_t b) {
+                       return keys[a] < keys[b];
+                     });
+  }
+
+  vector<pair<T, FileStat> > sorted_elements_with_stat;
+  sorted_elements_with_stat.reserve(elements_with_stat->size());
+  for (size_t index : indices) {
+    sorted_elements_with_stat.push_back(
+        std::move((*elements_with_stat)[index]));
+  }
+  elements_with_stat->swap(sorted_elements_with_stat);
+}
+
+}  // namespace
+
+bool GetPhysicalOffset(const boost::filesystem::path& path, uint64_t* offset) {
+  CHECK_NOTNULL(offset);
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+
+  // Room for the header and the first extent only.
+  uint64_t buffer[(sizeof(struct fiemap) + sizeof(struct fiemap_extent)) /
+                  sizeof(uint64_t)] = {};
+  struct fiemap* fiemap = reinterpret_cast<struct fiemap*>(buffer);
+  fiemap->fm_start = 0;
+  fiemap->fm_length = FIEMAP_MAX_OFFSET;
+  fiemap->fm_extent_count = 1;
+  const bool has_offset =
+      ioctl(fd, FS_IOC_FIEMAP, fiemap) == 0 &&
+      fiemap->fm_mapped_extents > 0 &&
+      !(fiemap->fm_extents[0].fe_flags &
+        (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DATA_INLINE));
+  close(fd);
+
+  if (has_offset) {
+    *offset = fiemap->fm_extents[0].fe_physical;
+  }
+  return has_offset;
+}
+
+void SortByDiskOrder(
+    DiskOrder order, size_t window_size,
+    vector<pair<boost::filesystem::path, FileStat> >* paths_with_stat) {
+  SortByDiskOrderInternal(
+      order, window_size,
+      [](const boost::filesystem::path& path)
+          -> const boost::filesystem::path& { return path; },
+      paths_with_stat);
+}
+
+void SortByDiskOrder(
+    DiskOrder order, size_t window_size, const PathArena& path_arena,
+    vector<pair<PathArena::Handle, FileStat> >* handles_with_stat) {
+  SortByDiskOrderInternal(
+      order, window_size,
+      [&path_arena](PathArena::Handle handle) {
+        return path_arena.GetPath(handle);
+      },
+      handles_with_stat);
+}
+
+}  // namespace disk_order_util
+}  // namespace polar_express
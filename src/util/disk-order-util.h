@@ -0,0 +1,56 @@
+#ifndef DISK_ORDER_UTIL_H
+#define DISK_ORDER_UTIL_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "base/macros.h"
+#include "util/path-arena.h"
+
+namespace polar_express {
+
+class FileStat;
+
+namespace disk_order_util {
+
+// Orders in which files found by a scan can be processed.
+enum class DiskOrder {
+  // The order in which the scanner found them (i.e. directory order).
+  kScan,
+  // By device and inode number. Costs nothing beyond the sort, and on
+  // file systems which allocate inodes and data near one another (e.g.
+  // ext4, XFS) approximates the order of the data on disk.
+  kInode,
+  // By device and the physical offset of each file's first extent, as
+  // reported by FIEMAP. Costs an open and an ioctl per file.
+  kPhysicalOffset,
+};
+
+// Fills in offset with the physical offset on its device of the first
+// extent of the regular file at path. Returns false if the file cannot be
+// opened, has no extents (e.g. it is empty, or its data is inline or not
+// yet allocated), or its file system does not support FIEMAP.
+bool GetPhysicalOffset(const boost::filesystem::path& path, uint64_t* offset);
+
+// Sorts each consecutive run of window_size paths (or all of them, if
+// window_size is zero) into the given order, so that no path moves further
+// than window_size from where the scan found it. Paths which compare equal
+// keep their scan order. For kPhysicalOffset, paths with no physical
+// offset (including everything but regular files) are ordered by inode,
+// ahead of those with one.
+void SortByDiskOrder(
+    DiskOrder order, size_t window_size,
+    vector<pair<boost::filesystem::path, FileStat> >* paths_with_stat);
+
+// As above, for paths stored in path_arena.
+void SortByDiskOrder(
+    DiskOrder order, size_t window_size, const PathArena& path_arena,
+    vector<pair<PathArena::Handle, FileStat> >* handles_with_stat);
+
+}  // namespace disk_order_util
+}  // namespace polar_express
+
+#endif  // DISK_ORDER_UTIL_H
@@ -0,0 +1,127 @@
+#include "util/disk-order-util.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <gtest/gtest.h>
+
+#include "proto/file.pb.h"
+#include "util/file-stat-util.h"
+
+namespace polar_express {
+namespace disk_order_util {
+namespace {
+
+class DiskOrderUtilTest : public testing::Test {
+ protected:
+  DiskOrderUtilTest()
+      : test_directory_(boost::filesystem::temp_directory_path() /
+                        boost::filesystem::unique_path()) {
+    boost::filesystem::create_directories(test_directory_);
+  }
+
+  virtual ~DiskOrderUtilTest() {
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(test_directory_, ec);
+  }
+
+  void AddPath(const string& name, int64_t device, int64_t inode) {
+    FileStat file_stat;
+    file_stat.set_device(device);
+    file_stat.set_inode(inode);
+    paths_with_stat_.push_back(make_pair(test_directory_ / name, file_stat));
+  }
+
+  vector<string> GetNames() const {
+    vector<string> names;
+    for (const auto& path_with_stat : paths_with_stat_) {
+      names.push_back(path_with_stat.first.filename().string());
+    }
+    return names;
+  }
+
+  const boost::filesystem::path test_directory_;
+  vector<pair<boost::filesystem::path, FileStat> > paths_with_stat_;
+};
+
+TEST_F(DiskOrderUtilTest, ScanOrderIsUnchanged) {
+  AddPath("a", 1, 30);
+  AddPath("b", 1, 10);
+  AddPath("c", 1, 20);
+  SortByDiskOrder(DiskOrder::kScan, 0, &paths_with_stat_);
+  EXPECT_EQ(vector<string>({ "a", "b", "c" }), GetNames());
+}
+
+TEST_F(DiskOrderUtilTest, SortsByDeviceAndInode) {
+  AddPath("a", 2, 10);
+  AddPath("b", 1, 30);
+  AddPath("c", 1, 10);
+  AddPath("d", 1, 20);
+  AddPath("e", 1, 10);
+  SortByDiskOrder(DiskOrder::kInode, 0, &paths_with_stat_);
+  EXPECT_EQ(vector<string>({ "c", "e", "d", "b", "a" }), GetNames());
+}
+
+TEST_F(DiskOrderUtilTest, SortsWithinWindows) {
+  AddPath("a", 1, 40);
+  AddPath("b", 1, 30);
+  AddPath("c", 1, 20);
+  AddPath("d", 1, 10);
+  AddPath("e", 1, 0);
+  SortByDiskOrder(DiskOrder::kInode, 2, &paths_with_stat_);
+  EXPECT_EQ(vector<string>({ "b", "a", "d", "c", "e" }), GetNames());
+}
+
+TEST_F(DiskOrderUtilTest, SortsPathArenaHandles) {
+  PathArena path_arena;
+  vector<pair<PathArena::Handle, FileStat> > handles_with_stat;
+  for (int inode : { 30, 10, 20 }) {
+    FileStat file_stat;
+    file_stat.set_device(1);
+    file_stat.set_inode(inode);
+    handles_with_stat.push_back(make_pair(
+        path_arena.Add(test_directory_ / std::to_string(inode)), file_stat));
+  }
+  SortByDiskOrder(DiskOrder::kInode, 0, path_arena, &handles_with_stat);
+  vector<string> names;
+  for (const auto& handle_with_stat : handles_with_stat) {
+    names.push_back(
+        path_arena.GetPath(handle_with_stat.first).filename().string());
+  }
+  EXPECT_EQ(vector<string>({ "10", "20", "30" }), names);
+}
+
+TEST_F(DiskOrderUtilTest, FilesWithoutPhysicalOffsetsSortByInodeFirst) {
+  const boost::filesystem::path file_path = test_directory_ / "file";
+  {
+    boost::filesystem::ofstream file(file_path);
+    file << string(64 * 1024, 'x');
+  }
+  FileStat file_stat;
+  ASSERT_TRUE(file_stat_util::GetFileStat(file_path, &file_stat));
+  paths_with_stat_.push_back(make_pair(file_path, file_stat));
+  // Not regular files, so never given a physical offset.
+  AddPath("b", file_stat.device(), 20);
+  AddPath("a", file_stat.device(), 10);
+
+  SortByDiskOrder(DiskOrder::kPhysicalOffset, 0, &paths_with_stat_);
+  uint64_t offset;
+  if (GetPhysicalOffset(file_path, &offset)) {
+    EXPECT_EQ(vector<string>({ "a", "b", "file" }), GetNames());
+  } else {
+    // FIEMAP is unsupported here (e.g. on tmpfs), so only inodes count.
+    EXPECT_EQ("a", GetNames()[0]);
+  }
+}
+
+TEST_F(DiskOrderUtilTest, NoPhysicalOffsetForMissingFile) {
+  uint64_t offset;
+  EXPECT_FALSE(GetPhysicalOffset(test_directory_ / "missing", &offset));
+}
+
+}  // namespace
+}  // namespace disk_order_util
+}  // namespace polar_express
@@ -0,0 +1,39 @@
+#include "util/file-identity-util.h"
+
+#include <sys/stat.h>
+
+#include "base/macros.h"
+#include "proto/snapshot.pb.h"
+
+namespace polar_express {
+
+// static
+bool FileIdentityUtil::GetFileIdentity(
+    const boost::filesystem::path& path, FileIdentity* file_identity) {
+  CHECK_NOTNULL(file_identity)->Clear();
+
+  struct stat unix_stat;
+  if (stat(path.string().c_str(), &unix_stat) != 0) {
+    return false;
+  }
+
+  file_identity->set_device(unix_stat.st_dev);
+  file_identity->set_inode(unix_stat.st_ino);
+  file_identity->set_length(unix_stat.st_size);
+  file_identity->set_modification_time_ns(
+      static_cast<int64_t>(unix_stat.st_mtim.tv_sec) * 1000000000 +
+      unix_stat.st_mtim.tv_nsec);
+  return true;
+}
+
+// static
+bool FileIdentityUtil::FileIdentitiesEqual(
+    const FileIdentity& lhs, const FileIdentity& rhs) {
+  return lhs.has_inode() && rhs.has_inode() &&
+      lhs.device() == rhs.device() &&
+      lhs.inode() == rhs.inode() &&
+      lhs.length() == rhs.length() &&
+      lhs.modification_time_ns() == rhs.modification_time_ns();
+}
+
+}  // namespace polar_express
@@ -0,0 +1,37 @@
+#ifndef FILE_IDENTITY_UTIL_H
+#define FILE_IDENTITY_UTIL_H
+
+#include <boost/filesystem.hpp>
+
+#include "base/macros.h"
+
+namespace polar_express {
+
+class FileIdentity;
+
+// Operations on the identity of a file (its device, inode, length and
+// modification time), which is recorded when its chunks are hashed and
+// compared later to decide whether those chunks still describe the file.
+class FileIdentityUtil {
+ public:
+  // Fills in file_identity from the current state of the file at
+  // path. Returns false (and clears file_identity) if the file cannot be
+  // stat'ed.
+  static bool GetFileIdentity(const boost::filesystem::path& path,
+                              FileIdentity* file_identity);
+
+  // Returns true if both identities are complete and equal, meaning that
+  // (barring deliberate tampering with timestamps) the file's contents
+  // have not changed between the two observations.
+  static bool FileIdentitiesEqual(
+      const FileIdentity& lhs, const FileIdentity& rhs);
+
+ private:
+  FileIdentityUtil();
+
+  DISALLOW_COPY_AND_ASSIGN(FileIdentityUtil);
+};
+
+}  // namespace polar_express
+
+#endif  // FILE_IDENTITY_UTIL_H
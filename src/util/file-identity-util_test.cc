@@ -0,0 +1,105 @@
+#include "util/file-identity-util.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#include "proto/snapshot.pb.h"
+
+namespace polar_express {
+namespace {
+
+class FileIdentityUtilTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    directory_ = boost::filesystem::temp_directory_path() /
+        boost::filesystem::unique_path("file-identity-util_test-%%%%%%%%");
+    ASSERT_TRUE(boost::filesystem::create_directories(directory_));
+    path_ = directory_ / "file";
+    WriteFile(path_, "0123456789");
+    SetModificationTime(path_, 1000000000, 123);
+    ASSERT_TRUE(FileIdentityUtil::GetFileIdentity(path_, &identity_));
+  }
+
+  virtual void TearDown() {
+    boost::filesystem::remove_all(directory_);
+  }
+
+  static void WriteFile(const boost::filesystem::path& path,
+                        const string& contents) {
+    std::ofstream file(path.string().c_str(), std::ios::binary);
+    file << contents;
+  }
+
+  static void SetModificationTime(const boost::filesystem::path& path,
+                                  time_t seconds, long nanoseconds) {
+    struct timespec times[2];
+    times[0].tv_sec = 0;
+    times[0].tv_nsec = UTIME_OMIT;
+    times[1].tv_sec = seconds;
+    times[1].tv_nsec = nanoseconds;
+    ASSERT_EQ(0, utimensat(AT_FDCWD, path.string().c_str(), times, 0));
+  }
+
+  // Returns whether the file at path_ still has identity_.
+  bool IdentityUnchanged() {
+    FileIdentity file_identity;
+    EXPECT_TRUE(FileIdentityUtil::GetFileIdentity(path_, &file_identity));
+    return FileIdentityUtil::FileIdentitiesEqual(identity_, file_identity);
+  }
+
+  boost::filesystem::path directory_;
+  boost::filesystem::path path_;
+  FileIdentity identity_;
+};
+
+TEST_F(FileIdentityUtilTest, RecordsStatOfFile) {
+  struct stat unix_stat;
+  ASSERT_EQ(0, stat(path_.string().c_str(), &unix_stat));
+  EXPECT_EQ(unix_stat.st_dev, identity_.device());
+  EXPECT_EQ(unix_stat.st_ino, identity_.inode());
+  EXPECT_EQ(10, identity_.length());
+  EXPECT_EQ(1000000000000000123LL, identity_.modification_time_ns());
+  EXPECT_TRUE(IdentityUnchanged());
+}
+
+TEST_F(FileIdentityUtilTest, ChangedLengthInvalidatesIdentity) {
+  WriteFile(path_, "01234567890");
+  SetModificationTime(path_, 1000000000, 123);
+  EXPECT_FALSE(IdentityUnchanged());
+}
+
+TEST_F(FileIdentityUtilTest, ChangedModificationTimeInvalidatesIdentity) {
+  WriteFile(path_, "9876543210");
+  SetModificationTime(path_, 1000000000, 124);
+  EXPECT_FALSE(IdentityUnchanged());
+}
+
+TEST_F(FileIdentityUtilTest, ChangedInodeInvalidatesIdentity) {
+  // Replaces the file with one of the same length and modification time.
+  const boost::filesystem::path replacement_path = directory_ / "replacement";
+  WriteFile(replacement_path, "9876543210");
+  SetModificationTime(replacement_path, 1000000000, 123);
+  boost::filesystem::rename(replacement_path, path_);
+  EXPECT_FALSE(IdentityUnchanged());
+}
+
+TEST_F(FileIdentityUtilTest, MissingFileHasNoIdentity) {
+  FileIdentity file_identity = identity_;
+  EXPECT_FALSE(FileIdentityUtil::GetFileIdentity(
+      directory_ / "missing", &file_identity));
+  EXPECT_FALSE(file_identity.has_inode());
+  EXPECT_FALSE(
+      FileIdentityUtil::FileIdentitiesEqual(identity_, file_identity));
+  EXPECT_FALSE(
+      FileIdentityUtil::FileIdentitiesEqual(file_identity, file_identity));
+}
+
+}  // namespace
+}  // namespace polar_express
@@ -0,0 +1,168 @@
+#include "util/file-stat-util.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/stat.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+
+#include "proto/file.pb.h"
+
+namespace polar_express {
+namespace file_stat_util {
+namespace {
+
+// Large enough that most directories are read with a single call, which
+// matters on network file systems where each call is a round trip.
+const size_t kDirectoryBufferSize = 256 * 1024;
+
+const unsigned kStatxMask = STATX_TYPE | STATX_MODE | STATX_UID | STATX_GID |
+    STATX_INO | STATX_SIZE | STATX_MTIME | STATX_CTIME;
+
+struct LinuxDirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+void SetFileStatFromStat(const struct stat& unix_stat, FileStat* file_stat) {
+  file_stat->set_mode(unix_stat.st_mode);
+  file_stat->set_uid(unix_stat.st_uid);
+  file_stat->set_gid(unix_stat.st_gid);
+  file_stat->set_device(unix_stat.st_dev);
+  file_stat->set_inode(unix_stat.st_ino);
+  file_stat->set_length(unix_stat.st_size);
+  file_stat->set_modification_time_ns(
+      static_cast<int64_t>(unix_stat.st_mtim.tv_sec) * 1000000000 +
+      unix_stat.st_mtim.tv_nsec);
+  file_stat->set_change_time_ns(
+      static_cast<int64_t>(unix_stat.st_ctim.tv_sec) * 1000000000 +
+      unix_stat.st_ctim.tv_nsec);
+}
+
+// Stats the entry name of the directory open as directory_fd, following
+// symlinks. Falls back to fstatat on kernels without statx.
+bool StatDirectoryEntry(int directory_fd, const char* name,
+                        FileStat* file_stat) {
+  static std::atomic<bool> statx_unavailable(false);
+  if (!statx_unavailable) {
+    struct statx unix_statx;
+    if (syscall(__NR_statx, directory_fd, name, AT_STATX_SYNC_AS_STAT,
+                kStatxMask, &unix_statx) == 0) {
+      file_stat->set_mode(unix_statx.stx_mode);
+      file_stat->set_uid(unix_statx.stx_uid);
+      file_stat->set_gid(unix_statx.stx_gid);
+      file_stat->set_device(
+          makedev(unix_statx.stx_dev_major, unix_statx.stx_dev_minor));
+      file_stat->set_inode(unix_statx.stx_ino);
+      file_stat->set_length(unix_statx.stx_size);
+      file_stat->set_modification_time_ns(
+          unix_statx.stx_mtime.tv_sec * 1000000000 +
+          unix_statx.stx_mtime.tv_nsec);
+      file_stat->set_change_time_ns(
+          unix_statx.stx_ctime.tv_sec * 1000000000 +
+          unix_statx.stx_ctime.tv_nsec);
+      return true;
+    }
+    if (errno != ENOSYS) {
+      return false;
+    }
+    statx_unavailable = true;
+  }
+
+  struct stat unix_stat;
+  if (fstatat(directory_fd, name, &unix_stat, 0) != 0) {
+    return false;
+  }
+  SetFileStatFromStat(unix_stat, file_stat);
+  return true;
+}
+
+}  // namespace
+
+bool GetFileStat(const boost::filesystem::path& path, FileStat* file_stat) {
+  CHECK_NOTNULL(file_stat)->Clear();
+
+  struct stat unix_stat;
+  if (stat(path.c_str(), &unix_stat) != 0) {
+    return false;
+  }
+  SetFileStatFromStat(unix_stat, file_stat);
+  return true;
+}
+
+bool IsRegularFile(const FileStat& file_stat) {
+  return file_stat.has_mode() && S_ISREG(file_stat.mode());
+}
+
+bool IsDirectory(const FileStat& file_stat) {
+  return file_stat.has_mode() && S_ISDIR(file_stat.mode());
+}
+
+bool ReadDirectory(
+    const boost::filesystem::path& directory,
+    vector<pair<boost::filesystem::path, FileStat> >* entries,
+    vector<boost::filesystem::path>* subdirectories) {
+  CHECK_NOTNULL(entries);
+  CHECK_NOTNULL(subdirectories);
+
+  const int directory_fd =
+      open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (directory_fd < 0) {
+    return false;
+  }
+
+  unique_ptr<char[]> buffer(new char[kDirectoryBufferSize]);
+  bool success = true;
+  for (;;) {
+    const long bytes_read = syscall(
+        __NR_getdents64, directory_fd, buffer.get(), kDirectoryBufferSize);
+    if (bytes_read <= 0) {
+      success = (bytes_read == 0);
+      break;
+    }
+
+    for (long offset = 0; offset < bytes_read;) {
+      const LinuxDirent64* dirent =
+          reinterpret_cast<const LinuxDirent64*>(buffer.get() + offset);
+      offset += dirent->d_reclen;
+
+      const char* name = dirent->d_name;
+      if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        continue;
+      }
+
+      entries->push_back(make_pair(directory / name, FileStat()));
+      FileStat* file_stat = &entries->back().second;
+      StatDirectoryEntry(directory_fd, name, file_stat);
+
+      // The stat follows symlinks, so only the entry's own type says
+      // whether it is really a subdirectory. Some file systems do not
+      // report it, in which case the entry has to be lstat'ed.
+      bool is_directory = (dirent->d_type == DT_DIR);
+      if (dirent->d_type == DT_UNKNOWN && IsDirectory(*file_stat)) {
+        struct stat unix_lstat;
+        is_directory =
+            fstatat(directory_fd, name, &unix_lstat,
+                    AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(unix_lstat.st_mode);
+      }
+      if (is_directory) {
+        subdirectories->push_back(entries->back().first);
+      }
+    }
+  }
+
+  close(directory_fd);
+  return success;
+}
+
+}  // namespace file_stat_util
+}  // namespace polar_express
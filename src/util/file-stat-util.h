@@ -0,0 +1,45 @@
+#ifndef FILE_STAT_UTIL_H
+#define FILE_STAT_UTIL_H
+
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "base/macros.h"
+
+namespace polar_express {
+
+class FileStat;
+
+namespace file_stat_util {
+
+// Fills in file_stat by stat'ing the file at path, following symlinks.
+// Returns false (and clears file_stat) if the file cannot be stat'ed.
+bool GetFileStat(const boost::filesystem::path& path, FileStat* file_stat);
+
+// Returns true if file_stat is for a regular file. False if it is empty.
+bool IsRegularFile(const FileStat& file_stat);
+
+// Returns true if file_stat is for a directory. False if it is empty.
+bool IsDirectory(const FileStat& file_stat);
+
+// Reads all of the entries of directory (other than "." and ".."),
+// appending each entry's path and stat results to entries and the paths
+// of its subdirectories (not including symlinks to directories) to
+// subdirectories. Entries that cannot be stat'ed (e.g. dangling symlinks)
+// are included with an empty FileStat. Returns false if the directory
+// cannot be read.
+//
+// On Linux, entries are read in bulk with getdents64, and each entry is
+// stat'ed with a single statx relative to the open directory, so that the
+// path is not resolved from the root again for each entry.
+bool ReadDirectory(
+    const boost::filesystem::path& directory,
+    vector<pair<boost::filesystem::path, FileStat> >* entries,
+    vector<boost::filesystem::path>* subdirectories);
+
+}  // namespace file_stat_util
+}  // namespace polar_express
+
+#endif  // FILE_STAT_UTIL_H
@@ -0,0 +1,52 @@
+#include "util/hex-util.h"
+
+namespace polar_express {
+namespace {
+
+const char kHexDigits[] = "0123456789ABCDEF";
+
+// Returns the value of a hex digit, or -1 if c is not a hex digit.
+int HexDigitValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  } else if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  } else if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+}  // namespace
+
+string HexEncode(const byte* data, size_t size) {
+  string hex(2 * size, '\0');
+  for (size_t i = 0; i < size; ++i) {
+    hex[2 * i] = kHexDigits[data[i] >> 4];
+    hex[2 * i + 1] = kHexDigits[data[i] & 0x0f];
+  }
+  return hex;
+}
+
+string HexEncode(const string& data) {
+  return HexEncode(reinterpret_cast<const byte*>(data.data()), data.size());
+}
+
+bool HexDecode(const string& hex, string* data) {
+  if (hex.size() % 2 != 0) {
+    return false;
+  }
+  string decoded(hex.size() / 2, '\0');
+  for (size_t i = 0; i < decoded.size(); ++i) {
+    int high = HexDigitValue(hex[2 * i]);
+    int low = HexDigitValue(hex[2 * i + 1]);
+    if (high < 0 || low < 0) {
+      return false;
+    }
+    decoded[i] = static_cast<char>((high << 4) | low);
+  }
+  CHECK_NOTNULL(data)->swap(decoded);
+  return true;
+}
+
+}  // namespace polar_express
@@ -0,0 +1,25 @@
+#ifndef HEX_UTIL_H
+#define HEX_UTIL_H
+
+#include <string>
+
+#include "base/macros.h"
+
+namespace polar_express {
+
+// Fast, table-driven conversion between binary data (e.g. digests) and
+// hexadecimal strings. Binary data is what is stored internally; hex
+// strings should only be produced at the edges of the system (HTTP
+// headers, filenames, logs).
+
+// Returns an uppercase hex encoding of the data.
+string HexEncode(const byte* data, size_t size);
+string HexEncode(const string& data);
+
+// Decodes a hex string (either case) into binary data. Returns false
+// and leaves data unmodified if hex is not valid hex.
+bool HexDecode(const string& hex, string* data);
+
+}  // namespace polar_express
+
+#endif  // HEX_UTIL_H
@@ -0,0 +1,54 @@
+#include "util/hex-util.h"
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "util/digest.h"
+
+namespace polar_express {
+namespace {
+
+const byte kTestData[] = { 0x00, 0x01, 0x7f, 0x80, 0xab, 0xff };
+
+TEST(HexUtilTest, Encode) {
+  EXPECT_EQ("", HexEncode(kTestData, 0));
+  EXPECT_EQ("00017F80ABFF", HexEncode(kTestData, sizeof(kTestData)));
+}
+
+TEST(HexUtilTest, DecodeRoundTrip) {
+  string data;
+  ASSERT_TRUE(HexDecode("00017F80ABFF", &data));
+  EXPECT_EQ(string(reinterpret_cast<const char*>(kTestData),
+                   sizeof(kTestData)), data);
+
+  // Lowercase is accepted too.
+  string lowercase_data;
+  ASSERT_TRUE(HexDecode("00017f80abff", &lowercase_data));
+  EXPECT_EQ(data, lowercase_data);
+  EXPECT_EQ("00017F80ABFF", HexEncode(data));
+}
+
+TEST(HexUtilTest, DecodeRejectsInvalidInput) {
+  string data = "unchanged";
+  EXPECT_FALSE(HexDecode("ABC", &data));
+  EXPECT_FALSE(HexDecode("GG", &data));
+  EXPECT_EQ("unchanged", data);
+}
+
+TEST(HexUtilTest, DigestBytesRoundTrip) {
+  string bytes;
+  ASSERT_TRUE(HexDecode("DA39A3EE5E6B4B0D3255BFEF95601890AFD80709", &bytes));
+
+  Sha1Digest digest;
+  ASSERT_TRUE(Sha1Digest::FromBytes(bytes, &digest));
+  EXPECT_EQ("DA39A3EE5E6B4B0D3255BFEF95601890AFD80709", digest.ToHex());
+  EXPECT_EQ(bytes, digest.ToBytes());
+  EXPECT_TRUE(digest.EqualsBytes(bytes));
+  EXPECT_FALSE(digest.EqualsBytes(bytes.substr(1)));
+  EXPECT_FALSE(Sha1Digest::FromBytes(bytes.substr(1), &digest));
+  EXPECT_NE(Sha1Digest(), digest);
+}
+
+}  // namespace
+}  // namespace polar_express
@@ -0,0 +1,62 @@
+#include "util/id-name-cache.h"
+
+#include <algorithm>
+
+namespace polar_express {
+
+IdNameCache::IdNameCache(LookupFunction lookup_function, size_t max_entries,
+                         Clock::duration ttl)
+    : lookup_function_(lookup_function),
+      max_entries_(std::max<size_t>(max_entries, 1)),
+      ttl_(ttl),
+      num_hits_(0),
+      num_misses_(0) {
+}
+
+string IdNameCache::GetName(uint32_t id) {
+  return GetName(id, Clock::now());
+}
+
+string IdNameCache::GetName(uint32_t id, Clock::time_point now) {
+  {
+    boost::mutex::scoped_lock lock(mu_);
+    auto it = entries_.find(id);
+    if (it != entries_.end() && now < it->second.expiration_time) {
+      ++num_hits_;
+      lru_ids_.splice(lru_ids_.begin(), lru_ids_, it->second.lru_position);
+      return it->second.name;
+    }
+    ++num_misses_;
+  }
+
+  const string name = lookup_function_(id);
+
+  boost::mutex::scoped_lock lock(mu_);
+  auto it = entries_.find(id);
+  if (it == entries_.end()) {
+    if (entries_.size() >= max_entries_) {
+      entries_.erase(lru_ids_.back());
+      lru_ids_.pop_back();
+    }
+    lru_ids_.push_front(id);
+    it = entries_.insert(make_pair(id, Entry())).first;
+    it->second.lru_position = lru_ids_.begin();
+  } else {
+    lru_ids_.splice(lru_ids_.begin(), lru_ids_, it->second.lru_position);
+  }
+  it->second.name = name;
+  it->second.expiration_time = now + ttl_;
+  return name;
+}
+
+uint64_t IdNameCache::num_hits() const {
+  boost::mutex::scoped_lock lock(mu_);
+  return num_hits_;
+}
+
+uint64_t IdNameCache::num_misses() const {
+  boost::mutex::scoped_lock lock(mu_);
+  return num_misses_;
+}
+
+}  // namespace polar_express
@@ -0,0 +1,78 @@
+#ifndef ID_NAME_CACHE_H
+#define ID_NAME_CACHE_H
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "base/macros.h"
+
+namespace polar_express {
+
+// A thread-safe cache of the names of numeric ids, such as user and group
+// names looked up by uid and gid. Looking a name up (through NSS, which may
+// be backed by LDAP or SSSD) can take milliseconds, while a backup sees
+// only a few distinct owners across all of its files.
+//
+// The cache holds at most max_entries names, evicting the least recently
+// used, and looks each name up again once it is older than ttl, so that
+// renamed users and groups are eventually noticed. Ids without a name are
+// cached as the empty string, so that they are not looked up for every
+// file either.
+//
+// Lookups are not made with the cache locked, so lookups of different ids
+// do not wait for each other. Simultaneous misses for the same id may each
+// look it up.
+class IdNameCache {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  // Returns the name for id, or the empty string if it has none.
+  typedef boost::function<string(uint32_t)> LookupFunction;
+
+  IdNameCache(LookupFunction lookup_function, size_t max_entries,
+              Clock::duration ttl);
+
+  // Returns the name for id, looking it up if it is not cached or has
+  // expired.
+  string GetName(uint32_t id);
+
+  // As above, but taking the current time from the caller.
+  string GetName(uint32_t id, Clock::time_point now);
+
+  uint64_t num_hits() const;
+  uint64_t num_misses() const;
+
+ private:
+  struct Entry {
+    string name;
+    Clock::time_point expiration_time;
+    std::list<uint32_t>::iterator lru_position;
+  };
+
+  const LookupFunction lookup_function_;
+  const size_t max_entries_;
+  const Clock::duration ttl_;
+
+  // Guards everything below.
+  mutable boost::mutex mu_;
+
+  std::unordered_map<uint32_t, Entry> entries_;
+
+  // Ids of all entries, most recently used first.
+  std::list<uint32_t> lru_ids_;
+
+  uint64_t num_hits_;
+  uint64_t num_misses_;
+
+  DISALLOW_COPY_AND_ASSIGN(IdNameCache);
+};
+
+}  // namespace polar_express
+
+#endif  // ID_NAME_CACHE_H
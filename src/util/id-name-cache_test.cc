@@ -0,0 +1,117 @@
+#include "util/id-name-cache.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <gtest/gtest.h>
+
+namespace polar_express {
+namespace {
+
+const size_t kMaxEntries = 3;
+const IdNameCache::Clock::duration kTtl = std::chrono::seconds(60);
+
+class IdNameCacheTest : public testing::Test {
+ protected:
+  IdNameCacheTest()
+      : id_name_cache_(boost::bind(&IdNameCacheTest::LookUp, this, _1),
+                       kMaxEntries, kTtl),
+        now_(IdNameCache::Clock::now()) {
+    names_[0] = "root";
+    names_[1000] = "alice";
+    names_[1001] = "bob";
+    names_[1002] = "carol";
+  }
+
+  string LookUp(uint32_t id) {
+    boost::mutex::scoped_lock lock(mu_);
+    ++num_lookups_[id];
+    auto it = names_.find(id);
+    return (it != names_.end()) ? it->second : "";
+  }
+
+  int num_lookups(uint32_t id) {
+    boost::mutex::scoped_lock lock(mu_);
+    return num_lookups_[id];
+  }
+
+  IdNameCache id_name_cache_;
+  IdNameCache::Clock::time_point now_;
+  std::map<uint32_t, string> names_;
+
+  boost::mutex mu_;
+  std::map<uint32_t, int> num_lookups_;
+};
+
+TEST_F(IdNameCacheTest, LooksUpEachIdOnce) {
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ("root", id_name_cache_.GetName(0, now_));
+    EXPECT_EQ("alice", id_name_cache_.GetName(1000, now_));
+  }
+  EXPECT_EQ(1, num_lookups(0));
+  EXPECT_EQ(1, num_lookups(1000));
+  EXPECT_EQ(18u, id_name_cache_.num_hits());
+  EXPECT_EQ(2u, id_name_cache_.num_misses());
+}
+
+TEST_F(IdNameCacheTest, CachesIdsWithoutNames) {
+  EXPECT_EQ("", id_name_cache_.GetName(4242, now_));
+  EXPECT_EQ("", id_name_cache_.GetName(4242, now_));
+  EXPECT_EQ(1, num_lookups(4242));
+}
+
+TEST_F(IdNameCacheTest, LooksUpAgainAfterTtl) {
+  EXPECT_EQ("alice", id_name_cache_.GetName(1000, now_));
+  names_[1000] = "alice2";
+  EXPECT_EQ("alice",
+            id_name_cache_.GetName(1000, now_ + kTtl - std::chrono::seconds(1)));
+  EXPECT_EQ("alice2", id_name_cache_.GetName(1000, now_ + kTtl));
+  EXPECT_EQ(2, num_lookups(1000));
+}
+
+TEST_F(IdNameCacheTest, EvictsLeastRecentlyUsed) {
+  id_name_cache_.GetName(0, now_);
+  id_name_cache_.GetName(1000, now_);
+  id_name_cache_.GetName(1001, now_);
+
+  // Using 0 again makes 1000 the least recently used, so it is evicted to
+  // make room for 1002.
+  id_name_cache_.GetName(0, now_);
+  id_name_cache_.GetName(1002, now_);
+
+  id_name_cache_.GetName(0, now_);
+  id_name_cache_.GetName(1001, now_);
+  id_name_cache_.GetName(1002, now_);
+  EXPECT_EQ(1, num_lookups(0));
+  EXPECT_EQ(1, num_lookups(1001));
+  EXPECT_EQ(1, num_lookups(1002));
+
+  EXPECT_EQ("alice", id_name_cache_.GetName(1000, now_));
+  EXPECT_EQ(2, num_lookups(1000));
+}
+
+TEST_F(IdNameCacheTest, ConcurrentLookups) {
+  const int kNumThreads = 8;
+  const int kLookupsPerThread = 1000;
+  boost::thread_group threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.create_thread([this]() {
+      for (int j = 0; j < kLookupsPerThread; ++j) {
+        const uint32_t id = (j % 2 == 0) ? 1000 : 1001;
+        EXPECT_EQ(names_.at(id), id_name_cache_.GetName(id, now_));
+      }
+    });
+  }
+  threads.join_all();
+
+  EXPECT_EQ(static_cast<uint64_t>(kNumThreads * kLookupsPerThread),
+            id_name_cache_.num_hits() + id_name_cache_.num_misses());
+  EXPECT_LE(num_lookups(1000), kNumThreads);
+  EXPECT_LE(num_lookups(1001), kNumThreads);
+}
+
+}  // namespace
+}  // namespace polar_express
@@ -0,0 +1,104 @@
+#include "util/path-arena.h"
+
+#include <cstring>
+#include <limits>
+
+namespace polar_express {
+
+PathArena::PathArena() {
+}
+
+PathArena::~PathArena() {
+}
+
+PathArena::Handle PathArena::Add(const boost::filesystem::path& path) {
+  const string& path_str = path.native();
+  const size_t name_offset = path_str.rfind('/') + 1;
+  return AddEntry(path_str.data(), name_offset,
+                  path_str.data() + name_offset,
+                  path_str.size() - name_offset);
+}
+
+PathArena::Handle PathArena::Add(
+    const PathArena& other, Handle other_handle) {
+  assert(other_handle < other.entries_.size());
+  const Entry& entry = other.entries_[other_handle];
+  const string& directory = *other.directories_[entry.directory_index];
+  return AddEntry(directory.data(), directory.size(),
+                  other.names_.data() + entry.name_offset,
+                  entry.name_length);
+}
+
+boost::filesystem::path PathArena::GetPath(Handle handle) const {
+  assert(handle < entries_.size());
+  const Entry& entry = entries_[handle];
+  const string& directory = *directories_[entry.directory_index];
+  string path_str;
+  path_str.reserve(directory.size() + entry.name_length);
+  path_str.append(directory);
+  path_str.append(names_, entry.name_offset, entry.name_length);
+  return boost::filesystem::path(std::move(path_str));
+}
+
+size_t PathArena::size() const {
+  return entries_.size();
+}
+
+size_t PathArena::num_directories() const {
+  return directories_.size();
+}
+
+bool PathArena::empty() const {
+  return entries_.empty();
+}
+
+size_t PathArena::memory_usage() const {
+  // Each directory also costs a hash table node and bucket, and its
+  // string's own allocation.
+  size_t directories_size = 0;
+  for (const string* directory : directories_) {
+    directories_size += directory->capacity() + sizeof(string) +
+        sizeof(uint32_t) + 3 * sizeof(void*);
+  }
+  return directories_size + directories_.capacity() * sizeof(string*) +
+      entries_.capacity() * sizeof(Entry) + names_.capacity();
+}
+
+void PathArena::Clear() {
+  std::unordered_map<string, uint32_t>().swap(directory_indices_);
+  vector<const string*>().swap(directories_);
+  vector<Entry>().swap(entries_);
+  string().swap(names_);
+}
+
+PathArena::Handle PathArena::AddEntry(
+    const char* directory, size_t directory_length,
+    const char* name, size_t name_length) {
+  assert(entries_.size() < std::numeric_limits<Handle>::max());
+
+  // Paths are usually added a directory at a time, so the directory of the
+  // last path is checked before looking the directory up.
+  uint32_t directory_index;
+  const string* last_directory = entries_.empty()
+      ? nullptr : directories_[entries_.back().directory_index];
+  if (last_directory != nullptr &&
+      last_directory->size() == directory_length &&
+      memcmp(last_directory->data(), directory, directory_length) == 0) {
+    directory_index = entries_.back().directory_index;
+  } else {
+    auto inserted = directory_indices_.insert(make_pair(
+        string(directory, directory_length),
+        static_cast<uint32_t>(directories_.size())));
+    if (inserted.second) {
+      directories_.push_back(&inserted.first->first);
+    }
+    directory_index = inserted.first->second;
+  }
+
+  entries_.push_back(
+      { names_.size(), static_cast<uint32_t>(name_length), directory_index });
+  names_.append(name, name_length);
+  return entries_.size() - 1;
+}
+
+}  // namespace polar_express
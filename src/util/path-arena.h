@@ -0,0 +1,76 @@
+#ifndef PATH_ARENA_H
+#define PATH_ARENA_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "base/macros.h"
+
+namespace polar_express {
+
+// Compact storage for many paths, most of which share their directories
+// with others (as the paths found by a scan do). Each directory is stored
+// once, and each path as a reference to its directory plus its name, with
+// all of the names in a single buffer, rather than as a separate heap
+// allocation per path. Paths are referred to by handle, and cannot be
+// removed individually; Clear removes them all. Not thread-safe.
+class PathArena {
+ public:
+  // Handles are assigned in order, starting from zero.
+  typedef uint32_t Handle;
+
+  PathArena();
+  ~PathArena();
+
+  // Stores path, returning its handle.
+  Handle Add(const boost::filesystem::path& path);
+
+  // Stores the path with the given handle in other, returning its handle
+  // in this arena. This avoids creating the path.
+  Handle Add(const PathArena& other, Handle other_handle);
+
+  // Returns the path with the given handle, exactly as it was added.
+  boost::filesystem::path GetPath(Handle handle) const;
+
+  // Returns the number of paths stored, and the number of distinct
+  // directories that they are in.
+  size_t size() const;
+  size_t num_directories() const;
+  bool empty() const;
+
+  // Returns an estimate of the memory used, in bytes.
+  size_t memory_usage() const;
+
+  // Removes all paths, and frees the memory that they used.
+  void Clear();
+
+ private:
+  struct Entry {
+    uint64_t name_offset;
+    uint32_t name_length;
+    uint32_t directory_index;
+  };
+
+  Handle AddEntry(const char* directory, size_t directory_length,
+                  const char* name, size_t name_length);
+
+  // Directories include their trailing separator, so that a path is its
+  // directory followed by its name. The directory of a path with no
+  // separator is empty.
+  std::unordered_map<string, uint32_t> directory_indices_;
+  // Keys of directory_indices_, by index.
+  vector<const string*> directories_;
+
+  vector<Entry> entries_;
+  string names_;
+
+  DISALLOW_COPY_AND_ASSIGN(PathArena);
+};
+
+}  // namespace polar_express
+
+#endif  // PATH_ARENA_H
@@ -0,0 +1,130 @@
+// Compares storing the paths found by a scan, with their stat results, as
+// separate paths with storing them in a PathArena, reporting the memory
+// used per path and the rate at which paths are added and read back. The
+// paths are synthetic, spread evenly across directories of the given size,
+// and nothing is read from disk. Both include the FileStat of each path,
+// which takes the same space either way.
+//
+// Usage: path-arena_benchmark [--benchmark_num_paths=N]
+//            [--benchmark_paths_per_directory=N]
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "base/macros.h"
+#include "base/options.h"
+#include "proto/file.pb.h"
+#include "util/path-arena.h"
+
+DEFINE_OPTION(benchmark_num_paths, int, 1000000,
+              "Number of paths to store.");
+DEFINE_OPTION(benchmark_paths_per_directory, int, 1000,
+              "Number of paths in each directory.");
+
+using polar_express::FileStat;
+using polar_express::PathArena;
+
+namespace {
+
+// An estimate of the per-allocation overhead of the heap.
+const size_t kMallocOverhead = 16;
+
+vector<boost::filesystem::path> GeneratePaths(
+    int num_paths, int paths_per_directory) {
+  vector<boost::filesystem::path> paths;
+  paths.reserve(num_paths);
+  for (int i = 0; i < num_paths; ++i) {
+    paths.push_back(
+        boost::filesystem::path("/home/user/data/projects") /
+        ("directory-" + std::to_string(i / paths_per_directory)) /
+        ("file-" + std::to_string(i) + ".dat"));
+  }
+  return paths;
+}
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+void PrintResult(const char* name, size_t num_paths, size_t memory_usage,
+                 double add_seconds, double get_seconds) {
+  printf("%-8s %10zu %12.1f %12.0f %12.0f\n", name, num_paths,
+         static_cast<double>(memory_usage) / num_paths,
+         num_paths / add_seconds, num_paths / get_seconds);
+}
+
+void MeasurePaths(const vector<boost::filesystem::path>& paths) {
+  auto start = std::chrono::steady_clock::now();
+  vector<pair<boost::filesystem::path, FileStat> > paths_with_stat;
+  for (const auto& path : paths) {
+    paths_with_stat.push_back(make_pair(path, FileStat()));
+  }
+  const double add_seconds = SecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  // Volatile, so that the reads are not optimized away.
+  volatile size_t total_length = 0;
+  for (const auto& path_with_stat : paths_with_stat) {
+    total_length += boost::filesystem::path(path_with_stat.first).size();
+  }
+  const double get_seconds = SecondsSince(start);
+
+  size_t memory_usage =
+      paths_with_stat.capacity() * sizeof(paths_with_stat[0]);
+  for (const auto& path_with_stat : paths_with_stat) {
+    // Short strings are stored inline, with no allocation of their own.
+    if (path_with_stat.first.native().capacity() >= sizeof(string)) {
+      memory_usage +=
+          path_with_stat.first.native().capacity() + 1 + kMallocOverhead;
+    }
+  }
+  PrintResult("paths", paths_with_stat.size(),
+              memory_usage, add_seconds, get_seconds);
+}
+
+void MeasurePathArena(const vector<boost::filesystem::path>& paths) {
+  auto start = std::chrono::steady_clock::now();
+  PathArena path_arena;
+  vector<pair<PathArena::Handle, FileStat> > handles_with_stat;
+  for (const auto& path : paths) {
+    handles_with_stat.push_back(make_pair(path_arena.Add(path), FileStat()));
+  }
+  const double add_seconds = SecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  // Volatile, so that the reads are not optimized away.
+  volatile size_t total_length = 0;
+  for (const auto& handle_with_stat : handles_with_stat) {
+    total_length += path_arena.GetPath(handle_with_stat.first).size();
+  }
+  const double get_seconds = SecondsSince(start);
+
+  PrintResult("arena", handles_with_stat.size(),
+              path_arena.memory_usage() +
+                  handles_with_stat.capacity() * sizeof(handles_with_stat[0]),
+              add_seconds, get_seconds);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (!polar_express::options::Init(argc, argv)) {
+    return 1;
+  }
+
+  const vector<boost::filesystem::path> paths = GeneratePaths(
+      polar_express::options::benchmark_num_paths,
+      polar_express::options::benchmark_paths_per_directory);
+
+  printf("%-8s %10s %12s %12s %12s\n", "storage", "paths", "bytes/path",
+         "adds/s", "gets/s");
+  MeasurePaths(paths);
+  MeasurePathArena(paths);
+  return 0;
+}
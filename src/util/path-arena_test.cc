@@ -0,0 +1,88 @@
+#include "util/path-arena.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+namespace polar_express {
+namespace {
+
+TEST(PathArenaTest, ReturnsPathsExactlyAsAdded) {
+  PathArena path_arena;
+  const vector<string> paths = {
+    "/a/b/c", "/a/b/d", "/a/e", "/f", "/", "g", "h/i", "/a/b/", "", "/a/b/c",
+  };
+  vector<PathArena::Handle> handles;
+  for (const string& path : paths) {
+    handles.push_back(path_arena.Add(path));
+  }
+
+  ASSERT_EQ(paths.size(), path_arena.size());
+  for (size_t i = 0; i < paths.size(); ++i) {
+    EXPECT_EQ(i, handles[i]);
+    EXPECT_EQ(paths[i], path_arena.GetPath(handles[i]).native());
+  }
+}
+
+TEST(PathArenaTest, StoresEachDirectoryOnce) {
+  PathArena path_arena;
+  for (int i = 0; i < 100; ++i) {
+    path_arena.Add(boost::filesystem::path("/root/x") / std::to_string(i));
+    path_arena.Add(boost::filesystem::path("/root/y") / std::to_string(i));
+  }
+  path_arena.Add("/root/x");
+  EXPECT_EQ(201, path_arena.size());
+  EXPECT_EQ(3, path_arena.num_directories());
+  EXPECT_EQ("/root/y/99", path_arena.GetPath(199).native());
+}
+
+TEST(PathArenaTest, AddsFromAnotherArena) {
+  PathArena source_path_arena;
+  const PathArena::Handle a = source_path_arena.Add("/x/a");
+  const PathArena::Handle b = source_path_arena.Add("/y/b");
+
+  PathArena path_arena;
+  path_arena.Add("/y/c");
+  EXPECT_EQ(1, path_arena.Add(source_path_arena, b));
+  EXPECT_EQ(2, path_arena.Add(source_path_arena, a));
+  EXPECT_EQ("/y/b", path_arena.GetPath(1).native());
+  EXPECT_EQ("/x/a", path_arena.GetPath(2).native());
+  EXPECT_EQ(2, path_arena.num_directories());
+}
+
+TEST(PathArenaTest, ClearRemovesAllPaths) {
+  PathArena path_arena;
+  for (int i = 0; i < 100; ++i) {
+    path_arena.Add("/a/" + std::to_string(i) + "/b");
+  }
+  EXPECT_FALSE(path_arena.empty());
+  const size_t memory_usage = path_arena.memory_usage();
+
+  path_arena.Clear();
+  EXPECT_TRUE(path_arena.empty());
+  EXPECT_EQ(0, path_arena.num_directories());
+  EXPECT_LT(path_arena.memory_usage(), memory_usage / 10);
+
+  EXPECT_EQ(0, path_arena.Add("/c/d"));
+  EXPECT_EQ("/c/d", path_arena.GetPath(0).native());
+}
+
+TEST(PathArenaTest, UsesLessMemoryThanPaths) {
+  PathArena path_arena;
+  const boost::filesystem::path directory(
+      "/home/user/projects/polar-express/build/objects");
+  const size_t num_paths = 10000;
+  for (size_t i = 0; i < num_paths; ++i) {
+    path_arena.Add(directory / ("file-" + std::to_string(i) + ".o"));
+  }
+  // Each path would otherwise take at least a path object and a heap
+  // allocation of the whole string.
+  EXPECT_LT(path_arena.memory_usage(),
+            num_paths * (sizeof(boost::filesystem::path) +
+                         directory.native().size()));
+}
+
+}  // namespace
+}  // namespace polar_express
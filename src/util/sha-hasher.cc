@@ -0,0 +1,161 @@
+#include "util/sha-hasher.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace polar_express {
+namespace internal {
+
+const uint32_t Sha1Traits::kInitialState[] = {
+  0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0,
+};
+
+const uint32_t Sha256Traits::kInitialState[] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+}  // namespace internal
+
+template <typename TraitsT>
+ShaHasher<TraitsT>::ShaHasher()
+    : backend_(DigestBackend::GetFastest()) {
+  Reset();
+}
+
+template <typename TraitsT>
+ShaHasher<TraitsT>::ShaHasher(const DigestBackend& backend)
+    : backend_(backend) {
+  Reset();
+}
+
+template <typename TraitsT>
+void ShaHasher<TraitsT>::Update(const byte* data, size_t size) {
+  total_size_ += size;
+
+  if (buffer_size_ > 0) {
+    size_t num_copied = std::min(size, sizeof(buffer_) - buffer_size_);
+    memcpy(buffer_ + buffer_size_, data, num_copied);
+    buffer_size_ += num_copied;
+    data += num_copied;
+    size -= num_copied;
+    if (buffer_size_ < sizeof(buffer_)) {
+      return;
+    }
+    Compress(buffer_, 1);
+    buffer_size_ = 0;
+  }
+
+  size_t num_blocks = size / DigestBackend::kBlockSize;
+  if (num_blocks > 0) {
+    Compress(data, num_blocks);
+    data += num_blocks * DigestBackend::kBlockSize;
+    size -= num_blocks * DigestBackend::kBlockSize;
+  }
+
+  memcpy(buffer_, data, size);
+  buffer_size_ = size;
+}
+
+template <typename TraitsT>
+void ShaHasher<TraitsT>::Final(DigestType* digest) {
+  // Append a single 1 bit, then zeros up to the last 8 bytes of a
+  // block, then the message length in bits (big-endian).
+  const uint64_t total_bits = total_size_ * 8;
+  buffer_[buffer_size_++] = 0x80;
+  if (buffer_size_ > sizeof(buffer_) - 8) {
+    memset(buffer_ + buffer_size_, 0, sizeof(buffer_) - buffer_size_);
+    Compress(buffer_, 1);
+    buffer_size_ = 0;
+  }
+  memset(buffer_ + buffer_size_, 0, sizeof(buffer_) - 8 - buffer_size_);
+  for (int i = 0; i < 8; ++i) {
+    buffer_[sizeof(buffer_) - 1 - i] = static_cast<byte>(total_bits >> (8 * i));
+  }
+  Compress(buffer_, 1);
+
+  static_assert(DigestType::kSize == 4 * TraitsT::kStateWords,
+                "Digest size does not match state size.");
+  byte* out = CHECK_NOTNULL(digest)->data();
+  for (size_t i = 0; i < TraitsT::kStateWords; ++i) {
+    out[4 * i] = static_cast<byte>(state_[i] >> 24);
+    out[4 * i + 1] = static_cast<byte>(state_[i] >> 16);
+    out[4 * i + 2] = static_cast<byte>(state_[i] >> 8);
+    out[4 * i + 3] = static_cast<byte>(state_[i]);
+  }
+
+  Reset();
+}
+
+// static
+template <typename TraitsT>
+void ShaHasher<TraitsT>::Hash(ByteSpan data, DigestType* digest) {
+  ShaHasher<TraitsT> hasher;
+  hasher.Update(data);
+  hasher.Final(digest);
+}
+
+// static
+template <typename TraitsT>
+void ShaHasher<TraitsT>::HashMultiple(
+    const vector<ByteSpan>& data, vector<DigestType>* digests) {
+  HashMultiple(DigestBackend::GetFastest(), data, digests);
+}
+
+// static
+template <typename TraitsT>
+void ShaHasher<TraitsT>::HashMultiple(
+    const DigestBackend& backend, const vector<ByteSpan>& data,
+    vector<DigestType>* digests) {
+  CHECK_NOTNULL(digests)->resize(data.size());
+  if (data.empty()) {
+    return;
+  }
+
+  // Compress the whole blocks that all inputs have in common in
+  // lock-step, then finish each input individually.
+  size_t min_size = data[0].size();
+  for (const ByteSpan& span : data) {
+    min_size = std::min(min_size, span.size());
+  }
+  const size_t num_common_blocks = min_size / DigestBackend::kBlockSize;
+
+  vector<unique_ptr<ShaHasher<TraitsT> > > hashers;
+  vector<uint32_t*> states;
+  vector<const byte*> blocks;
+  for (const ByteSpan& span : data) {
+    hashers.emplace_back(new ShaHasher<TraitsT>(backend));
+    states.push_back(hashers.back()->state_);
+    blocks.push_back(span.data());
+  }
+
+  if (num_common_blocks > 0) {
+    TraitsT::CompressMultiple(backend, states.data(), blocks.data(),
+                              data.size(), num_common_blocks);
+  }
+
+  const size_t common_size = num_common_blocks * DigestBackend::kBlockSize;
+  for (size_t i = 0; i < data.size(); ++i) {
+    hashers[i]->total_size_ = common_size;
+    hashers[i]->Update(data[i].subspan(common_size, data[i].size()));
+    hashers[i]->Final(&(*digests)[i]);
+  }
+}
+
+template <typename TraitsT>
+void ShaHasher<TraitsT>::Reset() {
+  std::copy(TraitsT::kInitialState,
+            TraitsT::kInitialState + TraitsT::kStateWords, state_);
+  buffer_size_ = 0;
+  total_size_ = 0;
+}
+
+template <typename TraitsT>
+void ShaHasher<TraitsT>::Compress(const byte* blocks, size_t num_blocks) {
+  TraitsT::Compress(backend_, state_, blocks, num_blocks);
+}
+
+template class ShaHasher<internal::Sha1Traits>;
+template class ShaHasher<internal::Sha256Traits>;
+
+}  // namespace polar_express
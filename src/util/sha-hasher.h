@@ -0,0 +1,106 @@
+#ifndef SHA_HASHER_H
+#define SHA_HASHER_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "base/byte-span.h"
+#include "base/macros.h"
+#include "util/digest.h"
+#include "util/digest-backend.h"
+
+namespace polar_express {
+
+namespace internal {
+struct Sha1Traits;
+struct Sha256Traits;
+}  // namespace internal
+
+// Incremental SHA-1 or SHA-256 hasher, built on whichever DigestBackend
+// is fastest on this CPU. Hashers are cheap to construct (no heap
+// allocation) and are not thread-safe; use one per thread.
+//
+// Use the Sha1Hasher and Sha256Hasher typedefs below rather than this
+// template directly.
+template <typename TraitsT>
+class ShaHasher {
+ public:
+  typedef typename TraitsT::DigestType DigestType;
+
+  ShaHasher();
+  explicit ShaHasher(const DigestBackend& backend);
+
+  void Update(const byte* data, size_t size);
+  void Update(ByteSpan data) { Update(data.data(), data.size()); }
+
+  // Writes the digest of everything passed to Update, and resets the
+  // hasher so that it may be reused.
+  void Final(DigestType* digest);
+
+  // Computes the digest of data in one shot.
+  static void Hash(ByteSpan data, DigestType* digest);
+
+  // Computes the digests of several independent inputs, using the
+  // backend's multi-buffer mode where available. This is most effective
+  // when the inputs are the same length (e.g. 1 MiB pieces of a
+  // larger buffer). digests is resized to match data.
+  static void HashMultiple(
+      const vector<ByteSpan>& data, vector<DigestType>* digests);
+  static void HashMultiple(
+      const DigestBackend& backend, const vector<ByteSpan>& data,
+      vector<DigestType>* digests);
+
+ private:
+  void Reset();
+  void Compress(const byte* blocks, size_t num_blocks);
+
+  const DigestBackend& backend_;
+  uint32_t state_[TraitsT::kStateWords];
+  byte buffer_[DigestBackend::kBlockSize];
+  size_t buffer_size_;
+  uint64_t total_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(ShaHasher);
+};
+
+typedef ShaHasher<internal::Sha1Traits> Sha1Hasher;
+typedef ShaHasher<internal::Sha256Traits> Sha256Hasher;
+
+namespace internal {
+
+struct Sha1Traits {
+  typedef Sha1Digest DigestType;
+  static const size_t kStateWords = DigestBackend::kSha1StateWords;
+  static const uint32_t kInitialState[kStateWords];
+  static void Compress(const DigestBackend& backend, uint32_t* state,
+                       const byte* blocks, size_t num_blocks) {
+    backend.Sha1Compress(state, blocks, num_blocks);
+  }
+  static void CompressMultiple(
+      const DigestBackend& backend, uint32_t* const* states,
+      const byte* const* blocks, size_t num_lanes, size_t num_blocks) {
+    backend.Sha1CompressMultiple(states, blocks, num_lanes, num_blocks);
+  }
+};
+
+struct Sha256Traits {
+  typedef Sha256Digest DigestType;
+  static const size_t kStateWords = DigestBackend::kSha256StateWords;
+  static const uint32_t kInitialState[kStateWords];
+  static void Compress(const DigestBackend& backend, uint32_t* state,
+                       const byte* blocks, size_t num_blocks) {
+    backend.Sha256Compress(state, blocks, num_blocks);
+  }
+  static void CompressMultiple(
+      const DigestBackend& backend, uint32_t* const* states,
+      const byte* const* blocks, size_t num_lanes, size_t num_blocks) {
+    backend.Sha256CompressMultiple(states, blocks, num_lanes, num_blocks);
+  }
+};
+
+}  // namespace internal
+
+}  // namespace polar_express
+
+#endif  // SHA_HASHER_H
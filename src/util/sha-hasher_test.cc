@@ -0,0 +1,136 @@
+#include "util/sha-hasher.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "util/digest-backend.h"
+#include "util/hex-util.h"
+
+namespace polar_express {
+namespace {
+
+const char kShortInput[] = "abc";
+const char kTwoBlockInput[] =
+    "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+
+ByteSpan StringSpan(const char* str) {
+  return ByteSpan(reinterpret_cast<const byte*>(str), strlen(str));
+}
+
+vector<byte> GenerateRandomData(size_t size, unsigned int seed) {
+  std::mt19937 generator(seed);
+  vector<byte> data(size);
+  for (byte& b : data) {
+    b = static_cast<byte>(generator());
+  }
+  return data;
+}
+
+template <typename HasherT>
+string HashToHex(const DigestBackend& backend, ByteSpan data) {
+  HasherT hasher(backend);
+  hasher.Update(data);
+  typename HasherT::DigestType digest;
+  hasher.Final(&digest);
+  return digest.ToHex();
+}
+
+// Runs each test once for every backend supported by this CPU.
+class ShaHasherTest : public testing::TestWithParam<const DigestBackend*> {
+ protected:
+  const DigestBackend& backend() const { return *GetParam(); }
+};
+
+TEST_P(ShaHasherTest, Sha1KnownVectors) {
+  EXPECT_EQ("DA39A3EE5E6B4B0D3255BFEF95601890AFD80709",
+            HashToHex<Sha1Hasher>(backend(), ByteSpan()));
+  EXPECT_EQ("A9993E364706816ABA3E25717850C26C9CD0D89D",
+            HashToHex<Sha1Hasher>(backend(), StringSpan(kShortInput)));
+  EXPECT_EQ("84983E441C3BD26EBAAE4AA1F95129E5E54670F1",
+            HashToHex<Sha1Hasher>(backend(), StringSpan(kTwoBlockInput)));
+}
+
+TEST_P(ShaHasherTest, Sha256KnownVectors) {
+  EXPECT_EQ("E3B0C44298FC1C149AFBF4C8996FB92427AE41E4649B934CA495991B7852B855",
+            HashToHex<Sha256Hasher>(backend(), ByteSpan()));
+  EXPECT_EQ("BA7816BF8F01CFEA414140DE5DAE2223B00361A396177A9CB410FF61F20015AD",
+            HashToHex<Sha256Hasher>(backend(), StringSpan(kShortInput)));
+  EXPECT_EQ("248D6A61D20638B8E5C026930C3E6039A33CE45964FF2167F6ECEDD419DB06C1",
+            HashToHex<Sha256Hasher>(backend(), StringSpan(kTwoBlockInput)));
+}
+
+TEST_P(ShaHasherTest, MillionAs) {
+  vector<byte> data(1000000, 'a');
+  EXPECT_EQ("34AA973CD4C4DAA4F61EEB2BDBAD27316534016F",
+            HashToHex<Sha1Hasher>(backend(), data));
+  EXPECT_EQ("CDC76E5C9914FB9281A1C7E284D73E67F1809A48A497200E046D39CCC7112CD0",
+            HashToHex<Sha256Hasher>(backend(), data));
+}
+
+TEST_P(ShaHasherTest, IncrementalUpdatesMatchOneShot) {
+  vector<byte> data = GenerateRandomData(100000, 1);
+  Sha256Hasher hasher(backend());
+  size_t offset = 0;
+  for (size_t piece_size = 1; offset < data.size(); piece_size += 37) {
+    size_t size = std::min(piece_size, data.size() - offset);
+    hasher.Update(data.data() + offset, size);
+    offset += size;
+  }
+  Sha256Digest digest;
+  hasher.Final(&digest);
+  EXPECT_EQ(HashToHex<Sha256Hasher>(backend(), data), digest.ToHex());
+
+  // The hasher is reset by Final and may be reused.
+  hasher.Update(StringSpan(kShortInput));
+  hasher.Final(&digest);
+  EXPECT_EQ("BA7816BF8F01CFEA414140DE5DAE2223B00361A396177A9CB410FF61F20015AD",
+            digest.ToHex());
+}
+
+TEST_P(ShaHasherTest, HashMultipleMatchesSingle) {
+  // Eleven inputs, so that multi-buffer backends have a partial batch,
+  // and one of them shorter than the rest.
+  vector<vector<byte> > data;
+  vector<ByteSpan> spans;
+  for (int i = 0; i < 11; ++i) {
+    data.push_back(GenerateRandomData(i == 5 ? 3000 : 64 * 1024 + 7, i));
+  }
+  for (const auto& d : data) {
+    spans.push_back(d);
+  }
+
+  vector<Sha1Digest> sha1_digests;
+  Sha1Hasher::HashMultiple(backend(), spans, &sha1_digests);
+  vector<Sha256Digest> sha256_digests;
+  Sha256Hasher::HashMultiple(backend(), spans, &sha256_digests);
+
+  ASSERT_EQ(data.size(), sha1_digests.size());
+  ASSERT_EQ(data.size(), sha256_digests.size());
+  for (size_t i = 0; i < data.size(); ++i) {
+    EXPECT_EQ(HashToHex<Sha1Hasher>(backend(), data[i]),
+              sha1_digests[i].ToHex());
+    EXPECT_EQ(HashToHex<Sha256Hasher>(backend(), data[i]),
+              sha256_digests[i].ToHex());
+  }
+}
+
+TEST_P(ShaHasherTest, MatchesGenericBackend) {
+  const DigestBackend& generic_backend = *DigestBackend::GetSupported()[0];
+  for (size_t size : { 0, 55, 56, 63, 64, 65, 1000, 1024 * 1024 + 1 }) {
+    vector<byte> data = GenerateRandomData(size, size);
+    EXPECT_EQ(HashToHex<Sha1Hasher>(generic_backend, data),
+              HashToHex<Sha1Hasher>(backend(), data));
+    EXPECT_EQ(HashToHex<Sha256Hasher>(generic_backend, data),
+              HashToHex<Sha256Hasher>(backend(), data));
+  }
+}
+
+INSTANTIATE_TEST_CASE_P(
+    AllSupportedBackends, ShaHasherTest,
+    testing::ValuesIn(DigestBackend::GetSupported()));
+
+}  // namespace
+}  // namespace polar_express